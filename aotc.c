@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include "parse.h"
+#include "eval.h"
+
+/*
+ * ahead-of-time compiler: translates a script of defines to C.
+ *
+ *   lisp_aotc <script> <output.c> <name>
+ *
+ * the output defines `int <name>_load(env_t* e)`, which binds every define of
+ * the script in e. lambdas over numbers (the forms the JIT accepts) become C
+ * functions bound with lisp_define_native_number, everything else is kept as
+ * source and evaluated by the load function. calls between compiled functions
+ * are bound when the script is compiled, so a later define of a callee does
+ * not change them.
+ *
+ * the script has one form per line, REPL transcripts like test.scm work too:
+ * a "> " prompt is dropped, "=>" result lines and forms other than define are
+ * skipped. if a name is defined several times only the last define is kept.
+ */
+
+enum {
+  AOT_NUMBER,
+  AOT_BOOL
+};
+
+typedef struct aot_def aot_def;
+struct aot_def {
+  lisp_value form;
+  char* source;
+  int compiled, kind;
+};
+
+typedef struct aot_script aot_script;
+struct aot_script {
+  aot_def* p;
+  size_t top, size;
+};
+
+#define NAME(d)		(&(d)->form.u.a.e[1])
+#define LAMBDA(d)	(&(d)->form.u.a.e[2])
+
+static int aot_symbol_eq(const lisp_value* a, const lisp_value* b) {
+  return a->type == LISP_SYMBOL && b->type == LISP_SYMBOL && a->u.sym.size == b->u.sym.size
+    && memcmp(a->u.sym.s, b->u.sym.s, a->u.sym.size) == 0;
+}
+
+static int aot_is_lambda(const lisp_value* v) {
+  return v->type == LISP_LIST && v->u.a.size == 3 && v->u.a.e[0].type == LISP_LAMBDA && v->u.a.e[1].type == LISP_LIST;
+}
+
+static int aot_parameter(const lisp_value* lambda, const lisp_value* symbol) {
+  size_t i;
+  for(i = 0; i < lambda->u.a.e[1].u.a.size; i++)
+    if(aot_symbol_eq(&lambda->u.a.e[1].u.a.e[i], symbol))
+      return (int)i;
+  return -1;
+}
+
+static aot_def* aot_lookup(aot_script* s, const lisp_value* symbol) {
+  size_t i;
+  for(i = 0; i < s->top; i++)
+    if(aot_symbol_eq(NAME(&s->p[i]), symbol))
+      return &s->p[i];
+  return NULL;
+}
+
+// under dynamic scoping a call resolves to a parameter of any active lambda
+// with that name, such calls are left to the interpreter.
+static int aot_is_parameter_name(aot_script* s, const lisp_value* symbol) {
+  size_t i;
+  for(i = 0; i < s->top; i++)
+    if(aot_is_lambda(LAMBDA(&s->p[i])) && aot_parameter(LAMBDA(&s->p[i]), symbol) >= 0)
+      return 1;
+  return 0;
+}
+
+static int aot_is_arith(int type) {
+  return type == LISP_PLUS || type == LISP_MINUS || type == LISP_MULTIPLY || type == LISP_DIVIDE;
+}
+
+static int aot_is_compare(int type) {
+  return type == LISP_LT || type == LISP_BT || type == LISP_EQ;
+}
+
+static int aot_kind(aot_script* s, const lisp_value* v, int depth) {
+  aot_def* d;
+  if(v->type != LISP_LIST || v->u.a.size == 0 || depth > 8) return AOT_NUMBER;
+  if(aot_is_compare(v->u.a.e[0].type) || v->u.a.e[0].type == LISP_NOT) return AOT_BOOL;
+  if(v->u.a.e[0].type == LISP_IF && v->u.a.size == 4) return aot_kind(s, &v->u.a.e[2], depth + 1);
+  if(v->u.a.e[0].type == LISP_SYMBOL && (d = aot_lookup(s, &v->u.a.e[0])) != NULL && aot_is_lambda(LAMBDA(d)))
+    return aot_kind(s, &LAMBDA(d)->u.a.e[2], depth + 1);
+  return AOT_NUMBER;
+}
+
+static int aot_check(aot_script* s, const lisp_value* lambda, const lisp_value* v, int kind) {
+  const lisp_value* head;
+  aot_def* d;
+  size_t i;
+  if(v->type == LISP_NUMBER || v->type == LISP_SYMBOL)
+    return kind == AOT_NUMBER && (v->type == LISP_NUMBER || aot_parameter(lambda, v) >= 0);
+  if(v->type != LISP_LIST || v->u.a.size == 0) return 0;
+  head = &v->u.a.e[0];
+  if(head->type == LISP_IF)
+    return v->u.a.size == 4 && aot_check(s, lambda, &v->u.a.e[1], AOT_BOOL)
+      && aot_check(s, lambda, &v->u.a.e[2], kind) && aot_check(s, lambda, &v->u.a.e[3], kind);
+  if(head->type == LISP_NOT)
+    return kind == AOT_BOOL && v->u.a.size == 2 && aot_check(s, lambda, &v->u.a.e[1], AOT_BOOL);
+  if(aot_is_arith(head->type) || aot_is_compare(head->type)) {
+    if(kind != (aot_is_arith(head->type) ? AOT_NUMBER : AOT_BOOL) || v->u.a.size < 2
+        || (aot_is_compare(head->type) && v->u.a.size != 3))
+      return 0;
+    for(i = 1; i < v->u.a.size; i++)
+      if(!aot_check(s, lambda, &v->u.a.e[i], AOT_NUMBER))
+        return 0;
+    return 1;
+  }
+  if(head->type != LISP_SYMBOL || aot_parameter(lambda, head) >= 0 || aot_is_parameter_name(s, head)
+      || (d = aot_lookup(s, head)) == NULL || !d->compiled || d->kind != kind
+      || LAMBDA(d)->u.a.e[1].u.a.size != v->u.a.size - 1)
+    return 0;
+  for(i = 1; i < v->u.a.size; i++)
+    if(!aot_check(s, lambda, &v->u.a.e[i], AOT_NUMBER))
+      return 0;
+  return 1;
+}
+
+// start from every lambda and drop the ones that use anything not compiled
+// until nothing changes, what is left only calls compiled functions.
+static void aot_select(aot_script* s) {
+  size_t i;
+  int changed;
+  for(i = 0; i < s->top; i++) {
+    s->p[i].compiled = aot_is_lambda(LAMBDA(&s->p[i])) && LAMBDA(&s->p[i])->u.a.e[1].u.a.size <= LISP_NATIVE_MAX_ARGS;
+    s->p[i].kind = s->p[i].compiled ? aot_kind(s, &LAMBDA(&s->p[i])->u.a.e[2], 0) : AOT_NUMBER;
+  }
+  do {
+    changed = 0;
+    for(i = 0; i < s->top; i++)
+      if(s->p[i].compiled && !aot_check(s, LAMBDA(&s->p[i]), &LAMBDA(&s->p[i])->u.a.e[2], s->p[i].kind))
+        s->p[i].compiled = 0, changed = 1;
+  } while(changed);
+}
+
+static void aot_emit_name(FILE* out, const lisp_value* symbol) {
+  size_t i;
+  fputs("aot_", out);
+  for(i = 0; i < symbol->u.sym.size; i++) {
+    if(isalnum((unsigned char)symbol->u.sym.s[i])) fputc(symbol->u.sym.s[i], out);
+    else fprintf(out, "_%02x", (unsigned char)symbol->u.sym.s[i]);
+  }
+}
+
+static void aot_emit_string(FILE* out, const char* str) {
+  fputc('"', out);
+  for(; *str; str++) {
+    if(*str == '"' || *str == '\\') fputc('\\', out);
+    fputc(*str, out);
+  }
+  fputc('"', out);
+}
+
+static void aot_emit_number(FILE* out, double n) {
+  char buf[32];
+  sprintf(buf, "%.17g", n);
+  fprintf(out, strpbrk(buf, ".e") != NULL ? "(%s)" : "(%s.0)", buf);
+}
+
+static void aot_emit(FILE* out, aot_script* s, const lisp_value* lambda, const lisp_value* v);
+
+static void aot_emit_cond(FILE* out, aot_script* s, const lisp_value* lambda, const lisp_value* v) {
+  const lisp_value* head = &v->u.a.e[0];
+  switch(head->type) {
+    case LISP_NOT:
+      fputs("!", out);
+      aot_emit_cond(out, s, lambda, &v->u.a.e[1]);
+      return;
+    case LISP_IF:
+      fputs("(", out);
+      aot_emit_cond(out, s, lambda, &v->u.a.e[1]);
+      fputs(" ? ", out);
+      aot_emit_cond(out, s, lambda, &v->u.a.e[2]);
+      fputs(" : ", out);
+      aot_emit_cond(out, s, lambda, &v->u.a.e[3]);
+      fputs(")", out);
+      return;
+    case LISP_LT: case LISP_BT: case LISP_EQ:
+      fputs("(", out);
+      aot_emit(out, s, lambda, &v->u.a.e[1]);
+      fputs(head->type == LISP_LT ? " < " : head->type == LISP_BT ? " > " : " == ", out);
+      aot_emit(out, s, lambda, &v->u.a.e[2]);
+      fputs(")", out);
+      return;
+    default:
+      fputs("(", out);
+      aot_emit(out, s, lambda, v);
+      fputs(" != 0)", out);
+  }
+}
+
+static void aot_emit(FILE* out, aot_script* s, const lisp_value* lambda, const lisp_value* v) {
+  const lisp_value* head;
+  size_t i;
+  if(v->type == LISP_NUMBER) {
+    aot_emit_number(out, v->u.n);
+    return;
+  }
+  if(v->type == LISP_SYMBOL) {
+    fprintf(out, "a[%d]", aot_parameter(lambda, v));
+    return;
+  }
+  head = &v->u.a.e[0];
+  if(aot_is_arith(head->type)) {
+    fputs("(", out);
+    for(i = 1; i < v->u.a.size; i++) {
+      if(i > 1) fputs(head->type == LISP_PLUS ? " + " : head->type == LISP_MINUS ? " - " : head->type == LISP_MULTIPLY ? " * " : " / ", out);
+      aot_emit(out, s, lambda, &v->u.a.e[i]);
+    }
+    fputs(")", out);
+  }
+  else if(head->type == LISP_IF) {
+    fputs("(", out);
+    aot_emit_cond(out, s, lambda, &v->u.a.e[1]);
+    fputs(" ? ", out);
+    aot_emit(out, s, lambda, &v->u.a.e[2]);
+    fputs(" : ", out);
+    aot_emit(out, s, lambda, &v->u.a.e[3]);
+    fputs(")", out);
+  }
+  else if(aot_is_compare(head->type) || head->type == LISP_NOT) {
+    fputs("(", out);
+    aot_emit_cond(out, s, lambda, v);
+    fputs(" ? 1.0 : 0.0)", out);
+  }
+  else {
+    aot_emit_name(out, head);
+    if(v->u.a.size == 1) {
+      fputs("(NULL)", out);
+      return;
+    }
+    fputs("((const double[]){ ", out);
+    for(i = 1; i < v->u.a.size; i++) {
+      if(i > 1) fputs(", ", out);
+      aot_emit(out, s, lambda, &v->u.a.e[i]);
+    }
+    fputs(" })", out);
+  }
+}
+
+static void aot_emit_script(FILE* out, aot_script* s, const char* script, const char* name) {
+  size_t i;
+  aot_def* d;
+  fprintf(out, "/* generated by lisp_aotc from %s, do not edit. */\n", script);
+  fputs("#include <stdlib.h>\n#include \"parse.h\"\n#include \"eval.h\"\n\n", out);
+  fprintf(out, "int %s_load(env_t* e);\n\n", name);
+  for(i = 0; i < s->top; i++) {
+    if(!s->p[i].compiled) continue;
+    fputs("static double ", out);
+    aot_emit_name(out, NAME(&s->p[i]));
+    fputs("(const double* a);\n", out);
+  }
+  for(i = 0; i < s->top; i++) {
+    d = &s->p[i];
+    if(!d->compiled) continue;
+    fprintf(out, "\n/* %s */\nstatic double ", d->source);
+    aot_emit_name(out, NAME(d));
+    fputs(LAMBDA(d)->u.a.e[1].u.a.size != 0 ? "(const double* a) {\n  return " : "(const double* a) {\n  (void)a;\n  return ", out);
+    aot_emit(out, s, LAMBDA(d), &LAMBDA(d)->u.a.e[2]);
+    fputs(";\n}\n", out);
+  }
+
+  fprintf(out, "\nstatic const char* %s_interpreted[] = {\n", name);
+  for(i = 0; i < s->top; i++) {
+    if(s->p[i].compiled) continue;
+    fputs("  ", out);
+    aot_emit_string(out, s->p[i].source);
+    fputs(",\n", out);
+  }
+  fputs("  NULL\n};\n\n", out);
+
+  fprintf(out, "int %s_load(env_t* e) {\n", name);
+  fputs("  lisp_value *v, result;\n  size_t i;\n  int ret;\n", out);
+  for(i = 0; i < s->top; i++) {
+    d = &s->p[i];
+    if(!d->compiled) continue;
+    fputs("  if((ret = lisp_define_native_number(e, ", out);
+    aot_emit_string(out, NAME(d)->u.sym.s);
+    fprintf(out, ", %zu, ", LAMBDA(d)->u.a.e[1].u.a.size);
+    aot_emit_name(out, NAME(d));
+    fprintf(out, ", %d)) != LISP_EVAL_OK)\n    return ret;\n", d->kind == AOT_BOOL);
+  }
+  fprintf(out, "  for(i = 0; %s_interpreted[i] != NULL; i++) {\n", name);
+  fputs("    v = (lisp_value*)malloc(sizeof(lisp_value));    // the env keeps pointing into the parse tree\n", out);
+  fputs("    lisp_value_init(v);\n", out);
+  fprintf(out, "    if(lisp_parse(v, %s_interpreted[i]) != LISP_PARSE_OK)\n      return LISP_EVAL_INVALID_VALUE;\n", name);
+  fputs("    if((ret = lisp_eval(v, &result, e)) != LISP_EVAL_OK)\n      return ret;\n  }\n", out);
+  fputs("  return LISP_EVAL_OK;\n}\n", out);
+}
+
+static void aot_add(aot_script* s, const char* line, size_t line_number) {
+  aot_def* d;
+  lisp_value form;
+  lisp_value_init(&form);
+  if(lisp_parse(&form, line) != LISP_PARSE_OK) {
+    fprintf(stderr, "line %zu: invalid form skipped\n", line_number);
+    return;
+  }
+  if(form.type != LISP_LIST || form.u.a.size != 3 || form.u.a.e[0].type != LISP_DEFINE || form.u.a.e[1].type != LISP_SYMBOL) {
+    lisp_value_free(&form);
+    return;
+  }
+  if((d = aot_lookup(s, &form.u.a.e[1])) != NULL) {    // redefined: only the last define is visible after loading
+    lisp_value_free(&d->form);
+    free(d->source);
+  }
+  else {
+    if(s->top == s->size) {
+      s->size = s->size == 0 ? 16 : s->size * 2;
+      s->p = (aot_def*)realloc(s->p, s->size * sizeof(aot_def));
+    }
+    d = &s->p[s->top++];
+  }
+  d->form = form;
+  d->source = strcpy((char*)malloc(strlen(line) + 1), line);
+}
+
+int main(int argc, char** argv) {
+  FILE *in, *out;
+  char* line = NULL, *p;
+  size_t size = 0, line_number = 0, i;
+  ssize_t len;
+  aot_script s = { NULL, 0, 0 };
+
+  if(argc != 4) {
+    fprintf(stderr, "usage: %s <script> <output.c> <name>\n", argv[0]);
+    return 1;
+  }
+  if((in = fopen(argv[1], "r")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  while((len = getline(&line, &size, in)) != -1) {
+    line_number++;
+    while(len > 0 && isspace((unsigned char)line[len-1]))
+      line[--len] = '\0';
+    for(p = line; isspace((unsigned char)*p); p++) ;
+    if(*p == '>') p++;
+    while(isspace((unsigned char)*p)) p++;
+    if(*p != '(') continue;
+    aot_add(&s, p, line_number);
+  }
+  free(line);
+  fclose(in);
+
+  aot_select(&s);
+  if((out = fopen(argv[2], "w")) == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+  aot_emit_script(out, &s, argv[1], argv[3]);
+  fclose(out);
+
+  for(i = 0; i < s.top; i++) {
+    fprintf(stderr, "%s: %s\n", NAME(&s.p[i])->u.sym.s, s.p[i].compiled ? "compiled" : "interpreted");
+    lisp_value_free(&s.p[i].form);
+    free(s.p[i].source);
+  }
+  free(s.p);
+  return 0;
+}
@@ -0,0 +1,760 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "parse.h"
+#include "eval.h"
+#include "perf.h"
+#include "prof.h"
+#include "stats.h"
+#include "vector.h"
+#include "table.h"
+#ifdef LISP_JIT
+#include "jit.h"
+#endif
+#ifdef LISP_CORO
+#include "coro.h"
+#endif
+
+/*
+ * lisp_bench: evaluator workloads with warmup and repeated trials.
+ *
+ *   lisp_bench [-w warmup] [-t trials] [-p] [-s hz] [filter]
+ *
+ * each case runs `warmup` operations, then `trials` timed trials of its own
+ * number of operations. cases whose name does not contain `filter` are
+ * skipped. the report is a JSON array on stdout with one object per case:
+ * median and minimum ns/op over the trials, heap allocations and bytes per
+ * op, and the peak RSS of the process after the case. with -p, hardware
+ * counters per op are added, null where perf_event_open has none. with -s,
+ * the lisp functions are sampled `hz` times a second of cpu and the folded
+ * stacks are written to stderr at the end, as are the interpreter counters
+ * of a LISP_STATS build. the diagnostics the evaluator prints are discarded.
+ */
+
+#define WARMUP 32
+#define TRIALS 5
+
+int test_scm_load(env_t* e);    // test.scm compiled by lisp_aotc
+
+enum {
+  BENCH_INTERPRETED,
+  BENCH_JIT,
+  BENCH_AOT
+};
+
+static const char* bench_modes[] = { "interpreted", "jit", "aot" };
+#ifdef LISP_PERF
+static const char* bench_counters[LISP_PERF_COUNTERS] = {
+  "cycles", "instructions", "branch_misses", "cache_misses", "task_clock_ns"
+};
+#endif
+static int bench_perf;
+
+typedef struct bench bench;
+struct bench {
+  const char* name;
+  long param;
+  int mode;
+  size_t ops;    // operations per trial
+  void (*setup)(bench* b);
+  void (*op)(bench* b);
+  env_t env;
+  char* code;    // evaluated by op_eval, parsed by op_parse
+  lisp_value v;
+};
+
+/* heap traffic, counted by replacing the allocator entry points. */
+#ifdef __GLIBC__
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void __libc_free(void* p);
+
+static size_t allocs, alloc_bytes;
+
+void* malloc(size_t size) {
+  allocs++;
+  alloc_bytes += size;
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  allocs++;
+  alloc_bytes += count * size;
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+  allocs++;
+  alloc_bytes += size;
+  return __libc_realloc(p, size);
+}
+
+void free(void* p) {
+  __libc_free(p);
+}
+#define BENCH_COUNTS_ALLOCS 1
+#else
+static size_t allocs, alloc_bytes;
+#define BENCH_COUNTS_ALLOCS 0
+#endif
+
+static double now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void define(env_t* e, const char* code) {
+  lisp_value* v = (lisp_value*)malloc(sizeof(lisp_value));    // the env keeps pointing into the parse tree
+  lisp_value result;
+  lisp_value_init(v);
+  if(lisp_parse(v, code) != LISP_PARSE_OK || lisp_eval(v, &result, e) != LISP_EVAL_OK) {
+    fprintf(stderr, "failed: %s\n", code);
+    exit(1);
+  }
+}
+
+static void set_code(bench* b, const char* format, long param) {
+  b->code = (char*)malloc(64);
+  sprintf(b->code, format, param);
+}
+
+// evaluate the defines of a REPL transcript, the forms that follow a "> " prompt.
+static void load_script(const char* path, env_t* e) {
+  FILE* in = fopen(path, "r");
+  char line[1024], *p;
+  if(in == NULL) {
+    perror(path);
+    exit(1);
+  }
+  while(fgets(line, sizeof(line), in) != NULL) {
+    for(p = line; isspace((unsigned char)*p) || *p == '>'; p++) ;
+    if(strncmp(p, "(define", 7) == 0)
+      define(e, p);
+  }
+  fclose(in);
+}
+
+static void op_eval(bench* b) {
+  lisp_value result;
+  if(lisp_eval(&b->v, &result, &b->env) != LISP_EVAL_OK) {
+    fprintf(stderr, "failed: %s\n", b->code);
+    exit(1);
+  }
+  lisp_value_free(&result);
+}
+
+static void op_parse(bench* b) {
+  lisp_value v;
+  lisp_value_init(&v);
+  if(lisp_parse(&v, b->code) != LISP_PARSE_OK) {
+    fprintf(stderr, "failed to parse the %s input\n", b->name);
+    exit(1);
+  }
+  lisp_value_free(&v);
+}
+
+#define BATCH_MAX 1000
+static lisp_value batch_results[BATCH_MAX];
+static int batch_rets[BATCH_MAX];
+
+// the forms of the code list, a lisp_eval each.
+static void op_each(bench* b) {
+  lisp_value result;
+  size_t i;
+  for(i = 0; i < b->v.u.a.size; i++) {
+    if(lisp_eval(&b->v.u.a.e[i], &result, &b->env) != LISP_EVAL_OK) {
+      fprintf(stderr, "failed: %s\n", b->code);
+      exit(1);
+    }
+    lisp_value_free(&result);
+  }
+}
+
+// the forms of the code list, one lisp_eval_batch.
+static void op_batch(bench* b) {
+  size_t i;
+  if(lisp_eval_batch(b->v.u.a.e, b->v.u.a.size, batch_results, batch_rets, &b->env) != 0) {
+    fprintf(stderr, "failed: %s\n", b->code);
+    exit(1);
+  }
+  for(i = 0; i < b->v.u.a.size; i++)
+    lisp_value_free(&batch_results[i]);
+}
+
+#ifdef LISP_TASK
+// the evaluation as a task, resumed every `param` steps.
+static void op_task(bench* b) {
+  lisp_value result;
+  lisp_task* t = lisp_task_new(&b->v, &b->env);
+  int ret;
+  while((ret = lisp_task_run(t, (size_t)b->param, 0, &result)) == LISP_EVAL_SUSPENDED) ;
+  lisp_task_free(t);
+  if(ret != LISP_EVAL_OK) {
+    fprintf(stderr, "failed: %s\n", b->code);
+    exit(1);
+  }
+  lisp_value_free(&result);
+}
+
+static void setup_task(bench* b) {
+  define(&b->env, "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))");
+  set_code(b, "(fib %ld)", 15);
+}
+#endif
+
+// `param` small forms, evaluated one by one or as a batch.
+static void setup_batch(bench* b) {
+  size_t size;
+  long i;
+  define(&b->env, "(define sq (lambda (x) (* x x)))");
+  b->code = (char*)malloc((size_t)b->param * 32 + 3);
+  size = sprintf(b->code, "(");
+  for(i = 0; i < b->param && i < BATCH_MAX; i++)
+    size += sprintf(b->code + size, " (+ (sq %ld) 1)", i);
+  strcpy(b->code + size, ")");
+}
+
+#ifdef LISP_CORO
+// every element of the code list spawned as a coroutine, then scheduled until all finished.
+static void op_coro(bench* b) {
+  size_t i;
+  for(i = 0; i < b->v.u.a.size; i++)
+    if(lisp_coro_spawn(&b->v.u.a.e[i], &b->env) < 0) {
+      fprintf(stderr, "failed to spawn %s\n", b->code);
+      exit(1);
+    }
+  if(lisp_coro_run() != 0) {
+    fprintf(stderr, "%s: coroutines blocked\n", b->name);
+    exit(1);
+  }
+}
+
+// `param` pairs of coroutines bouncing 100 numbers each over two pipes.
+static void setup_pipe(bench* b) {
+  int to[2], from[2];
+  size_t size;
+  long i;
+  lisp_coro_init(&b->env);
+  define(&b->env, "(define ping (lambda (out in n) (if (= n 0) 0 (+ (* 0 (write-fd out n)) (+ (read-fd in) (ping out in (- n 1)))))))");
+  define(&b->env, "(define pong (lambda (in out n) (if (= n 0) 0 (+ (write-fd out (read-fd in)) (pong in out (- n 1))))))");
+  b->code = (char*)malloc((size_t)b->param * 64 + 3);
+  size = sprintf(b->code, "(");
+  for(i = 0; i < b->param; i++) {
+    if(pipe(to) != 0 || pipe(from) != 0) {
+      perror("pipe");
+      exit(1);
+    }
+    size += sprintf(b->code + size, "(ping %d %d 100) (pong %d %d 100) ", to[1], from[0], to[0], from[1]);
+  }
+  strcpy(b->code + size, ")");
+}
+
+// `param` coroutines sending to one channel, one in a hundred receiving a hundred of them.
+static void setup_chan(bench* b) {
+  lisp_value v, result;
+  size_t size;
+  long i, ch;
+  lisp_coro_init(&b->env);
+  define(&b->env, "(define take (lambda (c n) (if (= n 0) 0 (+ (recv c) (take c (- n 1))))))");
+  lisp_value_init(&v);
+  if(lisp_parse(&v, "(chan)") != LISP_PARSE_OK || lisp_eval(&v, &result, &b->env) != LISP_EVAL_OK) {
+    fprintf(stderr, "failed to make a channel\n");
+    exit(1);
+  }
+  ch = (long)lisp_get_number(&result);
+  lisp_value_free(&v);
+  b->code = (char*)malloc((size_t)b->param * 40 + 3);
+  size = sprintf(b->code, "(");
+  for(i = 0; i < b->param; i++)
+    size += sprintf(b->code + size, i % 100 == 0 ? " (take %ld 100) (send %ld 1)" : " (send %ld 1)", ch, ch);
+  strcpy(b->code + size, ")");
+}
+#endif
+
+// one list of `param` defines, a typical rule file.
+static void setup_parse(bench* b) {
+  static const char line[] = "(define rule%ld (lambda (x y) (if (< x y) (+ x 1) (* y (- x 2)))))\n";
+  size_t size = 2;
+  long i;
+  b->code = (char*)malloc((size_t)b->param * (sizeof(line) + 16) + 3);
+  b->code[0] = '(';
+  b->code[1] = '\n';
+  for(i = 0; i < b->param; i++)
+    size += sprintf(b->code + size, line, i);
+  strcpy(b->code + size, ")");
+}
+
+static void setup_fib(bench* b) {
+  define(&b->env, "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))");
+  set_code(b, "(fib %ld)", b->param);
+}
+
+static void setup_fact(bench* b) {
+  define(&b->env, "(define fact (lambda (n) (if (= n 0) 1 (* n (fact (- n 1))))))");
+  set_code(b, "(fact %ld)", b->param);
+}
+
+static void setup_sqrt(bench* b) {
+  if(b->mode == BENCH_AOT) {
+    if(test_scm_load(&b->env) != LISP_EVAL_OK) {
+      fprintf(stderr, "failed to load the compiled test.scm\n");
+      exit(1);
+    }
+  }
+  else load_script(LISP_BENCH_SCRIPT, &b->env);
+  set_code(b, "(sqrt %ld)", b->param);
+}
+
+// code of head, a quoted list of the numbers 0 .. `param`-1, and tail.
+static void set_list_code(bench* b, const char* head, const char* tail) {
+  long i;
+  size_t size;
+  b->code = (char*)malloc((size_t)b->param * 24 + strlen(head) + strlen(tail) + 16);
+  size = sprintf(b->code, "%s(quote (", head);
+  for(i = 0; i < b->param; i++)
+    size += sprintf(b->code + size, i == 0 ? "%ld" : " %ld", i);
+  sprintf(b->code + size, "))%s", tail);
+}
+
+// a quoted list of `param` numbers, walked with car/cdr/null?.
+static void setup_list(bench* b) {
+  define(&b->env, "(define sum (lambda (l) (if (null? l) 0 (+ (car l) (sum (cdr l))))))");
+  set_list_code(b, "(sum ", ")");
+}
+
+// the list case written with macros, expanded when sum is defined: it runs as fast.
+static void setup_list_macro(bench* b) {
+  define(&b->env, "(define-macro (empty? l) (null? l))");
+  define(&b->env, "(define-macro (first l) (car l))");
+  define(&b->env, "(define-macro (rest l) (cdr l))");
+  define(&b->env, "(define sum (lambda (l) (if (empty? l) 0 (+ (first l) (sum (rest l))))))");
+  set_list_code(b, "(sum ", ")");
+}
+
+// the sum of a list of numbers in C, what sum computes in lisp.
+static int native_lsum(lisp_value* args, size_t count) {
+  lisp_value* l;
+  double n = 0;
+  size_t i;
+  if(args[0].type != LISP_LIST || args[0].u.a.size != 2 || args[0].u.a.e[0].type != LISP_QUOTE)
+    return LISP_EVAL_NOT_A_LIST;
+  l = &args[0].u.a.e[1];
+  for(i = 0; i < l->u.a.size; i++) {
+    if(l->u.a.e[i].type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
+    n += l->u.a.e[i].u.n;
+  }
+  args[0].type = LISP_NUMBER;
+  args[0].u.n = n;
+  return LISP_EVAL_OK;
+}
+
+// the list case with the sum bound to a native, see lisp_define_native.
+static void setup_list_native(bench* b) {
+  lisp_define_native(&b->env, "lsum", 1, native_lsum);
+  set_list_code(b, "(lsum ", ")");
+}
+
+// the same sum as a fold over the list, no list is copied.
+static void setup_list_fold(bench* b) {
+  set_list_code(b, "(fold (lambda (x acc) (+ x acc)) 0 ", ")");
+}
+
+// the squares of the first half summed, the map and filter fused into the fold.
+static void setup_list_pipeline(bench* b) {
+  char head[160];
+  sprintf(head, "(fold (lambda (x acc) (+ x acc)) 0 (map (lambda (x) (* x x)) (filter (lambda (x) (< x %ld)) ", b->param / 2);
+  set_list_code(b, head, ")))");
+}
+
+// the last field of a record, a quoted list of `param` fields, read the way
+// record accessors are written: (car (cdr (cdr ... r))).
+static void setup_record(bench* b) {
+  long i;
+  size_t size;
+  char* code = (char*)malloc((size_t)b->param * 7 + 64);
+  size = sprintf(code, "(define rlast (lambda (r) (car");
+  for(i = 1; i < b->param; i++)
+    size += sprintf(code + size, " (cdr");
+  size += sprintf(code + size, " r");
+  for(i = 0; i < b->param; i++)
+    code[size++] = ')';
+  strcpy(code + size, "))");
+  define(&b->env, code);
+  free(code);
+  set_list_code(b, "(rlast ", ")");
+}
+
+// the dot product of two quoted lists of `param` numbers, the list version of vdot.
+static void setup_ldot(bench* b) {
+  long i, j;
+  size_t size;
+  define(&b->env, "(define ldot (lambda (a b) (if (null? a) 0 (+ (* (car a) (car b)) (ldot (cdr a) (cdr b))))))");
+  b->code = (char*)malloc((size_t)b->param * 48 + 64);
+  size = sprintf(b->code, "(ldot");
+  for(j = 1; j <= 2; j++) {
+    size += sprintf(b->code + size, " (quote (");
+    for(i = 0; i < b->param; i++)
+      size += sprintf(b->code + size, i == 0 ? "%ld" : " %ld", j);
+    size += sprintf(b->code + size, "))");
+  }
+  strcpy(b->code + size, ")");
+}
+
+// the same over vectors of `param` elements, made by the form like the lists are parsed.
+static void setup_vdot(bench* b) {
+  lisp_vec_set_isa(LISP_VEC_AVX2);    // or the best the cpu has
+  b->code = (char*)malloc(96);
+  sprintf(b->code, "(vector-dot (make-vector %ld 1) (make-vector %ld 2))", b->param, b->param);
+}
+
+static void setup_vdot_scalar(bench* b) {
+  setup_vdot(b);
+  lisp_vec_set_isa(LISP_VEC_SCALAR);
+}
+
+#define BENCH_WINDOW 65536
+
+// `param` numbers as a quoted literal, the way data got into a script before the loaders.
+static void setup_literal(bench* b) {
+  long i;
+  size_t size;
+  b->code = (char*)malloc((size_t)b->param * 24 + 32);
+  size = sprintf(b->code, "(quote (");
+  for(i = 0; i < b->param; i++)
+    size += sprintf(b->code + size, i == 0 ? "%ld" : " %ld", i);
+  strcpy(b->code + size, "))");
+}
+
+#ifdef LISP_DATA
+// the sum of a file of `param` doubles, mapped in windows.
+static void setup_f64(bench* b) {
+  char code[160];
+  FILE* out = fopen("lisp_bench.f64", "wb");
+  double x;
+  long i;
+  for(i = 0; i < b->param; i++) {
+    x = (double)i;
+    fwrite(&x, sizeof(x), 1, out);
+  }
+  fclose(out);
+  sprintf(code, "(define fsum (lambda (i) (if (< i %ld) (+ (vector-sum (load-f64 lisp_bench.f64 i %d)) (fsum (+ i %d))) 0)))",
+      b->param, BENCH_WINDOW, BENCH_WINDOW);
+  define(&b->env, code);
+  set_code(b, "(fsum %ld)", 0);
+}
+
+// the sum of a csv column of `param` rows, read in windows.
+static void setup_csv(bench* b) {
+  char code[160];
+  FILE* out = fopen("lisp_bench.csv", "w");
+  long i;
+  fprintf(out, "id,price\n");
+  for(i = 0; i < b->param; i++)
+    fprintf(out, "%ld,%.2f\n", i, i * 0.25);
+  fclose(out);
+  sprintf(code, "(define csum (lambda (i) (if (< i %ld) (+ (vector-sum (load-csv lisp_bench.csv 1 i %d)) (csum (+ i %d))) 0)))",
+      b->param, BENCH_WINDOW, BENCH_WINDOW);
+  define(&b->env, code);
+  set_code(b, "(csum %ld)", 0);
+}
+
+// the latencies of the failed requests of a `param` line access log, summed.
+static void setup_log(bench* b) {
+  FILE* out = fopen("lisp_bench.log", "w");
+  long i;
+  for(i = 0; i < b->param; i++)
+    fprintf(out, "2024-01-01T12:%02ld:%02ld host%ld GET /api/items/%ld %d %ldms\n",
+        i / 60 % 60, i % 60, i % 8, i, i % 10 == 0 ? 500 : 200, i % 300);
+  fclose(out);
+  define(&b->env, "(define errs (lambda (text at) (if (< at 0) 0 (+ (string->number (substring text (+ at 5) (string-search text \"ms\" at))) (errs text (string-search text \" 500 \" (+ at 1)))))))");
+  define(&b->env, "(define scan (lambda (text) (errs text (string-search text \" 500 \" 0))))");
+  set_code(b, "(scan (load-text lisp_bench.log))", 0);
+}
+#endif
+
+/*
+ * tables, filled and probed by trees of calls ten wide: the keys 0 .. n-1,
+ * n a power of ten, a recursion only log10(n) deep.
+ */
+static void define_table_trees(env_t* e) {
+  define(e, "(define tfill (lambda (t base n) (if (= n 1) (table-set! t base base) (tfill10 t base (/ n 10)))))");
+  define(e, "(define tfill10 (lambda (t base m) (+ (tfill t base m) (tfill t (+ base m) m) (tfill t (+ base (* 2 m)) m) (tfill t (+ base (* 3 m)) m) (tfill t (+ base (* 4 m)) m) (tfill t (+ base (* 5 m)) m) (tfill t (+ base (* 6 m)) m) (tfill t (+ base (* 7 m)) m) (tfill t (+ base (* 8 m)) m) (tfill t (+ base (* 9 m)) m))))");
+  define(e, "(define tprobe (lambda (t base n) (if (= n 1) (table-ref t base) (tprobe10 t base (/ n 10)))))");
+  define(e, "(define tprobe10 (lambda (t base m) (+ (tprobe t base m) (tprobe t (+ base m) m) (tprobe t (+ base (* 2 m)) m) (tprobe t (+ base (* 3 m)) m) (tprobe t (+ base (* 4 m)) m) (tprobe t (+ base (* 5 m)) m) (tprobe t (+ base (* 6 m)) m) (tprobe t (+ base (* 7 m)) m) (tprobe t (+ base (* 8 m)) m) (tprobe t (+ base (* 9 m)) m))))");
+}
+
+// a table of `param` keys made, filled and freed.
+static void setup_table_set(bench* b) {
+  define_table_trees(&b->env);
+  define(&b->env, "(define tbuild (lambda (t n) (+ (tfill t 0 n) (if (table-free t) 0 1))))");
+  set_code(b, "(tbuild (make-table) %ld)", b->param);
+}
+
+// the last 1000 keys of a table of `param` looked up.
+static void setup_table_ref(bench* b) {
+  char code[64];
+  long t = (long)lisp_table_register(&b->env, lisp_table_new());
+  define_table_trees(&b->env);
+  sprintf(code, "(tfill %ld 0 %ld)", t, b->param);
+  define(&b->env, code);
+  b->code = (char*)malloc(64);
+  sprintf(b->code, "(tprobe %ld %ld 1000)", t, b->param - 1000);
+}
+
+// the last key of a `param` entry association list, what scripts did before tables.
+static void setup_alist(bench* b) {
+  char* code = (char*)malloc((size_t)b->param * 24 + 64);
+  size_t size;
+  long i;
+  define(&b->env, "(define assv (lambda (k l) (if (null? l) -1 (if (= (car (car l)) k) (car (cdr (car l))) (assv k (cdr l))))))");
+  size = sprintf(code, "(define people (quote (");
+  for(i = 0; i < b->param; i++)
+    size += sprintf(code + size, i == 0 ? "(%ld %ld)" : " (%ld %ld)", i, i);
+  strcpy(code + size, ")))");
+  define(&b->env, code);
+  free(code);
+  set_code(b, "(assv %ld people)", b->param - 1);
+}
+
+// the list pipeline over the integers as a stream: `param` elements are taken,
+// the cells are forced as the fold goes, it runs in as much memory for any param.
+static void setup_stream(bench* b) {
+  define(&b->env, "(define ints (lambda (n) (stream-cons n (ints (+ n 1)))))");
+  b->code = (char*)malloc(160);
+  sprintf(b->code, "(fold (lambda (x acc) (+ x acc)) 0 (stream-take %ld (map (lambda (x) (* x x)) (filter (lambda (x) (< 0 x)) (ints 0)))))", b->param);
+}
+
+// an accumulator over 0 .. `param`-1 as a do loop: the variables are updated in
+// place, it runs in one frame for any param.
+static void setup_loop_do(bench* b) {
+  define(&b->env, "(define sum (lambda (n) (do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i n) acc))))");
+  set_code(b, "(sum %ld)", b->param);
+}
+
+// the loop as a named let, its tail calls go back to the top of it.
+static void setup_loop_let(bench* b) {
+  define(&b->env, "(define sum (lambda (n) (let loop ((i 0) (acc 0)) (if (= i n) acc (loop (+ i 1) (+ acc i))))))");
+  set_code(b, "(sum %ld)", b->param);
+}
+
+// the loop as recursion, a frame an iteration: every call looks rsum up past the
+// frames below it, and some thousands of them overflow the C stack.
+static void setup_loop_rec(bench* b) {
+  define(&b->env, "(define rsum (lambda (i acc n) (if (= i n) acc (rsum (+ i 1) (+ acc i) n))))");
+  set_code(b, "(rsum 0 0 %ld)", b->param);
+}
+
+// (fact 20) defined below `param` other globals.
+static void setup_env(bench* b) {
+  char code[64];
+  long i;
+  define(&b->env, "(define fact (lambda (n) (if (= n 0) 1 (* n (fact (- n 1))))))");
+  for(i = 0; i < b->param; i++) {
+    sprintf(code, "(define g%ld %ld)", i, i);
+    define(&b->env, code);
+  }
+  set_code(b, "(fact %ld)", 20);
+}
+
+static bench benches[] = {
+  { "parse", 100, BENCH_INTERPRETED, 100, setup_parse, op_parse },
+  { "parse", 10000, BENCH_INTERPRETED, 2, setup_parse, op_parse },
+  { "fib", 15, BENCH_INTERPRETED, 10, setup_fib, op_eval },
+  { "fib", 20, BENCH_INTERPRETED, 1, setup_fib, op_eval },
+  { "fact", 20, BENCH_INTERPRETED, 1000, setup_fact, op_eval },
+  { "sqrt", 1000, BENCH_INTERPRETED, 200, setup_sqrt, op_eval },
+  { "sqrt", 1000, BENCH_AOT, 10000, setup_sqrt, op_eval },
+  { "list", 10, BENCH_INTERPRETED, 1000, setup_list, op_eval },
+  { "list", 100, BENCH_INTERPRETED, 20, setup_list, op_eval },
+  { "list_macro", 10, BENCH_INTERPRETED, 1000, setup_list_macro, op_eval },
+  { "list_native", 10, BENCH_INTERPRETED, 1000, setup_list_native, op_eval },
+  { "list_native", 100, BENCH_INTERPRETED, 1000, setup_list_native, op_eval },
+  { "list_fold", 10, BENCH_INTERPRETED, 1000, setup_list_fold, op_eval },
+  { "list_fold", 100, BENCH_INTERPRETED, 1000, setup_list_fold, op_eval },
+  { "list_fold", 10000, BENCH_INTERPRETED, 10, setup_list_fold, op_eval },
+  { "list_pipeline", 10000, BENCH_INTERPRETED, 10, setup_list_pipeline, op_eval },
+  { "stream", 10000, BENCH_INTERPRETED, 10, setup_stream, op_eval },
+  { "stream", 100000, BENCH_INTERPRETED, 1, setup_stream, op_eval },
+  { "loop_rec", 1000, BENCH_INTERPRETED, 10, setup_loop_rec, op_eval },
+  { "loop_do", 1000, BENCH_INTERPRETED, 10, setup_loop_do, op_eval },
+  { "loop_do", 10000000, BENCH_INTERPRETED, 1, setup_loop_do, op_eval },
+  { "loop_let", 10000000, BENCH_INTERPRETED, 1, setup_loop_let, op_eval },
+  { "record", 10, BENCH_INTERPRETED, 1000, setup_record, op_eval },
+  { "record", 50, BENCH_INTERPRETED, 1000, setup_record, op_eval },
+  { "record", 200, BENCH_INTERPRETED, 100, setup_record, op_eval },
+  { "env", 0, BENCH_INTERPRETED, 1000, setup_env, op_eval },
+  { "env", 100, BENCH_INTERPRETED, 1000, setup_env, op_eval },
+  { "env", 1000, BENCH_INTERPRETED, 1000, setup_env, op_eval },
+  { "env", 10000, BENCH_INTERPRETED, 1000, setup_env, op_eval },
+  { "each", 1000, BENCH_INTERPRETED, 100, setup_batch, op_each },
+  { "batch", 1000, BENCH_INTERPRETED, 100, setup_batch, op_batch },
+  { "ldot", 100, BENCH_INTERPRETED, 100, setup_ldot, op_eval },
+  { "ldot", 1000, BENCH_INTERPRETED, 1, setup_ldot, op_eval },
+  { "vdot", 100, BENCH_INTERPRETED, 10000, setup_vdot, op_eval },
+  { "vdot", 1000, BENCH_INTERPRETED, 10000, setup_vdot, op_eval },
+  { "vdot", 100000, BENCH_INTERPRETED, 100, setup_vdot, op_eval },
+  { "vdot_scalar", 100000, BENCH_INTERPRETED, 100, setup_vdot_scalar, op_eval },
+  { "literal", 100000, BENCH_INTERPRETED, 1, setup_literal, op_parse },
+#ifdef LISP_DATA
+  { "f64", 1000000, BENCH_INTERPRETED, 10, setup_f64, op_eval },
+  { "csv", 100000, BENCH_INTERPRETED, 1, setup_csv, op_eval },
+  { "log", 2000, BENCH_INTERPRETED, 100, setup_log, op_eval },
+#endif
+  { "alist", 1000, BENCH_INTERPRETED, 10, setup_alist, op_eval },
+  { "table", 1000, BENCH_INTERPRETED, 100, setup_table_ref, op_eval },
+  { "table_ref", 1000000, BENCH_INTERPRETED, 100, setup_table_ref, op_eval },
+  { "table_set", 1000000, BENCH_INTERPRETED, 1, setup_table_set, op_eval },
+#ifdef LISP_TASK
+  { "task", 100, BENCH_INTERPRETED, 10, setup_task, op_task },
+  { "task", 10000, BENCH_INTERPRETED, 10, setup_task, op_task },
+#endif
+#ifdef LISP_CORO
+  { "pipe", 1, BENCH_INTERPRETED, 10, setup_pipe, op_coro },
+  { "pipe", 10, BENCH_INTERPRETED, 10, setup_pipe, op_coro },
+  { "pipe", 100, BENCH_INTERPRETED, 1, setup_pipe, op_coro },
+  { "chan", 1000, BENCH_INTERPRETED, 10, setup_chan, op_coro },
+#endif
+#ifdef LISP_JIT
+  { "fib", 20, BENCH_JIT, 50, setup_fib, op_eval },
+  { "fact", 20, BENCH_JIT, 10000, setup_fact, op_eval },
+  { "sqrt", 1000, BENCH_JIT, 10000, setup_sqrt, op_eval },
+#endif
+};
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void run(bench* b, size_t warmup, size_t trials, FILE* report, int first) {
+  double* ns = (double*)malloc(trials * sizeof(double)), start;
+  size_t i, j, allocs_before, bytes_before;
+  struct rusage usage;
+
+#ifdef LISP_JIT
+  lisp_jit_enable(b->mode == BENCH_JIT);
+#endif
+  env_init(NULL, &b->env);
+  b->setup(b);
+  lisp_value_init(&b->v);
+  if(b->op != op_parse && lisp_parse(&b->v, b->code) != LISP_PARSE_OK) {
+    fprintf(stderr, "failed to parse %s\n", b->code);
+    exit(1);
+  }
+
+  for(i = 0; i < warmup; i++)    // hot lambdas get compiled here
+    b->op(b);
+  allocs_before = allocs;
+  bytes_before = alloc_bytes;
+#ifdef LISP_PERF
+  lisp_perf_reset();
+#endif
+  for(i = 0; i < trials; i++) {
+    start = now_ns();
+    for(j = 0; j < b->ops; j++)
+      b->op(b);
+    ns[i] = (now_ns() - start) / b->ops;
+  }
+  getrusage(RUSAGE_SELF, &usage);
+  qsort(ns, trials, sizeof(double), cmp_double);
+
+  fprintf(report, "%s  {\"name\": \"%s\", \"param\": %ld, \"mode\": \"%s\", \"trials\": %zu, \"ops\": %zu, "
+      "\"ns_per_op\": %.1f, \"ns_per_op_min\": %.1f, ",
+      first ? "" : ",\n", b->name, b->param, bench_modes[b->mode], trials, b->ops, ns[trials/2], ns[0]);
+  if(BENCH_COUNTS_ALLOCS)
+    fprintf(report, "\"allocs_per_op\": %.1f, \"bytes_per_op\": %.1f, ",
+        (double)(allocs - allocs_before) / (trials * b->ops), (double)(alloc_bytes - bytes_before) / (trials * b->ops));
+  else fprintf(report, "\"allocs_per_op\": null, \"bytes_per_op\": null, ");
+#ifdef LISP_PERF
+  if(bench_perf) {
+    lisp_perf_sample parse, eval;
+    int k;
+    lisp_perf_total(LISP_PERF_PARSE, &parse);
+    lisp_perf_total(LISP_PERF_EVAL, &eval);
+    for(k = 0; k < LISP_PERF_COUNTERS; k++) {
+      if(lisp_perf_available(k))
+        fprintf(report, "\"%s_per_op\": %.1f, ", bench_counters[k], (double)(parse.counts[k] + eval.counts[k]) / (trials * b->ops));
+      else fprintf(report, "\"%s_per_op\": null, ", bench_counters[k]);
+    }
+  }
+#endif
+  fprintf(report, "\"peak_rss_kb\": %ld}", usage.ru_maxrss);
+  fflush(report);
+
+  if(b->op == op_eval)
+    lisp_value_free(&b->v);
+  free(b->code);
+  free(ns);
+  env_free(&b->env);
+}
+
+int main(int argc, char** argv) {
+  size_t warmup = WARMUP, trials = TRIALS, i;
+  const char* filter = NULL;
+  FILE* report;
+  int opt, first = 1, hz = 0;
+
+  while((opt = getopt(argc, argv, "w:t:ps:")) != -1) {
+    switch(opt) {
+      case 'w': warmup = strtoul(optarg, NULL, 10); break;
+      case 't': trials = strtoul(optarg, NULL, 10); break;
+      case 'p': bench_perf = 1; break;
+      case 's': hz = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-w warmup] [-t trials] [-p] [-s hz] [filter]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind < argc)
+    filter = argv[optind];
+  if(trials == 0)
+    trials = 1;
+#ifdef LISP_PERF
+  if(bench_perf && lisp_perf_enable(1) == 0)
+    fprintf(stderr, "no performance counters available\n");
+#else
+  if(bench_perf)
+    fprintf(stderr, "built without LISP_PERF, -p ignored\n");
+  bench_perf = 0;
+#endif
+#ifdef LISP_PROF
+  if(hz > 0 && lisp_prof_enable(hz) != 0)
+    fprintf(stderr, "the profiling timer is unavailable\n");
+#else
+  if(hz > 0)
+    fprintf(stderr, "built without LISP_PROF, -s ignored\n");
+#endif
+
+  // the evaluator prints diagnostics to stdout, keep it for the report only.
+  if((report = fdopen(dup(STDOUT_FILENO), "w")) == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    return 1;
+  fprintf(report, "[\n");
+  for(i = 0; i < sizeof(benches)/sizeof(benches[0]); i++) {
+    if(filter != NULL && strstr(benches[i].name, filter) == NULL)
+      continue;
+    run(&benches[i], warmup, trials, report, first);
+    first = 0;
+  }
+  fprintf(report, "\n]\n");
+  fclose(report);
+  remove("lisp_bench.f64");    // written by the loader cases
+  remove("lisp_bench.csv");
+  remove("lisp_bench.log");
+#ifdef LISP_STATS
+  lisp_stats_report(stderr);
+#endif
+#ifdef LISP_PROF
+  if(hz > 0) {
+    lisp_prof_enable(0);
+    lisp_prof_report(stderr);
+  }
+#endif
+  return 0;
+}
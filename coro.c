@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "coro.h"
+
+#define CORO_NONE	-1
+#define CORO_TOPLEVEL	-2    // a primitive called outside of any coroutine
+#define CORO_EVENTS	64
+
+enum {
+  CORO_FREE,
+  CORO_READY,
+  CORO_RUNNING,
+  CORO_BLOCKED
+};
+
+typedef struct coro coro;
+struct coro {
+  lisp_task* task;
+  lisp_value* code;    // the spawned expression, owned by the coroutine
+  int state, parked;    // parked: blocked during its last run, not preempted
+  long next;    // next waiter on the same channel, or next free slot
+};
+
+typedef struct coro_chan coro_chan;
+struct coro_chan {
+  double buf[LISP_CHAN_CAPACITY];
+  size_t head, count;
+  long recv_head, recv_tail, send_head, send_tail;    // coroutines waiting, in order
+};
+
+typedef struct coro_fd coro_fd;
+struct coro_fd {
+  int used, registered, eof;    // used: made non-blocking. registered: in the epoll set
+  long reader, writer;    // waiting for the descriptor, at most one each
+  unsigned char in[sizeof(double)];    // a number read in pieces
+  size_t have;
+};
+
+static LISP_THREAD_LOCAL struct {
+  int inited, epoll, toplevel;    // toplevel: the descriptor waited for outside coroutines is ready
+  coro* p;
+  size_t size, live, waiting;    // waiting: waiters on descriptors
+  long free, current;
+  long* ready;    // ring of coroutines to run
+  size_t ready_head, ready_count, ready_size;
+  coro_chan* chans;
+  size_t chans_top, chans_size;
+  coro_fd* fds;
+  size_t fds_size;
+  lisp_coro_stats stats;
+  int error;    // of the first coroutine that failed since lisp_coro_error
+}sched;
+
+static int coro_step();
+
+static void coro_setup() {
+  if(sched.inited) return;
+  memset(&sched, 0, sizeof(sched));
+  sched.inited = 1;
+  sched.free = CORO_NONE;
+  sched.current = CORO_NONE;
+  sched.epoll = epoll_create1(EPOLL_CLOEXEC);
+}
+
+static void coro_ready_push(long id) {
+  long* ready;
+  size_t i, size = sched.ready_size;
+  if(sched.ready_count == size) {
+    ready = (long*)malloc((sched.ready_size = size == 0 ? 64 : size * 2) * sizeof(long));
+    for(i = 0; i < sched.ready_count; i++)
+      ready[i] = sched.ready[(sched.ready_head + i) % size];
+    free(sched.ready);
+    sched.ready = ready;
+    sched.ready_head = 0;
+  }
+  sched.ready[(sched.ready_head + sched.ready_count++) % sched.ready_size] = id;
+}
+
+static long coro_ready_pop() {
+  long id = sched.ready[sched.ready_head];
+  sched.ready_head = (sched.ready_head + 1) % sched.ready_size;
+  sched.ready_count--;
+  return id;
+}
+
+static void coro_wake(long id) {
+  if(id == CORO_TOPLEVEL) sched.toplevel = 1;
+  else if(id >= 0 && sched.p[id].state == CORO_BLOCKED) {
+    sched.p[id].state = CORO_READY;
+    coro_ready_push(id);
+  }
+}
+
+static void coro_wait_push(long* head, long* tail, long id) {
+  sched.p[id].next = CORO_NONE;
+  if(*tail == CORO_NONE) *head = id;
+  else sched.p[*tail].next = id;
+  *tail = id;
+}
+
+static long coro_wait_pop(long* head, long* tail) {
+  long id = *head;
+  if(id != CORO_NONE && (*head = sched.p[id].next) == CORO_NONE)
+    *tail = CORO_NONE;
+  return id;
+}
+
+// block the running coroutine until coro_wake, LISP_EVAL_CANCELLED if it is cancelled meanwhile.
+static int coro_park() {
+  coro* co = &sched.p[sched.current];
+  co->state = CORO_BLOCKED;
+  co->parked = 1;
+  return lisp_task_yield();
+}
+
+static void coro_finish(long id) {
+  coro* co = &sched.p[id];
+  lisp_task_free(co->task);
+  lisp_value_free(co->code);
+  free(co->code);
+  co->task = NULL;
+  co->code = NULL;
+  co->state = CORO_FREE;
+  co->next = sched.free;
+  sched.free = id;
+  sched.live--;
+  sched.stats.finished++;
+}
+
+static void coro_resume(long id) {
+  lisp_value result;
+  long current = sched.current;
+  int ret;
+  sched.p[id].state = CORO_RUNNING;
+  sched.p[id].parked = 0;
+  sched.current = id;
+  sched.stats.switches++;
+  ret = lisp_task_run(sched.p[id].task, LISP_CORO_SLICE, 0, &result);
+  sched.current = current;
+  if(ret == LISP_EVAL_OK)
+    lisp_value_free(&result);
+  else if(ret != LISP_EVAL_SUSPENDED && ret != LISP_EVAL_CANCELLED) {
+    sched.stats.failed++;
+    if(sched.error == LISP_EVAL_OK)
+      sched.error = ret;
+  }
+  if(ret != LISP_EVAL_SUSPENDED)
+    coro_finish(id);
+  else if(!sched.p[id].parked) {    // preempted or (yield)
+    sched.p[id].state = CORO_READY;
+    coro_ready_push(id);
+  }
+}
+
+static int coro_fd_arm(int fd) {
+  coro_fd* f = &sched.fds[fd];
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLONESHOT | (f->reader != CORO_NONE ? EPOLLIN : 0) | (f->writer != CORO_NONE ? EPOLLOUT : 0);
+  ev.data.fd = fd;
+  if(epoll_ctl(sched.epoll, f->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0)
+    return -1;
+  f->registered = 1;
+  return 0;
+}
+
+static void coro_poll(int timeout) {
+  struct epoll_event events[CORO_EVENTS];
+  coro_fd* f;
+  long id;
+  int i, n;
+  sched.stats.polls++;
+  if((n = epoll_wait(sched.epoll, events, CORO_EVENTS, timeout)) <= 0)
+    return;    // EINTR included, the next step polls again
+  for(i = 0; i < n; i++) {
+    f = &sched.fds[events[i].data.fd];
+    if((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (id = f->reader) != CORO_NONE) {
+      f->reader = CORO_NONE;
+      sched.waiting--;
+      coro_wake(id);
+    }
+    if((events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && (id = f->writer) != CORO_NONE) {
+      f->writer = CORO_NONE;
+      sched.waiting--;
+      coro_wake(id);
+    }
+    if(f->reader != CORO_NONE || f->writer != CORO_NONE)
+      coro_fd_arm(events[i].data.fd);    // one shot, the other direction still waits
+  }
+}
+
+// one round: wake what the descriptors allow, then run every coroutine that was ready.
+// returns 0 if nothing can run now or later.
+static int coro_step() {
+  size_t n;
+  if(sched.ready_count == 0) {
+    if(sched.waiting == 0) return 0;
+    coro_poll(-1);
+  }
+  else if(sched.waiting != 0) coro_poll(0);
+  for(n = sched.ready_count; n > 0; n--)
+    coro_resume(coro_ready_pop());
+  return 1;
+}
+
+long lisp_coro_spawn(const lisp_value* expr, env_t* e) {
+  lisp_value* code;
+  env_t* outer = e;
+  long id;
+  coro_setup();
+  while(outer->prev != NULL)
+    outer = outer->prev;
+  if((code = (lisp_value*)malloc(sizeof(lisp_value))) == NULL)
+    return -1;
+  lisp_value_copy(code, expr);
+  if(sched.free == CORO_NONE) {
+    sched.p = (coro*)realloc(sched.p, (sched.size + 1) * sizeof(coro));
+    sched.free = (long)sched.size++;
+    sched.p[sched.free].next = CORO_NONE;
+  }
+  id = sched.free;
+  if((sched.p[id].task = lisp_task_new(code, outer)) == NULL) {
+    lisp_value_free(code);
+    free(code);
+    return -1;
+  }
+  lisp_task_capture(sched.p[id].task, e);    // the caller's parameters are gone when it runs
+  sched.free = sched.p[id].next;
+  sched.p[id].code = code;
+  sched.p[id].state = CORO_READY;
+  sched.p[id].parked = 0;
+  coro_ready_push(id);
+  sched.live++;
+  sched.stats.spawned++;
+  return id;
+}
+
+size_t lisp_coro_run() {
+  coro_setup();
+  while(coro_step()) ;
+  return sched.live;
+}
+
+void lisp_get_coro_stats(lisp_coro_stats* s) {
+  *s = sched.stats;
+}
+
+int lisp_coro_error() {
+  int ret = sched.error;
+  sched.error = LISP_EVAL_OK;
+  return ret;
+}
+
+void lisp_coro_free() {
+  size_t i;
+  if(!sched.inited) return;
+  for(i = 0; i < sched.size; i++) {
+    if(sched.p[i].state == CORO_FREE) continue;
+    sched.current = (long)i;
+    lisp_task_free(sched.p[i].task);
+    lisp_value_free(sched.p[i].code);
+    free(sched.p[i].code);
+  }
+  if(sched.epoll != -1)
+    close(sched.epoll);
+  free(sched.p);
+  free(sched.ready);
+  free(sched.chans);
+  free(sched.fds);
+  memset(&sched, 0, sizeof(sched));
+}
+
+static coro_chan* coro_chan_get(double id) {
+  if(!(id >= 0 && id < sched.chans_top) || id != (double)(size_t)id)
+    return NULL;
+  return &sched.chans[(size_t)id];
+}
+
+static double coro_chan_new(const double* args) {
+  coro_chan* c;
+  (void)args;
+  coro_setup();
+  if(sched.chans_top == sched.chans_size) {
+    sched.chans_size = sched.chans_size == 0 ? 16 : sched.chans_size * 2;
+    sched.chans = (coro_chan*)realloc(sched.chans, sched.chans_size * sizeof(coro_chan));
+  }
+  c = &sched.chans[sched.chans_top];
+  c->head = c->count = 0;
+  c->recv_head = c->recv_tail = c->send_head = c->send_tail = CORO_NONE;
+  return (double)sched.chans_top++;
+}
+
+static double coro_send(const double* args) {
+  coro_chan* c;
+  while((c = coro_chan_get(args[0])) != NULL && c->count == LISP_CHAN_CAPACITY) {
+    if(sched.current < 0) {
+      if(!coro_step()) return NAN;
+      continue;
+    }
+    coro_wait_push(&c->send_head, &c->send_tail, sched.current);
+    if(coro_park() != LISP_EVAL_OK) return NAN;
+  }
+  if(c == NULL) return NAN;
+  c->buf[(c->head + c->count++) % LISP_CHAN_CAPACITY] = args[1];
+  coro_wake(coro_wait_pop(&c->recv_head, &c->recv_tail));
+  return args[1];
+}
+
+static double coro_recv(const double* args) {
+  coro_chan* c;
+  double x;
+  while((c = coro_chan_get(args[0])) != NULL && c->count == 0) {
+    if(sched.current < 0) {
+      if(!coro_step()) return NAN;
+      continue;
+    }
+    coro_wait_push(&c->recv_head, &c->recv_tail, sched.current);
+    if(coro_park() != LISP_EVAL_OK) return NAN;
+  }
+  if(c == NULL) return NAN;
+  x = c->buf[c->head];
+  c->head = (c->head + 1) % LISP_CHAN_CAPACITY;
+  c->count--;
+  coro_wake(coro_wait_pop(&c->send_head, &c->send_tail));
+  return x;
+}
+
+static double coro_yield(const double* args) {
+  (void)args;
+  if(sched.current >= 0) lisp_task_yield();
+  else coro_step();
+  return 0;
+}
+
+static coro_fd* coro_fd_get(double n) {
+  int fd = (int)n, flags;
+  size_t size;
+  coro_fd* f;
+  if(!(n >= 0 && n < 1 << 20) || n != (double)fd)
+    return NULL;
+  if((size_t)fd >= sched.fds_size) {
+    size = sched.fds_size == 0 ? 64 : sched.fds_size;
+    while(size <= (size_t)fd) size *= 2;
+    sched.fds = (coro_fd*)realloc(sched.fds, size * sizeof(coro_fd));
+    memset(sched.fds + sched.fds_size, 0, (size - sched.fds_size) * sizeof(coro_fd));
+    sched.fds_size = size;
+  }
+  f = &sched.fds[fd];
+  if(!f->used) {
+    if((flags = fcntl(fd, F_GETFL)) == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+      return NULL;
+    f->used = 1;
+    f->reader = f->writer = CORO_NONE;
+  }
+  return f;
+}
+
+// park until fd is readable or writable. 0 when it is, -1 if it cannot be waited for.
+static int coro_wait_fd(int fd, int out) {
+  long self = sched.current >= 0 ? sched.current : CORO_TOPLEVEL;
+  coro_fd* f = &sched.fds[fd];
+  if(out) f->writer = self;
+  else f->reader = self;
+  if(sched.epoll == -1 || coro_fd_arm(fd) != 0) {
+    if(out) f->writer = CORO_NONE;
+    else f->reader = CORO_NONE;
+    return -1;
+  }
+  sched.waiting++;
+  if(self != CORO_TOPLEVEL)
+    return coro_park() == LISP_EVAL_OK ? 0 : -1;
+  for(sched.toplevel = 0; !sched.toplevel; )
+    if(!coro_step()) return -1;
+  return 0;
+}
+
+// buffer the next number of fd. 1 when it is there, 0 at end of file, -1 on errors.
+static int coro_fill(double n) {
+  coro_fd* f;
+  ssize_t got;
+  coro_setup();
+  for(;;) {
+    if((f = coro_fd_get(n)) == NULL) return -1;
+    if(f->have == sizeof(double)) return 1;
+    if(f->eof) return 0;
+    if((got = read((int)n, f->in + f->have, sizeof(double) - f->have)) > 0)
+      f->have += (size_t)got;
+    else if(got == 0)
+      f->eof = 1;
+    else if(errno != EINTR && (errno != EAGAIN || coro_wait_fd((int)n, 0) != 0))
+      return -1;
+  }
+}
+
+static double coro_read_fd(const double* args) {
+  coro_fd* f;
+  double x;
+  if(coro_fill(args[0]) != 1) return NAN;
+  f = &sched.fds[(int)args[0]];
+  memcpy(&x, f->in, sizeof(double));
+  f->have = 0;
+  return x;
+}
+
+static double coro_eof(const double* args) {
+  return coro_fill(args[0]) != 1;
+}
+
+static double coro_write_fd(const double* args) {
+  size_t done = 0;
+  ssize_t put;
+  coro_setup();
+  if(coro_fd_get(args[0]) == NULL) return NAN;
+  while(done < sizeof(double)) {
+    if((put = write((int)args[0], (const char*)&args[1] + done, sizeof(double) - done)) > 0)
+      done += (size_t)put;
+    else if(put < 0 && errno != EINTR && (errno != EAGAIN || coro_wait_fd((int)args[0], 1) != 0))
+      return NAN;
+  }
+  return args[1];
+}
+
+int lisp_coro_init(env_t* e) {
+  coro_setup();
+  lisp_define_native_number(e, "yield", 0, coro_yield, 0);
+  lisp_define_native_number(e, "chan", 0, coro_chan_new, 0);
+  lisp_define_native_number(e, "send", 2, coro_send, 0);
+  lisp_define_native_number(e, "recv", 1, coro_recv, 0);
+  lisp_define_native_number(e, "read-fd", 1, coro_read_fd, 0);
+  lisp_define_native_number(e, "write-fd", 2, coro_write_fd, 0);
+  lisp_define_native_number(e, "eof?", 1, coro_eof, 1);
+  return LISP_EVAL_OK;
+}
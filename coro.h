@@ -0,0 +1,53 @@
+#ifndef LEPT_CORO__
+#define LEPT_CORO__
+#include <stddef.h>
+#include "eval.h"
+
+/*
+ * coroutines: (spawn expr) evaluates expr as a task of its own, see
+ * lisp_task_new, and a scheduler interleaves the tasks on one thread. a
+ * coroutine gives the thread up when its slice of steps is spent, on
+ * (yield), or when it blocks on a channel or a file descriptor; blocked
+ * descriptors are waited for with epoll. built with LISP_CORO.
+ *
+ * primitives bound by lisp_coro_init, channels and descriptors are numbers:
+ *   (yield)            lets the other coroutines run, 0
+ *   (chan)             a new channel of LISP_CHAN_CAPACITY numbers
+ *   (send ch x)        x, blocks while ch is full
+ *   (recv ch)          the oldest number in ch, blocks while it is empty
+ *   (read-fd fd)       the next number of fd, 8 bytes in host order
+ *   (write-fd fd x)    x, written as 8 bytes
+ *   (eof? fd)          whether fd has no number left, blocks until that is known
+ * descriptors are made non-blocking on first use. outside a coroutine a
+ * primitive that would block runs the scheduler until it can go on; a
+ * failed primitive, like a receive nobody will ever send to, returns NaN.
+ */
+
+#ifndef LISP_CORO_SLICE
+#define LISP_CORO_SLICE 1000    // steps a coroutine runs before the next one is scheduled
+#endif
+#ifndef LISP_CHAN_CAPACITY
+#define LISP_CHAN_CAPACITY 16
+#endif
+
+typedef struct lisp_coro_stats lisp_coro_stats;
+struct lisp_coro_stats {
+  size_t spawned, finished, failed, switches, polls;    // failed: finished with an eval error. polls: epoll_wait calls
+};
+
+#ifdef LISP_CORO
+// binds the primitives above in e. returns LISP_EVAL_OK.
+int lisp_coro_init(env_t* e);
+// a coroutine evaluating a copy of expr in the outermost env of e, the parameters of e
+// it uses bound to what they are now, see lisp_task_capture. returns its id, -1 on failure.
+long lisp_coro_spawn(const lisp_value* expr, env_t* e);
+// run coroutines until every one finished or the rest block on channels forever. returns how many are left.
+size_t lisp_coro_run();
+void lisp_get_coro_stats(lisp_coro_stats* s);
+// the eval error a coroutine finished with, the first since the last call, LISP_EVAL_OK if none failed.
+int lisp_coro_error();
+// cancels the coroutines left, frees channels and the scheduler.
+void lisp_coro_free();
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "data.h"
+#include "eval.h"
+#include "vector.h"
+#include "str.h"
+
+#define DATA_CSV_CHUNK	4096    // elements a csv window starts with, it doubles from there
+
+// where the last csv window of a file stopped, so that the next one need not scan from the top.
+static LISP_THREAD_LOCAL struct {
+  char* path;
+  size_t column, row;    // data rows before offset
+  off_t offset, size;
+  struct timespec mtime;
+}csv_resume;
+
+static void data_vector(lisp_value* v, double* d, size_t size, size_t map) {
+  v->type = LISP_VECTOR;
+  v->u.vec.d = d;
+  v->u.vec.size = size;
+  v->u.vec.map = map;
+}
+
+// a window that cannot be mapped as it is: an empty one, or the host is big-endian.
+static int data_f64_read(int fd, size_t start, size_t count, lisp_value* v) {
+  double* d = lisp_vec_alloc(count);
+  size_t i, done = 0;
+  ssize_t n;
+  uint64_t u;
+  if(d == NULL)
+    return LISP_EVAL_IO_ERROR;
+  while(done < count * sizeof(double)) {
+    if((n = pread(fd, (char*)d + done, count * sizeof(double) - done, (off_t)(start * sizeof(double) + done))) <= 0) {
+      free(d);
+      return LISP_EVAL_IO_ERROR;
+    }
+    done += (size_t)n;
+  }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  for(i = 0; i < count; i++) {
+    memcpy(&u, &d[i], sizeof(u));
+    u = __builtin_bswap64(u);
+    memcpy(&d[i], &u, sizeof(u));
+  }
+#else
+  (void)i;
+  (void)u;
+#endif
+  data_vector(v, d, count, 0);
+  return LISP_EVAL_OK;
+}
+
+int lisp_data_f64(const char* path, size_t start, size_t count, lisp_value* v) {
+  struct stat st;
+  size_t size, delta;
+  long page;
+  char* p;
+  int fd, ret;
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return LISP_EVAL_IO_ERROR;
+  if(fstat(fd, &st) != 0) {
+    close(fd);
+    return LISP_EVAL_IO_ERROR;
+  }
+  size = (size_t)st.st_size / sizeof(double);    // a trailing partial double is ignored
+  if(start > size)
+    start = size;
+  if(count > size - start)
+    count = size - start;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  if(1) {
+#else
+  if(count == 0) {
+#endif
+    ret = data_f64_read(fd, start, count, v);
+    close(fd);
+    return ret;
+  }
+  // the mapping starts at the page holding the first double of the window.
+  page = sysconf(_SC_PAGESIZE);
+  delta = start * sizeof(double) % (size_t)page;
+  p = (char*)mmap(NULL, delta + count * sizeof(double), PROT_READ, MAP_PRIVATE, fd, (off_t)(start * sizeof(double) - delta));
+  close(fd);
+  if(p == MAP_FAILED)
+    return LISP_EVAL_IO_ERROR;
+  madvise(p, delta + count * sizeof(double), MADV_SEQUENTIAL);
+  data_vector(v, (double*)(p + delta), count, delta + 1);
+  return LISP_EVAL_OK;
+}
+
+// the number in the column of a csv line. 0 if the field is missing or not a number.
+static int data_csv_field(const char* line, size_t column, double* x) {
+  char* end;
+  for(; column > 0; column--) {
+    if((line = strchr(line, ',')) == NULL)
+      return 0;
+    line++;
+  }
+  *x = strtod(line, &end);
+  if(end == line)
+    return 0;
+  while(*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+    end++;
+  return *end == ',' || *end == '\0';
+}
+
+static int data_csv_resumes(const char* path, size_t column, size_t start, const struct stat* st) {
+  return csv_resume.path != NULL && strcmp(csv_resume.path, path) == 0 && csv_resume.column == column
+    && csv_resume.row <= start && csv_resume.size == st->st_size
+    && csv_resume.mtime.tv_sec == st->st_mtim.tv_sec && csv_resume.mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+int lisp_data_csv(const char* path, size_t column, size_t start, size_t count, lisp_value* v) {
+  struct stat st;
+  FILE* in;
+  char* line = NULL;
+  size_t line_size = 0, size = 0, cap = 0, row = 0;
+  double x, *d = NULL, *grown;
+  if((in = fopen(path, "r")) == NULL)
+    return LISP_EVAL_IO_ERROR;
+  if(fstat(fileno(in), &st) != 0) {
+    fclose(in);
+    return LISP_EVAL_IO_ERROR;
+  }
+  if(data_csv_resumes(path, column, start, &st) && fseeko(in, csv_resume.offset, SEEK_SET) == 0)
+    row = csv_resume.row;
+  while(size < count && getline(&line, &line_size, in) > 0) {
+    if(!data_csv_field(line, column, &x) || row++ < start)
+      continue;
+    if(size == cap) {
+      cap = cap == 0 ? DATA_CSV_CHUNK : cap * 2;
+      if(cap > count)
+        cap = count;
+      if((grown = lisp_vec_alloc(cap)) == NULL)
+        break;
+      if(d != NULL)
+        memcpy(grown, d, size * sizeof(double));
+      free(d);
+      d = grown;
+    }
+    d[size++] = x;
+  }
+  free(line);
+  if(ferror(in) || (size < count && !feof(in)) || (d == NULL && (d = lisp_vec_alloc(0)) == NULL)) {
+    free(d);
+    fclose(in);
+    return LISP_EVAL_IO_ERROR;
+  }
+  if(csv_resume.path == NULL || strcmp(csv_resume.path, path) != 0) {
+    free(csv_resume.path);
+    csv_resume.path = strdup(path);
+  }
+  csv_resume.column = column;
+  csv_resume.row = row;
+  csv_resume.offset = ftello(in);
+  csv_resume.size = st.st_size;
+  csv_resume.mtime = st.st_mtim;
+  fclose(in);
+  data_vector(v, d, size, 0);
+  return LISP_EVAL_OK;
+}
+
+int lisp_data_text(const char* path, lisp_value* v) {
+  struct stat st;
+  size_t done = 0;
+  ssize_t n;
+  char* p;
+  int fd;
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return LISP_EVAL_IO_ERROR;
+  if(fstat(fd, &st) != 0) {
+    close(fd);
+    return LISP_EVAL_IO_ERROR;
+  }
+  p = lisp_str_alloc(v, (size_t)st.st_size);
+  while(done < (size_t)st.st_size) {
+    if((n = pread(fd, p + done, (size_t)st.st_size - done, (off_t)done)) <= 0) {
+      lisp_str_free(v);
+      close(fd);
+      return LISP_EVAL_IO_ERROR;
+    }
+    done += (size_t)n;
+  }
+  close(fd);
+  return LISP_EVAL_OK;
+}
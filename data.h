@@ -0,0 +1,32 @@
+#ifndef LEPT_DATA__
+#define LEPT_DATA__
+#include <stddef.h>
+#include "parse.h"
+
+/*
+ * loaders of numbers from files into vectors, and of text into strings,
+ * without going through the parser. built with LISP_DATA.
+ *   (load-f64 path)                       the whole file as little-endian doubles
+ *   (load-f64 path start count)           the doubles start .. start+count-1
+ *   (load-csv path column)                the numbers of a column, counted from 0
+ *   (load-csv path column start count)    its rows start .. start+count-1
+ *   (load-text path)                      the whole file as a string
+ * a symbol path is taken as written, it is not evaluated; any other path is
+ * an expression giving a string. a window running past the
+ * end of the file is cut short, possibly to nothing, so a script can step
+ * through a file larger than memory window by window: only the windows in use
+ * are held. f64 windows are mapped from the file rather than read. csv rows
+ * whose column is not a number, like a header, are skipped and not counted;
+ * a window starting where the last one of the same file stopped resumes
+ * reading there instead of scanning the file again.
+ */
+
+#define LISP_DATA_ALL	((size_t)-1)    // count of a window up to the end of the file
+
+// v becomes a vector, released with lisp_value_free. returns LISP_EVAL_OK or LISP_EVAL_IO_ERROR.
+int lisp_data_f64(const char* path, size_t start, size_t count, lisp_value* v);
+int lisp_data_csv(const char* path, size_t column, size_t start, size_t count, lisp_value* v);
+// v becomes a string, released with lisp_value_free.
+int lisp_data_text(const char* path, lisp_value* v);
+
+#endif
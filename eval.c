@@ -1,12 +1,35 @@
 #include <stdlib.h>
+#include <ctype.h>
 #include <math.h>
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#ifdef LISP_TASK
+#include <ucontext.h>
+#endif
 
 #include "parse.h"
 #include "eval.h"
+#include "perf.h"
+#include "prof.h"
+#define LISP_STATS_ALLOCATOR
+#include "stats.h"
+#include "trace.h"
+#include "vector.h"
+#include "str.h"
+#include "table.h"
+#include "promise.h"
+#ifdef LISP_DATA
+#include "data.h"
+#endif
+#ifdef LISP_CORO
+#include "coro.h"
+#endif
+#ifdef LISP_JIT
+#include "jit.h"
+#endif
 
 #ifndef LISP_EVAL_INIT_STACK_SIZE
 #define LISP_EVAL_INIT_STACK_SIZE 1024
@@ -20,11 +43,45 @@ struct eval_context {
   char* stack;
   size_t size, top;
 };
-eval_context eval_stack;
-eval_context eval_tmp_variables;
+LISP_THREAD_LOCAL eval_context eval_stack;
+LISP_THREAD_LOCAL eval_context eval_tmp_variables;
+LISP_THREAD_LOCAL env_t global_env;
+
+static LISP_THREAD_LOCAL unsigned long lisp_env_versions;
+static LISP_THREAD_LOCAL lisp_ic_stats ic_stats;
+
+#ifdef LISP_TASK
+struct lisp_task {
+  ucontext_t context, caller;
+  char* stack;
+  lisp_value* v;
+  lisp_value result;
+  lisp_value captured;    // a promise holding the bindings of lisp_task_capture
+  env_t env;
+  eval_context eval_stack, tmp_variables;
+  size_t budget, steps;    // steps until the next check, and left in the slice after those
+  double deadline;    // ns, 0 if the slice has no time limit
+  int started, done, cancelled, ret;
+};
 
-#define PUTV(v) 	do { *(lisp_value*)eval_context_push(&eval_stack, sizeof(lisp_value)) = (v); } while(0)
-#define LINKTO(v)	do { *(lisp_value**)eval_context_push(&eval_tmp_variables, sizeof(lisp_value*)) = (v); } while(0)
+static LISP_THREAD_LOCAL lisp_task* lisp_task_current;
+// stacks of freed tasks, a scheduler spawning many short tasks reuses them.
+static LISP_THREAD_LOCAL char* lisp_task_stacks[LISP_TASK_STACK_CACHE];
+static LISP_THREAD_LOCAL size_t lisp_task_stacks_top;
+
+static int lisp_task_tick();
+#define LISP_TASK_STEP() \
+  do { \
+    int stepped; \
+    if(lisp_task_current != NULL && --lisp_task_current->budget == 0 && (stepped = lisp_task_tick()) != LISP_EVAL_OK) \
+      return stepped; \
+  } while(0)
+#else
+#define LISP_TASK_STEP()	do { } while(0)
+#endif
+
+#define PUTV(v) 	do { *(lisp_value*)eval_context_push(&eval_stack, sizeof(lisp_value)) = (v); LISP_STATS_HIGH(eval_stack_high, eval_stack.top); } while(0)
+#define LINKTO(v)	do { *(lisp_value**)eval_context_push(&eval_tmp_variables, sizeof(lisp_value*)) = (v); LISP_TRACE_EVENT(LISP_TRACE_ALLOC, sizeof(lisp_value), (v), NULL, 0); } while(0)
 
 static void eval_context_init() {
   eval_stack.stack = NULL;
@@ -58,29 +115,39 @@ void env_init(env_t* p, env_t* e) {
   e->s.p = NULL;
   e->s.size = 0;
   e->s.top = 0;
+  e->inl.p = NULL;
+  e->inl.size = 0;
+  e->inl.top = 0;
+  e->macros.p = NULL;
+  e->macros.size = 0;
+  e->macros.top = 0;
+  e->tables.p = NULL;
+  e->tables.size = 0;
+  e->tables.top = 0;
+  e->version = ++lisp_env_versions;
+  memset(e->shadow, 0, sizeof(e->shadow));
 }
 
+static void lisp_inline_free(env_t* e);
+static void lisp_box_release(env_t* e, size_t pair);
+
 // TODO: free allocated temp environmental values
 void env_free(env_t* e) {
-  for(; e != NULL; e = e->next)
+  size_t i;
+  for(; e != NULL; e = e->next) {
+    lisp_inline_free(e);
+    lisp_box_release(e, 0);
     free(e->s.p);
-}
-
-static void lisp_free_tmp_variable(eval_context* tmp_stack) {
-  size_t i, size = tmp_stack->top / sizeof(lisp_value*);
-  lisp_value** p = (lisp_value**)tmp_stack->stack;
-  char* s;
-  if(lisp_get_type(p[size-1]) == LISP_LIST) size--;
-  printf("# of variable: %zu\n", size);
-  for(i = 0; i < size; i++) {
-    s = lisp_stringfy(p[i]);
-    printf("# %zu value is: %s\n", i, s);
-    free(s);
-    lisp_value_free(p[i]);
-    free(p[i]);
+    for(i = 0; i < e->macros.top; i++)
+      free(e->macros.p[i]);
+    free(e->macros.p);
+    lisp_tables_free(e);
   }
 }
 
+// the temporaries go to the trace, see trace.h; they are no longer printed.
+static void lisp_drop_tmp_variables(size_t top);
+
 static void* lisp_env_push(env_t* e, size_t size) {
   assert(e != NULL);
   void* ret;
@@ -93,6 +160,7 @@ static void* lisp_env_push(env_t* e, size_t size) {
   }
   ret = e->s.p + e->s.top/sizeof(lisp_value_pair);    // e->s.p's type matters. WTF.
   e->s.top += size;
+  LISP_STATS_HIGH(env_stack_high, e->s.top);
   return ret;
 }
 
@@ -101,6 +169,71 @@ static void* lisp_env_pop(env_t* e, size_t size) {
   return e->s.p + (e->s.top -= size)/sizeof(lisp_value_pair);
 }
 
+/*
+ * a binding set! changes, and a variable of let or do, holds its value in a box
+ * of its own: what a parameter is bound to may be in the code, or a temporary
+ * a loop drops at the end of an iteration. a box goes with its binding, when
+ * lisp_env_leave pops it or its env is freed.
+ */
+typedef struct lisp_box lisp_box;
+struct lisp_box {
+  env_t* e;
+  size_t pair;    // index of the binding in e->s.p
+  lisp_value* v;
+};
+
+static LISP_THREAD_LOCAL struct {
+  lisp_box* p;
+  size_t top, size;
+}boxes;
+
+// binding pair of e is bound to a new box, empty.
+static lisp_value* lisp_box_new(env_t* e, size_t pair) {
+  lisp_box* b;
+  if(boxes.top == boxes.size) {
+    boxes.size = boxes.size == 0 ? 16 : boxes.size * 2;
+    boxes.p = (lisp_box*)realloc(boxes.p, boxes.size * sizeof(lisp_box));
+  }
+  b = &boxes.p[boxes.top++];
+  b->e = e;
+  b->pair = pair;
+  b->v = (lisp_value*)malloc(sizeof(lisp_value));
+  b->v->type = LISP_NULL;
+  e->s.p[pair].value = b->v;
+  return b->v;
+}
+
+static int lisp_is_box(const lisp_value* v) {
+  size_t i;
+  for(i = boxes.top; i-- > 0; )
+    if(boxes.p[i].v == v)
+      return 1;
+  return 0;
+}
+
+// the boxes of the bindings of e from pair on go with them.
+static void lisp_box_release(env_t* e, size_t pair) {
+  size_t i, j;
+  for(i = j = 0; i < boxes.top; i++) {
+    if(boxes.p[i].e == e && boxes.p[i].pair >= pair) {
+      lisp_value_free(boxes.p[i].v);
+      free(boxes.p[i].v);
+    }
+    else boxes.p[j++] = boxes.p[i];
+  }
+  boxes.top = j;
+}
+
+// pop the parameters of a finished application, they no longer shadow globals.
+static void lisp_env_leave(env_t* e, size_t count) {
+  lisp_value_pair* p = (lisp_value_pair*)lisp_env_pop(e, count*sizeof(lisp_value_pair));
+  size_t i;
+  for(i = 0; i < count; i++)
+    e->shadow[LISP_SHADOW_BUCKET(p[i].symbol)]--;
+  if(boxes.top != 0)
+    lisp_box_release(e, e->s.top/sizeof(lisp_value_pair));
+}
+
 void lisp_env_print(env_t* e) {
   size_t i;
   char *symbol, *value;
@@ -121,10 +254,17 @@ void lisp_print_value(lisp_value* v) {
 
 static int lisp_is_lambda_or_quote(lisp_value* v) {
   assert(lisp_get_type(v) == LISP_LIST);
+  if(lisp_get_list_size(v) == 0)
+    return 0;
   lisp_value* p = lisp_get_list_element(v, 0);
   return lisp_get_type(p) == LISP_LAMBDA || lisp_get_type(p) == LISP_QUOTE;
 }
 
+// the elements of a parameter or argument list, the cdr0 of a call without arguments is nil.
+static size_t lisp_list_count(lisp_value* v) {
+  return lisp_get_type(v) == LISP_LIST ? lisp_get_list_size(v) : 0;
+}
+
 static int lisp_copy_list(lisp_value* dst, lisp_value* src, size_t size) {
   assert(lisp_get_type(src) == LISP_LIST);
   size_t i;
@@ -137,6 +277,7 @@ static int lisp_copy_list(lisp_value* dst, lisp_value* src, size_t size) {
     if(lisp_get_type(p) == LISP_LIST) {
       lisp_copy_list(&(dst->u.a.e[i]), p, lisp_get_list_size(p));
     }
+    else if(lisp_get_type(p) == LISP_STRING) lisp_str_ref(&dst->u.a.e[i], p);    // the copy is freed on its own
     else dst->u.a.e[i] = *p;	// perform deep copy.
   }
   return LISP_EVAL_OK;
@@ -158,6 +299,8 @@ lisp_value cdr0(lisp_value c) {
 
 static int lisp_eval_value(lisp_value v, env_t* e);
 static int lisp_eval_symbol(lisp_value v, env_t* e);
+static int lisp_eval_let_call(lisp_value* form, lisp_value v, env_t* e);
+static int lisp_is_lambda(const lisp_value* v);
 
 static int lisp_eval_number(lisp_value v) {
   assert(v.type == LISP_NUMBER);
@@ -171,11 +314,16 @@ static int lisp_eval_bin_op(lisp_value v, int type, env_t* e) {
   size_t i, count = lisp_get_list_size(&v) - 1;
   lisp_value dummy;
   double tmp = 0;
+  if(count == 0)
+    return LISP_EVAL_ARITY_MISMATCH;
   for(dummy = cdr0(v); lisp_get_type(&dummy) != LISP_NIL; dummy = cdr0(dummy)) {    // TODO: change to iter form
     if((ret = lisp_eval_value(car0(dummy), e)) != LISP_EVAL_OK)
       return ret;
   }
   oprans = (lisp_value*)eval_context_pop(&eval_stack, count*sizeof(lisp_value));
+  for(i = 0; i < count; i++)
+    if(lisp_get_type(&oprans[i]) != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
   tmp = lisp_get_number(oprans);
   switch(type) {
     case LISP_PLUS:
@@ -205,13 +353,17 @@ static int lisp_eval_logic_op(lisp_value v, int type, env_t* e) {
   lisp_value* oprans;
   int ret;
   lisp_value dummy;
+  if(lisp_get_list_size(&v) != 3)
+    return LISP_EVAL_ARITY_MISMATCH;
   for(dummy = cdr0(v); lisp_get_type(&dummy) != LISP_NIL; dummy = cdr0(dummy)) {
     if((ret = lisp_eval_value(car0(dummy), e)) != LISP_EVAL_OK)
       return ret;
   }
   oprans = (lisp_value*)eval_context_pop(&eval_stack, 2*sizeof(lisp_value));
+  if(lisp_get_type(&oprans[0]) != LISP_NUMBER || lisp_get_type(&oprans[1]) != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
   switch(type) {
-    case LISP_BT: dummy.type = oprans[0].u.n > oprans[1].u.n ? LISP_TRUE : LISP_FALSE; break;	// type check..
+    case LISP_BT: dummy.type = oprans[0].u.n > oprans[1].u.n ? LISP_TRUE : LISP_FALSE; break;
     case LISP_LT: dummy.type = oprans[0].u.n < oprans[1].u.n ? LISP_TRUE : LISP_FALSE; break;
     case LISP_EQ: dummy.type = oprans[0].u.n == oprans[1].u.n ? LISP_TRUE : LISP_FALSE; break;
   }
@@ -219,21 +371,127 @@ static int lisp_eval_logic_op(lisp_value v, int type, env_t* e) {
   return LISP_EVAL_OK;
 }
 
-static int lisp_eval_if(lisp_value v, env_t* e) {
+static int lisp_eval_num_op(lisp_value* v, env_t* e, double* n);
+
+// operand of a specialized operator, evaluated straight to a double. only
+// operands the type inference could not prove are checked.
+static int lisp_eval_double(lisp_value* v, env_t* e, int proven, double* n) {
+  lisp_value* p;
+  int ret;
+  switch(v->type) {
+    case LISP_NUMBER: *n = v->u.n; return LISP_EVAL_OK;
+    case LISP_SYMBOL:
+      if((p = lisp_env_lookup(e, v)) == NULL)
+        return LISP_EVAL_VARIABLE_NOT_FOUND;
+      break;
+    case LISP_LIST:
+      if(v->u.a.size != 0) switch(v->u.a.e[0].type) {
+        case LISP_NUM_PLUS:
+        case LISP_NUM_MINUS:
+        case LISP_NUM_MULTIPLY:
+        case LISP_NUM_DIVIDE: return lisp_eval_num_op(v, e, n);
+      }
+      if((ret = lisp_eval_value(*v, e)) != LISP_EVAL_OK)
+        return ret;
+      p = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+      break;
+    default: return LISP_EVAL_NOT_A_NUMBER;
+  }
+  if(!proven && p->type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  *n = p->u.n;
+  return LISP_EVAL_OK;
+}
+
+#define LISP_OPERAND_PROVEN(head, i)	((i) <= sizeof(size_t)*8 && ((head)->u.op.proven >> ((i)-1) & 1))
+
+static int lisp_eval_num_op(lisp_value* v, env_t* e, double* n) {
+  lisp_value* head = &v->u.a.e[0];
+  size_t i, count = v->u.a.size;
+  double tmp;
+  int ret;
+  if(count < 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_double(&v->u.a.e[1], e, LISP_OPERAND_PROVEN(head, 1), n)) != LISP_EVAL_OK)
+    return ret;
+  for(i = 2; i < count; i++) {
+    if((ret = lisp_eval_double(&v->u.a.e[i], e, LISP_OPERAND_PROVEN(head, i), &tmp)) != LISP_EVAL_OK)
+      return ret;
+    switch(head->type) {
+      case LISP_NUM_PLUS		: *n += tmp; break;
+      case LISP_NUM_MINUS		: *n -= tmp; break;
+      case LISP_NUM_MULTIPLY	: *n *= tmp; break;
+      case LISP_NUM_DIVIDE	: *n /= tmp; break;
+    }
+  }
+  return LISP_EVAL_OK;
+}
+
+static int lisp_eval_num_cmp(lisp_value* v, env_t* e, int* truth) {
+  lisp_value* head = &v->u.a.e[0];
+  double a, b;
+  int ret;
+  if(v->u.a.size != 3)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_double(&v->u.a.e[1], e, LISP_OPERAND_PROVEN(head, 1), &a)) != LISP_EVAL_OK)
+    return ret;
+  if((ret = lisp_eval_double(&v->u.a.e[2], e, LISP_OPERAND_PROVEN(head, 2), &b)) != LISP_EVAL_OK)
+    return ret;
+  switch(head->type) {
+    case LISP_NUM_LT: *truth = a < b; break;
+    case LISP_NUM_BT: *truth = a > b; break;
+    case LISP_NUM_EQ: *truth = a == b; break;
+  }
+  return LISP_EVAL_OK;
+}
+
+static int lisp_eval_num_value(lisp_value v, env_t* e) {
+  lisp_value dummy;
+  int ret, truth;
+  switch(v.u.a.e[0].type) {
+    case LISP_NUM_LT:
+    case LISP_NUM_BT:
+    case LISP_NUM_EQ:
+      if((ret = lisp_eval_num_cmp(&v, e, &truth)) != LISP_EVAL_OK)
+        return ret;
+      dummy.type = truth ? LISP_TRUE : LISP_FALSE;
+      break;
+    default:
+      if((ret = lisp_eval_num_op(&v, e, &dummy.u.n)) != LISP_EVAL_OK)
+        return ret;
+      dummy.type = LISP_NUMBER;
+  }
+  PUTV(dummy);
+  return LISP_EVAL_OK;
+}
+
+// the test of an if, or of a do: true is true, anything else is not.
+static int lisp_eval_truth(lisp_value* cond, env_t* e, int* truth) {
   lisp_value* oprans;
   int ret;
-  if((ret = lisp_eval_value(*(lisp_value*)lisp_get_list_element(&v, 1), e)) != LISP_EVAL_OK)
+  if(cond->type == LISP_LIST && cond->u.a.size == 3 && cond->u.a.e[0].type >= LISP_NUM_LT && cond->u.a.e[0].type <= LISP_NUM_EQ)
+    return lisp_eval_num_cmp(cond, e, truth);
+  if((ret = lisp_eval_value(*cond, e)) != LISP_EVAL_OK)
     return ret;
   oprans = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
-  if(lisp_get_type(oprans) == LISP_TRUE)
-    return lisp_eval_value(*(lisp_value*)lisp_get_list_element(&v, 2), e);
-  else
-    return lisp_eval_value(*(lisp_value*)lisp_get_list_element(&v, 3), e);
+  *truth = lisp_get_type(oprans) == LISP_TRUE;
+  return LISP_EVAL_OK;
+}
+
+static int lisp_eval_if(lisp_value v, env_t* e) {
+  int ret, truth;
+  if(lisp_get_list_size(&v) != 4)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_truth(lisp_get_list_element(&v, 1), e, &truth)) != LISP_EVAL_OK)
+    return ret;
+  return lisp_eval_value(*(lisp_value*)lisp_get_list_element(&v, truth ? 2 : 3), e);
 }
 
 static int lisp_eval_not(lisp_value v, env_t* e) {
   lisp_value* oprans;
   int ret;
+  if(lisp_get_list_size(&v) != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
   if((ret = lisp_eval_value(*(lisp_value*)lisp_get_list_element(&v, 1), e)) != LISP_EVAL_OK)
     return ret;
   oprans = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
@@ -245,119 +503,102 @@ static int lisp_eval_not(lisp_value v, env_t* e) {
   return LISP_EVAL_OK;
 }
 
-static int lisp_eval_car(lisp_value v, env_t* e);
-static int lisp_eval_cdr(lisp_value v, env_t* e);
 static int lisp_eval_cons(lisp_value v, env_t* e);
+static int lisp_list_of(const lisp_value* x, lisp_value* list);
+static void lisp_list_put(lisp_value* elements, size_t size);
 
-// TODO: keep track tmp list memory.
-static int lisp_eval_car(lisp_value v, env_t* e) {
-  lisp_value* lst, *p;
-  lisp_value n;
-  int ret, type;
-  p = lisp_get_list_element(&v, 1);
-  if(lisp_get_type(p) == LISP_SYMBOL) {
-    if((ret = lisp_eval_symbol(*p, e)) != LISP_EVAL_OK) return ret;
-    n = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
-    lst = &n;
-  }
-  else {
-    type = lisp_get_type(lisp_get_list_element(p, 0));
-    if(type != LISP_QUOTE) {	// (car (car (quote ((1 2) 3))))
-      n = *(lisp_value*)lisp_get_list_element(&v, 1);
-      switch(type) {
-        case LISP_CAR 	:	if((ret = lisp_eval_car(n, e)) != LISP_EVAL_OK) return ret; break;
-        case LISP_CDR 	:	if((ret = lisp_eval_cdr(n, e)) != LISP_EVAL_OK) return ret; break;
-        case LISP_CONS	:	if((ret = lisp_eval_cons(n, e)) != LISP_EVAL_OK) return ret; break;
-        default			:	return LISP_LISP_OP_ILLEAGE;
-      }
-      n = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
-      lst = &n;
-    }
-    else lst = lisp_get_list_element(&v, 1);	// lst point to quoted list.
-  }
-
-  assert(lisp_get_type(lst) == LISP_LIST && lisp_get_list_size(lst) > 0);
-  p = lisp_get_list_element(lisp_get_list_element(lst, 1), 0);
-  if(lisp_get_type(p) == LISP_LIST) {    // return quoted list : (car (quote ((1) 2))) => (quote (1))
-    lisp_value* res = (lisp_value*)malloc(sizeof(lisp_value));
-    res->type = LISP_LIST;
-    res->u.a.size = 2;
-    // TODO: memory leak
-    res->u.a.e = (lisp_value*)malloc(2*sizeof(lisp_value));
-    LINKTO(res);
-    res->u.a.e[0].type = LISP_QUOTE;
-    lisp_copy_list(&(res->u.a.e[1]), p, lisp_get_list_size(p));
-    PUTV(*res);
+// the steps of a car, cdr or c[ad]+r head, 0 if it is none. bit i of the path
+// is set if step i is a car, step 0 is the rightmost letter, the first applied.
+static size_t lisp_cxr_steps(const lisp_value* head, size_t* path) {
+  switch(head->type) {
+    case LISP_CAR	:	*path = 1; return 1;
+    case LISP_CDR	:	*path = 0; return 1;
+    case LISP_CXR	:	*path = head->u.cxr.path; return head->u.cxr.size;
+    default			:	return 0;
   }
-  else PUTV(*p);
-  return LISP_EVAL_OK;
 }
 
-static int lisp_eval_cdr(lisp_value v, env_t* e) {
-  lisp_value *lst, *p, *res;
-  lisp_value n, dummy;
-  int ret, type;
-  p = lisp_get_list_element(&v, 1);
-  if(lisp_get_type(p) == LISP_SYMBOL) {    // (cdr lst)
-    if((ret = lisp_eval_symbol(*p, e)) != LISP_EVAL_OK) return ret;
+// (car (cdr (cdr l))) takes the steps of the accessors it holds first, so a
+// chain walks the list once by index: a cdr moves along, a car goes into an
+// element, and only the result is made.
+static int lisp_eval_cxr(lisp_value v, env_t* e) {
+  lisp_value *x, *p, *res;
+  lisp_value n, list;
+  size_t path, size, inner_path, inner_size, count, i;
+  int ret;
+  if(v.u.a.size != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  size = lisp_cxr_steps(&v.u.a.e[0], &path);
+  for(x = &v.u.a.e[1]; x->type == LISP_LIST && x->u.a.size == 2
+      && (inner_size = lisp_cxr_steps(&x->u.a.e[0], &inner_path)) != 0 && size + inner_size <= LISP_CXR_MAX; x = &x->u.a.e[1]) {
+    path = inner_path | path << inner_size;
+    size += inner_size;
+  }
+  if(x->type == LISP_LIST && x->u.a.size != 0 && x->u.a.e[0].type == LISP_QUOTE)
+    n = *x;    // lst point to quoted list.
+  else {
+    if(x->type == LISP_SYMBOL)
+      ret = lisp_eval_symbol(*x, e);
+    else if(x->type == LISP_LIST && x->u.a.size != 0 && x->u.a.e[0].type == LISP_CONS)
+      ret = lisp_eval_cons(*x, e);
+    else ret = lisp_eval_value(*x, e);
+    if(ret != LISP_EVAL_OK)
+      return ret;
     n = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
-    lst = &n;
-  }
-  else {    // (cdr (quote ()))
-    type = lisp_get_type(lisp_get_list_element(p, 0));
-    if(type != LISP_QUOTE) {
-      n = *(lisp_value*)lisp_get_list_element(&v, 1);
-      switch(type) {
-        case LISP_CAR 	:	if((ret = lisp_eval_car(n, e)) != LISP_EVAL_OK) return ret; break;
-        case LISP_CDR 	:	if((ret = lisp_eval_cdr(n, e)) != LISP_EVAL_OK) return ret; break;
-        case LISP_CONS 	: 	if((ret = lisp_eval_cons(n, e)) != LISP_EVAL_OK) return ret; break;
-        default			:	return LISP_LISP_OP_ILLEAGE;
-      }
-      n = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
-      lst = &n;
+  }
+  if((ret = lisp_list_of(&n, &list)) != LISP_EVAL_OK)
+    return ret;
+  p = list.u.a.e;
+  count = list.u.a.size;
+  for(i = 0; i < size; i++) {
+    if(count == 0)
+      return LISP_EVAL_INDEX_OUT_OF_RANGE;    // (car (quote ()))
+    if(!(path >> i & 1)) {
+      p++;
+      count--;
+    }
+    else if(i + 1 < size) {
+      if(p->type != LISP_LIST)
+        return LISP_EVAL_NOT_A_LIST;
+      count = p->u.a.size;
+      p = p->u.a.e;
     }
-    else lst = lisp_get_list_element(&v, 1);
   }
-
-  lst = lisp_get_list_element(lst, 1);
-
-  size_t size = lisp_get_list_size(lst);
-  assert(size > 0);
-  res = (lisp_value*)malloc(sizeof(lisp_value));
-  res->type = LISP_LIST;
-  res->u.a.size = size;
-  if(size == 1) {
-    res->u.a.size = 2;
-    res->u.a.e = (lisp_value*)malloc(2 * sizeof(lisp_value));	// (cdr (quote (1)))	=> (quote ())
-    LINKTO(res);
-    res->u.a.e[0].type = LISP_QUOTE;
-    res->u.a.e[1].type = LISP_LIST;
-    res->u.a.e[1].u.a.size = 0;
-    res->u.a.e[1].u.a.e = NULL;
-  } else {
-    res->u.a.e = (lisp_value*)malloc(size * sizeof(lisp_value));	// (cdr (quote (1 2)))	=> (quote (2))
-    LINKTO(res);
-    res->u.a.e[0].type = LISP_QUOTE;
-    dummy.type = LISP_LIST;
-    dummy.u.a.size = size - 1;
-    dummy.u.a.e = lisp_get_list_element(lst, 1);
-    lisp_copy_list(&(res->u.a.e[1]), &dummy, size-1);
+  if(path >> (size - 1) & 1) {
+    if(p->type == LISP_LIST) {    // return quoted list : (car (quote ((1) 2))) => (quote (1))
+      res = (lisp_value*)malloc(sizeof(lisp_value));
+      res->type = LISP_LIST;
+      res->u.a.size = 2;
+      res->u.a.e = (lisp_value*)malloc(2 * sizeof(lisp_value));
+      LINKTO(res);
+      res->u.a.e[0].type = LISP_QUOTE;
+      lisp_copy_list(&res->u.a.e[1], p, lisp_get_list_size(p));
+      PUTV(*res);
+    }
+    else PUTV(*p);
+    return LISP_EVAL_OK;
   }
-  PUTV(*res);
+  // (cdr (quote (1 2)))	=> (quote (2))
+  list.u.a.e = p;
+  list.u.a.size = count;
+  lisp_copy_list(&n, &list, count);
+  lisp_list_put(n.u.a.e, count);
   return LISP_EVAL_OK;
 }
 
 static int lisp_eval_cons(lisp_value v, env_t* e) {
-
+  return LISP_EVAL_NOT_A_FUNCTION;    // not supported, lists are arrays: see append
 }
 
 // (null? symbol)
 // (null? (quote ())) => LISP_TRUE
 // (null? (quote (1))) => LISP_FALSE
 static int lisp_eval_is_null(lisp_value v, env_t* e) {
-  lisp_value* p = lisp_get_list_element(&v, 1);
-  lisp_value dummy;
+  lisp_value *p, dummy, list;
   int ret;
+  if(lisp_get_list_size(&v) != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  p = lisp_get_list_element(&v, 1);
   switch(lisp_get_type(p)) {
     // find symbol value from env_t. <= (null? lst)
     case LISP_SYMBOL:
@@ -375,80 +616,304 @@ static int lisp_eval_is_null(lisp_value v, env_t* e) {
       }
   }
   // (null? (quote ()))
-  p = lisp_get_list_element(p, 1);
-  dummy.type = lisp_get_list_size(p) == 0 ? LISP_TRUE : LISP_FALSE;
+  if((ret = lisp_list_of(p, &list)) != LISP_EVAL_OK)
+    return ret;
+  dummy.type = list.u.a.size == 0 ? LISP_TRUE : LISP_FALSE;
   PUTV(dummy);
   return LISP_EVAL_OK;
 }
 
-static int lisp_extend_eval_env(env_t* e, lisp_value*s, lisp_value* args);
+static int lisp_extend_eval_env(env_t* e, lisp_value*s, lisp_value* args, const lisp_value* values);
 
 static int lisp_cmp_symbol(lisp_value* v, lisp_value *e) {
   assert(v != NULL && e != NULL);
   return (lisp_get_string_length(v) != lisp_get_string_length(e)) || memcmp(v->u.sym.s, e->u.sym.s, v->u.sym.size);
 }
 
+/*
+ * monomorphic inline cache: the head symbol of a call site remembers the lambda
+ * it resolved to, stamped with the env version. any define changes the version.
+ * with dynamic scoping a parameter may shadow the global, so a cache is only
+ * filled or used while no live parameter falls into the symbol's hash bucket.
+ */
+typedef struct lisp_ic lisp_ic;
+struct lisp_ic {
+  unsigned long version;
+  lisp_value* lambda;
+};
+
+static lisp_value* lisp_ic_get(lisp_value* head, env_t* e) {
+  lisp_ic* ic = head->u.sym.ic;
+  if(ic == NULL || ic->lambda == NULL || e->prev != NULL || e->shadow[LISP_SHADOW_BUCKET(head)] != 0) {
+    ic_stats.misses++;
+    return NULL;
+  }
+  if(ic->version != e->version) {
+    ic->lambda = NULL;
+    ic_stats.invalidations++;
+    ic_stats.misses++;
+    return NULL;
+  }
+  ic_stats.hits++;
+  return ic->lambda;
+}
+
+// a task's env is not stamped by defines in the env it was made from, its calls are not cached.
+static void lisp_ic_set(lisp_value* head, env_t* e, lisp_value* lambda) {
+  if(e->prev != NULL || e->shadow[LISP_SHADOW_BUCKET(head)] != 0) return;
+  if(head->u.sym.ic == NULL)
+    head->u.sym.ic = (lisp_ic*)malloc(sizeof(lisp_ic));
+  head->u.sym.ic->version = e->version;
+  head->u.sym.ic->lambda = lambda;
+}
+
+void lisp_get_ic_stats(lisp_ic_stats* s) {
+  *s = ic_stats;
+}
+
+void lisp_reset_ic_stats() {
+  memset(&ic_stats, 0, sizeof(ic_stats));
+}
+
+// arguments of an application, each evaluated straight to a double.
+static int lisp_eval_double_args(lisp_value v, env_t* e, double* args) {
+  size_t i;
+  int ret;
+  for(i = 0; i + 1 < v.u.a.size; i++) {
+    if(v.u.a.e[i+1].type == LISP_LIST && lisp_is_lambda_or_quote(&v.u.a.e[i+1]))
+      return LISP_EVAL_NOT_A_NUMBER;
+    if((ret = lisp_eval_double(&v.u.a.e[i+1], e, 0, &args[i])) != LISP_EVAL_OK)
+      return ret;
+  }
+  return LISP_EVAL_OK;
+}
+
+static int lisp_apply_native_number(lisp_value* native, lisp_value v, env_t* e) {
+  double args[LISP_NATIVE_MAX_ARGS], n;
+  lisp_value result;
+  int ret;
+  if(v.u.a.size - 1 != native->u.native.arity)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_double_args(v, e, args)) != LISP_EVAL_OK)
+    return ret;
+  n = native->u.native.fn(args);
+  if(native->u.native.boolean)
+    result.type = n != 0 ? LISP_TRUE : LISP_FALSE;
+  else {
+    result.type = LISP_NUMBER;
+    result.u.n = n;
+  }
+  PUTV(result);
+  return LISP_EVAL_OK;
+}
+
+// the arguments are evaluated onto the eval stack and handed to the function
+// where they are, the value it leaves in the first slot is the one of the call.
+static int lisp_apply_native_value(lisp_value* native, lisp_value v, env_t* e) {
+  lisp_value *args, *r, result;
+  size_t i, count = v.u.a.size - 1;
+  int ret;
+  if(count != native->u.native.arity)
+    return LISP_EVAL_ARITY_MISMATCH;
+  for(i = 1; i <= count; i++)
+    if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  if(count == 0) {
+    result.type = LISP_NULL;
+    PUTV(result);
+  }
+  args = (lisp_value*)eval_context_pop(&eval_stack, (count != 0 ? count : 1) * sizeof(lisp_value));
+  if((ret = native->u.native.call(args, count)) != LISP_EVAL_OK)
+    return ret;
+  result = args[0];
+  switch(result.type) {
+    case LISP_NULL	:	return LISP_EVAL_INVALID_VALUE;    // it left nothing
+    case LISP_STRING:
+    case LISP_VECTOR:
+    case LISP_LIST	:
+      r = (lisp_value*)malloc(sizeof(lisp_value));
+      *r = result;
+      LINKTO(r);
+      break;
+  }
+  PUTV(result);
+  return LISP_EVAL_OK;
+}
+
+static int lisp_apply_c(lisp_value* native, lisp_value v, env_t* e) {
+  return native->u.native.call != NULL ? lisp_apply_native_value(native, v, e) : lisp_apply_native_number(native, v, e);
+}
+
+#ifdef LISP_JIT
+// a call a compiled lambda may take: as many arguments as it has parameters,
+// none of them a lambda or quoted data, which are bound unevaluated.
+static int lisp_native_call_ok(lisp_jit* jit, lisp_value v) {
+  size_t i;
+  if(v.u.a.size - 1 != lisp_jit_arity(jit))
+    return 0;
+  for(i = 1; i < v.u.a.size; i++)
+    if(v.u.a.e[i].type == LISP_LIST && lisp_is_lambda_or_quote(&v.u.a.e[i]))
+      return 0;
+  return 1;
+}
+
+// run a compiled lambda on the values of its arguments. returns LISP_EVAL_NOT_A_NUMBER
+// if one is no number, the interpreter binds the same values then.
+static int lisp_apply_native(lisp_jit* jit, const lisp_value* values, size_t count) {
+  double args[LISP_JIT_MAX_ARGS];
+  lisp_value result;
+  size_t i;
+  for(i = 0; i < count; i++) {
+    if(values[i].type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
+    args[i] = values[i].u.n;
+  }
+  lisp_jit_call(jit, args, &result);
+  PUTV(result);
+  return LISP_EVAL_OK;
+}
+#endif
+
+// symbol application: bind arguments of v to the lambda's parameters and evaluate its body.
+static int lisp_apply_lambda(lisp_value* lambda, lisp_value v, env_t* e) {
+  int ret;
+  size_t num_of_parameter;
+  lisp_value body, parameters, args, *values = NULL, *head;
+#ifdef LISP_JIT
+  lisp_jit* jit;
+  size_t i;
+#endif
+  if(lambda->type == LISP_NATIVE)
+    return lisp_apply_c(lambda, v, e);
+  if(!lisp_is_lambda(lambda))
+    return LISP_EVAL_NOT_A_FUNCTION;    // (g 1) of a g bound to a quoted list
+#ifdef LISP_JIT
+  // native code runs to completion, a task keeps to the interpreter so its budget holds.
+  // the arguments are evaluated once, the interpreter binds them if the code cannot take them.
+  if(e->prev == NULL && (jit = lisp_jit_enter(lambda, e)) != NULL && lisp_native_call_ok(jit, v)) {
+    for(i = 1; i < v.u.a.size; i++)
+      if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+        return ret;
+    values = (lisp_value*)eval_context_pop(&eval_stack, (v.u.a.size - 1) * sizeof(lisp_value));
+    if((ret = lisp_apply_native(jit, values, v.u.a.size - 1)) != LISP_EVAL_NOT_A_NUMBER)
+      return ret;
+  }
+#endif
+  body = *(lisp_value*)lisp_get_list_element(lambda, 2);
+  parameters = *(lisp_value*)lisp_get_list_element(lambda, 1);
+  args = cdr0(v);
+  num_of_parameter = lisp_list_count(&args);
+  if((ret = lisp_extend_eval_env(e, &parameters, &args, values)) != LISP_EVAL_ENV_EXTENED_OK)
+    return ret;
+  // lambda may be on the eval stack, which the body can move; its elements stay.
+  head = &lambda->u.a.e[0];
+  head->u.fn.running++;
+  ret = lisp_eval_value(body, e);
+  head->u.fn.running--;
+  if(ret != LISP_EVAL_OK)
+    return ret;
+  lisp_env_leave(e, num_of_parameter);
+  return LISP_EVAL_OK;
+}
+
+// the call is on the profiler's shadow stack under the name of its head symbol.
+static int lisp_apply(lisp_value* lambda, lisp_value v, env_t* e) {
+  int ret;
+#if defined(LISP_PROF) || defined(LISP_TRACE)
+  lisp_value* head = lisp_get_list_element(&v, 0);
+#endif
+  LISP_PROF_PUSH(head->u.sym.s, head->u.sym.size);
+  LISP_TRACE_EVENT(LISP_TRACE_ENTER, (unsigned)(e->s.top/sizeof(lisp_value_pair)), head, head->u.sym.s, head->u.sym.size);
+  ret = lisp_apply_lambda(lambda, v, e);
+  LISP_TRACE_EVENT(LISP_TRACE_EXIT, (unsigned)ret, head, head->u.sym.s, head->u.sym.size);
+  LISP_PROF_POP();
+  return ret;
+}
+
 static int lisp_eval_symbol(lisp_value v, env_t* e) {
   assert((v.type == LISP_SYMBOL || v.type == LISP_LIST) && e != NULL);
-  int ret;
-  size_t i, num_of_parameter;
-  lisp_value body, parameters, args, dummy;
+  size_t i, top;
+  lisp_value *head = NULL, *lambda, dummy;
+  env_t* s;
 
   if(v.type == LISP_SYMBOL) dummy = v;
-  else dummy = *(lisp_value*)lisp_get_list_element(&v, 0);
-
-  // look symbol-value pair backwards
-  for(i = e->s.top/sizeof(lisp_value_pair) - 1; i >= 0 ; i--) {
-    if(lisp_cmp_symbol(&dummy, e->s.p[i].symbol) == 0) {
-      switch(lisp_get_type(e->s.p[i].value)) {	// according to symbol value's type, doing correspondent operations
-        case LISP_NUMBER: PUTV(*(e->s.p[i].value)); return LISP_EVAL_OK;
-        case LISP_LIST 	:
-                          // if type of v is list, means it is symbol application, otherwise lambda calculus.
-                          if(lisp_get_type(&v) == LISP_LIST) {
-                            body = *(lisp_value*)lisp_get_list_element(e->s.p[i].value, 2);
-                            parameters = *(lisp_value*)lisp_get_list_element(e->s.p[i].value, 1);
-                            args = cdr0(v);
-                            // printf("application: "); lisp_print_value(&v);
-                            // printf("lambda: "); lisp_print_value(e->s.p[i].value);
-                            // printf("args: "); lisp_print_value(&args);
-                            num_of_parameter = lisp_get_list_size(&args);
-                            if((ret = lisp_extend_eval_env(e, &parameters, &args)) != LISP_EVAL_ENV_EXTENED_OK)
-                              return ret;
-                            if((ret = lisp_eval_value(body, e)) != LISP_EVAL_OK)
-                              return ret;
-                            lisp_env_pop(e, num_of_parameter*sizeof(lisp_value_pair));
-                          } else {
-                            PUTV(*(e->s.p[i].value));
-                          }
-                          return LISP_EVAL_OK;
-        case LISP_SYMBOL: dummy = *(e->s.p[i].value);	// found next
+  else {
+    head = lisp_get_list_element(&v, 0);
+    if((lambda = lisp_ic_get(head, e)) != NULL) {
+      LISP_STATS_DEPTH(0);
+      return lisp_apply(lambda, v, e);
+    }
+    dummy = *head;
+  }
+
+  // look symbol-value pair backwards, then in the envs a task's env was made from.
+  for(s = e; s != NULL; s = s->prev) {
+    top = s->s.top/sizeof(lisp_value_pair);
+    for(i = top; i-- > 0; ) {
+      if(lisp_cmp_symbol(&dummy, s->s.p[i].symbol) == 0) {
+        LISP_STATS_DEPTH(top - i);
+        switch(lisp_get_type(s->s.p[i].value)) {	// according to symbol value's type, doing correspondent operations
+          case LISP_NUMBER:
+          case LISP_TRUE	:
+          case LISP_FALSE	:
+          case LISP_VECTOR:
+          case LISP_STRING:
+          case LISP_PROMISE: PUTV(*(s->s.p[i].value)); return LISP_EVAL_OK;
+          case LISP_NATIVE:
+          case LISP_LIST 	:
+                            // if type of v is list, means it is symbol application, otherwise lambda calculus.
+                            if(lisp_get_type(&v) == LISP_LIST) {
+                              lisp_ic_set(head, e, s->s.p[i].value);
+                              return lisp_apply(s->s.p[i].value, v, e);
+                            }
+                            PUTV(*(s->s.p[i].value));
+                            return LISP_EVAL_OK;
+          case LISP_SYMBOL: dummy = *(s->s.p[i].value);	// found next
+                            break;
+          case LISP_DEFINE_MACRO:	return LISP_EVAL_MACRO_ERROR;    // defined after the code using it was expanded
+          case LISP_LET	:	// the name of a named let, bound to the let
+                            if(lisp_get_type(&v) == LISP_LIST)
+                              return lisp_eval_let_call(s->s.p[i].value, v, e);
+                            return LISP_EVAL_INVALID_VALUE;
+        }
       }
     }
   }
+  LISP_STATS_DEPTH(e->s.top/sizeof(lisp_value_pair));
   return LISP_EVAL_VARIABLE_NOT_FOUND;
 }
 
-// to support recurisive calls, using strict value evaluation.
-static int lisp_extend_eval_env(env_t* e, lisp_value* s, lisp_value* args) {
-  assert(e != NULL && lisp_get_list_size(s) == lisp_get_list_size(args));
-  size_t i, count = lisp_get_list_size(s);
+// to support recurisive calls, using strict value evaluation. values, if not NULL,
+// are those of args evaluated already: an application is bound to its value there.
+static int lisp_extend_eval_env(env_t* e, lisp_value* s, lisp_value* args, const lisp_value* values) {
+  assert(e != NULL);
+  size_t i, count = lisp_list_count(s);
   int ret;
-  lisp_value_pair* p = (lisp_value_pair*)lisp_env_push(e, count*sizeof(lisp_value_pair));
+  lisp_value_pair* p;
+  if(count != lisp_list_count(args))
+    return LISP_EVAL_ARITY_MISMATCH;
+  for(i = 0; i < count; i++)
+    if(s->u.a.e[i].type != LISP_SYMBOL)
+      return LISP_EVAL_INVALID_VALUE;
+  p = (lisp_value_pair*)lisp_env_push(e, count*sizeof(lisp_value_pair));
   for(i = 0; i < count; i++) {
     if(lisp_get_type(lisp_get_list_element(args, i)) == LISP_LIST && !lisp_is_lambda_or_quote(lisp_get_list_element(args, i))) {
       e->s.top -= count * sizeof(lisp_value_pair);
-      if((ret = lisp_eval_value(*(lisp_value*)lisp_get_list_element(args, i), e)) != LISP_EVAL_OK)
+      if(values == NULL && (ret = lisp_eval_value(*(lisp_value*)lisp_get_list_element(args, i), e)) != LISP_EVAL_OK)
         return ret;
-      // keep track of the malloced memory using linked list.
+      // keep track of the malloced memory using linked list. a list result is
+      // still owned by the tmp variable car/cdr made for it, bind a copy.
       p[i].value = (lisp_value*)malloc(sizeof(lisp_value));
       LINKTO(p[i].value);
-      *(p[i].value) = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+      lisp_value_copy(p[i].value, values != NULL ? &values[i] : (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value)));
       e->s.top += count * sizeof(lisp_value_pair);
     }
     else p[i].value = lisp_get_list_element(args, i);
 
     p[i].symbol = lisp_get_list_element(s, i);
   }
+  for(i = 0; i < count; i++)
+    e->shadow[LISP_SHADOW_BUCKET(p[i].symbol)]++;
   return LISP_EVAL_ENV_EXTENED_OK;
 }
 
@@ -457,19 +922,23 @@ static int lisp_eval_lambda(lisp_value args, env_t *e) {
   int ret;
   size_t num_of_parameter;
   lisp_value lambda = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));    // pop lambda expression from stack
+  if(!lisp_is_lambda(&lambda))
+    return LISP_EVAL_NOT_A_FUNCTION;
   lisp_value parameters = *(lisp_value*)lisp_get_list_element(&lambda, 1);        // parameter symbols
   lisp_value body = *(lisp_value*)lisp_get_list_element(&lambda, 2);                // body
-  num_of_parameter = lisp_get_list_size(&args);    // book keeping the number of parameters
-  if((ret = lisp_extend_eval_env(e, &parameters, &args)) != LISP_EVAL_ENV_EXTENED_OK)
+  num_of_parameter = lisp_list_count(&args);    // book keeping the number of parameters
+  if((ret = lisp_extend_eval_env(e, &parameters, &args, NULL)) != LISP_EVAL_ENV_EXTENED_OK)
     return ret;
   if((ret = lisp_eval_value(body, e)) != LISP_EVAL_OK)
     return ret;
-  lisp_env_pop(e, num_of_parameter*sizeof(lisp_value_pair));
+  lisp_env_leave(e, num_of_parameter);
   return LISP_EVAL_OK;                            // (x 1) x := (lambda (y) y)
 }
 
 static int lisp_eval_get_lambda(lisp_value v, env_t* e) {
   int ret;
+  if(lisp_get_list_size(lisp_get_list_element(&v, 0)) == 0)
+    return LISP_EVAL_NOT_A_FUNCTION;    // (() 1)
   if(lisp_get_type(lisp_get_list_element(lisp_get_list_element(&v, 0), 0)) == LISP_LAMBDA) {
     PUTV(*(lisp_value*)(lisp_get_list_element(&v, 0)));
   }
@@ -480,69 +949,2527 @@ static int lisp_eval_get_lambda(lisp_value v, env_t* e) {
   return LISP_EVAL_OK;
 }
 
-static int lisp_eval_define(lisp_value v, env_t* e) {
-  assert(lisp_get_list_size(&v) == 3);    // typical : (define id (lambda (x) x))
-  lisp_value_pair* p = (lisp_value_pair*)lisp_env_push(e, sizeof(lisp_value_pair));
-  p[0].symbol = lisp_get_list_element(&v, 1);
-  p[0].value = lisp_get_list_element(&v, 2);
-  return LISP_EVAL_OK;
+// look symbol up the same way lisp_eval_symbol does, following symbol aliases.
+lisp_value* lisp_env_lookup(env_t* e, lisp_value* symbol) {
+  size_t i;
+  for(; e != NULL; e = e->prev) {
+    i = e->s.top/sizeof(lisp_value_pair);
+    while(i-- > 0) {
+      if(lisp_cmp_symbol(symbol, e->s.p[i].symbol) == 0) {
+        if(lisp_get_type(e->s.p[i].value) != LISP_SYMBOL)
+          return e->s.p[i].value;
+        symbol = e->s.p[i].value;
+      }
+    }
+  }
+  return NULL;
 }
 
-static int lisp_eval_list(lisp_value v, env_t* e) {
-  int ret;
-  lisp_value dummy = car0(v);
-  switch(lisp_get_type(&dummy)) {
-    case LISP_PLUS        : 	return lisp_eval_bin_op(v, LISP_PLUS, e);
-    case LISP_MINUS        : 	return lisp_eval_bin_op(v, LISP_MINUS, e);
-    case LISP_MULTIPLY	: 	return lisp_eval_bin_op(v, LISP_MULTIPLY, e);
-    case LISP_DIVIDE	: 	return lisp_eval_bin_op(v, LISP_DIVIDE, e);
-    case LISP_BT         :	return lisp_eval_logic_op(v, LISP_BT, e);
-    case LISP_LT         :	return lisp_eval_logic_op(v, LISP_LT, e);
-    case LISP_EQ         : 	return lisp_eval_logic_op(v, LISP_EQ, e);
-    case LISP_IF        :	return lisp_eval_if(v, e);
-    case LISP_NOT        :	return lisp_eval_not(v, e);
-    case LISP_CAR        :	return lisp_eval_car(v, e);
-    case LISP_CDR         :	return lisp_eval_cdr(v, e);
-    case LISP_NULL$        :	return lisp_eval_is_null(v, e);
-    case LISP_SYMBOL 	:	return lisp_eval_symbol(v, e);
-    case LISP_DEFINE 	:	return lisp_eval_define(v, e);	// (define id (lambda (x) x))
-    case LISP_LAMBDA 	: 	PUTV(v); return LISP_EVAL_OK;	// put lambda expression to the stack.
-                          // (((lambda (x) x) (lambda (y) y)) 1) => return lambda first.
-    case LISP_LIST         :	if((ret = lisp_eval_get_lambda(v, e)) != LISP_EVAL_OK) return ret;
-    default                :
-                                dummy = cdr0(v);						// args
-                                return lisp_eval_lambda(dummy, e);		// ((lambda (x y) (- y (- x x))) 2 1), push and pop
-  }
+/*
+ * inliner: at define time, calls to small non-recursive global lambdas are
+ * replaced by their bodies with parameters substituted by the arguments.
+ * the original lambda stays in the parse tree, the rewritten copy is kept in
+ * e->inl and is rebuilt whenever one of the helpers it used is redefined.
+ */
+#ifndef LISP_INLINE_MAX_NODES
+#define LISP_INLINE_MAX_NODES 24
+#endif
+
+struct lisp_inline_def {
+  size_t pair;            // index of the definition in e->s.p
+  lisp_value* lambda;     // original lambda, owned by the parse tree
+  lisp_value* inlined;    // rewritten copy, NULL if nothing was inlined
+  lisp_value deps;        // list of helper symbols inlined into the copy
+};
+
+typedef struct lisp_inline_scope lisp_inline_scope;
+struct lisp_inline_scope {
+  const lisp_value* parameters;
+  const lisp_inline_scope* up;
+};
+
+typedef struct lisp_inline_use lisp_inline_use;
+struct lisp_inline_use {
+  size_t count, order;
+  int in_branch;
+};
+
+static int lisp_is_lambda(const lisp_value* v) {
+  return v != NULL && v->type == LISP_LIST && v->u.a.size == 3
+    && v->u.a.e[0].type == LISP_LAMBDA && v->u.a.e[1].type == LISP_LIST;
 }
 
-static int lisp_eval_value(lisp_value v, env_t* e) {
-  switch(lisp_get_type(&v)) {
-    case LISP_NUMBER 	: return lisp_eval_number(v);
-    case LISP_LIST         : return lisp_eval_list(v, e);
-    case LISP_SYMBOL 	: return lisp_eval_symbol(v, e);
-    default : return LISP_EVAL_INVALID_VALUE;
+static size_t lisp_count_nodes(const lisp_value* v) {
+  size_t i, n = 1;
+  if(v->type == LISP_LIST)
+    for(i = 0; i < v->u.a.size; i++)
+      n += lisp_count_nodes(&v->u.a.e[i]);
+  return n;
+}
+
+static int lisp_symbol_in(lisp_value* symbol, const lisp_value* lst) {
+  size_t i;
+  for(i = 0; i < lst->u.a.size; i++)
+    if(lst->u.a.e[i].type == LISP_SYMBOL && lisp_cmp_symbol(symbol, &lst->u.a.e[i]) == 0)
+      return 1;
+  return 0;
+}
+
+// a leaf body only uses primitive forms: with dynamic scoping, calling another
+// function from an inlined body would hide the helper's parameters from it.
+static int lisp_inline_is_leaf(lisp_value* v, lisp_value* name) {
+  size_t i;
+  switch(v->type) {
+    case LISP_SYMBOL:	return lisp_cmp_symbol(v, name) != 0;
+    case LISP_LIST:
+      if(v->u.a.size == 0) return 1;
+      switch(v->u.a.e[0].type) {
+        case LISP_QUOTE	:	return 1;
+        case LISP_SYMBOL:
+        case LISP_LIST	:
+        case LISP_LAMBDA:
+        case LISP_DEFINE:
+        case LISP_DEFINE_MACRO:
+        case LISP_TIME	:
+        case LISP_BENCH	:
+        case LISP_SPAWN	:
+        case LISP_MAP	:
+        case LISP_FILTER:
+        case LISP_FOLD	:
+        case LISP_DELAY	:
+        case LISP_FORCE	:
+        case LISP_STREAM_CONS:
+        case LISP_STREAM_CDR:
+        case LISP_STREAM_TAKE:
+        case LISP_SET	:
+        case LISP_LET	:
+        case LISP_DO	:	return 0;
+      }
+      for(i = 1; i < v->u.a.size; i++)
+        if(!lisp_inline_is_leaf(&v->u.a.e[i], name))
+          return 0;
+      return 1;
+    default: return 1;
   }
 }
 
-int lisp_eval(lisp_value* v, lisp_value* result, env_t* e) {
-  int ret;
-  eval_context_init();
-  memset(&eval_tmp_variables, 0, sizeof(eval_context));
-  if((ret = lisp_eval_value(*v, e)) != LISP_EVAL_OK) {
-    free(eval_stack.stack);
-    return ret;
+// a helper's name must not be a parameter of any global lambda, otherwise a
+// dynamically scoped call could resolve it to that parameter at run time.
+int lisp_is_parameter_name(env_t* e, lisp_value* symbol) {
+  size_t i;
+  for(i = 0; i < e->s.top/sizeof(lisp_value_pair); i++)
+    if(lisp_is_lambda(e->s.p[i].value) && lisp_symbol_in(symbol, &e->s.p[i].value->u.a.e[1]))
+      return 1;
+  return 0;
+}
+
+static void lisp_inline_count_uses(lisp_value* v, const lisp_value* parameters, lisp_inline_use* uses, size_t* order, int in_branch) {
+  size_t i;
+  if(v->type == LISP_SYMBOL) {
+    for(i = 0; i < parameters->u.a.size; i++) {
+      if(lisp_cmp_symbol(v, &parameters->u.a.e[i]) == 0) {
+        if(uses[i].count++ == 0) uses[i].order = (*order)++;
+        uses[i].in_branch |= in_branch;
+        return;
+      }
+    }
   }
-  if(lisp_get_type(v) != LISP_LIST || lisp_get_type(lisp_get_list_element(v, 0)) != LISP_DEFINE)
-    *result = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
-  else result->type = LISP_NIL;
-  assert(eval_stack.top == 0);
-  free(eval_stack.stack);
+  else if(v->type == LISP_LIST && v->u.a.size != 0 && v->u.a.e[0].type != LISP_QUOTE) {
+    for(i = 0; i < v->u.a.size; i++)
+      lisp_inline_count_uses(&v->u.a.e[i], parameters, uses, order, in_branch || (v->u.a.e[0].type == LISP_IF && i >= 2));
+  }
+}
 
-  // final result at top, remove it from tmp variable list.
-  if(eval_tmp_variables.top != 0) {
-    eval_tmp_variables.top -= sizeof(lisp_value*);
-    if(eval_tmp_variables.top != 0)
-      lisp_free_tmp_variable(&eval_tmp_variables);
+// tables are state: a body using tables could see a substituted argument's
+// table operations after its own, or its own after the argument's.
+static int lisp_uses_forms(const lisp_value* v, int first, int last) {
+  size_t i;
+  if(v->type != LISP_LIST || v->u.a.size == 0 || v->u.a.e[0].type == LISP_QUOTE) return 0;
+  if(v->u.a.e[0].type >= first && v->u.a.e[0].type <= last) return 1;
+  for(i = 0; i < v->u.a.size; i++)
+    if(lisp_uses_forms(&v->u.a.e[i], first, last))
+      return 1;
+  return 0;
+}
+
+// arguments are evaluated once, in order, before the body. numbers, symbols and
+// quoted data can be substituted freely, anything else only when it is made of
+// primitive forms, so that it cannot run user code that sets what the body reads
+// before it, the parameter is used exactly once, unconditionally, and in the same
+// order as the arguments, and the body uses no tables.
+static int lisp_inline_args_ok(lisp_value* lambda, lisp_value* name, lisp_value* args, size_t count) {
+  lisp_inline_use uses[8];
+  size_t i, order = 0, last = 0;
+  int type, first = 1, tables = lisp_uses_forms(&lambda->u.a.e[2], LISP_MAKE_TABLE, LISP_TABLE_FREE);
+  if(count > sizeof(uses)/sizeof(uses[0])) return 0;
+  memset(uses, 0, sizeof(uses));
+  lisp_inline_count_uses(&lambda->u.a.e[2], &lambda->u.a.e[1], uses, &order, 0);
+  for(i = 0; i < count; i++) {
+    type = args[i].type;
+    if(type == LISP_NUMBER || type == LISP_SYMBOL) continue;
+    if(type == LISP_LIST && args[i].u.a.size != 0 && args[i].u.a.e[0].type == LISP_QUOTE) continue;
+    if(type != LISP_LIST || tables || uses[i].count != 1 || uses[i].in_branch) return 0;
+    if(!lisp_inline_is_leaf(&args[i], name)) return 0;    // (f (bump y)), bump may set! what f reads
+    if(!first && uses[i].order < last) return 0;
+    last = uses[i].order;
+    first = 0;
   }
-  return ret;
+  return 1;
 }
+
+// copy body, replacing all parameters at once so an argument is never substituted twice.
+static void lisp_inline_subst(lisp_value* dst, const lisp_value* src, const lisp_value* parameters, const lisp_value* args) {
+  size_t i;
+  if(src->type == LISP_SYMBOL) {
+    for(i = 0; i < parameters->u.a.size; i++)
+      if(lisp_cmp_symbol((lisp_value*)src, &parameters->u.a.e[i]) == 0) {
+        lisp_value_copy(dst, &args[i]);
+        return;
+      }
+  }
+  if(src->type != LISP_LIST || src->u.a.size == 0 || src->u.a.e[0].type == LISP_QUOTE) {
+    lisp_value_copy(dst, src);
+    return;
+  }
+  dst->type = LISP_LIST;
+  dst->u.a.size = src->u.a.size;
+  dst->u.a.e = (lisp_value*)malloc(src->u.a.size * sizeof(lisp_value));
+  for(i = 0; i < src->u.a.size; i++)
+    lisp_inline_subst(&dst->u.a.e[i], &src->u.a.e[i], parameters, args);
+}
+
+static int lisp_inline_is_bound(lisp_value* symbol, const lisp_inline_scope* scope) {
+  for(; scope != NULL; scope = scope->up)
+    if(lisp_symbol_in(symbol, scope->parameters))
+      return 1;
+  return 0;
+}
+
+static void lisp_inline_add_dep(lisp_value* deps, lisp_value* symbol) {
+  if(lisp_symbol_in(symbol, deps)) return;
+  deps->u.a.e = (lisp_value*)realloc(deps->u.a.e, (deps->u.a.size + 1) * sizeof(lisp_value));
+  lisp_value_copy(&deps->u.a.e[deps->u.a.size++], symbol);
+}
+
+static lisp_inline_def* lisp_inline_find(env_t* e, lisp_value* lambda) {
+  size_t i;
+  for(i = 0; i < e->inl.top; i++)
+    if(e->inl.p[i].lambda == lambda || e->inl.p[i].inlined == lambda)
+      return &e->inl.p[i];
+  return NULL;
+}
+
+static void lisp_inline_body(env_t* e, lisp_value* v, lisp_value* name, const lisp_inline_scope* scope, lisp_value* deps);
+static int lisp_loop_bindings_ok(const lisp_value* bindings, size_t size);
+
+// a let or a do: the names it binds are in scope of all but the values they start with.
+static void lisp_inline_loop(env_t* e, lisp_value* v, lisp_value* name, const lisp_inline_scope* scope, lisp_value* deps) {
+  size_t i, j, named = v->u.a.e[0].type == LISP_LET && v->u.a.size == 4;
+  lisp_value names, *bindings = &v->u.a.e[1 + named], *x;
+  lisp_inline_scope inner;
+  if(v->u.a.size < 3 || !lisp_loop_bindings_ok(bindings, v->u.a.e[0].type == LISP_DO ? 3 : 2))
+    return;    // its evaluation fails
+  names.type = LISP_LIST;
+  names.u.a.size = named + bindings->u.a.size;
+  names.u.a.e = (lisp_value*)malloc((names.u.a.size + 1) * sizeof(lisp_value));
+  if(named)
+    names.u.a.e[0] = v->u.a.e[1];
+  for(i = 0; i < bindings->u.a.size; i++)
+    names.u.a.e[named + i] = bindings->u.a.e[i].u.a.e[0];
+  inner.parameters = &names;
+  inner.up = scope;
+  for(i = 0; i < bindings->u.a.size; i++)
+    for(j = 1; j < bindings->u.a.e[i].u.a.size; j++)
+      lisp_inline_body(e, &bindings->u.a.e[i].u.a.e[j], name, j == 1 ? scope : &inner, deps);
+  for(i = 2 + named; i < v->u.a.size; i++) {
+    x = &v->u.a.e[i];
+    if(v->u.a.e[0].type == LISP_DO && i == 2 && x->type == LISP_LIST) {
+      for(j = 0; j < x->u.a.size; j++)    // (test r ...) is no call
+        lisp_inline_body(e, &x->u.a.e[j], name, &inner, deps);
+    }
+    else lisp_inline_body(e, x, name, &inner, deps);
+  }
+  free(names.u.a.e);
+}
+
+static void lisp_inline_body(env_t* e, lisp_value* v, lisp_value* name, const lisp_inline_scope* scope, lisp_value* deps) {
+  size_t i, count;
+  lisp_value *head, *helper, tmp;
+  lisp_inline_def* def;
+  lisp_inline_scope inner;
+  if(v->type != LISP_LIST || v->u.a.size == 0) return;
+  head = &v->u.a.e[0];
+  switch(head->type) {
+    case LISP_QUOTE	: return;
+    case LISP_LAMBDA:
+      if(!lisp_is_lambda(v)) return;
+      inner.parameters = &v->u.a.e[1];
+      inner.up = scope;
+      lisp_inline_body(e, &v->u.a.e[2], name, &inner, deps);
+      return;
+    case LISP_LET	:
+    case LISP_DO	:
+      lisp_inline_loop(e, v, name, scope, deps);
+      return;
+  }
+  for(i = 0; i < v->u.a.size; i++)
+    lisp_inline_body(e, &v->u.a.e[i], name, scope, deps);
+
+  if(head->type != LISP_SYMBOL || lisp_cmp_symbol(head, name) == 0 || lisp_inline_is_bound(head, scope))
+    return;
+  if(!lisp_is_lambda(helper = lisp_env_lookup(e, head)))
+    return;
+  count = v->u.a.size - 1;
+  if(lisp_get_list_size(&helper->u.a.e[1]) != count
+      || lisp_count_nodes(&helper->u.a.e[2]) > LISP_INLINE_MAX_NODES
+      || !lisp_inline_is_leaf(&helper->u.a.e[2], head)
+      || lisp_is_parameter_name(e, head)
+      || !lisp_inline_args_ok(helper, head, v->u.a.e + 1, count))
+    return;
+  lisp_inline_subst(&tmp, &helper->u.a.e[2], &helper->u.a.e[1], v->u.a.e + 1);
+  // the helper's body may carry code inlined from other helpers.
+  if((def = lisp_inline_find(e, helper)) != NULL)
+    for(i = 0; i < def->deps.u.a.size; i++)
+      lisp_inline_add_dep(deps, &def->deps.u.a.e[i]);
+  lisp_inline_add_dep(deps, head);
+  lisp_value_free(v);
+  *v = tmp;
+}
+
+/*
+ * local type inference over a lambda body. arithmetic always yields a number
+ * and comparisons a boolean, so operators are rewritten to their LISP_NUM_*
+ * forms, which evaluate operands straight to doubles. operands proven to be
+ * numbers (literals, nested arithmetic, ifs of numbers) skip the type check,
+ * everything else, parameters and calls included, is still checked at run time.
+ */
+enum {
+  LISP_TYPE_UNKNOWN,
+  LISP_TYPE_NUMBER,
+  LISP_TYPE_BOOL
+};
+
+// (car (cdr (cdr l))) => (caddr l), the inner shells are freed.
+static void lisp_cxr_fuse(lisp_value* v) {
+  lisp_value *x, *shell;
+  size_t path, size, inner_path, inner_size;
+  size = lisp_cxr_steps(&v->u.a.e[0], &path);
+  while(v->u.a.size == 2 && (x = &v->u.a.e[1])->type == LISP_LIST && x->u.a.size == 2
+      && (inner_size = lisp_cxr_steps(&x->u.a.e[0], &inner_path)) != 0 && size + inner_size <= LISP_CXR_MAX) {
+    path = inner_path | path << inner_size;
+    size += inner_size;
+    shell = x->u.a.e;
+    v->u.a.e[1] = shell[1];
+    free(shell);
+    v->u.a.e[0].type = LISP_CXR;
+    v->u.a.e[0].u.cxr.path = path;
+    v->u.a.e[0].u.cxr.size = size;
+  }
+}
+
+static int lisp_specialize(lisp_value* v) {
+  size_t i;
+  int t, type = LISP_NULL;
+  lisp_value* head;
+  if(v->type == LISP_NUMBER) return LISP_TYPE_NUMBER;
+  if(v->type != LISP_LIST || v->u.a.size == 0) return LISP_TYPE_UNKNOWN;
+  head = &v->u.a.e[0];
+  switch(head->type) {
+    case LISP_QUOTE	:
+    case LISP_DEFINE:
+    case LISP_DEFINE_MACRO:	return LISP_TYPE_UNKNOWN;
+    case LISP_PLUS	: case LISP_NUM_PLUS	: type = LISP_NUM_PLUS; break;
+    case LISP_MINUS	: case LISP_NUM_MINUS	: type = LISP_NUM_MINUS; break;
+    case LISP_MULTIPLY: case LISP_NUM_MULTIPLY: type = LISP_NUM_MULTIPLY; break;
+    case LISP_DIVIDE: case LISP_NUM_DIVIDE: type = LISP_NUM_DIVIDE; break;
+    case LISP_LT	: case LISP_NUM_LT	: type = LISP_NUM_LT; break;
+    case LISP_BT	: case LISP_NUM_BT	: type = LISP_NUM_BT; break;
+    case LISP_EQ	: case LISP_NUM_EQ	: type = LISP_NUM_EQ; break;
+    case LISP_NOT	:
+    case LISP_NULL$	:
+      for(i = 1; i < v->u.a.size; i++)
+        lisp_specialize(&v->u.a.e[i]);
+      return LISP_TYPE_BOOL;
+    case LISP_VECTOR_REF:
+    case LISP_VECTOR_LENGTH:
+    case LISP_VECTOR_DOT:
+    case LISP_VECTOR_SUM:
+    case LISP_VECTOR_MIN:
+    case LISP_VECTOR_MAX:
+    case LISP_STRING_LENGTH:
+    case LISP_STRING_SEARCH:
+    case LISP_MAKE_TABLE:
+    case LISP_TABLE_SIZE:
+    case LISP_TABLE_NEXT:
+    case LISP_LENGTH:
+      for(i = 1; i < v->u.a.size; i++)
+        lisp_specialize(&v->u.a.e[i]);
+      return LISP_TYPE_NUMBER;
+    case LISP_STRING_EQ:
+    case LISP_STRING_LT:
+    case LISP_TABLE_DELETE:
+    case LISP_TABLE_FREE:
+      for(i = 1; i < v->u.a.size; i++)
+        lisp_specialize(&v->u.a.e[i]);
+      return LISP_TYPE_BOOL;
+    case LISP_CAR	:
+    case LISP_CDR	:
+    case LISP_CXR	:
+      lisp_cxr_fuse(v);
+      break;
+    case LISP_IF	:
+      if(v->u.a.size != 4) break;
+      lisp_specialize(&v->u.a.e[1]);
+      t = lisp_specialize(&v->u.a.e[2]);
+      return lisp_specialize(&v->u.a.e[3]) == t ? t : LISP_TYPE_UNKNOWN;
+  }
+  // the generic operators expect one operand at least, comparisons exactly two.
+  if(type == LISP_NULL || v->u.a.size < 2 || (type >= LISP_NUM_LT && v->u.a.size != 3)) {
+    for(i = head->type == LISP_LAMBDA ? 2 : 0; i < v->u.a.size; i++)
+      lisp_specialize(&v->u.a.e[i]);
+    return LISP_TYPE_UNKNOWN;
+  }
+  head->u.op.proven = 0;
+  for(i = 1; i < v->u.a.size; i++)
+    if(lisp_specialize(&v->u.a.e[i]) == LISP_TYPE_NUMBER && i <= sizeof(size_t)*8)
+      head->u.op.proven |= (size_t)1 << (i-1);
+  head->type = type;
+  return type >= LISP_NUM_LT ? LISP_TYPE_BOOL : LISP_TYPE_NUMBER;
+}
+
+static void lisp_inline_rebuild(env_t* e, lisp_inline_def* def) {
+  lisp_inline_scope scope;
+  e->s.p[def->pair].value = def->lambda;    // the env must not see the old copy while inlining
+  if(def->inlined != NULL) {
+    lisp_value_free(def->inlined);
+    free(def->inlined);
+    def->inlined = NULL;
+  }
+  lisp_value_free(&def->deps);
+  def->deps.type = LISP_LIST;
+  def->deps.u.a.size = 0;
+  def->deps.u.a.e = NULL;
+
+  def->inlined = (lisp_value*)malloc(sizeof(lisp_value));
+  lisp_value_copy(def->inlined, def->lambda);
+  scope.parameters = &def->inlined->u.a.e[1];
+  scope.up = NULL;
+  lisp_inline_body(e, &def->inlined->u.a.e[2], e->s.p[def->pair].symbol, &scope, &def->deps);
+  if(def->deps.u.a.size == 0) {
+    lisp_value_free(def->inlined);
+    free(def->inlined);
+    def->inlined = NULL;
+  }
+  e->s.p[def->pair].value = def->inlined != NULL ? def->inlined : def->lambda;
+  lisp_specialize(&e->s.p[def->pair].value->u.a.e[2]);
+}
+
+static void lisp_inline_define(env_t* e, size_t pair) {
+  lisp_inline_def* def;
+  // helpers of a task's env may be redefined in the env it was made from, out of reach of invalidation.
+  if(!lisp_is_lambda(e->s.p[pair].value) || e->prev != NULL) return;
+  if(e->inl.top == e->inl.size) {
+    e->inl.size = e->inl.size == 0 ? 16 : e->inl.size + (e->inl.size >> 1);
+    e->inl.p = (lisp_inline_def*)realloc(e->inl.p, e->inl.size * sizeof(lisp_inline_def));
+  }
+  def = &e->inl.p[e->inl.top++];
+  def->pair = pair;
+  def->lambda = e->s.p[pair].value;
+  def->inlined = NULL;
+  lisp_value_init(&def->deps);
+  lisp_inline_rebuild(e, def);
+}
+
+// rebuild definitions that inlined `symbol`, in definition order so that
+// helpers are rebuilt before the functions that inlined them.
+static void lisp_inline_invalidate(env_t* e, lisp_value* symbol) {
+  size_t i;
+  for(i = 0; i < e->inl.top; i++)
+    if(e->inl.p[i].deps.type == LISP_LIST && lisp_symbol_in(symbol, &e->inl.p[i].deps))
+      lisp_inline_rebuild(e, &e->inl.p[i]);
+}
+
+// a definition set! changed is no longer rebuilt from the lambda it was defined to.
+static void lisp_inline_detach(env_t* e, size_t pair) {
+  size_t i;
+  for(i = 0; i < e->inl.top; i++)
+    if(e->inl.p[i].pair == pair)
+      lisp_value_free(&e->inl.p[i].deps);
+}
+
+static void lisp_inline_free(env_t* e) {
+  size_t i;
+  for(i = 0; i < e->inl.top; i++) {
+    if(e->inl.p[i].inlined != NULL) {
+      lisp_value_free(e->inl.p[i].inlined);
+      free(e->inl.p[i].inlined);
+    }
+    lisp_value_free(&e->inl.p[i].deps);
+  }
+  free(e->inl.p);
+  e->inl.p = NULL;
+  e->inl.top = e->inl.size = 0;
+}
+
+static void lisp_env_define(env_t* e, lisp_value* symbol, lisp_value* value) {
+  size_t i, pair = e->s.top/sizeof(lisp_value_pair);
+  lisp_value *parameters;
+  lisp_value_pair* p = (lisp_value_pair*)lisp_env_push(e, sizeof(lisp_value_pair));
+  p[0].symbol = symbol;
+  p[0].value = value;
+  LISP_TRACE_EVENT(LISP_TRACE_DEFINE, (unsigned)pair, value, symbol->u.sym.s, symbol->u.sym.size);
+  e->version = ++lisp_env_versions;
+  lisp_inline_define(e, pair);
+  // a redefined helper, or a new parameter shadowing one, invalidates inlined copies.
+  lisp_inline_invalidate(e, symbol);
+  if(lisp_is_lambda(value)) {
+    parameters = lisp_get_list_element(value, 1);
+    for(i = 0; i < lisp_get_list_size(parameters); i++)
+      lisp_inline_invalidate(e, lisp_get_list_element(parameters, i));
+  }
+}
+
+static int lisp_eval_define(lisp_value v, env_t* e) {
+  if(lisp_get_list_size(&v) != 3)    // typical : (define id (lambda (x) x))
+    return LISP_EVAL_ARITY_MISMATCH;
+  if(lisp_get_type(lisp_get_list_element(&v, 1)) != LISP_SYMBOL)
+    return LISP_EVAL_INVALID_VALUE;
+  lisp_env_define(e, lisp_get_list_element(&v, 1), lisp_get_list_element(&v, 2));
+  return LISP_EVAL_OK;
+}
+
+/*
+ * macros: (define-macro (name p ...) template) binds name to the define-macro
+ * form itself. a call of it in a top-level form, the defines in it included,
+ * is replaced in the parse tree by a copy of the template with the parameters
+ * substituted by the argument forms, before the form is evaluated: it is
+ * expanded once, the calls of a defined lambda find the expansion there.
+ * what the special forms do not evaluate is left alone: quoted data, lambda
+ * parameters, the names defines, set!, let and do bind and the templates of
+ * other macros.
+ */
+#ifndef LISP_MACRO_DEPTH
+#define LISP_MACRO_DEPTH 64    // nested expansions before a macro is taken to expand without end
+#endif
+
+// is head, or any name if head is NULL, defined as a macro in e or an env it extends?
+static int lisp_macro_named(env_t* e, const lisp_value* head) {
+  size_t i;
+  for(; e != NULL; e = e->prev)
+    for(i = 0; i < e->macros.top; i++)
+      if(head == NULL || (strlen(e->macros.p[i]) == head->u.sym.size && memcmp(e->macros.p[i], head->u.sym.s, head->u.sym.size) == 0))
+        return 1;
+  return 0;
+}
+
+static int lisp_eval_define_macro(lisp_value v, env_t* e) {
+  lisp_value* signature;
+  size_t i;
+  if(v.u.a.size != 3)
+    return LISP_EVAL_INVALID_VALUE;
+  signature = lisp_get_list_element(&v, 1);
+  if(signature->type != LISP_LIST || signature->u.a.size == 0)
+    return LISP_EVAL_INVALID_VALUE;
+  for(i = 0; i < signature->u.a.size; i++)
+    if(signature->u.a.e[i].type != LISP_SYMBOL)
+      return LISP_EVAL_INVALID_VALUE;
+  for(i = 0; i < e->macros.top; i++)    // a redefinition keeps the name it has
+    if(strlen(e->macros.p[i]) == signature->u.a.e[0].u.sym.size && memcmp(e->macros.p[i], signature->u.a.e[0].u.sym.s, signature->u.a.e[0].u.sym.size) == 0)
+      break;
+  if(i == e->macros.top) {
+    if(e->macros.top == e->macros.size) {
+      e->macros.size = e->macros.size == 0 ? 16 : e->macros.size * 2;
+      e->macros.p = (char**)realloc(e->macros.p, e->macros.size * sizeof(char*));
+    }
+    e->macros.p[e->macros.top++] = strndup(signature->u.a.e[0].u.sym.s, signature->u.a.e[0].u.sym.size);
+  }
+  lisp_env_define(e, &signature->u.a.e[0], &v.u.a.e[0]);
+  return LISP_EVAL_OK;
+}
+
+// the define-macro form head is bound to, NULL if it is no macro.
+static lisp_value* lisp_macro_lookup(lisp_value* head, env_t* e) {
+  lisp_value* m;
+  if(!lisp_macro_named(e, head) || (m = lisp_env_lookup(e, head)) == NULL || m->type != LISP_DEFINE_MACRO)
+    return NULL;
+  return m;
+}
+
+// a copy of template with each parameter replaced by a copy of its argument.
+static void lisp_macro_substitute(lisp_value* dst, const lisp_value* template, lisp_value* parameters, lisp_value* args) {
+  size_t i;
+  if(template->type == LISP_SYMBOL) {
+    for(i = 1; i < parameters->u.a.size; i++) {
+      if(lisp_cmp_symbol((lisp_value*)template, &parameters->u.a.e[i]) == 0) {
+        lisp_value_copy(dst, &args[i]);
+        return;
+      }
+    }
+  }
+  if(template->type != LISP_LIST) {
+    lisp_value_copy(dst, template);
+    return;
+  }
+  dst->type = LISP_LIST;
+  dst->u.a.size = template->u.a.size;
+  dst->u.a.e = template->u.a.size != 0 ? (lisp_value*)malloc(template->u.a.size * sizeof(lisp_value)) : NULL;
+  for(i = 0; i < template->u.a.size; i++)
+    lisp_macro_substitute(&dst->u.a.e[i], &template->u.a.e[i], parameters, args);
+}
+
+static int lisp_macro_expand(lisp_value* v, env_t* e, size_t depth);
+
+// a let or a do: the names it binds, and the clause of a do's test, are no calls.
+static int lisp_macro_expand_loop(lisp_value* v, env_t* e, size_t depth) {
+  size_t i, j, named = v->u.a.e[0].type == LISP_LET && v->u.a.size == 4;
+  lisp_value *bindings = &v->u.a.e[1 + named], *x;
+  int ret;
+  if(v->u.a.size < 3 || !lisp_loop_bindings_ok(bindings, v->u.a.e[0].type == LISP_DO ? 3 : 2))
+    return LISP_EVAL_OK;    // its evaluation fails
+  for(i = 0; i < bindings->u.a.size; i++)
+    for(j = 1; j < bindings->u.a.e[i].u.a.size; j++)
+      if((ret = lisp_macro_expand(&bindings->u.a.e[i].u.a.e[j], e, depth)) != LISP_EVAL_OK)
+        return ret;
+  for(i = 2 + named; i < v->u.a.size; i++) {
+    x = &v->u.a.e[i];
+    if(v->u.a.e[0].type != LISP_DO || i != 2 || x->type != LISP_LIST) {
+      if((ret = lisp_macro_expand(x, e, depth)) != LISP_EVAL_OK)
+        return ret;
+      continue;
+    }
+    for(j = 0; j < x->u.a.size; j++)
+      if((ret = lisp_macro_expand(&x->u.a.e[j], e, depth)) != LISP_EVAL_OK)
+        return ret;
+  }
+  return LISP_EVAL_OK;
+}
+
+static int lisp_macro_expand(lisp_value* v, env_t* e, size_t depth) {
+  lisp_value *m, expansion;
+  size_t i = 0;
+  int ret;
+  if(v->type != LISP_LIST || v->u.a.size == 0)
+    return LISP_EVAL_OK;
+  switch(v->u.a.e[0].type) {
+    case LISP_QUOTE	:
+    case LISP_DEFINE_MACRO:	return LISP_EVAL_OK;
+    case LISP_LET	:
+    case LISP_DO	:	return lisp_macro_expand_loop(v, e, depth);
+    case LISP_LAMBDA:
+    case LISP_DEFINE:
+    case LISP_SET	:	i = 2; break;
+    case LISP_SYMBOL:
+      if((m = lisp_macro_lookup(&v->u.a.e[0], e)) == NULL)
+        break;
+      if(m[1].u.a.size != v->u.a.size)
+        return LISP_EVAL_ARITY_MISMATCH;
+      if(depth == LISP_MACRO_DEPTH)
+        return LISP_EVAL_MACRO_ERROR;
+      lisp_macro_substitute(&expansion, &m[2], &m[1], v->u.a.e);
+      lisp_value_free(v);
+      *v = expansion;
+      return lisp_macro_expand(v, e, depth + 1);
+  }
+  for(; i < v->u.a.size; i++)
+    if((ret = lisp_macro_expand(&v->u.a.e[i], e, depth)) != LISP_EVAL_OK)
+      return ret;
+  return LISP_EVAL_OK;
+}
+
+// like a define, the binding lives as long as the env. name and value are
+// allocated together and never freed.
+static lisp_value* lisp_native_new(const char* name) {
+  size_t size = strlen(name);
+  lisp_value* p = (lisp_value*)malloc(2*sizeof(lisp_value) + size + 1);
+  p[0].type = LISP_SYMBOL;
+  p[0].u.sym.s = memcpy((char*)(p + 2), name, size + 1);
+  p[0].u.sym.size = size;
+  p[0].u.sym.ic = NULL;
+  p[1].type = LISP_NATIVE;
+  p[1].u.native.fn = NULL;
+  p[1].u.native.boolean = 0;
+  p[1].u.native.call = NULL;
+  return p;
+}
+
+int lisp_define_native_number(env_t* e, const char* name, size_t arity, lisp_native_number_fn fn, int boolean) {
+  lisp_value* p;
+  if(arity > LISP_NATIVE_MAX_ARGS)
+    return LISP_EVAL_ARITY_MISMATCH;
+  p = lisp_native_new(name);
+  p[1].u.native.fn = fn;
+  p[1].u.native.arity = arity;
+  p[1].u.native.boolean = boolean;
+  lisp_env_define(e, &p[0], &p[1]);
+  return LISP_EVAL_OK;
+}
+
+int lisp_define_native(env_t* e, const char* name, size_t arity, lisp_native_fn fn) {
+  lisp_value* p = lisp_native_new(name);
+  p[1].u.native.call = fn;
+  p[1].u.native.arity = arity;
+  lisp_env_define(e, &p[0], &p[1]);
+  return LISP_EVAL_OK;
+}
+
+// a number that is a valid size or index below limit.
+static int lisp_is_index(const lisp_value* n, double limit) {
+  return n->type == LISP_NUMBER && n->u.n >= 0 && n->u.n < limit && n->u.n == (double)(size_t)n->u.n;
+}
+
+static double lisp_now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// evaluate expr once, its value is left on the eval stack.
+static int lisp_eval_timed(lisp_value expr, env_t* e, double* ns, size_t* temporaries) {
+  size_t top = eval_stack.top, tmp = eval_tmp_variables.top;
+  double start = lisp_now_ns();
+  int ret = lisp_eval_value(expr, e);
+  *ns = lisp_now_ns() - start;
+  *temporaries = (eval_tmp_variables.top - tmp)/sizeof(lisp_value*);
+  if(ret == LISP_EVAL_OK && eval_stack.top == top)
+    return LISP_LISP_OP_ILLEAGE;    // a define has no value to time
+  return ret;
+}
+
+// release the temporaries made since top, a run of bench that is thrown away.
+static void lisp_drop_tmp_variables(size_t top) {
+  lisp_value** p = (lisp_value**)eval_tmp_variables.stack;
+  size_t i;
+  for(i = top/sizeof(lisp_value*); i < eval_tmp_variables.top/sizeof(lisp_value*); i++) {
+    LISP_TRACE_EVENT(LISP_TRACE_FREE, (unsigned)lisp_get_type(p[i]), p[i], NULL, 0);
+    lisp_value_free(p[i]);
+    free(p[i]);
+  }
+  eval_tmp_variables.top = top;
+}
+
+// (time expr): the value of expr, its latency and temporaries printed.
+static int lisp_eval_time(lisp_value v, env_t* e) {
+  double ns;
+  size_t temporaries;
+  int ret;
+  if(lisp_get_list_size(&v) != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_timed(*(lisp_value*)lisp_get_list_element(&v, 1), e, &ns, &temporaries)) != LISP_EVAL_OK)
+    return ret;
+  printf("time: %.0f ns, %zu temporaries\n", ns, temporaries);
+  return LISP_EVAL_OK;
+}
+
+static int lisp_cmp_ns(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+// (bench n expr): n/10 warmup runs, then n timed runs of expr. prints the
+// mean and percentiles, and evaluates to the mean in ns.
+static int lisp_eval_bench(lisp_value v, env_t* e) {
+  lisp_value* n;
+  double* ns, mean = 0;
+  size_t runs, warmup, i, temporaries, total = 0, tmp = eval_tmp_variables.top;
+  int ret;
+#ifdef LISP_STATS
+  lisp_stats before = lisp_stats_counters;
+#endif
+  if(lisp_get_list_size(&v) != 3)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_value(*(lisp_value*)lisp_get_list_element(&v, 1), e)) != LISP_EVAL_OK)
+    return ret;
+  n = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if(lisp_get_type(n) != LISP_NUMBER || n->u.n < 1)
+    return LISP_EVAL_NOT_A_NUMBER;
+  if(!lisp_is_index(n, (double)((size_t)-1 / sizeof(double))))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  runs = (size_t)n->u.n;
+  warmup = runs/10;
+  if((ns = (double*)malloc(runs * sizeof(double))) == NULL)
+    return LISP_EVAL_INVALID_VALUE;
+  for(i = 0; i < warmup + runs; i++) {
+    if((ret = lisp_eval_timed(*(lisp_value*)lisp_get_list_element(&v, 2), e, &ns[i < warmup ? 0 : i - warmup], &temporaries)) != LISP_EVAL_OK) {
+      free(ns);
+      return ret;
+    }
+    eval_context_pop(&eval_stack, sizeof(lisp_value));
+    lisp_drop_tmp_variables(tmp);
+    if(i >= warmup)
+      total += temporaries;
+  }
+  for(i = 0; i < runs; i++)
+    mean += ns[i];
+  mean /= runs;
+  qsort(ns, runs, sizeof(double), lisp_cmp_ns);
+  printf("bench: %zu runs after %zu warmup, mean %.0f ns, p50 %.0f ns, p90 %.0f ns, p99 %.0f ns, max %.0f ns, %.1f temporaries/run\n",
+      runs, warmup, mean, ns[runs*50/100], ns[runs*90/100], ns[runs*99/100], ns[runs-1], (double)total/runs);
+#ifdef LISP_STATS
+  printf("bench: %.1f mallocs/run, %.1f bytes/run\n", (double)(lisp_stats_counters.mallocs - before.mallocs)/(warmup + runs),
+      (double)(lisp_stats_counters.malloc_bytes - before.malloc_bytes)/(warmup + runs));
+#endif
+  free(ns);
+  n->type = LISP_NUMBER;
+  n->u.n = mean;
+  PUTV(*n);
+  return LISP_EVAL_OK;
+}
+
+// (spawn expr): the id of a coroutine evaluating expr, see coro.h.
+static int lisp_eval_spawn(lisp_value v, env_t* e) {
+  lisp_value id;
+  if(lisp_get_list_size(&v) != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+#ifdef LISP_CORO
+  id.type = LISP_NUMBER;
+  if((id.u.n = (double)lisp_coro_spawn(lisp_get_list_element(&v, 1), e)) < 0)
+    return LISP_LISP_OP_ILLEAGE;
+  PUTV(id);
+  return LISP_EVAL_OK;
+#else
+  (void)id;
+  (void)e;
+  return LISP_LISP_OP_ILLEAGE;
+#endif
+}
+
+/*
+ * vectors: contiguous doubles worked on by the kernels of vector.c. like the
+ * lists car and cdr make, a vector a form makes is a temporary, freed with the
+ * evaluation unless it is the result; a parameter is bound to a copy.
+ */
+static lisp_value* lisp_vector_new(size_t size) {
+  lisp_value* v = (lisp_value*)malloc(sizeof(lisp_value));
+  if((v->u.vec.d = lisp_vec_alloc(size)) == NULL) {
+    free(v);
+    return NULL;
+  }
+  v->type = LISP_VECTOR;
+  v->u.vec.size = size;
+  v->u.vec.map = 0;
+  LINKTO(v);
+  return v;
+}
+
+// a vector made by the operand form itself is seen by nothing but the form
+// consuming it, its temporary is released right away. a loop over the windows
+// of a large file then holds one window at a time.
+static void lisp_vector_consumed(const lisp_value* operand, const lisp_value* value) {
+  lisp_value** p = (lisp_value**)eval_tmp_variables.stack;
+  size_t i, size = eval_tmp_variables.top/sizeof(lisp_value*);
+  int type;
+  if(value->type != LISP_VECTOR || operand->type != LISP_LIST || operand->u.a.size == 0)
+    return;
+  type = operand->u.a.e[0].type;
+  if(type != LISP_MAKE_VECTOR && type != LISP_VECTOR_NEW && type != LISP_LOAD_F64 && type != LISP_LOAD_CSV
+      && (type < LISP_VECTOR_ADD || type > LISP_VECTOR_EQ))
+    return;
+  for(i = size; i-- > 0; ) {
+    if(p[i]->type == LISP_VECTOR && p[i]->u.vec.d == value->u.vec.d) {
+      LISP_TRACE_EVENT(LISP_TRACE_FREE, (unsigned)LISP_VECTOR, p[i], NULL, 0);
+      lisp_value_free(p[i]);
+      free(p[i]);
+      memmove(p + i, p + i + 1, (size - i - 1)*sizeof(lisp_value*));
+      eval_tmp_variables.top -= sizeof(lisp_value*);
+      return;
+    }
+  }
+}
+
+// the count operands of v, evaluated in order and copied off the eval stack to args.
+static int lisp_eval_operands(lisp_value* v, env_t* e, lisp_value* args, size_t count) {
+  size_t i;
+  int ret;
+  if(v->u.a.size != count + 1)
+    return LISP_EVAL_ARITY_MISMATCH;
+  for(i = 1; i <= count; i++)
+    if((ret = lisp_eval_value(v->u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  memcpy(args, eval_context_pop(&eval_stack, count*sizeof(lisp_value)), count*sizeof(lisp_value));
+  return LISP_EVAL_OK;
+}
+
+// (make-vector n) or (make-vector n x): n elements, all x or 0.
+static int lisp_eval_make_vector(lisp_value v, env_t* e) {
+  lisp_value args[2], *r;
+  int ret;
+  args[1].type = LISP_NUMBER;
+  args[1].u.n = 0;
+  if((ret = lisp_eval_operands(&v, e, args, v.u.a.size == 2 ? 1 : 2)) != LISP_EVAL_OK)
+    return ret;
+  if(args[0].type != LISP_NUMBER || args[1].type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  if(!lisp_is_index(&args[0], (double)((size_t)-1 / sizeof(double))))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  if((r = lisp_vector_new((size_t)args[0].u.n)) == NULL)
+    return LISP_EVAL_INVALID_VALUE;
+  lisp_vec_fill(r->u.vec.d, args[1].u.n, r->u.vec.size);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (vector x ...)
+static int lisp_eval_vector_new(lisp_value v, env_t* e) {
+  lisp_value *args, *r;
+  size_t i, count = v.u.a.size - 1;
+  int ret;
+  for(i = 1; i <= count; i++)
+    if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  args = (lisp_value*)eval_context_pop(&eval_stack, count*sizeof(lisp_value));
+  for(i = 0; i < count; i++)
+    if(args[i].type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
+  if((r = lisp_vector_new(count)) == NULL)
+    return LISP_EVAL_INVALID_VALUE;
+  for(i = 0; i < count; i++)
+    r->u.vec.d[i] = args[i].u.n;
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (vector-ref v i) and (vector-length v)
+static int lisp_eval_vector_access(lisp_value v, int type, env_t* e) {
+  lisp_value args[2], n;
+  int ret;
+  if((ret = lisp_eval_operands(&v, e, args, type == LISP_VECTOR_REF ? 2 : 1)) != LISP_EVAL_OK)
+    return ret;
+  if(args[0].type != LISP_VECTOR)
+    return LISP_EVAL_NOT_A_VECTOR;
+  n.type = LISP_NUMBER;
+  if(type == LISP_VECTOR_LENGTH)
+    n.u.n = (double)args[0].u.vec.size;
+  else if(args[1].type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  else if(!lisp_is_index(&args[1], (double)args[0].u.vec.size))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  else n.u.n = args[0].u.vec.d[(size_t)args[1].u.n];
+  lisp_vector_consumed(&v.u.a.e[1], &args[0]);
+  PUTV(n);
+  return LISP_EVAL_OK;
+}
+
+// (vector+ a b) and the other elementwise forms. a number on one side goes with every element.
+static int lisp_eval_vector_op(lisp_value v, int type, env_t* e) {
+  lisp_value args[2], *r;
+  size_t i, size;
+  int ret;
+  if((ret = lisp_eval_operands(&v, e, args, 2)) != LISP_EVAL_OK)
+    return ret;
+  for(i = 0; i < 2; i++)
+    if(args[i].type != LISP_VECTOR && args[i].type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_VECTOR;
+  if(args[0].type != LISP_VECTOR && args[1].type != LISP_VECTOR)
+    return LISP_EVAL_NOT_A_VECTOR;
+  size = args[0].type == LISP_VECTOR ? args[0].u.vec.size : args[1].u.vec.size;
+  if(args[0].type == LISP_VECTOR && args[1].type == LISP_VECTOR && args[1].u.vec.size != size)
+    return LISP_EVAL_LENGTH_MISMATCH;
+  if((r = lisp_vector_new(size)) == NULL)
+    return LISP_EVAL_INVALID_VALUE;
+  lisp_vec_binary(type - LISP_VECTOR_ADD, r->u.vec.d,
+      args[0].type == LISP_VECTOR ? args[0].u.vec.d : &args[0].u.n, args[0].type == LISP_VECTOR,
+      args[1].type == LISP_VECTOR ? args[1].u.vec.d : &args[1].u.n, args[1].type == LISP_VECTOR, size);
+  lisp_vector_consumed(&v.u.a.e[1], &args[0]);
+  lisp_vector_consumed(&v.u.a.e[2], &args[1]);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (vector-sum v), (vector-min v), (vector-max v) and (vector-dot a b)
+static int lisp_eval_vector_reduce(lisp_value v, int type, env_t* e) {
+  lisp_value args[2], n;
+  int ret;
+  if((ret = lisp_eval_operands(&v, e, args, type == LISP_VECTOR_DOT ? 2 : 1)) != LISP_EVAL_OK)
+    return ret;
+  if(args[0].type != LISP_VECTOR || (type == LISP_VECTOR_DOT && args[1].type != LISP_VECTOR))
+    return LISP_EVAL_NOT_A_VECTOR;
+  n.type = LISP_NUMBER;
+  if(type != LISP_VECTOR_DOT)
+    n.u.n = lisp_vec_reduce(type - LISP_VECTOR_SUM, args[0].u.vec.d, args[0].u.vec.size);
+  else if(args[0].u.vec.size != args[1].u.vec.size)
+    return LISP_EVAL_LENGTH_MISMATCH;
+  else n.u.n = lisp_vec_dot(args[0].u.vec.d, args[1].u.vec.d, args[0].u.vec.size);
+  lisp_vector_consumed(&v.u.a.e[1], &args[0]);
+  if(type == LISP_VECTOR_DOT)
+    lisp_vector_consumed(&v.u.a.e[2], &args[1]);
+  PUTV(n);
+  return LISP_EVAL_OK;
+}
+
+#ifndef LISP_PATH_MAX
+#define LISP_PATH_MAX 4096
+#endif
+
+// the path operand of a loader: a symbol as written, or an expression giving a string.
+static int lisp_eval_path(lisp_value* operand, env_t* e, char* path) {
+  lisp_value* p;
+  int ret;
+  if(operand->type == LISP_SYMBOL) {
+    if(operand->u.sym.size >= LISP_PATH_MAX)
+      return LISP_EVAL_IO_ERROR;
+    memcpy(path, operand->u.sym.s, operand->u.sym.size + 1);
+    return LISP_EVAL_OK;
+  }
+  if((ret = lisp_eval_value(*operand, e)) != LISP_EVAL_OK)
+    return ret;
+  p = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if(p->type != LISP_STRING)
+    return LISP_EVAL_NOT_A_STRING;
+  if(lisp_str_size(p) >= LISP_PATH_MAX || memchr(lisp_str_data(p), '\0', lisp_str_size(p)) != NULL)
+    return LISP_EVAL_IO_ERROR;
+  memcpy(path, lisp_str_data(p), lisp_str_size(p));
+  path[lisp_str_size(p)] = '\0';
+  return LISP_EVAL_OK;
+}
+
+// (load-f64 path [start count]), (load-csv path column [start count]) and (load-text path), see data.h.
+static int lisp_eval_load(lisp_value v, int type, env_t* e) {
+  lisp_value *args, *r;
+  size_t i, n, fixed = type == LISP_LOAD_CSV, window[3] = { 0, 0, (size_t)-1 };    // column, start, count
+  char path[LISP_PATH_MAX];
+  int ret;
+  if(v.u.a.size < 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  n = v.u.a.size - 2;
+  if(n != fixed && (n != fixed + 2 || type == LISP_LOAD_TEXT))
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_path(&v.u.a.e[1], e, path)) != LISP_EVAL_OK)
+    return ret;
+  for(i = 2; i < v.u.a.size; i++)
+    if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  args = (lisp_value*)eval_context_pop(&eval_stack, n*sizeof(lisp_value));
+  for(i = 0; i < n; i++) {
+    if(args[i].type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
+    if(!lisp_is_index(&args[i], (double)(size_t)-1))
+      return LISP_EVAL_INDEX_OUT_OF_RANGE;
+    window[i + !fixed] = (size_t)args[i].u.n;
+  }
+#ifdef LISP_DATA
+  r = (lisp_value*)malloc(sizeof(lisp_value));
+  switch(type) {
+    case LISP_LOAD_F64:	ret = lisp_data_f64(path, window[1], window[2], r); break;
+    case LISP_LOAD_CSV:	ret = lisp_data_csv(path, window[0], window[1], window[2], r); break;
+    default:	ret = lisp_data_text(path, r);
+  }
+  if(ret != LISP_EVAL_OK) {
+    free(r);
+    return ret;
+  }
+  LINKTO(r);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+#else
+  (void)r;
+  (void)window;
+  return LISP_LISP_OP_ILLEAGE;
+#endif
+}
+
+/*
+ * strings, see str.h. like vectors, the strings the forms make are temporaries;
+ * a slice or a parameter bound to a string takes a reference, not a copy.
+ */
+static lisp_value* lisp_string_new() {
+  lisp_value* v = (lisp_value*)malloc(sizeof(lisp_value));
+  LINKTO(v);
+  return v;
+}
+
+// the count operands of v, which have to be strings.
+static int lisp_eval_strings(lisp_value* v, env_t* e, lisp_value* args, size_t count) {
+  size_t i;
+  int ret;
+  if((ret = lisp_eval_operands(v, e, args, count)) != LISP_EVAL_OK)
+    return ret;
+  for(i = 0; i < count; i++)
+    if(args[i].type != LISP_STRING)
+      return LISP_EVAL_NOT_A_STRING;
+  return LISP_EVAL_OK;
+}
+
+// (string-length s), (string=? a b) and (string<? a b)
+static int lisp_eval_string_op(lisp_value v, int type, env_t* e) {
+  lisp_value args[2], n;
+  int ret;
+  if((ret = lisp_eval_strings(&v, e, args, type == LISP_STRING_LENGTH ? 1 : 2)) != LISP_EVAL_OK)
+    return ret;
+  switch(type) {
+    case LISP_STRING_LENGTH:
+      n.type = LISP_NUMBER;
+      n.u.n = (double)lisp_str_size(&args[0]);
+      break;
+    case LISP_STRING_EQ:
+      n.type = lisp_str_size(&args[0]) == lisp_str_size(&args[1])
+        && memcmp(lisp_str_data(&args[0]), lisp_str_data(&args[1]), lisp_str_size(&args[0])) == 0 ? LISP_TRUE : LISP_FALSE;
+      break;
+    default:
+      n.type = lisp_str_compare(&args[0], &args[1]) < 0 ? LISP_TRUE : LISP_FALSE;
+  }
+  PUTV(n);
+  return LISP_EVAL_OK;
+}
+
+// (string-append s ...)
+static int lisp_eval_string_append(lisp_value v, env_t* e) {
+  lisp_value *args, *r;
+  size_t i, size = 0, count = v.u.a.size - 1;
+  char* p;
+  int ret;
+  for(i = 1; i <= count; i++)
+    if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  args = (lisp_value*)eval_context_pop(&eval_stack, count*sizeof(lisp_value));
+  for(i = 0; i < count; i++) {
+    if(args[i].type != LISP_STRING)
+      return LISP_EVAL_NOT_A_STRING;
+    size += lisp_str_size(&args[i]);
+  }
+  r = lisp_string_new();
+  p = lisp_str_alloc(r, size);
+  for(i = 0; i < count; p += lisp_str_size(&args[i++]))
+    memcpy(p, lisp_str_data(&args[i]), lisp_str_size(&args[i]));
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (substring s start [end]): the bytes start .. end-1, shared with s.
+static int lisp_eval_substring(lisp_value v, env_t* e) {
+  lisp_value args[3], *r;
+  size_t size;
+  int ret;
+  if((ret = lisp_eval_operands(&v, e, args, v.u.a.size == 3 ? 2 : 3)) != LISP_EVAL_OK)
+    return ret;
+  if(args[0].type != LISP_STRING)
+    return LISP_EVAL_NOT_A_STRING;
+  size = lisp_str_size(&args[0]);
+  if(v.u.a.size == 3) {
+    args[2].type = LISP_NUMBER;
+    args[2].u.n = (double)size;
+  }
+  if(args[1].type != LISP_NUMBER || args[2].type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  if(!lisp_is_index(&args[2], (double)size + 1) || !lisp_is_index(&args[1], args[2].u.n + 1))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  r = lisp_string_new();
+  lisp_str_slice(r, &args[0], (size_t)args[1].u.n, (size_t)(args[2].u.n - args[1].u.n));
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (string-search s pattern [start]): the index of the first occurrence, or -1.
+static int lisp_eval_string_search(lisp_value v, env_t* e) {
+  lisp_value args[3], n;
+  size_t at;
+  int ret;
+  args[2].type = LISP_NUMBER;
+  args[2].u.n = 0;
+  if((ret = lisp_eval_operands(&v, e, args, v.u.a.size == 3 ? 2 : 3)) != LISP_EVAL_OK)
+    return ret;
+  if(args[0].type != LISP_STRING || args[1].type != LISP_STRING)
+    return LISP_EVAL_NOT_A_STRING;
+  if(args[2].type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  if(!lisp_is_index(&args[2], (double)lisp_str_size(&args[0]) + 1))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  at = lisp_str_search(&args[0], &args[1], (size_t)args[2].u.n);
+  n.type = LISP_NUMBER;
+  n.u.n = at == LISP_STR_NONE ? -1 : (double)at;
+  PUTV(n);
+  return LISP_EVAL_OK;
+}
+
+// (string->number s): the number s spells, false if it is not one. (number->string x)
+static int lisp_eval_string_number(lisp_value v, int type, env_t* e) {
+  lisp_value arg, *r;
+  char buf[64], *end;
+  size_t size;
+  int ret;
+  if((ret = lisp_eval_operands(&v, e, &arg, 1)) != LISP_EVAL_OK)
+    return ret;
+  if(type == LISP_NUMBER_TO_STRING) {
+    if(arg.type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
+    r = lisp_string_new();
+    lisp_str_make(r, buf, (size_t)sprintf(buf, "%.15g", arg.u.n));
+    PUTV(*r);
+    return LISP_EVAL_OK;
+  }
+  if(arg.type != LISP_STRING)
+    return LISP_EVAL_NOT_A_STRING;
+  size = lisp_str_size(&arg);
+  if(size != 0 && size < sizeof(buf))
+    memcpy(buf, lisp_str_data(&arg), size);
+  arg.type = LISP_FALSE;
+  if(size != 0 && size < sizeof(buf)) {
+    buf[size] = '\0';
+    arg.u.n = strtod(buf, &end);
+    if(end == buf + size && !isspace((unsigned char)buf[0]))
+      arg.type = LISP_NUMBER;
+  }
+  PUTV(arg);
+  return LISP_EVAL_OK;
+}
+
+/*
+ * tables, see table.h. the table operand is a number; a key given as
+ * (quote name) is the symbol name.
+ */
+static int lisp_eval_table_args(lisp_value* v, env_t* e, lisp_value* args, size_t count, lisp_table** t) {
+  int ret;
+  if((ret = lisp_eval_operands(v, e, args, count)) != LISP_EVAL_OK)
+    return ret;
+  if(args[0].type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  if((*t = lisp_table_lookup(e, args[0].u.n)) == NULL)
+    return LISP_EVAL_NOT_A_TABLE;
+  return LISP_EVAL_OK;
+}
+
+static lisp_value* lisp_table_key_arg(lisp_value* k) {
+  if(k->type == LISP_LIST && k->u.a.size == 2 && k->u.a.e[0].type == LISP_QUOTE)
+    k = &k->u.a.e[1];
+  switch(k->type) {
+    case LISP_NUMBER:
+    case LISP_SYMBOL:
+    case LISP_STRING:	return k;
+    default:	return NULL;
+  }
+}
+
+// a value out of a table: a string gets a reference of its own, a delete must not free it under the form.
+static void lisp_table_put(const lisp_value* x) {
+  lisp_value* r;
+  if(x->type != LISP_STRING) {
+    PUTV(*x);
+    return;
+  }
+  r = lisp_string_new();
+  lisp_str_ref(r, x);
+  PUTV(*r);
+}
+
+// (make-table), (table-size t) and (table-free t)
+static int lisp_eval_table(lisp_value v, int type, env_t* e) {
+  lisp_value arg, n;
+  lisp_table* t;
+  int ret;
+  if(type == LISP_MAKE_TABLE) {
+    if(v.u.a.size != 1)
+      return LISP_EVAL_ARITY_MISMATCH;
+    n.type = LISP_NUMBER;
+    n.u.n = lisp_table_register(e, lisp_table_new());
+  }
+  else {
+    if((ret = lisp_eval_table_args(&v, e, &arg, 1, &t)) != LISP_EVAL_OK)
+      return ret;
+    if(type == LISP_TABLE_SIZE) {
+      n.type = LISP_NUMBER;
+      n.u.n = (double)t->size;
+    }
+    else n.type = lisp_table_release(e, arg.u.n) ? LISP_TRUE : LISP_FALSE;
+  }
+  PUTV(n);
+  return LISP_EVAL_OK;
+}
+
+// (table-ref t k [default]), (table-set! t k x) and (table-delete! t k)
+static int lisp_eval_table_key(lisp_value v, int type, env_t* e) {
+  lisp_value args[3], *key, n;
+  const lisp_value* x;
+  lisp_table* t;
+  int ret;
+  args[2].type = LISP_FALSE;
+  if((ret = lisp_eval_table_args(&v, e, args, type == LISP_TABLE_SET || v.u.a.size == 4 ? 3 : 2, &t)) != LISP_EVAL_OK)
+    return ret;
+  if((key = lisp_table_key_arg(&args[1])) == NULL)
+    return LISP_EVAL_NOT_A_KEY;
+  switch(type) {
+    case LISP_TABLE_REF:
+      x = lisp_table_ref(t, key);
+      lisp_table_put(x != NULL ? x : &args[2]);
+      return LISP_EVAL_OK;
+    case LISP_TABLE_SET:
+      if((ret = lisp_table_set(t, key, &args[2])) != LISP_EVAL_OK)
+        return ret;
+      PUTV(args[2]);
+      return LISP_EVAL_OK;
+    default:
+      n.type = lisp_table_delete(t, key) ? LISP_TRUE : LISP_FALSE;
+      PUTV(n);
+      return LISP_EVAL_OK;
+  }
+}
+
+// (table-next t i), (table-key t i) and (table-value t i)
+static int lisp_eval_table_entry(lisp_value v, int type, env_t* e) {
+  lisp_value args[2], n, *r;
+  lisp_table_entry* entry;
+  lisp_table* t;
+  size_t i;
+  int ret;
+  if((ret = lisp_eval_table_args(&v, e, args, 2, &t)) != LISP_EVAL_OK)
+    return ret;
+  if(!lisp_is_index(&args[1], (double)(size_t)-1))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  i = (size_t)args[1].u.n;
+  if(type == LISP_TABLE_NEXT) {
+    i = lisp_table_next(t, i);
+    n.type = LISP_NUMBER;
+    n.u.n = i == LISP_TABLE_END ? -1 : (double)i;
+    PUTV(n);
+    return LISP_EVAL_OK;
+  }
+  if(lisp_table_next(t, i) != i)
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;    // past the entries, or a deleted one
+  entry = &t->entries[i];
+  if(type == LISP_TABLE_VALUE)
+    lisp_table_put(&entry->value);
+  else if(!lisp_table_key_is_symbol(entry))
+    lisp_table_put(&entry->key);
+  else {
+    r = (lisp_value*)malloc(sizeof(lisp_value));
+    r->type = LISP_SYMBOL;
+    r->u.sym.size = lisp_str_size(&entry->key);
+    r->u.sym.s = (char*)malloc(r->u.sym.size + 1);
+    memcpy(r->u.sym.s, lisp_str_data(&entry->key), r->u.sym.size);
+    r->u.sym.s[r->u.sym.size] = '\0';
+    r->u.sym.ic = NULL;
+    LINKTO(r);
+    PUTV(*r);
+  }
+  return LISP_EVAL_OK;
+}
+
+/*
+ * lists: the library forms work on the element arrays of the quoted lists car
+ * and cdr walk, and make their lists as temporaries like cdr does.
+ *   (length l) (reverse l) (append l ...)
+ *   (map f l) (filter f l)        f of each element, the elements f is true of
+ *   (fold f init l)               (f x acc) over the elements from the left
+ * f is applied the way a call of it is, to values rather than expressions. the
+ * map and filter forms of a list operand run in the same pass over the list the
+ * innermost one starts from, an element at a time, no list is made in between.
+ * they take streams too, see below.
+ */
+#define LISP_LIST_STAGES	8    // map and filter forms fused into one pass, the rest make their lists
+
+typedef struct lisp_list_fn lisp_list_fn;
+struct lisp_list_fn {
+  lisp_value* lambda;    // where f lives, NULL if it was made at run time
+  lisp_value fn, head;    // head: the symbol f was named by, LISP_LAMBDA if none
+  int type;    // the stage of a pipeline: LISP_MAP or LISP_FILTER
+};
+
+typedef struct lisp_list_pipeline lisp_list_pipeline;
+struct lisp_list_pipeline {
+  lisp_list_fn stages[LISP_LIST_STAGES];    // outermost first
+  size_t count;
+  lisp_value list;    // the elements of the list they start from
+  lisp_value stream;    // or a copy of the stream cell they start from, LISP_NULL if it is a list
+};
+
+// the elements of a list value, (quote (...)).
+static int lisp_list_of(const lisp_value* x, lisp_value* list) {
+  if(x->type != LISP_LIST || x->u.a.size != 2 || x->u.a.e[0].type != LISP_QUOTE || x->u.a.e[1].type != LISP_LIST)
+    return LISP_EVAL_NOT_A_LIST;
+  *list = x->u.a.e[1];
+  return LISP_EVAL_OK;
+}
+
+// an element as a value: a list in a list is quoted, the way car gives it.
+static lisp_value lisp_list_element(lisp_value* x, lisp_value* quoted) {
+  lisp_value v;
+  if(x->type != LISP_LIST)
+    return *x;
+  quoted[0].type = LISP_QUOTE;
+  quoted[1] = *x;
+  v.type = LISP_LIST;
+  v.u.a.e = quoted;
+  v.u.a.size = 2;
+  return v;
+}
+
+// a value as an element of a list the forms make, unquoted.
+static void lisp_list_store(lisp_value* dst, const lisp_value* x) {
+  if(x->type == LISP_LIST && x->u.a.size == 2 && x->u.a.e[0].type == LISP_QUOTE)
+    x = &x->u.a.e[1];
+  lisp_value_copy(dst, x);
+}
+
+static void lisp_list_free(lisp_value* elements, size_t size) {
+  size_t i;
+  for(i = 0; i < size; i++)
+    lisp_value_free(&elements[i]);
+  free(elements);
+}
+
+// r becomes (quote (elements)), which takes the elements over.
+static void lisp_list_make(lisp_value* r, lisp_value* elements, size_t size) {
+  r->type = LISP_LIST;
+  r->u.a.size = 2;
+  r->u.a.e = (lisp_value*)malloc(2 * sizeof(lisp_value));
+  r->u.a.e[0].type = LISP_QUOTE;
+  r->u.a.e[1].type = LISP_LIST;
+  r->u.a.e[1].u.a.size = size;
+  r->u.a.e[1].u.a.e = size != 0 ? elements : NULL;
+  if(size == 0)
+    free(elements);
+}
+
+// (quote (elements)) as the value of the form.
+static void lisp_list_put(lisp_value* elements, size_t size) {
+  lisp_value* r = (lisp_value*)malloc(sizeof(lisp_value));
+  lisp_list_make(r, elements, size);
+  LINKTO(r);
+  PUTV(*r);
+}
+
+// f of arity parameters. a named one or a lambda in the code is applied where
+// it lives, as a call of it would be: the inline cache, the profiler and the
+// jit see the same lambda.
+static int lisp_list_fn_eval(lisp_value* x, size_t arity, env_t* e, lisp_list_fn* f) {
+  int ret;
+  f->lambda = NULL;
+  f->head.type = LISP_LAMBDA;
+  if(x->type == LISP_SYMBOL) {
+    if((f->lambda = lisp_env_lookup(e, x)) == NULL)
+      return LISP_EVAL_VARIABLE_NOT_FOUND;
+    f->head = *x;
+    f->fn = *f->lambda;
+  }
+  else if(lisp_is_lambda(x))
+    f->fn = *(f->lambda = x);
+  else if(x->type != LISP_LIST)
+    return LISP_EVAL_NOT_A_FUNCTION;    // car and the other forms are not values
+  else {
+    if((ret = lisp_eval_value(*x, e)) != LISP_EVAL_OK)
+      return ret;
+    f->fn = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  }
+  if(f->fn.type == LISP_NATIVE)
+    return f->fn.u.native.arity == arity ? LISP_EVAL_OK : LISP_EVAL_ARITY_MISMATCH;
+  if(!lisp_is_lambda(&f->fn))
+    return LISP_EVAL_NOT_A_FUNCTION;
+  return lisp_get_list_size(&f->fn.u.a.e[1]) == arity ? LISP_EVAL_OK : LISP_EVAL_ARITY_MISMATCH;
+}
+
+// (f x ...) of values, its result left on the eval stack. a symbol is bound
+// quoted, bare it would be looked up.
+static int lisp_list_apply(lisp_list_fn* f, const lisp_value* args, size_t count, env_t* e) {
+  lisp_value call[3], quoted[2][2], v;
+  size_t i;
+  assert(count <= 2);
+  call[0] = f->head;
+  for(i = 0; i < count; i++) {
+    if(args[i].type != LISP_SYMBOL) {
+      call[i+1] = args[i];
+      continue;
+    }
+    quoted[i][0].type = LISP_QUOTE;
+    quoted[i][1] = args[i];
+    call[i+1].type = LISP_LIST;
+    call[i+1].u.a.e = quoted[i];
+    call[i+1].u.a.size = 2;
+  }
+  v.type = LISP_LIST;
+  v.u.a.e = call;
+  v.u.a.size = count + 1;
+  if(f->lambda != NULL)
+    return f->head.type == LISP_SYMBOL ? lisp_apply(f->lambda, v, e) : lisp_apply_lambda(f->lambda, v, e);
+  if(f->fn.type == LISP_NATIVE)
+    return lisp_apply_c(&f->fn, v, e);
+  // nothing the jit could keep a pointer to, it goes like ((lambda ...) x).
+  PUTV(f->fn);
+  return lisp_eval_lambda(cdr0(v), e);
+}
+
+// x through the stages, innermost first. kept is 0 if a filter drops it.
+static int lisp_list_stages(lisp_list_fn* stages, size_t count, lisp_value* x, int* kept, env_t* e) {
+  lisp_value r;
+  int ret;
+  for(*kept = 1; *kept && count-- > 0; ) {
+    if((ret = lisp_list_apply(&stages[count], x, 1, e)) != LISP_EVAL_OK)
+      return ret;
+    r = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+    if(stages[count].type == LISP_MAP)
+      *x = r;
+    else *kept = r.type == LISP_TRUE;
+  }
+  return LISP_EVAL_OK;
+}
+
+/*
+ * streams: the promises of promise.h are forced here. a delay keeps copies of
+ * the parameters its code uses, with dynamic scoping they would be gone or
+ * bound to something else by the time it is forced; its other symbols are
+ * looked up then. map and filter of a stream run their stages a cell at a
+ * time, as the cells are forced.
+ */
+static int lisp_promise_force(lisp_promise* p, env_t* e);
+
+// a stream value: a cell, or an empty list where it ends.
+static int lisp_is_stream(const lisp_value* x) {
+  lisp_value list;
+  return lisp_promise_tail(x) != NULL || (lisp_list_of(x, &list) == LISP_EVAL_OK && list.u.a.size == 0);
+}
+
+// the parameters v uses are bound for p to what they are now.
+static void lisp_promise_capture(lisp_promise* p, lisp_value* v, env_t* e) {
+  lisp_promise_binding* b;
+  lisp_value* x;
+  size_t i;
+  if(v->type == LISP_SYMBOL) {
+    if(e->shadow[LISP_SHADOW_BUCKET(v)] == 0 || (x = lisp_env_lookup(e, v)) == NULL)
+      return;
+    for(i = 0; i < p->count; i++)
+      if(lisp_cmp_symbol(v, p->bindings[i].symbol) == 0)
+        return;
+    p->bindings = (lisp_promise_binding*)realloc(p->bindings, (p->count + 1) * sizeof(lisp_promise_binding));
+    b = &p->bindings[p->count++];
+    b->symbol = v;
+    // a lambda in a box may go with its binding before p is forced, it is copied.
+    b->lambda = (lisp_is_lambda(x) && !lisp_is_box(x)) || x->type == LISP_LET ? x : NULL;
+    if(b->lambda == NULL)
+      lisp_value_copy(&b->value, x);
+    else b->value.type = LISP_NULL;
+    if(x->type == LISP_LET)
+      lisp_promise_capture(p, &x[3], e);    // a call of the name runs its body again
+    return;
+  }
+  if(v->type != LISP_LIST || v->u.a.size == 0 || v->u.a.e[0].type == LISP_QUOTE)
+    return;
+  for(i = 0; i < v->u.a.size; i++)
+    lisp_promise_capture(p, &v->u.a.e[i], e);
+}
+
+// r becomes a promise of code.
+static void lisp_promise_delay(lisp_value* r, lisp_value* code, env_t* e) {
+  lisp_promise* p = lisp_promise_new(r, LISP_PROMISE_CODE);
+  p->code = code;
+  lisp_promise_capture(p, code, e);
+}
+
+// the value of the code of p, with its parameters bound again.
+static int lisp_promise_eval(lisp_promise* p, lisp_value* out, env_t* e) {
+  lisp_value_pair* pairs = (lisp_value_pair*)lisp_env_push(e, p->count * sizeof(lisp_value_pair));
+  size_t i;
+  int ret;
+  for(i = 0; i < p->count; i++) {
+    pairs[i].symbol = p->bindings[i].symbol;
+    pairs[i].value = p->bindings[i].lambda != NULL ? p->bindings[i].lambda : &p->bindings[i].value;
+    e->shadow[LISP_SHADOW_BUCKET(pairs[i].symbol)]++;
+  }
+  if((ret = lisp_eval_value(*p->code, e)) != LISP_EVAL_OK)
+    return ret;
+  lisp_env_leave(e, p->count);
+  lisp_value_copy(out, (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value)));
+  return LISP_EVAL_OK;
+}
+
+// a copy of the cell s starts with, s being a cell or a promise of one.
+static int lisp_stream_resolve(const lisp_value* s, lisp_value* cell, env_t* e) {
+  int ret;
+  if(s->type == LISP_PROMISE) {
+    if((ret = lisp_promise_force(s->u.promise.p, e)) != LISP_EVAL_OK)
+      return ret;
+    s = &s->u.promise.p->value;
+  }
+  if(!lisp_is_stream(s))
+    return LISP_EVAL_NOT_A_STREAM;
+  lisp_value_copy(cell, s);
+  return LISP_EVAL_OK;
+}
+
+// cell becomes the one after it. the rest is not copied, only the next cell.
+static int lisp_stream_step(lisp_value* cell, env_t* e) {
+  lisp_value next;
+  int ret;
+  if((ret = lisp_stream_resolve(&cell->u.a.e[1].u.a.e[1], &next, e)) != LISP_EVAL_OK)
+    return ret;
+  lisp_value_free(cell);
+  *cell = next;
+  return LISP_EVAL_OK;
+}
+
+// out becomes the first cell of the stages over the stream from cell on, the
+// rest of it a promise of the stages over the rest. cell is taken over. the
+// temporaries of the elements filtered out are released as it goes.
+static int lisp_stream_pipe(lisp_list_fn* stages, size_t count, lisp_value* cell, lisp_value* out, env_t* e) {
+  lisp_value x, quoted[2], *elements;
+  size_t mark = eval_tmp_variables.top;
+  lisp_promise* p;
+  int ret, kept;
+  for(;;) {
+    if(lisp_promise_tail(cell) == NULL) {
+      lisp_value_free(cell);
+      lisp_list_make(out, NULL, 0);
+      return LISP_EVAL_OK;
+    }
+    x = lisp_list_element(&cell->u.a.e[1].u.a.e[0], quoted);
+    if((ret = lisp_list_stages(stages, count, &x, &kept, e)) != LISP_EVAL_OK
+        || (!kept && (ret = lisp_stream_step(cell, e)) != LISP_EVAL_OK)) {
+      lisp_value_free(cell);
+      return ret;
+    }
+    if(kept)
+      break;
+    lisp_drop_tmp_variables(mark);
+  }
+  elements = (lisp_value*)malloc(2 * sizeof(lisp_value));
+  lisp_list_store(&elements[0], &x);
+  p = lisp_promise_new(&elements[1], LISP_PROMISE_PIPE);
+  p->stages = malloc(count * sizeof(lisp_list_fn));
+  memcpy(p->stages, stages, count * sizeof(lisp_list_fn));
+  p->count = count;
+  p->value = cell->u.a.e[1].u.a.e[1];    // the promise of the rest goes over to p
+  cell->u.a.e[1].u.a.e[1].type = LISP_NULL;
+  lisp_value_free(cell);
+  lisp_list_make(out, elements, 2);
+  lisp_drop_tmp_variables(mark);
+  return LISP_EVAL_OK;
+}
+
+// out becomes the first n elements of the stream from cell on, which is taken over.
+static void lisp_stream_take(size_t n, lisp_value* cell, lisp_value* out) {
+  lisp_value* elements = NULL;
+  lisp_promise* p;
+  if(n != 0 && lisp_promise_tail(cell) != NULL) {
+    elements = (lisp_value*)malloc(2 * sizeof(lisp_value));
+    elements[0] = cell->u.a.e[1].u.a.e[0];
+    p = lisp_promise_new(&elements[1], LISP_PROMISE_TAKE);
+    p->count = n - 1;
+    p->value = cell->u.a.e[1].u.a.e[1];
+    cell->u.a.e[1].u.a.e[0].type = cell->u.a.e[1].u.a.e[1].type = LISP_NULL;
+  }
+  lisp_value_free(cell);
+  lisp_list_make(out, elements, elements != NULL ? 2 : 0);
+}
+
+static int lisp_promise_force(lisp_promise* p, env_t* e) {
+  lisp_value cell, out;
+  int ret, kind = p->kind;
+  switch(kind) {
+    case LISP_PROMISE_DONE:	return LISP_EVAL_OK;
+    case LISP_PROMISE_FORCING:	return LISP_EVAL_PROMISE_ERROR;
+  }
+  p->kind = LISP_PROMISE_FORCING;
+  if(kind == LISP_PROMISE_CODE)
+    ret = lisp_promise_eval(p, &out, e);
+  else if(kind == LISP_PROMISE_TAKE && p->count == 0) {
+    lisp_list_make(&out, NULL, 0);    // what it was taken from is not forced any further
+    ret = LISP_EVAL_OK;
+  }
+  else if((ret = lisp_stream_resolve(&p->value, &cell, e)) == LISP_EVAL_OK) {
+    if(kind == LISP_PROMISE_PIPE)
+      ret = lisp_stream_pipe((lisp_list_fn*)p->stages, p->count, &cell, &out, e);
+    else lisp_stream_take(p->count, &cell, &out);
+  }
+  if(ret != LISP_EVAL_OK) {
+    p->kind = kind;
+    return ret;
+  }
+  lisp_promise_done(p, &out);
+  return LISP_EVAL_OK;
+}
+
+// a forced value as the value of the form. the promise keeps its own, a list or
+// a vector is copied to a temporary.
+static void lisp_promise_put(const lisp_value* x) {
+  lisp_value* r;
+  if(x->type != LISP_LIST && x->type != LISP_VECTOR) {
+    PUTV(*x);
+    return;
+  }
+  r = (lisp_value*)malloc(sizeof(lisp_value));
+  lisp_value_copy(r, x);
+  LINKTO(r);
+  PUTV(*r);
+}
+
+// (delay x)
+static int lisp_eval_delay(lisp_value v, env_t* e) {
+  lisp_value* r;
+  if(v.u.a.size != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  r = (lisp_value*)malloc(sizeof(lisp_value));
+  lisp_promise_delay(r, &v.u.a.e[1], e);
+  LINKTO(r);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (force p), anything but a promise is its own value.
+static int lisp_eval_force(lisp_value v, env_t* e) {
+  lisp_value x;
+  int ret;
+  if(v.u.a.size != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_value(v.u.a.e[1], e)) != LISP_EVAL_OK)
+    return ret;
+  x = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if(x.type != LISP_PROMISE) {
+    PUTV(x);
+    return LISP_EVAL_OK;
+  }
+  if((ret = lisp_promise_force(x.u.promise.p, e)) != LISP_EVAL_OK)
+    return ret;
+  lisp_promise_put(&x.u.promise.p->value);
+  return LISP_EVAL_OK;
+}
+
+// (stream-cons x y)
+static int lisp_eval_stream_cons(lisp_value v, env_t* e) {
+  lisp_value* elements;
+  int ret;
+  if(v.u.a.size != 3)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_value(v.u.a.e[1], e)) != LISP_EVAL_OK)
+    return ret;
+  elements = (lisp_value*)malloc(2 * sizeof(lisp_value));
+  lisp_list_store(&elements[0], (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value)));
+  lisp_promise_delay(&elements[1], &v.u.a.e[2], e);
+  lisp_list_put(elements, 2);
+  return LISP_EVAL_OK;
+}
+
+// (stream-car s) and (stream-cdr s)
+static int lisp_eval_stream_access(lisp_value v, int type, env_t* e) {
+  lisp_value *x, head, quoted[2], *r;
+  lisp_promise* p;
+  int ret;
+  if(v.u.a.size != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_value(v.u.a.e[1], e)) != LISP_EVAL_OK)
+    return ret;
+  x = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if((p = lisp_promise_tail(x)) == NULL)
+    return LISP_EVAL_NOT_A_STREAM;
+  if(type == LISP_STREAM_CDR) {
+    if((ret = lisp_promise_force(p, e)) != LISP_EVAL_OK)
+      return ret;
+    if(!lisp_is_stream(&p->value))
+      return LISP_EVAL_NOT_A_STREAM;
+    lisp_promise_put(&p->value);
+    return LISP_EVAL_OK;
+  }
+  head = x->u.a.e[1].u.a.e[0];
+  if(head.type != LISP_LIST) {
+    PUTV(head);
+    return LISP_EVAL_OK;
+  }
+  head = lisp_list_element(&head, quoted);    // a list in it is given quoted, as car gives it
+  r = (lisp_value*)malloc(sizeof(lisp_value));
+  lisp_value_copy(r, &head);
+  LINKTO(r);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (stream-take n s)
+static int lisp_eval_stream_take(lisp_value v, env_t* e) {
+  lisp_value *x, cell, *r;
+  size_t mark;
+  double n;
+  int ret;
+  if(v.u.a.size != 3)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_eval_value(v.u.a.e[1], e)) != LISP_EVAL_OK)
+    return ret;
+  x = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if(x->type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  if(!((n = x->u.n) >= 0))
+    return LISP_EVAL_INDEX_OUT_OF_RANGE;
+  mark = eval_tmp_variables.top;
+  if((ret = lisp_eval_value(v.u.a.e[2], e)) != LISP_EVAL_OK)
+    return ret;
+  x = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if(!lisp_is_stream(x))
+    return LISP_EVAL_NOT_A_STREAM;
+  lisp_value_copy(&cell, x);
+  lisp_drop_tmp_variables(mark);    // the copy holds the stream, what it was reached through can go
+  r = (lisp_value*)malloc(sizeof(lisp_value));
+  lisp_stream_take((size_t)n, &cell, r);
+  LINKTO(r);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// the map and filter forms from v inwards, their functions evaluated in that
+// order, then the list or the stream the innermost one works on.
+static int lisp_list_pipeline_eval(lisp_value* v, lisp_list_pipeline* p, env_t* e) {
+  lisp_value* x;
+  size_t mark;
+  int ret;
+  p->stream.type = LISP_NULL;
+  for(p->count = 0; p->count < LISP_LIST_STAGES && v->type == LISP_LIST && v->u.a.size != 0
+      && (v->u.a.e[0].type == LISP_MAP || v->u.a.e[0].type == LISP_FILTER); p->count++) {
+    if(v->u.a.size != 3)
+      return LISP_EVAL_ARITY_MISMATCH;
+    p->stages[p->count].type = v->u.a.e[0].type;
+    if((ret = lisp_list_fn_eval(&v->u.a.e[1], 1, e, &p->stages[p->count])) != LISP_EVAL_OK)
+      return ret;
+    v = &v->u.a.e[2];
+  }
+  mark = eval_tmp_variables.top;
+  if((ret = lisp_eval_value(*v, e)) != LISP_EVAL_OK)
+    return ret;
+  x = (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  if(lisp_promise_tail(x) == NULL)
+    return lisp_list_of(x, &p->list);
+  p->list.u.a.size = 0;
+  lisp_value_copy(&p->stream, x);
+  lisp_drop_tmp_variables(mark);    // the copy holds the stream, what it was reached through can go
+  return LISP_EVAL_OK;
+}
+
+// element i of what a pipeline starts from, NULL past its end. a stream is
+// walked by lisp_list_pipeline_run, its element is the one of the cell it holds.
+static lisp_value* lisp_list_pipeline_at(lisp_list_pipeline* p, size_t i) {
+  if(p->stream.type == LISP_NULL)
+    return i < p->list.u.a.size ? &p->list.u.a.e[i] : NULL;
+  return lisp_promise_tail(&p->stream) != NULL ? &p->stream.u.a.e[1].u.a.e[0] : NULL;
+}
+
+// every element through the stages, innermost first. what passes the filters
+// goes to the consumer: LISP_MAP stores it to out, LISP_LENGTH only counts it
+// and LISP_FOLD folds it into acc with f. the temporaries of an element are
+// released once it is consumed, acc holds a copy of its own; so are the cells
+// of a stream, unless something else holds them.
+static int lisp_list_pipeline_run(lisp_list_pipeline* p, int consumer, lisp_list_fn* f, lisp_value* acc, lisp_value* out, size_t* size, env_t* e) {
+  lisp_value x, r, args[2], quoted[2], *y;
+  size_t i, mark = eval_tmp_variables.top;
+  int ret, kept;
+  *size = 0;
+  for(i = 0; (y = lisp_list_pipeline_at(p, i)) != NULL; i++) {
+    x = lisp_list_element(y, quoted);
+    if((ret = lisp_list_stages(p->stages, p->count, &x, &kept, e)) != LISP_EVAL_OK)
+      return ret;
+    if(kept && consumer == LISP_MAP)
+      lisp_list_store(&out[(*size)++], &x);
+    else if(kept && consumer == LISP_LENGTH)
+      (*size)++;
+    else if(kept) {
+      args[0] = x;
+      args[1] = *acc;
+      if((ret = lisp_list_apply(f, args, 2, e)) != LISP_EVAL_OK)
+        return ret;
+      lisp_value_copy(&r, (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value)));
+      lisp_value_free(acc);    // after the copy, the result may be acc itself
+      *acc = r;
+    }
+    if(p->stream.type != LISP_NULL && (ret = lisp_stream_step(&p->stream, e)) != LISP_EVAL_OK)
+      return ret;
+    lisp_drop_tmp_variables(mark);
+  }
+  return LISP_EVAL_OK;
+}
+
+// (map f l) and (filter f l), of a stream a stream
+static int lisp_eval_list_map(lisp_value v, env_t* e) {
+  lisp_list_pipeline p;
+  lisp_value *out, *r;
+  size_t size;
+  int ret;
+  if((ret = lisp_list_pipeline_eval(&v, &p, e)) != LISP_EVAL_OK)
+    return ret;
+  if(p.stream.type != LISP_NULL) {
+    r = (lisp_value*)malloc(sizeof(lisp_value));
+    if((ret = lisp_stream_pipe(p.stages, p.count, &p.stream, r, e)) != LISP_EVAL_OK) {
+      free(r);
+      return ret;
+    }
+    LINKTO(r);
+    PUTV(*r);
+    return LISP_EVAL_OK;
+  }
+  out = (lisp_value*)malloc((p.list.u.a.size + 1) * sizeof(lisp_value));
+  if((ret = lisp_list_pipeline_run(&p, LISP_MAP, NULL, NULL, out, &size, e)) != LISP_EVAL_OK) {
+    lisp_list_free(out, size);
+    return ret;
+  }
+  if(size < p.list.u.a.size)
+    out = (lisp_value*)realloc(out, (size + 1) * sizeof(lisp_value));
+  lisp_list_put(out, size);
+  return LISP_EVAL_OK;
+}
+
+// (length l)
+static int lisp_eval_list_length(lisp_value v, env_t* e) {
+  lisp_list_pipeline p;
+  lisp_value n;
+  size_t size;
+  int ret;
+  if(v.u.a.size != 2)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_list_pipeline_eval(&v.u.a.e[1], &p, e)) != LISP_EVAL_OK)
+    return ret;
+  if(p.count == 0 && p.stream.type == LISP_NULL)
+    size = p.list.u.a.size;
+  else ret = lisp_list_pipeline_run(&p, LISP_LENGTH, NULL, NULL, NULL, &size, e);
+  lisp_value_free(&p.stream);
+  if(ret != LISP_EVAL_OK)
+    return ret;
+  n.type = LISP_NUMBER;
+  n.u.n = (double)size;
+  PUTV(n);
+  return LISP_EVAL_OK;
+}
+
+// (fold f init l)
+static int lisp_eval_list_fold(lisp_value v, env_t* e) {
+  lisp_list_pipeline p;
+  lisp_list_fn f;
+  lisp_value acc, *r;
+  size_t size;
+  int ret;
+  if(v.u.a.size != 4)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if((ret = lisp_list_fn_eval(&v.u.a.e[1], 2, e, &f)) != LISP_EVAL_OK)
+    return ret;
+  if((ret = lisp_eval_value(v.u.a.e[2], e)) != LISP_EVAL_OK)
+    return ret;
+  lisp_value_copy(&acc, (lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value)));
+  if((ret = lisp_list_pipeline_eval(&v.u.a.e[3], &p, e)) == LISP_EVAL_OK) {
+    ret = lisp_list_pipeline_run(&p, LISP_FOLD, &f, &acc, NULL, &size, e);
+    lisp_value_free(&p.stream);
+  }
+  if(ret != LISP_EVAL_OK) {
+    lisp_value_free(&acc);
+    return ret;
+  }
+  switch(acc.type) {
+    case LISP_NUMBER:
+    case LISP_TRUE:
+    case LISP_FALSE:
+    case LISP_NIL:	PUTV(acc); return LISP_EVAL_OK;
+  }
+  r = (lisp_value*)malloc(sizeof(lisp_value));    // a temporary, as if a form had made it
+  *r = acc;
+  LINKTO(r);
+  PUTV(*r);
+  return LISP_EVAL_OK;
+}
+
+// (append l ...) and (reverse l)
+static int lisp_eval_list_copy(lisp_value v, int type, env_t* e) {
+  lisp_value *args, list, *out;
+  size_t i, j, size = 0, count = v.u.a.size - 1;
+  int ret;
+  if(type == LISP_REVERSE && count != 1)
+    return LISP_EVAL_ARITY_MISMATCH;
+  for(i = 1; i <= count; i++)
+    if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  args = (lisp_value*)eval_context_pop(&eval_stack, count*sizeof(lisp_value));
+  for(i = 0; i < count; i++) {
+    if((ret = lisp_list_of(&args[i], &list)) != LISP_EVAL_OK)
+      return ret;
+    size += list.u.a.size;
+  }
+  out = (lisp_value*)malloc((size + 1) * sizeof(lisp_value));
+  for(i = 0, size = 0; i < count; i++) {
+    lisp_list_of(&args[i], &list);
+    for(j = 0; j < list.u.a.size; j++, size++)
+      lisp_value_copy(&out[size], &list.u.a.e[type == LISP_REVERSE ? list.u.a.size - 1 - j : j]);
+  }
+  lisp_list_put(out, size);
+  return LISP_EVAL_OK;
+}
+
+/*
+ * set!, let and do. (set! x v) binds x, where it is looked up, to v in place and
+ * v is its value. (let ((x v) ...) body) binds x to v for body, and
+ * (let name ((x v) ...) body) binds name too: a call of name where body ends,
+ * in a branch of an if, binds x to its arguments and evaluates body again, in a
+ * loop, without a frame of its own. a call anywhere else enters the loop again,
+ * like the call of a lambda would. (do ((x v step) ...) (test r ...) body ...)
+ * evaluates body until test is true, then r ..., the last is the value; each
+ * x is bound to its step once all steps are evaluated. the temporaries of an
+ * iteration are dropped before the next one, a loop runs in as much memory
+ * for any count of them.
+ */
+
+// (x v), or (x v step) for size 3.
+static int lisp_loop_bindings_ok(const lisp_value* bindings, size_t size) {
+  const lisp_value* b;
+  size_t i;
+  if(bindings->type != LISP_LIST)
+    return 0;
+  for(i = 0; i < bindings->u.a.size; i++) {
+    b = &bindings->u.a.e[i];
+    if(b->type != LISP_LIST || b->u.a.size < 2 || b->u.a.size > size || b->u.a.e[0].type != LISP_SYMBOL)
+      return 0;
+  }
+  return 1;
+}
+
+// the env and the index of the binding symbol is looked up to, NULL if there is none.
+static env_t* lisp_env_binding(env_t* e, lisp_value* symbol, size_t* pair) {
+  size_t i;
+  for(; e != NULL; e = e->prev) {
+    for(i = e->s.top/sizeof(lisp_value_pair); i-- > 0; ) {
+      if(lisp_cmp_symbol(symbol, e->s.p[i].symbol) == 0) {
+        *pair = i;
+        return e;
+      }
+    }
+  }
+  return NULL;
+}
+
+static int lisp_is_function(const lisp_value* v) {
+  return lisp_is_lambda(v) || v->type == LISP_NATIVE;
+}
+
+// binding pair of e is bound to a copy of x. the old value may still be used by
+// the form around the set!, it goes to the temporaries; a lambda being applied
+// stays in its box and the binding gets a new one, the box goes with the binding.
+static void lisp_binding_set(env_t* e, size_t pair, const lisp_value* x) {
+  lisp_value *slot = e->s.p[pair].value, *old;
+  int function = lisp_is_function(slot);
+  if(!lisp_is_box(slot) || (lisp_is_lambda(slot) && slot->u.a.e[0].u.fn.running != 0))
+    slot = lisp_box_new(e, pair);
+  else if(slot->type != LISP_NUMBER && slot->type != LISP_TRUE && slot->type != LISP_FALSE) {
+    old = (lisp_value*)malloc(sizeof(lisp_value));
+    *old = *slot;
+    LINKTO(old);
+  }
+  lisp_value_copy(slot, x);
+  if(function || lisp_is_function(slot)) {
+    // calls of it are cached, compiled or inlined.
+    e->version = ++lisp_env_versions;
+    lisp_inline_detach(e, pair);
+    lisp_inline_invalidate(e, e->s.p[pair].symbol);
+  }
+}
+
+// (set! x v)
+static int lisp_eval_set(lisp_value v, env_t* e) {
+  lisp_value x;
+  size_t pair;
+  env_t* s;
+  int ret;
+  if(v.u.a.size != 3)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if(v.u.a.e[1].type != LISP_SYMBOL)
+    return LISP_EVAL_INVALID_VALUE;
+  if((ret = lisp_eval_value(v.u.a.e[2], e)) != LISP_EVAL_OK)
+    return ret;
+  if((s = lisp_env_binding(e, &v.u.a.e[1], &pair)) == NULL)
+    return LISP_EVAL_VARIABLE_NOT_FOUND;
+  x = *(lisp_value*)(eval_stack.stack + eval_stack.top - sizeof(lisp_value));    // it stays there as the value
+  lisp_binding_set(s, pair, &x);
+  return LISP_EVAL_OK;
+}
+
+// binds name, if there is one, to the let form and the variables of bindings
+// to boxes of the values on the eval stack from top, which are popped along
+// with the temporaries since mark. returns how many bindings there are.
+static size_t lisp_loop_enter(env_t* e, lisp_value* form, lisp_value* name, lisp_value* bindings, size_t top, size_t mark) {
+  size_t i, count = bindings->u.a.size + (name != NULL), pair = e->s.top/sizeof(lisp_value_pair);
+  lisp_value* x = (lisp_value*)(eval_stack.stack + top);
+  lisp_value_pair* p = (lisp_value_pair*)lisp_env_push(e, count * sizeof(lisp_value_pair));
+  if(name != NULL) {
+    p[0].symbol = name;
+    p[0].value = form;
+  }
+  for(i = 0; i < bindings->u.a.size; i++) {
+    p[count - bindings->u.a.size + i].symbol = &bindings->u.a.e[i].u.a.e[0];
+    lisp_value_copy(lisp_box_new(e, pair + count - bindings->u.a.size + i), &x[i]);
+  }
+  for(i = 0; i < count; i++)
+    e->shadow[LISP_SHADOW_BUCKET(p[i].symbol)]++;
+  eval_stack.top = top;
+  lisp_drop_tmp_variables(mark);
+  return count;
+}
+
+// the variables from binding pair of e on, those with a step if stepped, are
+// bound to the values on the eval stack from top. they are all copied first,
+// one may be in the box of another.
+static void lisp_loop_update(env_t* e, size_t pair, lisp_value* bindings, int stepped, size_t top) {
+  lisp_value *x = (lisp_value*)(eval_stack.stack + top), copy, *slot;
+  size_t i, j, count = (eval_stack.top - top)/sizeof(lisp_value);
+  for(j = 0; j < count; j++) {
+    lisp_value_copy(&copy, &x[j]);
+    x[j] = copy;
+  }
+  for(i = j = 0; i < bindings->u.a.size; i++) {
+    if(stepped && bindings->u.a.e[i].u.a.size != 3)
+      continue;
+    slot = e->s.p[pair + i].value;
+    lisp_value_free(slot);
+    *slot = x[j++];
+  }
+  eval_stack.top = top;
+}
+
+// the boxes of the count bindings of a loop go, its value on the eval stack is
+// copied to a temporary if it has storage that may be in one of them.
+static void lisp_loop_leave(env_t* e, size_t count) {
+  lisp_value x = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value)), *r;
+  if(x.type == LISP_NUMBER || x.type == LISP_TRUE || x.type == LISP_FALSE)
+    PUTV(x);
+  else {
+    r = (lisp_value*)malloc(sizeof(lisp_value));
+    lisp_value_copy(r, &x);
+    LINKTO(r);
+    PUTV(*r);
+  }
+  lisp_env_leave(e, count);
+}
+
+// the body of a named let where it ends. a call of name there binds the
+// variables to its arguments and sets again, anything else is the value.
+static int lisp_loop_tail(lisp_value* x, lisp_value* name, lisp_value* bindings, env_t* e, size_t pair, int* again) {
+  size_t i, top = eval_stack.top;
+  int ret, truth;
+  while(x->type == LISP_LIST && x->u.a.size == 4 && x->u.a.e[0].type == LISP_IF) {
+    if((ret = lisp_eval_truth(&x->u.a.e[1], e, &truth)) != LISP_EVAL_OK)
+      return ret;
+    x = &x->u.a.e[truth ? 2 : 3];
+  }
+  if(x->type != LISP_LIST || x->u.a.size == 0 || x->u.a.e[0].type != LISP_SYMBOL || lisp_cmp_symbol(&x->u.a.e[0], name) != 0)
+    return lisp_eval_value(*x, e);
+  if(x->u.a.size - 1 != bindings->u.a.size)
+    return LISP_EVAL_ARITY_MISMATCH;
+  for(i = 1; i < x->u.a.size; i++)
+    if((ret = lisp_eval_value(x->u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  lisp_loop_update(e, pair, bindings, 0, top);
+  *again = 1;
+  return LISP_EVAL_OK;
+}
+
+// a let whose values are on the eval stack from top, evaluated since mark.
+static int lisp_loop_let(lisp_value* form, size_t top, size_t mark, env_t* e) {
+  lisp_value *name = form[1].type == LISP_SYMBOL ? &form[1] : NULL, *bindings = &form[name != NULL ? 2 : 1];
+  size_t count, pair = e->s.top/sizeof(lisp_value_pair) + (name != NULL);
+  int ret, again;
+  count = lisp_loop_enter(e, form, name, bindings, top, mark);
+  if(name == NULL) {
+    if((ret = lisp_eval_value(form[2], e)) != LISP_EVAL_OK)
+      return ret;
+    lisp_loop_leave(e, count);
+    return LISP_EVAL_OK;
+  }
+  do {
+    LISP_TASK_STEP();
+    again = 0;
+    if((ret = lisp_loop_tail(&form[3], name, bindings, e, pair, &again)) != LISP_EVAL_OK)
+      return ret;
+    if(again)
+      lisp_drop_tmp_variables(mark);
+  } while(again);
+  lisp_loop_leave(e, count);
+  return LISP_EVAL_OK;
+}
+
+// (let ((x v) ...) body) and (let name ((x v) ...) body)
+static int lisp_eval_let(lisp_value v, env_t* e) {
+  lisp_value* bindings;
+  size_t i, top = eval_stack.top, mark = eval_tmp_variables.top, named = v.u.a.size == 4;
+  int ret;
+  if(v.u.a.size != 3 && v.u.a.size != 4)
+    return LISP_EVAL_ARITY_MISMATCH;
+  bindings = &v.u.a.e[1 + named];
+  if((named && v.u.a.e[1].type != LISP_SYMBOL) || !lisp_loop_bindings_ok(bindings, 2))
+    return LISP_EVAL_INVALID_VALUE;
+  for(i = 0; i < bindings->u.a.size; i++)
+    if((ret = lisp_eval_value(bindings->u.a.e[i].u.a.e[1], e)) != LISP_EVAL_OK)
+      return ret;
+  return lisp_loop_let(v.u.a.e, top, mark, e);
+}
+
+// a call of a named let's name, from anywhere but where its body ends.
+static int lisp_eval_let_call(lisp_value* form, lisp_value v, env_t* e) {
+  size_t i, top = eval_stack.top, mark = eval_tmp_variables.top;
+  int ret;
+  if(v.u.a.size - 1 != form[2].u.a.size)
+    return LISP_EVAL_ARITY_MISMATCH;
+  for(i = 1; i < v.u.a.size; i++)
+    if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  return lisp_loop_let(form, top, mark, e);
+}
+
+// (do ((x v step) ...) (test r ...) body ...)
+static int lisp_eval_do(lisp_value v, env_t* e) {
+  lisp_value *bindings = &v.u.a.e[1], *clause = &v.u.a.e[2];
+  size_t i, count, top = eval_stack.top, mark = eval_tmp_variables.top, pair = e->s.top/sizeof(lisp_value_pair);
+  int ret, truth;
+  if(v.u.a.size < 3)
+    return LISP_EVAL_ARITY_MISMATCH;
+  if(!lisp_loop_bindings_ok(bindings, 3) || clause->type != LISP_LIST || clause->u.a.size == 0)
+    return LISP_EVAL_INVALID_VALUE;
+  for(i = 0; i < bindings->u.a.size; i++)
+    if((ret = lisp_eval_value(bindings->u.a.e[i].u.a.e[1], e)) != LISP_EVAL_OK)
+      return ret;
+  count = lisp_loop_enter(e, NULL, NULL, bindings, top, mark);
+  for(;;) {
+    LISP_TASK_STEP();
+    if((ret = lisp_eval_truth(&clause->u.a.e[0], e, &truth)) != LISP_EVAL_OK)
+      return ret;
+    if(truth)
+      break;
+    for(i = 3; i < v.u.a.size; i++) {
+      if((ret = lisp_eval_value(v.u.a.e[i], e)) != LISP_EVAL_OK)
+        return ret;
+      eval_stack.top = top;
+    }
+    for(i = 0; i < bindings->u.a.size; i++)
+      if(bindings->u.a.e[i].u.a.size == 3 && (ret = lisp_eval_value(bindings->u.a.e[i].u.a.e[2], e)) != LISP_EVAL_OK)
+        return ret;
+    lisp_loop_update(e, pair, bindings, 1, top);
+    lisp_drop_tmp_variables(mark);
+  }
+  if(clause->u.a.size == 1) {
+    v.type = LISP_TRUE;    // (test), what it was is the value
+    PUTV(v);
+  }
+  for(i = 1; i < clause->u.a.size; i++) {
+    eval_stack.top = top;
+    if((ret = lisp_eval_value(clause->u.a.e[i], e)) != LISP_EVAL_OK)
+      return ret;
+  }
+  lisp_loop_leave(e, count);
+  return LISP_EVAL_OK;
+}
+
+static int lisp_eval_list(lisp_value v, env_t* e) {
+  int ret;
+  lisp_value dummy;
+  if(lisp_get_list_size(&v) == 0)
+    return LISP_EVAL_INVALID_VALUE;    // ()
+  dummy = car0(v);
+  LISP_STATS_FORM(lisp_get_type(&dummy));
+  switch(lisp_get_type(&dummy)) {
+    case LISP_PLUS        : 	return lisp_eval_bin_op(v, LISP_PLUS, e);
+    case LISP_MINUS        : 	return lisp_eval_bin_op(v, LISP_MINUS, e);
+    case LISP_MULTIPLY	: 	return lisp_eval_bin_op(v, LISP_MULTIPLY, e);
+    case LISP_DIVIDE	: 	return lisp_eval_bin_op(v, LISP_DIVIDE, e);
+    case LISP_BT         :	return lisp_eval_logic_op(v, LISP_BT, e);
+    case LISP_LT         :	return lisp_eval_logic_op(v, LISP_LT, e);
+    case LISP_EQ         : 	return lisp_eval_logic_op(v, LISP_EQ, e);
+    case LISP_NUM_PLUS	:
+    case LISP_NUM_MINUS	:
+    case LISP_NUM_MULTIPLY	:
+    case LISP_NUM_DIVIDE	:
+    case LISP_NUM_LT	:
+    case LISP_NUM_BT	:
+    case LISP_NUM_EQ	:	return lisp_eval_num_value(v, e);
+    case LISP_IF        :	return lisp_eval_if(v, e);
+    case LISP_NOT        :	return lisp_eval_not(v, e);
+    case LISP_CAR        :
+    case LISP_CDR         :
+    case LISP_CXR         :	return lisp_eval_cxr(v, e);
+    case LISP_NULL$        :	return lisp_eval_is_null(v, e);
+    case LISP_SYMBOL 	:	return lisp_eval_symbol(v, e);
+    case LISP_DEFINE 	:	return lisp_eval_define(v, e);	// (define id (lambda (x) x))
+    case LISP_DEFINE_MACRO:	return lisp_eval_define_macro(v, e);
+    case LISP_TIME	:	return lisp_eval_time(v, e);
+    case LISP_BENCH	:	return lisp_eval_bench(v, e);
+    case LISP_SPAWN	:	return lisp_eval_spawn(v, e);
+    case LISP_MAKE_VECTOR	:	return lisp_eval_make_vector(v, e);
+    case LISP_VECTOR_NEW	:	return lisp_eval_vector_new(v, e);
+    case LISP_VECTOR_REF	:
+    case LISP_VECTOR_LENGTH	:	return lisp_eval_vector_access(v, lisp_get_type(&dummy), e);
+    case LISP_VECTOR_ADD	:
+    case LISP_VECTOR_SUB	:
+    case LISP_VECTOR_MUL	:
+    case LISP_VECTOR_DIV	:
+    case LISP_VECTOR_LT	:
+    case LISP_VECTOR_BT	:
+    case LISP_VECTOR_EQ	:	return lisp_eval_vector_op(v, lisp_get_type(&dummy), e);
+    case LISP_VECTOR_DOT	:
+    case LISP_VECTOR_SUM	:
+    case LISP_VECTOR_MIN	:
+    case LISP_VECTOR_MAX	:	return lisp_eval_vector_reduce(v, lisp_get_type(&dummy), e);
+    case LISP_LOAD_F64	:
+    case LISP_LOAD_CSV	:
+    case LISP_LOAD_TEXT	:	return lisp_eval_load(v, lisp_get_type(&dummy), e);
+    case LISP_STRING_LENGTH	:
+    case LISP_STRING_EQ	:
+    case LISP_STRING_LT	:	return lisp_eval_string_op(v, lisp_get_type(&dummy), e);
+    case LISP_STRING_APPEND	:	return lisp_eval_string_append(v, e);
+    case LISP_SUBSTRING	:	return lisp_eval_substring(v, e);
+    case LISP_STRING_SEARCH	:	return lisp_eval_string_search(v, e);
+    case LISP_STRING_TO_NUMBER	:
+    case LISP_NUMBER_TO_STRING	:	return lisp_eval_string_number(v, lisp_get_type(&dummy), e);
+    case LISP_MAKE_TABLE	:
+    case LISP_TABLE_SIZE	:
+    case LISP_TABLE_FREE	:	return lisp_eval_table(v, lisp_get_type(&dummy), e);
+    case LISP_TABLE_REF	:
+    case LISP_TABLE_SET	:
+    case LISP_TABLE_DELETE	:	return lisp_eval_table_key(v, lisp_get_type(&dummy), e);
+    case LISP_TABLE_NEXT	:
+    case LISP_TABLE_KEY	:
+    case LISP_TABLE_VALUE	:	return lisp_eval_table_entry(v, lisp_get_type(&dummy), e);
+    case LISP_LENGTH	:	return lisp_eval_list_length(v, e);
+    case LISP_MAP	:
+    case LISP_FILTER	:	return lisp_eval_list_map(v, e);
+    case LISP_FOLD	:	return lisp_eval_list_fold(v, e);
+    case LISP_APPEND	:
+    case LISP_REVERSE	:	return lisp_eval_list_copy(v, lisp_get_type(&dummy), e);
+    case LISP_DELAY	:	return lisp_eval_delay(v, e);
+    case LISP_FORCE	:	return lisp_eval_force(v, e);
+    case LISP_STREAM_CONS	:	return lisp_eval_stream_cons(v, e);
+    case LISP_STREAM_CAR	:
+    case LISP_STREAM_CDR	:	return lisp_eval_stream_access(v, lisp_get_type(&dummy), e);
+    case LISP_STREAM_TAKE	:	return lisp_eval_stream_take(v, e);
+    case LISP_SET	:	return lisp_eval_set(v, e);
+    case LISP_LET	:	return lisp_eval_let(v, e);
+    case LISP_DO	:	return lisp_eval_do(v, e);
+    case LISP_QUOTE	:	PUTV(v); return LISP_EVAL_OK;	// a quoted list is its own value, like car returns it.
+    case LISP_LAMBDA 	: 	PUTV(v); return LISP_EVAL_OK;	// put lambda expression to the stack.
+                          // (((lambda (x) x) (lambda (y) y)) 1) => return lambda first.
+    case LISP_LIST         :	if((ret = lisp_eval_get_lambda(v, e)) != LISP_EVAL_OK) return ret;
+                                dummy = cdr0(v);						// args
+                                return lisp_eval_lambda(dummy, e);		// ((lambda (x y) (- y (- x x))) 2 1), push and pop
+    default                :	return LISP_EVAL_NOT_A_FUNCTION;    // (1 2), (cons 1 2)
+  }
+}
+
+static int lisp_eval_value(lisp_value v, env_t* e) {
+  LISP_TASK_STEP();
+  switch(lisp_get_type(&v)) {
+    case LISP_NUMBER 	: return lisp_eval_number(v);
+    case LISP_STRING	: PUTV(v); return LISP_EVAL_OK;    // a literal, owned by the code
+    case LISP_PROMISE	: PUTV(v); return LISP_EVAL_OK;    // an argument lisp_list_apply passes
+    case LISP_LIST         : return lisp_eval_list(v, e);
+    case LISP_SYMBOL 	: return lisp_eval_symbol(v, e);
+    default : return LISP_EVAL_INVALID_VALUE;
+  }
+}
+
+// one form on the stacks as they are, emptied first and left allocated.
+static int lisp_eval_form(lisp_value* v, lisp_value* result, env_t* e) {
+  int ret;
+  size_t i, size, top = e != NULL ? e->s.top : 0;
+  lisp_value** p, copy;
+  eval_stack.top = 0;
+  eval_tmp_variables.top = 0;
+  if(lisp_macro_named(e, NULL) && (ret = lisp_macro_expand(v, e, 0)) != LISP_EVAL_OK)
+    return ret;
+  if((ret = lisp_eval_value(*v, e)) != LISP_EVAL_OK) {
+    // drop the parameters of the applications that failed half way.
+    if(e != NULL && e->s.top > top)
+      lisp_env_leave(e, (e->s.top - top)/sizeof(lisp_value_pair));
+    lisp_drop_tmp_variables(0);
+    LISP_TRACE_FAILED(ret);
+    return ret;
+  }
+  if(lisp_get_type(v) != LISP_LIST || (lisp_get_type(lisp_get_list_element(v, 0)) != LISP_DEFINE && lisp_get_type(lisp_get_list_element(v, 0)) != LISP_DEFINE_MACRO))
+    *result = *(lisp_value*)eval_context_pop(&eval_stack, sizeof(lisp_value));
+  else result->type = LISP_NIL;
+  assert(eval_stack.top == 0);
+  if(lisp_get_type(result) == LISP_STRING)
+    lisp_str_ref(result, result);    // a reference of its own: to a literal, or one the temporaries drop
+  else if(lisp_get_type(result) == LISP_PROMISE)
+    lisp_promise_ref(result, result);
+
+  switch(lisp_get_type(result)) {
+    case LISP_LIST:
+    case LISP_SYMBOL:
+    case LISP_VECTOR:
+      // the result is the caller's: storage a temporary holds is taken over from it,
+      // storage of the code, an env or a list it is an element of is copied.
+      p = (lisp_value**)eval_tmp_variables.stack;
+      size = eval_tmp_variables.top/sizeof(lisp_value*);
+      for(i = size; i-- > 0; ) {
+        if(lisp_get_type(p[i]) == lisp_get_type(result) && p[i]->u.a.e == result->u.a.e && p[i]->u.a.size == result->u.a.size) {    // the storage and size of the three alike
+          free(p[i]);
+          memmove(p + i, p + i + 1, (size - i - 1)*sizeof(lisp_value*));
+          eval_tmp_variables.top -= sizeof(lisp_value*);
+          break;
+        }
+      }
+      if(i == (size_t)-1) {
+        lisp_value_copy(&copy, result);
+        *result = copy;
+      }
+      break;
+    default: ;    // no storage of its own, or a reference of its own
+  }
+  lisp_drop_tmp_variables(0);
+  return ret;
+}
+
+static int lisp_eval_root(lisp_value* v, lisp_value* result, env_t* e) {
+  int ret;
+  eval_context_init();
+  memset(&eval_tmp_variables, 0, sizeof(eval_context));
+  ret = lisp_eval_form(v, result, e);
+  free(eval_stack.stack);
+  free(eval_tmp_variables.stack);
+  return ret;
+}
+
+int lisp_eval(lisp_value* v, lisp_value* result, env_t* e) {
+  int ret;
+  LISP_PERF_BEGIN(LISP_PERF_EVAL);
+  ret = lisp_eval_root(v, result, e);
+  LISP_PERF_END(LISP_PERF_EVAL);
+  return ret;
+}
+
+// the stacks are set up once for the batch: once they have grown to the
+// largest form, a form that makes no temporaries does not allocate.
+size_t lisp_eval_batch(lisp_value* forms, size_t count, lisp_value* results, int* rets, env_t* e) {
+  size_t i, failed = 0;
+  LISP_PERF_BEGIN(LISP_PERF_EVAL);
+  eval_context_init();
+  memset(&eval_tmp_variables, 0, sizeof(eval_context));
+  for(i = 0; i < count; i++) {
+    lisp_value_init(&results[i]);
+    if((rets[i] = lisp_eval_form(&forms[i], &results[i], e)) != LISP_EVAL_OK)
+      failed++;
+  }
+  free(eval_stack.stack);
+  free(eval_tmp_variables.stack);
+  LISP_PERF_END(LISP_PERF_EVAL);
+  return failed;
+}
+
+#ifdef LISP_TASK
+/*
+ * tasks: an evaluation run in slices on its own C stack. the step hook in
+ * lisp_eval_value counts down the slice's budget and switches back to
+ * lisp_task_run when it is spent, the evaluator's stacks are swapped along.
+ * the task evaluates in a child env, so its parameters and defines do not
+ * interleave with other evaluations of the env it was made from.
+ */
+static void lisp_task_refill(lisp_task* t) {
+  t->budget = t->steps < LISP_TASK_CLOCK_STEPS ? t->steps : LISP_TASK_CLOCK_STEPS;
+  t->steps -= t->budget;
+}
+
+// the budget ran out: go on with a new one, or suspend until the next lisp_task_run.
+static int lisp_task_tick() {
+  lisp_task* t = lisp_task_current;
+  if(t->cancelled) {
+    t->budget = 1;    // every further step fails while the evaluation unwinds
+    return LISP_EVAL_CANCELLED;
+  }
+  if(t->steps != 0 && (t->deadline == 0 || lisp_now_ns() < t->deadline)) {
+    lisp_task_refill(t);
+    return LISP_EVAL_OK;
+  }
+  swapcontext(&t->context, &t->caller);
+  if(t->cancelled) {
+    t->budget = 1;
+    return LISP_EVAL_CANCELLED;
+  }
+  return LISP_EVAL_OK;
+}
+
+static void lisp_task_main() {
+  lisp_task* t = lisp_task_current;
+  t->ret = lisp_eval_root(t->v, &t->result, &t->env);
+  t->done = 1;
+}
+
+lisp_task* lisp_task_new(lisp_value* v, env_t* e) {
+  lisp_task* t = (lisp_task*)calloc(1, sizeof(lisp_task));
+  if(t != NULL && lisp_task_stacks_top != 0)
+    t->stack = lisp_task_stacks[--lisp_task_stacks_top];
+  else if(t != NULL)
+    t->stack = (char*)malloc(LISP_TASK_STACK_SIZE);
+  if(t == NULL || t->stack == NULL) {
+    free(t);
+    return NULL;
+  }
+  env_init(e, &t->env);
+  t->v = v;
+  t->captured.type = LISP_NULL;
+  getcontext(&t->context);
+  t->context.uc_stack.ss_sp = t->stack;
+  t->context.uc_stack.ss_size = LISP_TASK_STACK_SIZE;
+  t->context.uc_link = &t->caller;
+  makecontext(&t->context, lisp_task_main, 0);
+  return t;
+}
+
+// the bindings are those a delay of t->v would keep, pushed where the task's lookups start.
+void lisp_task_capture(lisp_task* t, env_t* e) {
+  lisp_promise* p;
+  lisp_value_pair* pairs;
+  size_t i;
+  lisp_promise_delay(&t->captured, t->v, e);
+  p = t->captured.u.promise.p;
+  pairs = (lisp_value_pair*)lisp_env_push(&t->env, p->count * sizeof(lisp_value_pair));
+  for(i = 0; i < p->count; i++) {
+    pairs[i].symbol = p->bindings[i].symbol;
+    pairs[i].value = p->bindings[i].lambda != NULL ? p->bindings[i].lambda : &p->bindings[i].value;
+    t->env.shadow[LISP_SHADOW_BUCKET(pairs[i].symbol)]++;
+  }
+}
+
+int lisp_task_run(lisp_task* t, size_t steps, long us, lisp_value* result) {
+  eval_context stack = eval_stack, tmp_variables = eval_tmp_variables;
+  lisp_task* current = lisp_task_current;
+  if(t->done) {
+    if(t->ret == LISP_EVAL_OK)
+      *result = t->result;
+    return t->ret;
+  }
+  if(t->cancelled && !t->started) {
+    t->done = 1;
+    return t->ret = LISP_EVAL_CANCELLED;
+  }
+  t->steps = steps != 0 ? steps : (size_t)-1;
+  t->deadline = us > 0 ? lisp_now_ns() + us * 1e3 : 0;
+  lisp_task_refill(t);
+  t->started = 1;
+  eval_stack = t->eval_stack;
+  eval_tmp_variables = t->tmp_variables;
+  lisp_task_current = t;
+  swapcontext(&t->caller, &t->context);
+  lisp_task_current = current;
+  t->eval_stack = eval_stack;
+  t->tmp_variables = eval_tmp_variables;
+  eval_stack = stack;
+  eval_tmp_variables = tmp_variables;
+  if(!t->done)
+    return LISP_EVAL_SUSPENDED;
+  if(t->ret == LISP_EVAL_OK)
+    *result = t->result;
+  return t->ret;
+}
+
+int lisp_task_yield() {
+  lisp_task* t = lisp_task_current;
+  if(t == NULL)
+    return -1;
+  swapcontext(&t->context, &t->caller);
+  if(t->cancelled) {
+    t->budget = 1;
+    return LISP_EVAL_CANCELLED;
+  }
+  return LISP_EVAL_OK;
+}
+
+void lisp_task_cancel(lisp_task* t) {
+  t->cancelled = 1;
+}
+
+void lisp_task_free(lisp_task* t) {
+  lisp_value result;
+  if(t == NULL) return;
+  // unwind a suspended evaluation, the error paths release what it holds.
+  if(t->started && !t->done) {
+    t->cancelled = 1;
+    lisp_task_run(t, 0, 0, &result);
+  }
+  env_free(&t->env);
+  if(t->captured.type == LISP_PROMISE)
+    lisp_promise_free(&t->captured);
+  if(lisp_task_stacks_top < LISP_TASK_STACK_CACHE)
+    lisp_task_stacks[lisp_task_stacks_top++] = t->stack;
+  else free(t->stack);
+  free(t);
+}
+#endif
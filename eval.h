@@ -8,14 +8,46 @@ enum {
   LISP_EVAL_UNKNOWN_BIN_OP,
   LISP_EVAL_ENV_EXTENED_OK,
   LISP_EVAL_VARIABLE_NOT_FOUND,
-  LISP_LISP_OP_ILLEAGE
+  LISP_LISP_OP_ILLEAGE,
+  LISP_EVAL_NOT_A_NUMBER,
+  LISP_EVAL_ARITY_MISMATCH,
+  LISP_EVAL_SUSPENDED,    // a task's slice ran out, lisp_task_run resumes it
+  LISP_EVAL_CANCELLED,
+  LISP_EVAL_NOT_A_VECTOR,
+  LISP_EVAL_LENGTH_MISMATCH,    // vectors of different lengths in one elementwise form
+  LISP_EVAL_INDEX_OUT_OF_RANGE,
+  LISP_EVAL_IO_ERROR,    // a file a loader was given cannot be read
+  LISP_EVAL_NOT_A_STRING,
+  LISP_EVAL_NOT_A_TABLE,
+  LISP_EVAL_NOT_A_KEY,    // a table key that is not a number, a symbol or a string
+  LISP_EVAL_NOT_STORABLE,    // a table value that is not a number, a boolean or a string
+  LISP_EVAL_NOT_A_LIST,
+  LISP_EVAL_NOT_A_FUNCTION,    // what a list form applies is not a lambda or a native
+  LISP_EVAL_MACRO_ERROR,    // a macro expands without end, or is used where it was not expanded
+  LISP_EVAL_NOT_A_STREAM,
+  LISP_EVAL_PROMISE_ERROR    // a promise forced again while it is being forced
 };
 
+// with LISP_THREADS the interpreter state is per thread: every thread evaluates
+// in its own global_env, with its own stacks, inline cache stamps and jit code.
+#ifdef LISP_THREADS
+#define LISP_THREAD_LOCAL _Thread_local
+#else
+#define LISP_THREAD_LOCAL
+#endif
+
 typedef struct lisp_value_pair lisp_value_pair;
 struct lisp_value_pair {
   lisp_value *symbol, *value;
 };
 
+#ifndef LISP_ENV_SHADOW_BUCKETS
+#define LISP_ENV_SHADOW_BUCKETS 64
+#endif
+#define LISP_SHADOW_BUCKET(v)	(((unsigned char)(v)->u.sym.s[0] * 31u + (v)->u.sym.size) & (LISP_ENV_SHADOW_BUCKETS - 1))
+
+typedef struct lisp_inline_def lisp_inline_def;
+
 typedef struct env env_t;
 struct env {
   env_t *prev, *next;
@@ -23,11 +55,47 @@ struct env {
     lisp_value_pair* p;
     size_t top, size;
   }s;
+  struct {
+    lisp_inline_def* p;    // definitions whose bodies were rewritten by the inliner
+    size_t top, size;
+  }inl;
+  struct {
+    char** p;    // names define-macro bound here, a walk only looks up the heads that may be one
+    size_t top, size;
+  }macros;
+  struct {
+    struct lisp_table** p;    // made by make-table in this env, a handle is an index. NULL: freed, handles are not reused
+    size_t top, size;
+  }tables;
+  unsigned long version;    // changes on every define, stamps inline caches
+  size_t shadow[LISP_ENV_SHADOW_BUCKETS];    // live parameters per symbol hash bucket
 };
 
-env_t global_env;
+typedef struct lisp_ic_stats lisp_ic_stats;
+struct lisp_ic_stats {
+  size_t hits, misses, invalidations;
+};
 
+#ifndef LISP_NATIVE_MAX_ARGS
+#define LISP_NATIVE_MAX_ARGS 16
+#endif
+
+typedef double (*lisp_native_number_fn)(const double* args);
+// a C function bound with lisp_define_native. args points at its count arguments,
+// evaluated on the eval stack and not copied; it leaves its value in args[0], which
+// is there for count 0 too, and returns LISP_EVAL_OK or an error code. a string,
+// vector or (quote (...)) list it leaves is the evaluation's from then on, so an
+// argument it gives back has to be a copy, see lisp_value_copy.
+typedef int (*lisp_native_fn)(lisp_value* args, size_t count);
+
+extern LISP_THREAD_LOCAL env_t global_env;
+
+// result is the caller's, lisp_value_free lets it go: v and e keep no part of it.
 int lisp_eval(lisp_value* v, lisp_value* result, env_t* e);
+// evaluate forms in order with one eval context, results[i] and rets[i] are what lisp_eval
+// gives for forms[i]. a failed form does not stop the others. returns how many failed.
+// the forms of a buffer parsed as one list are its elements.
+size_t lisp_eval_batch(lisp_value* forms, size_t count, lisp_value* results, int* rets, env_t* e);
 
 #if 1
 lisp_value* car(lisp_value* c, lisp_value* v);
@@ -41,5 +109,43 @@ void env_init(env_t* p, env_t* e);
 void env_free(env_t* e);
 size_t env_size(env_t* e);
 void lisp_env_print(env_t* e);
+lisp_value* lisp_env_lookup(env_t* e, lisp_value* symbol);
+// 1 if symbol is a parameter of a lambda bound in e.
+int lisp_is_parameter_name(env_t* e, lisp_value* symbol);
+// bind name to a C function of arity numbers, a boolean one returns 1.0 or 0.0.
+int lisp_define_native_number(env_t* e, const char* name, size_t arity, lisp_native_number_fn fn, int boolean);
+// bind name to a C function of arity values of any type.
+int lisp_define_native(env_t* e, const char* name, size_t arity, lisp_native_fn fn);
+
+void lisp_get_ic_stats(lisp_ic_stats* s);
+void lisp_reset_ic_stats();
+
+#ifdef LISP_TASK
+#ifndef LISP_TASK_STACK_SIZE
+#define LISP_TASK_STACK_SIZE (1 << 20)
+#endif
+#ifndef LISP_TASK_STACK_CACHE
+#define LISP_TASK_STACK_CACHE 64    // freed stacks kept for the next tasks
+#endif
+#ifndef LISP_TASK_CLOCK_STEPS
+#define LISP_TASK_CLOCK_STEPS 256    // steps between two reads of the clock
+#endif
+
+typedef struct lisp_task lisp_task;
+// an evaluation of v in a child env of e, run in slices. v must outlive the task.
+lisp_task* lisp_task_new(lisp_value* v, env_t* e);
+// binds in t's env the parameters of e that v uses to copies of what they are now, as
+// delay does: for a task made from an env outer than e. call it before the first run.
+void lisp_task_capture(lisp_task* t, env_t* e);
+// run for at most steps evaluation steps and us microseconds, 0 for no limit. returns
+// LISP_EVAL_SUSPENDED until the evaluation finishes, then what lisp_eval would.
+int lisp_task_run(lisp_task* t, size_t steps, long us, lisp_value* result);
+// called by a C function the task applies: suspend it, lisp_task_run returns LISP_EVAL_SUSPENDED.
+// returns LISP_EVAL_CANCELLED if the task was cancelled meanwhile, -1 outside of tasks.
+int lisp_task_yield();
+// the next lisp_task_run unwinds the evaluation and returns LISP_EVAL_CANCELLED.
+void lisp_task_cancel(lisp_task* t);
+void lisp_task_free(lisp_task* t);
+#endif
 
 #endif
@@ -0,0 +1,505 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "parse.h"
+#include "eval.h"
+#include "jit.h"
+
+/*
+ * x86-64 (System V) compiler for hot numeric lambdas. a compiled lambda is a
+ * `double f(const double* args)`: parameters are doubles read through rbx,
+ * results come back in xmm0, booleans as 1.0/0.0. temporaries are spilled to
+ * 16 byte stack slots so rsp stays aligned at every call. calls to global
+ * lambdas go through the callee's `entry` slot, so mutually recursive
+ * functions can be linked before either is finished.
+ *
+ * a lambda is compiled as a whole or not at all: any form other than numbers,
+ * parameters, arithmetic, comparisons, not, if and calls to compilable global
+ * lambdas leaves it to the interpreter.
+ */
+
+#ifndef LISP_JIT_ARENA_SIZE
+#define LISP_JIT_ARENA_SIZE (64*1024)
+#endif
+#ifndef LISP_JIT_INIT_CODE_SIZE
+#define LISP_JIT_INIT_CODE_SIZE 256
+#endif
+
+enum {
+  LISP_JIT_COMPILING,
+  LISP_JIT_READY,
+  LISP_JIT_FAILED
+};
+
+enum {
+  LISP_JIT_UNKNOWN,
+  LISP_JIT_NUMBER,
+  LISP_JIT_BOOL
+};
+
+typedef double (*lisp_jit_fn)(const double* args);
+
+typedef struct lisp_jit_link lisp_jit_link;
+struct lisp_jit_link {
+  lisp_value* name;    // call site head, must not be shadowed by a live parameter on entry
+  lisp_jit* target;
+};
+
+struct lisp_jit {
+  lisp_jit_fn entry;
+  lisp_value* lambda;
+  unsigned long version, visited;
+  int state, kind;
+  struct {
+    lisp_jit_link* p;
+    size_t top, size;
+  }links;
+  lisp_jit* next;
+};
+
+typedef struct lisp_jit_buf lisp_jit_buf;
+struct lisp_jit_buf {
+  unsigned char* p;
+  size_t top, size;
+};
+
+typedef struct lisp_jit_patches lisp_jit_patches;
+struct lisp_jit_patches {
+  size_t p[8];
+  size_t top;
+};
+
+typedef struct lisp_jit_context lisp_jit_context;
+struct lisp_jit_context {
+  lisp_jit_buf code;
+  lisp_jit* jit;
+  env_t* e;
+};
+
+static LISP_THREAD_LOCAL int jit_enabled = 1;
+static LISP_THREAD_LOCAL lisp_jit* jit_records;
+static LISP_THREAD_LOCAL unsigned long jit_visits;
+static LISP_THREAD_LOCAL lisp_jit_stats jit_stats;
+static LISP_THREAD_LOCAL struct {
+  unsigned char* p;
+  size_t top, size;
+}jit_arena;
+
+void lisp_jit_enable(int on) {
+  jit_enabled = on;
+}
+
+void lisp_get_jit_stats(lisp_jit_stats* s) {
+  *s = jit_stats;
+}
+
+size_t lisp_jit_arity(const lisp_jit* jit) {
+  return jit->lambda->u.a.e[1].u.a.size;
+}
+
+// copies code into the arena and returns where it runs. the arena is mapped
+// writable, the pages code goes to are made writable only while it is copied
+// and executable after: no page is both (W^X).
+static void* lisp_jit_install(const void* code, size_t size) {
+  void* p;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE), start, end, used = (size + 15) & ~(size_t)15;
+  if(jit_arena.p == NULL || jit_arena.top + used > jit_arena.size) {
+    jit_arena.size = used > LISP_JIT_ARENA_SIZE ? (used + page - 1) & ~(page - 1) : LISP_JIT_ARENA_SIZE;
+    p = mmap(NULL, jit_arena.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) {    // no memory for code: stay in the interpreter.
+      jit_arena.p = NULL;
+      jit_enabled = 0;
+      return NULL;
+    }
+    jit_arena.p = (unsigned char*)p;
+    jit_arena.top = 0;
+  }
+  p = jit_arena.p + jit_arena.top;
+  start = jit_arena.top & ~(page - 1);
+  end = (jit_arena.top + used + page - 1) & ~(page - 1);
+  jit_arena.top += used;
+  // the first page may hold code compiled before, it is not run while this thread compiles.
+  if(mprotect(jit_arena.p + start, end - start, PROT_READ | PROT_WRITE) != 0)
+    return NULL;
+  memcpy(p, code, size);
+  if(mprotect(jit_arena.p + start, end - start, PROT_READ | PROT_EXEC) != 0) {    // no executable memory
+    jit_enabled = 0;
+    return NULL;
+  }
+  return p;
+}
+
+static void jit_emit(lisp_jit_buf* b, const void* bytes, size_t size) {
+  if(b->top + size >= b->size) {
+    if(b->size == 0)
+      b->size = LISP_JIT_INIT_CODE_SIZE;
+    while(b->top + size >= b->size)
+      b->size += b->size >> 1;
+    b->p = (unsigned char*)realloc(b->p, b->size);
+  }
+  memcpy(b->p + b->top, bytes, size);
+  b->top += size;
+}
+
+#define EMIT(c, ...)	do { const unsigned char bytes_[] = { __VA_ARGS__ }; jit_emit(&(c)->code, bytes_, sizeof(bytes_)); } while(0)
+#define EMIT32(c, x)	do { int x_ = (int)(x); jit_emit(&(c)->code, &x_, 4); } while(0)
+#define EMIT64(c, x)	do { jit_emit(&(c)->code, &(x), 8); } while(0)
+
+// jcc/jmp with a rel32 to be patched once the label is known, returns the patch offset.
+static size_t jit_jump(lisp_jit_context* c, unsigned char cc) {
+  if(cc == 0) EMIT(c, 0xE9);
+  else EMIT(c, 0x0F, cc);
+  EMIT32(c, 0);
+  return c->code.top - 4;
+}
+
+static void jit_bind(lisp_jit_context* c, size_t patch) {
+  int rel = (int)(c->code.top - (patch + 4));
+  memcpy(c->code.p + patch, &rel, 4);
+}
+
+#define JA	0x87
+#define JBE	0x86
+#define JE	0x84
+#define JNE	0x85
+#define JP	0x8A
+#define JNP	0x8B
+
+static void jit_load_constant(lisp_jit_context* c, double n, int xmm) {
+  EMIT(c, 0x48, 0xB8); EMIT64(c, n);				// mov rax, imm64
+  if(xmm == 0) EMIT(c, 0x66, 0x48, 0x0F, 0x6E, 0xC0);	// movq xmm0, rax
+  else         EMIT(c, 0x66, 0x48, 0x0F, 0x6E, 0xC8);	// movq xmm1, rax
+}
+
+static int jit_parameter(lisp_jit_context* c, lisp_value* symbol) {
+  lisp_value* parameters = &c->jit->lambda->u.a.e[1];
+  size_t i;
+  for(i = 0; i < parameters->u.a.size; i++)
+    if(parameters->u.a.e[i].type == LISP_SYMBOL && parameters->u.a.e[i].u.sym.size == symbol->u.sym.size
+        && memcmp(parameters->u.a.e[i].u.sym.s, symbol->u.sym.s, symbol->u.sym.size) == 0)
+      return (int)i;
+  return -1;
+}
+
+static int jit_is_arith(int type) {
+  switch(type) {
+    case LISP_PLUS: case LISP_MINUS: case LISP_MULTIPLY: case LISP_DIVIDE:
+    case LISP_NUM_PLUS: case LISP_NUM_MINUS: case LISP_NUM_MULTIPLY: case LISP_NUM_DIVIDE: return 1;
+    default: return 0;
+  }
+}
+
+static int jit_is_compare(int type) {
+  switch(type) {
+    case LISP_LT: case LISP_BT: case LISP_EQ:
+    case LISP_NUM_LT: case LISP_NUM_BT: case LISP_NUM_EQ: return 1;
+    default: return 0;
+  }
+}
+
+static int lisp_jit_compile(lisp_jit* jit, env_t* e);
+
+static lisp_jit* jit_record(lisp_value* lambda) {
+  lisp_value* head = &lambda->u.a.e[0];
+  lisp_jit* jit = head->u.fn.jit;
+  if(jit == NULL) {
+    jit = head->u.fn.jit = (lisp_jit*)calloc(1, sizeof(lisp_jit));
+    jit->lambda = lambda;
+    jit->version = ~0UL;
+    jit->state = LISP_JIT_FAILED;
+    jit->next = jit_records;
+    jit_records = jit;
+  }
+  return jit;
+}
+
+// resolve the callee of a call site at compile time, compiling it if needed.
+static lisp_jit* jit_callee(lisp_jit_context* c, lisp_value* v) {
+  lisp_value *head = &v->u.a.e[0], *lambda;
+  lisp_jit* target;
+  if(head->type != LISP_SYMBOL || jit_parameter(c, head) >= 0 || lisp_is_parameter_name(c->e, head)
+      || c->e->shadow[LISP_SHADOW_BUCKET(head)] != 0)    // the lookup could see a caller's parameter
+    return NULL;
+  lambda = lisp_env_lookup(c->e, head);
+  if(lambda == NULL || lambda->type != LISP_LIST || lambda->u.a.size != 3 || lambda->u.a.e[0].type != LISP_LAMBDA
+      || lambda->u.a.e[1].type != LISP_LIST || lambda->u.a.e[1].u.a.size != v->u.a.size - 1
+      || lambda->u.a.e[1].u.a.size > LISP_JIT_MAX_ARGS)
+    return NULL;
+  target = jit_record(lambda);
+  if(target->version != c->e->version || (target->state != LISP_JIT_READY && target->state != LISP_JIT_COMPILING))
+    if(target->version == c->e->version || !lisp_jit_compile(target, c->e))
+      return NULL;
+  if(c->jit->links.top == c->jit->links.size) {
+    c->jit->links.size = c->jit->links.size == 0 ? 4 : c->jit->links.size * 2;
+    c->jit->links.p = (lisp_jit_link*)realloc(c->jit->links.p, c->jit->links.size * sizeof(lisp_jit_link));
+  }
+  c->jit->links.p[c->jit->links.top].name = head;
+  c->jit->links.p[c->jit->links.top++].target = target;
+  return target;
+}
+
+// syntactic result kind, used to type a function before its body is compiled.
+static int jit_kind(env_t* e, lisp_value* v, int depth) {
+  lisp_value *head, *lambda;
+  int kind;
+  if(v->type == LISP_NUMBER || v->type == LISP_SYMBOL) return LISP_JIT_NUMBER;
+  if(v->type != LISP_LIST || v->u.a.size == 0 || depth > 8) return LISP_JIT_UNKNOWN;
+  head = &v->u.a.e[0];
+  if(jit_is_arith(head->type)) return LISP_JIT_NUMBER;
+  if(jit_is_compare(head->type) || head->type == LISP_NOT) return LISP_JIT_BOOL;
+  if(head->type == LISP_IF && v->u.a.size == 4) {
+    if((kind = jit_kind(e, &v->u.a.e[2], depth + 1)) != LISP_JIT_UNKNOWN) return kind;
+    return jit_kind(e, &v->u.a.e[3], depth + 1);
+  }
+  if(head->type == LISP_SYMBOL && (lambda = lisp_env_lookup(e, head)) != NULL && lambda->type == LISP_LIST
+      && lambda->u.a.size == 3 && lambda->u.a.e[0].type == LISP_LAMBDA) {
+    if(lambda->u.a.e[0].u.fn.jit != NULL && lambda->u.a.e[0].u.fn.jit->version == e->version
+        && lambda->u.a.e[0].u.fn.jit->state != LISP_JIT_FAILED)
+      return lambda->u.a.e[0].u.fn.jit->kind;
+    return jit_kind(e, &lambda->u.a.e[2], depth + 1);
+  }
+  return LISP_JIT_UNKNOWN;
+}
+
+static int jit_number(lisp_jit_context* c, lisp_value* v);
+static int jit_bool(lisp_jit_context* c, lisp_value* v);
+
+static void jit_spill(lisp_jit_context* c) {
+  EMIT(c, 0x48, 0x83, 0xEC, 0x10);				// sub rsp, 16
+  EMIT(c, 0xF2, 0x0F, 0x11, 0x04, 0x24);			// movsd [rsp], xmm0
+}
+
+static void jit_unspill(lisp_jit_context* c) {
+  EMIT(c, 0x66, 0x0F, 0x28, 0xC8);				// movapd xmm1, xmm0
+  EMIT(c, 0xF2, 0x0F, 0x10, 0x04, 0x24);			// movsd xmm0, [rsp]
+  EMIT(c, 0x48, 0x83, 0xC4, 0x10);				// add rsp, 16
+}
+
+// with the left operand in xmm0, get the right one into xmm1 keeping xmm0.
+static int jit_operand(lisp_jit_context* c, lisp_value* v) {
+  int i;
+  if(v->type == LISP_NUMBER) {
+    jit_load_constant(c, v->u.n, 1);
+    return 1;
+  }
+  if(v->type == LISP_SYMBOL) {
+    if((i = jit_parameter(c, v)) < 0) return 0;
+    EMIT(c, 0xF2, 0x0F, 0x10, 0x8B); EMIT32(c, 8*i);	// movsd xmm1, [rbx+8i]
+    return 1;
+  }
+  jit_spill(c);
+  if(!jit_number(c, v)) return 0;
+  jit_unspill(c);
+  return 1;
+}
+
+static int jit_call(lisp_jit_context* c, lisp_value* v, int kind) {
+  lisp_jit* target;
+  size_t i, count = v->u.a.size - 1, frame = (8*count + 15) & ~(size_t)15;
+  void* slot;
+  if((target = jit_callee(c, v)) == NULL || target->kind != kind)
+    return 0;
+  if(frame != 0) { EMIT(c, 0x48, 0x81, 0xEC); EMIT32(c, frame); }	// sub rsp, frame
+  for(i = 0; i < count; i++) {
+    if(!jit_number(c, &v->u.a.e[i+1])) return 0;
+    EMIT(c, 0xF2, 0x0F, 0x11, 0x84, 0x24); EMIT32(c, 8*i);		// movsd [rsp+8i], xmm0
+  }
+  slot = &target->entry;
+  EMIT(c, 0x48, 0x89, 0xE7);						// mov rdi, rsp
+  EMIT(c, 0x48, 0xB8); EMIT64(c, slot);				// mov rax, &target->entry
+  EMIT(c, 0xFF, 0x10);							// call [rax]
+  if(frame != 0) { EMIT(c, 0x48, 0x81, 0xC4); EMIT32(c, frame); }	// add rsp, frame
+  return 1;
+}
+
+// emit a jump to the label patched later when v evaluates to `when`.
+static int jit_branch(lisp_jit_context* c, lisp_value* v, int when, lisp_jit_patches* out) {
+  lisp_value* head;
+  size_t skip;
+  if(out->top + 2 > sizeof(out->p)/sizeof(out->p[0])) return 0;
+  if(v->type == LISP_LIST && v->u.a.size != 0) {
+    head = &v->u.a.e[0];
+    if(head->type == LISP_NOT && v->u.a.size == 2)
+      return jit_branch(c, &v->u.a.e[1], !when, out);
+    if(jit_is_compare(head->type) && v->u.a.size == 3) {
+      if(!jit_number(c, &v->u.a.e[1]) || !jit_operand(c, &v->u.a.e[2])) return 0;
+      switch(head->type) {
+        case LISP_LT: case LISP_NUM_LT:
+          EMIT(c, 0x66, 0x0F, 0x2E, 0xC8);				// ucomisd xmm1, xmm0
+          out->p[out->top++] = jit_jump(c, when ? JA : JBE);
+          return 1;
+        case LISP_BT: case LISP_NUM_BT:
+          EMIT(c, 0x66, 0x0F, 0x2E, 0xC1);				// ucomisd xmm0, xmm1
+          out->p[out->top++] = jit_jump(c, when ? JA : JBE);
+          return 1;
+        default:
+          EMIT(c, 0x66, 0x0F, 0x2E, 0xC1);				// ucomisd xmm0, xmm1
+          if(when) {    // equal: ZF=1 and PF=0
+            skip = jit_jump(c, JP);
+            out->p[out->top++] = jit_jump(c, JE);
+            jit_bind(c, skip);
+          } else {
+            out->p[out->top++] = jit_jump(c, JNE);
+            out->p[out->top++] = jit_jump(c, JP);
+          }
+          return 1;
+      }
+    }
+  }
+  if(!jit_bool(c, v)) return 0;
+  EMIT(c, 0x66, 0x0F, 0x57, 0xC9);						// xorpd xmm1, xmm1
+  EMIT(c, 0x66, 0x0F, 0x2E, 0xC1);						// ucomisd xmm0, xmm1
+  out->p[out->top++] = jit_jump(c, when ? JNE : JE);
+  return 1;
+}
+
+static int jit_if(lisp_jit_context* c, lisp_value* v, int (*branch)(lisp_jit_context*, lisp_value*)) {
+  lisp_jit_patches otherwise;
+  size_t i, end;
+  otherwise.top = 0;
+  if(v->u.a.size != 4 || !jit_branch(c, &v->u.a.e[1], 0, &otherwise) || !branch(c, &v->u.a.e[2]))
+    return 0;
+  end = jit_jump(c, 0);
+  for(i = 0; i < otherwise.top; i++)
+    jit_bind(c, otherwise.p[i]);
+  if(!branch(c, &v->u.a.e[3])) return 0;
+  jit_bind(c, end);
+  return 1;
+}
+
+static int jit_number(lisp_jit_context* c, lisp_value* v) {
+  lisp_value* head;
+  size_t i;
+  int n;
+  switch(v->type) {
+    case LISP_NUMBER:
+      jit_load_constant(c, v->u.n, 0);
+      return 1;
+    case LISP_SYMBOL:
+      if((n = jit_parameter(c, v)) < 0) return 0;
+      EMIT(c, 0xF2, 0x0F, 0x10, 0x83); EMIT32(c, 8*n);	// movsd xmm0, [rbx+8n]
+      return 1;
+    case LISP_LIST:
+      if(v->u.a.size == 0) return 0;
+      head = &v->u.a.e[0];
+      if(jit_is_arith(head->type)) {
+        if(v->u.a.size < 2 || !jit_number(c, &v->u.a.e[1])) return 0;
+        for(i = 2; i < v->u.a.size; i++) {
+          if(!jit_operand(c, &v->u.a.e[i])) return 0;
+          switch(head->type) {
+            case LISP_PLUS: case LISP_NUM_PLUS:			EMIT(c, 0xF2, 0x0F, 0x58, 0xC1); break;	// addsd xmm0, xmm1
+            case LISP_MINUS: case LISP_NUM_MINUS:		EMIT(c, 0xF2, 0x0F, 0x5C, 0xC1); break;	// subsd xmm0, xmm1
+            case LISP_MULTIPLY: case LISP_NUM_MULTIPLY:	EMIT(c, 0xF2, 0x0F, 0x59, 0xC1); break;	// mulsd xmm0, xmm1
+            default:									EMIT(c, 0xF2, 0x0F, 0x5E, 0xC1); break;	// divsd xmm0, xmm1
+          }
+        }
+        return 1;
+      }
+      if(head->type == LISP_IF) return jit_if(c, v, jit_number);
+      if(head->type == LISP_SYMBOL) return jit_call(c, v, LISP_JIT_NUMBER);
+      return 0;
+    default: return 0;
+  }
+}
+
+static int jit_bool(lisp_jit_context* c, lisp_value* v) {
+  lisp_jit_patches otherwise;
+  size_t i, end;
+  if(v->type != LISP_LIST || v->u.a.size == 0) return 0;
+  if(v->u.a.e[0].type == LISP_IF) return jit_if(c, v, jit_bool);
+  if(v->u.a.e[0].type == LISP_SYMBOL) return jit_call(c, v, LISP_JIT_BOOL);
+  if(!jit_is_compare(v->u.a.e[0].type) && v->u.a.e[0].type != LISP_NOT) return 0;
+  otherwise.top = 0;
+  if(!jit_branch(c, v, 0, &otherwise)) return 0;
+  jit_load_constant(c, 1.0, 0);
+  end = jit_jump(c, 0);
+  for(i = 0; i < otherwise.top; i++)
+    jit_bind(c, otherwise.p[i]);
+  EMIT(c, 0x66, 0x0F, 0x57, 0xC0);						// xorpd xmm0, xmm0
+  jit_bind(c, end);
+  return 1;
+}
+
+static int lisp_jit_compile(lisp_jit* jit, env_t* e) {
+  lisp_jit_context c;
+  lisp_value* body = &jit->lambda->u.a.e[2];
+  void* code;
+  int ok;
+
+  jit->state = LISP_JIT_COMPILING;
+  jit->version = e->version;
+  jit->entry = NULL;
+  jit->links.top = 0;
+  if((jit->kind = jit_kind(e, body, 0)) == LISP_JIT_UNKNOWN)
+    jit->kind = LISP_JIT_NUMBER;
+
+  c.code.p = NULL;
+  c.code.top = c.code.size = 0;
+  c.jit = jit;
+  c.e = e;
+  EMIT(&c, 0x55);							// push rbp
+  EMIT(&c, 0x48, 0x89, 0xE5);					// mov rbp, rsp
+  EMIT(&c, 0x53);							// push rbx
+  EMIT(&c, 0x48, 0x83, 0xEC, 0x08);			// sub rsp, 8
+  EMIT(&c, 0x48, 0x89, 0xFB);					// mov rbx, rdi
+  ok = jit->kind == LISP_JIT_BOOL ? jit_bool(&c, body) : jit_number(&c, body);
+  EMIT(&c, 0x48, 0x83, 0xC4, 0x08);			// add rsp, 8
+  EMIT(&c, 0x5B);							// pop rbx
+  EMIT(&c, 0x5D);							// pop rbp
+  EMIT(&c, 0xC3);							// ret
+
+  if(ok && (code = lisp_jit_install(c.code.p, c.code.top)) != NULL) {
+    memcpy(&jit->entry, &code, sizeof(code));    // ISO C has no object to function pointer cast
+    jit->state = LISP_JIT_READY;
+    jit_stats.compiled++;
+  }
+  else {
+    jit->state = LISP_JIT_FAILED;
+    jit_stats.failed++;
+  }
+  free(c.code.p);
+  return jit->state == LISP_JIT_READY;
+}
+
+// every function reachable from jit must be compiled for the current env, and
+// no global it calls may be shadowed by a parameter of an interpreted caller.
+static int lisp_jit_runnable(lisp_jit* jit, env_t* e, unsigned long visit) {
+  size_t i;
+  if(jit->visited == visit) return 1;
+  jit->visited = visit;
+  if(jit->state != LISP_JIT_READY || jit->version != e->version) return 0;
+  for(i = 0; i < jit->links.top; i++)
+    if(e->shadow[LISP_SHADOW_BUCKET(jit->links.p[i].name)] != 0 || !lisp_jit_runnable(jit->links.p[i].target, e, visit))
+      return 0;
+  return 1;
+}
+
+lisp_jit* lisp_jit_enter(lisp_value* lambda, env_t* e) {
+  lisp_value* head = &lambda->u.a.e[0];
+  lisp_jit* jit = head->u.fn.jit;
+  if(!jit_enabled) return NULL;
+  if(jit == NULL) {
+    if(++head->u.fn.calls < LISP_JIT_THRESHOLD || lambda->u.a.e[1].u.a.size > LISP_JIT_MAX_ARGS)
+      return NULL;
+    jit = jit_record(lambda);
+  }
+  if(jit->version != e->version && !lisp_jit_compile(jit, e))
+    return NULL;
+  if(!lisp_jit_runnable(jit, e, ++jit_visits))
+    return NULL;
+  return jit;
+}
+
+void lisp_jit_call(lisp_jit* jit, const double* args, lisp_value* result) {
+  double n = jit->entry(args);
+  jit_stats.native_calls++;
+  if(jit->kind == LISP_JIT_BOOL)
+    result->type = n != 0 ? LISP_TRUE : LISP_FALSE;
+  else {
+    result->type = LISP_NUMBER;
+    result->u.n = n;
+  }
+}
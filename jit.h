@@ -0,0 +1,28 @@
+#ifndef LEPT_JIT__
+#define LEPT_JIT__
+#include "parse.h"
+#include "eval.h"
+
+#ifndef LISP_JIT_THRESHOLD
+#define LISP_JIT_THRESHOLD 16
+#endif
+#ifndef LISP_JIT_MAX_ARGS
+#define LISP_JIT_MAX_ARGS 8
+#endif
+
+typedef struct lisp_jit lisp_jit;
+
+typedef struct lisp_jit_stats lisp_jit_stats;
+struct lisp_jit_stats {
+  size_t compiled, failed, native_calls;
+};
+
+void lisp_jit_enable(int on);
+void lisp_get_jit_stats(lisp_jit_stats* s);
+
+// used by the evaluator's application path
+lisp_jit* lisp_jit_enter(lisp_value* lambda, env_t* e);
+size_t lisp_jit_arity(const lisp_jit* jit);
+void lisp_jit_call(lisp_jit* jit, const double* args, lisp_value* result);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * lisp_load: load generator for lisp_server.
+ *
+ *   lisp_load [-c connections] [-d depth] [-n requests] [-s setup] path [expr]
+ *
+ * every connection first sends the `setup` line and waits for its answer,
+ * then keeps `depth` requests of `expr` in flight until the `requests` are
+ * spread over the connections. a request's latency runs from the moment it
+ * was written to the moment its response line arrived. the report is a JSON
+ * object on stdout: throughput, latency percentiles in microseconds, and
+ * the number of "error" responses. by default fib is defined and (fib 15)
+ * requested.
+ */
+
+#define LOAD_EVENTS	64
+#define LOAD_READ	4096
+
+typedef struct client client;
+struct client {
+  int fd;
+  size_t quota, sent, received;
+  double* started;    // ring of depth send times
+  char* in;
+  size_t in_top;
+};
+
+static const char* load_expr = "(fib 15)";
+static size_t load_depth = 16, load_errors;
+static double* latencies;
+static size_t latencies_top;
+
+static double now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static int load_connect(const char* path) {
+  struct sockaddr_un addr;
+  int fd;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror(path);
+    exit(1);
+  }
+  return fd;
+}
+
+static void load_write(int fd, const char* s, size_t size) {
+  ssize_t n;
+  while(size > 0) {
+    if((n = send(fd, s, size, MSG_NOSIGNAL)) < 0) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK) continue;    // the server reads behind, spin
+      perror("send");
+      exit(1);
+    }
+    s += n;
+    size -= (size_t)n;
+  }
+}
+
+// the setup line and its answer, before the connection turns non-blocking.
+static void load_setup(client* c, const char* setup) {
+  char ch;
+  load_write(c->fd, setup, strlen(setup));
+  load_write(c->fd, "\n", 1);
+  do {
+    if(read(c->fd, &ch, 1) != 1) {
+      fprintf(stderr, "the server closed the connection during setup\n");
+      exit(1);
+    }
+  } while(ch != '\n');
+}
+
+// top up the requests in flight, written as one batch.
+static void load_fill(client* c, char* batch, size_t line) {
+  size_t top = 0;
+  double now = now_ns();
+  while(c->sent < c->quota && c->sent - c->received < load_depth) {
+    memcpy(batch + top, load_expr, line - 1);
+    batch[top + line - 1] = '\n';
+    top += line;
+    c->started[c->sent++ % load_depth] = now;
+  }
+  if(top != 0)
+    load_write(c->fd, batch, top);
+}
+
+// returns how many responses were complete.
+static size_t load_read(client* c) {
+  double now;
+  size_t count = 0;
+  char *p, *nl, *end;
+  ssize_t n;
+  while((n = read(c->fd, c->in + c->in_top, LOAD_READ - c->in_top)) > 0) {
+    now = now_ns();
+    c->in_top += (size_t)n;
+    end = c->in + c->in_top;
+    for(p = c->in; (nl = (char*)memchr(p, '\n', end - p)) != NULL; p = nl + 1) {
+      if(end - p >= 5 && strncmp(p, "error", 5) == 0)
+        load_errors++;
+      latencies[latencies_top++] = (now - c->started[c->received++ % load_depth]) / 1e3;
+      count++;
+    }
+    c->in_top = end - p;
+    if(c->in_top == LOAD_READ) {
+      fprintf(stderr, "response line too long\n");
+      exit(1);
+    }
+    memmove(c->in, p, c->in_top);
+  }
+  if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    fprintf(stderr, "the server closed a connection\n");
+    exit(1);
+  }
+  return count;
+}
+
+int main(int argc, char** argv) {
+  const char* setup = "(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))";
+  struct epoll_event ev, events[LOAD_EVENTS];
+  size_t connections = 1, requests = 10000, received = 0, i, line;
+  client* clients;
+  char* batch;
+  double start, seconds;
+  int opt, epoll, n, j;
+
+  while((opt = getopt(argc, argv, "c:d:n:s:")) != -1) {
+    switch(opt) {
+      case 'c':	connections = (size_t)atol(optarg); break;
+      case 'd':	load_depth = (size_t)atol(optarg); break;
+      case 'n':	requests = (size_t)atol(optarg); break;
+      case 's':	setup = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-c connections] [-d depth] [-n requests] [-s setup] path [expr]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind == argc || optind + 2 < argc || connections == 0 || load_depth == 0 || requests == 0) {
+    fprintf(stderr, "usage: %s [-c connections] [-d depth] [-n requests] [-s setup] path [expr]\n", argv[0]);
+    return 1;
+  }
+  if(optind + 1 < argc)
+    load_expr = argv[optind + 1];
+  line = strlen(load_expr) + 1;
+
+  clients = (client*)calloc(connections, sizeof(client));
+  latencies = (double*)malloc(requests * sizeof(double));
+  batch = (char*)malloc(line * load_depth);
+  epoll = epoll_create1(EPOLL_CLOEXEC);
+  for(i = 0; i < connections; i++) {
+    clients[i].fd = load_connect(argv[optind]);
+    clients[i].quota = requests / connections + (i < requests % connections);
+    clients[i].started = (double*)malloc(load_depth * sizeof(double));
+    clients[i].in = (char*)malloc(LOAD_READ);
+    if(*setup != '\0')
+      load_setup(&clients[i], setup);
+    fcntl(clients[i].fd, F_SETFL, fcntl(clients[i].fd, F_GETFL) | O_NONBLOCK);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &clients[i];
+    epoll_ctl(epoll, EPOLL_CTL_ADD, clients[i].fd, &ev);
+  }
+
+  start = now_ns();
+  for(i = 0; i < connections; i++)
+    load_fill(&clients[i], batch, line);
+  while(received < requests) {
+    if((n = epoll_wait(epoll, events, LOAD_EVENTS, -1)) < 0) {
+      if(errno == EINTR) continue;
+      perror("epoll_wait");
+      return 1;
+    }
+    for(j = 0; j < n; j++) {
+      received += load_read((client*)events[j].data.ptr);
+      load_fill((client*)events[j].data.ptr, batch, line);
+    }
+  }
+  seconds = (now_ns() - start) / 1e9;
+
+  qsort(latencies, latencies_top, sizeof(double), cmp_double);
+  printf("{\"connections\": %zu, \"depth\": %zu, \"requests\": %zu, \"errors\": %zu, \"seconds\": %.3f, "
+      "\"requests_per_s\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}\n",
+      connections, load_depth, requests, load_errors, seconds, requests / seconds,
+      latencies[latencies_top / 2], latencies[latencies_top * 99 / 100], latencies[latencies_top - 1]);
+
+  for(i = 0; i < connections; i++) {
+    close(clients[i].fd);
+    free(clients[i].started);
+    free(clients[i].in);
+  }
+  free(clients);
+  free(latencies);
+  free(batch);
+  close(epoll);
+  return 0;
+}
@@ -7,11 +7,18 @@
 #include <assert.h>
 
 #include "parse.h"
+#include "vector.h"
+#include "str.h"
+#include "promise.h"
+#include "perf.h"
+#define LISP_STATS_ALLOCATOR
+#include "stats.h"
 
 #define EXPECT(c, ch)		do { assert((*c->code)==(ch)); c->code++; } while(0)
 #define ISDIGIT(ch) 		((ch)>='0' && (ch)<='9')
 #define ISDIGIT1TO9(ch)		((ch)>='1' && (ch)<='9')
 #define ISVALIDSYMBOL(ch)	(((ch)>='a' && (ch)<='z') || ((ch)>='A' && ((ch)<='Z')) || (ch)=='-' || (ch)=='_')
+#define ISDELIMITER(ch)		((ch)=='\0' || (ch)==' ' || (ch)=='\t' || (ch)=='\r' || (ch)=='\n' || (ch)=='(' || (ch)==')')
 
 #ifndef LISP_PARSE_INIT_STACK_SIZE
 #define LISP_PARSE_INIT_STACK_SIZE 1024
@@ -79,23 +86,36 @@ static int lisp_parse_literal(lisp_context* c, lisp_value* v, const char* litera
   return LISP_PARSE_OK;
 }
 
+// car, cdr, cons, and the c[ad]+r accessors: cadr is (car (cdr x)).
 static int lisp_parse_list_op(lisp_context* c, lisp_value* v) {
   EXPECT(c, 'c');
-  size_t i;
-  char* s = NULL;
-  int type;
-  switch(*c->code) {
-    case 'a': s = "ar"; type = LISP_CAR; break;
-    case 'd': s = "dr"; type = LISP_CDR; break;
-    case 'o': s = "ons"; type = LISP_CONS; break;	// TODO: add list support
-    default : return LISP_PARSE_INVALID_VALUE;
+  size_t i, k, path = 0;
+  const char* s = "ons";
+  if(*c->code == 'o') {    // TODO: add list support
+    for(i = 0; s[i]; i++) {
+      if(c->code[i] != s[i])
+        return LISP_PARSE_INVALID_VALUE;
+    }
+    v->type = LISP_CONS;
+    c->code += i;
+    return LISP_PARSE_OK;
   }
-  for(i = 0; s[i]; i++) {
-    if(c->code[i] != s[i])
-      return LISP_PARSE_INVALID_VALUE;
+  for(i = 0; c->code[i] == 'a' || c->code[i] == 'd'; i++);
+  if(i == 0 || i > LISP_CXR_MAX || c->code[i] != 'r')
+    return LISP_PARSE_INVALID_VALUE;
+  if(i > 1 && !ISDELIMITER(c->code[i + 1]))
+    return LISP_PARSE_INVALID_VALUE;    // cadrx is a symbol, carx stays car x like lambdab
+  for(k = 0; k < i; k++)
+    if(c->code[i - 1 - k] == 'a')
+      path |= (size_t)1 << k;
+  if(i == 1)
+    v->type = path ? LISP_CAR : LISP_CDR;
+  else {
+    v->type = LISP_CXR;
+    v->u.cxr.path = path;
+    v->u.cxr.size = i;
   }
-  v->type = type;
-  c->code += i;
+  c->code += i + 1;
   return LISP_PARSE_OK;
 }
 
@@ -129,19 +149,46 @@ static int lisp_parse_number(lisp_context* c, lisp_value* v) {
 
 
 static int lisp_parse_string(lisp_context* c, lisp_value* v) {
-  assert(ISVALIDSYMBOL(*c->code));
   size_t size = 0;
   const char* p = c->code;
-  while(*p != ' ' && *p != ')')
+  if(!ISVALIDSYMBOL(*c->code))
+    return LISP_PARSE_INVALID_VALUE;    // #t, ), a stray character
+  while(*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '(' && *p != ')')
     PUTC(c, *p++);
   size = p - c->code;
   v->u.sym.size = size;
+  v->u.sym.ic = NULL;
   v->type = LISP_SYMBOL;
   memcpy((v->u.sym.s = (char*)malloc(size+1)), (char*)lisp_context_pop(c, size), size);
+  v->u.sym.s[size] = '\0';
   c->code = p;
   return LISP_PARSE_OK;
 }
 
+// "text", with \" \\ \n and \t escapes.
+static int lisp_parse_quoted(lisp_context* c, lisp_value* v) {
+  size_t size;
+  char ch;
+  EXPECT(c, '"');
+  for(size = 0; (ch = *c->code) != '"'; size++) {
+    if(ch == '\0' || (ch == '\\' && c->code[1] == '\0')) {
+      lisp_context_pop(c, size);
+      return LISP_PARSE_MISS_QUOTATION_MARK;
+    }
+    if(ch == '\\') {
+      switch(ch = *++c->code) {
+        case 'n': ch = '\n'; break;
+        case 't': ch = '\t'; break;
+      }
+    }
+    PUTC(c, ch);
+    c->code++;
+  }
+  c->code++;
+  lisp_str_make(v, (char*)lisp_context_pop(c, size), size);
+  return LISP_PARSE_OK;
+}
+
 static int lisp_parse_value(lisp_context* c, lisp_value* v);
 
 static int lisp_parse_list(lisp_context* c, lisp_value* v) {
@@ -194,10 +241,90 @@ static int lisp_parse_list(lisp_context* c, lisp_value* v) {
   return ret;
 }
 
+// forms matched as whole words, ahead of the prefix matching in lisp_parse_value.
+static const struct {
+  const char* name;
+  size_t size;
+  int type;
+}lisp_keywords[] = {
+  { "time", 4, LISP_TIME },
+  { "bench", 5, LISP_BENCH },
+  { "spawn", 5, LISP_SPAWN },
+  { "make-vector", 11, LISP_MAKE_VECTOR },
+  { "vector", 6, LISP_VECTOR_NEW },
+  { "vector-ref", 10, LISP_VECTOR_REF },
+  { "vector-length", 13, LISP_VECTOR_LENGTH },
+  { "vector+", 7, LISP_VECTOR_ADD },
+  { "vector-", 7, LISP_VECTOR_SUB },
+  { "vector*", 7, LISP_VECTOR_MUL },
+  { "vector/", 7, LISP_VECTOR_DIV },
+  { "vector<", 7, LISP_VECTOR_LT },
+  { "vector>", 7, LISP_VECTOR_BT },
+  { "vector=", 7, LISP_VECTOR_EQ },
+  { "vector-dot", 10, LISP_VECTOR_DOT },
+  { "vector-sum", 10, LISP_VECTOR_SUM },
+  { "vector-min", 10, LISP_VECTOR_MIN },
+  { "vector-max", 10, LISP_VECTOR_MAX },
+  { "load-f64", 8, LISP_LOAD_F64 },
+  { "load-csv", 8, LISP_LOAD_CSV },
+  { "string-length", 13, LISP_STRING_LENGTH },
+  { "string-append", 13, LISP_STRING_APPEND },
+  { "substring", 9, LISP_SUBSTRING },
+  { "string=?", 8, LISP_STRING_EQ },
+  { "string<?", 8, LISP_STRING_LT },
+  { "string-search", 13, LISP_STRING_SEARCH },
+  { "string->number", 14, LISP_STRING_TO_NUMBER },
+  { "number->string", 14, LISP_NUMBER_TO_STRING },
+  { "load-text", 9, LISP_LOAD_TEXT },
+  { "make-table", 10, LISP_MAKE_TABLE },
+  { "table-ref", 9, LISP_TABLE_REF },
+  { "table-set!", 10, LISP_TABLE_SET },
+  { "table-delete!", 13, LISP_TABLE_DELETE },
+  { "table-size", 10, LISP_TABLE_SIZE },
+  { "table-next", 10, LISP_TABLE_NEXT },
+  { "table-key", 9, LISP_TABLE_KEY },
+  { "table-value", 11, LISP_TABLE_VALUE },
+  { "table-free", 10, LISP_TABLE_FREE },
+  { "length", 6, LISP_LENGTH },
+  { "map", 3, LISP_MAP },
+  { "filter", 6, LISP_FILTER },
+  { "fold", 4, LISP_FOLD },
+  { "append", 6, LISP_APPEND },
+  { "reverse", 7, LISP_REVERSE },
+  { "define-macro", 12, LISP_DEFINE_MACRO },
+  { "delay", 5, LISP_DELAY },
+  { "force", 5, LISP_FORCE },
+  { "stream-cons", 11, LISP_STREAM_CONS },
+  { "stream-car", 10, LISP_STREAM_CAR },
+  { "stream-cdr", 10, LISP_STREAM_CDR },
+  { "stream-take", 11, LISP_STREAM_TAKE },
+  { "set!", 4, LISP_SET },
+  { "let", 3, LISP_LET },
+  { "do", 2, LISP_DO }
+};
+
+static int lisp_parse_keyword(lisp_context* c, lisp_value* v) {
+  size_t i;
+  char end;
+  for(i = 0; i < sizeof(lisp_keywords)/sizeof(lisp_keywords[0]); i++) {
+    if(strncmp(c->code, lisp_keywords[i].name, lisp_keywords[i].size) != 0)
+      continue;
+    end = c->code[lisp_keywords[i].size];
+    if(ISDELIMITER(end)) {
+      c->code += lisp_keywords[i].size;
+      v->type = lisp_keywords[i].type;
+      return LISP_PARSE_OK;
+    }
+  }
+  return LISP_PARSE_INVALID_VALUE;
+}
+
 // recursive root
 static int lisp_parse_value(lisp_context* c, lisp_value* v) {
   int ret, a = 0;
   assert(c != NULL && v != NULL);
+  if(ISVALIDSYMBOL(*c->code) && lisp_parse_keyword(c, v) == LISP_PARSE_OK)
+    return LISP_PARSE_OK;
   switch(*c->code) {
     case '+': return lisp_parse_operator(c, v, '+', LISP_PLUS);
     case '-':
@@ -209,6 +336,7 @@ static int lisp_parse_value(lisp_context* c, lisp_value* v) {
     case '>': return lisp_parse_operator(c, v, '>', LISP_BT);
     case '=': return lisp_parse_operator(c, v, '=', LISP_EQ);
     case '(': return lisp_parse_list(c, v);
+    case '"': return lisp_parse_quoted(c, v);
     case '0':
     case '1':
     case '2':
@@ -220,7 +348,7 @@ static int lisp_parse_value(lisp_context* c, lisp_value* v) {
     case '8':
     case '9': return lisp_parse_number(c, v);
     case 'd': if((ret = lisp_parse_literal(c, v, "define", LISP_DEFINE)) == LISP_PARSE_OK) return ret; a = 1; break;
-    case 'l': if((ret = lisp_parse_literal(c, v, "lambda", LISP_LAMBDA)) == LISP_PARSE_OK) return ret; a = 1; break;
+    case 'l': if((ret = lisp_parse_literal(c, v, "lambda", LISP_LAMBDA)) == LISP_PARSE_OK) { v->u.fn.running = 0; return ret; } a = 1; break;
     case 'i': if((ret = lisp_parse_literal(c, v, "if", LISP_IF)) == LISP_PARSE_OK) return ret; a = 1; break;
     case 'n': 
                 if(*(c->code+1) == 'o')
@@ -228,7 +356,7 @@ static int lisp_parse_value(lisp_context* c, lisp_value* v) {
                 else
                 { if((ret = lisp_parse_literal(c, v, "null?", LISP_NULL$)) == LISP_PARSE_OK) return ret; a = 1; break; }
     case 'q': if((ret = lisp_parse_literal(c, v, "quote", LISP_QUOTE)) == LISP_PARSE_OK) return ret; a = 1; break;
-    case 'c': if((ret = lisp_parse_list_op(c, v)) == LISP_PARSE_OK) return ret; break;
+    case 'c': if((ret = lisp_parse_list_op(c, v)) == LISP_PARSE_OK) return ret; a = 1; break;
     default : ;	// TODO: add procedure definition supports
   }
   c->code -= a;
@@ -238,16 +366,19 @@ static int lisp_parse_value(lisp_context* c, lisp_value* v) {
 int lisp_parse(lisp_value* v, const char* code) {
   int ret;
   lisp_context c;
+  LISP_PERF_BEGIN(LISP_PERF_PARSE);
   lisp_context_init(&c, code);
   lisp_parse_whitespace(&c);
   if((ret = lisp_parse_value(&c, v)) == LISP_PARSE_OK) {
     lisp_parse_whitespace(&c);
     if(*c.code != '\0') {
-      v->type = LISP_NULL;
-      return LISP_PARSE_ROOT_NOT_SINGULAR;
+      lisp_value_free(v);
+      ret = LISP_PARSE_ROOT_NOT_SINGULAR;
     }
   }
   assert(c.top == 0);
+  free(c.stack);
+  LISP_PERF_END(LISP_PERF_PARSE);
   return ret;
 }
 
@@ -263,12 +394,62 @@ void lisp_value_free(lisp_value* v) {
       break;
     case LISP_SYMBOL:
       free(v->u.sym.s);
+      free(v->u.sym.ic);
+      break;
+    case LISP_VECTOR:
+      lisp_vec_free(v->u.vec.d, v->u.vec.size, v->u.vec.map);
+      break;
+    case LISP_STRING:
+      lisp_str_free(v);
+      break;
+    case LISP_PROMISE:
+      lisp_promise_free(v);
       break;
     default: ;
   }
   v->type = LISP_NULL;
 }
 
+void lisp_value_copy(lisp_value* dst, const lisp_value* src) {
+  assert(dst != NULL && src != NULL);
+  size_t i;
+  switch(src->type) {
+    case LISP_LIST:
+      dst->type = LISP_LIST;
+      dst->u.a.size = src->u.a.size;
+      dst->u.a.e = src->u.a.size != 0 ? (lisp_value*)malloc(src->u.a.size * sizeof(lisp_value)) : NULL;
+      for(i = 0; i < src->u.a.size; i++)
+        lisp_value_copy(&dst->u.a.e[i], &src->u.a.e[i]);
+      break;
+    case LISP_SYMBOL:
+      *dst = *src;
+      dst->u.sym.ic = NULL;
+      memcpy((dst->u.sym.s = (char*)malloc(src->u.sym.size+1)), src->u.sym.s, src->u.sym.size);
+      dst->u.sym.s[src->u.sym.size] = '\0';
+      break;
+    case LISP_LAMBDA:
+      dst->type = LISP_LAMBDA;
+      dst->u.fn.calls = 0;
+      dst->u.fn.jit = NULL;
+      dst->u.fn.running = 0;
+      break;
+    case LISP_VECTOR:
+      *dst = *src;
+      dst->u.vec.map = 0;
+      if((dst->u.vec.d = lisp_vec_alloc(src->u.vec.size)) != NULL)
+        memcpy(dst->u.vec.d, src->u.vec.d, src->u.vec.size * sizeof(double));
+      else dst->u.vec.size = 0;
+      break;
+    case LISP_STRING:
+      lisp_str_ref(dst, src);
+      break;
+    case LISP_PROMISE:
+      lisp_promise_ref(dst, src);
+      break;
+    default: *dst = *src;
+  }
+}
+
 int lisp_get_type(const lisp_value* v) {
   assert(v != NULL);
   return v->type;
@@ -309,16 +490,53 @@ static void lisp_stringfy_number(lisp_context* c, const lisp_value* v) {
     PUTC(c, buf[i++]);
 }
 
+// (vector 1 2 3), so that it reads back as the form making it.
+static void lisp_stringfy_vector(lisp_context* c, const lisp_value* v) {
+  size_t i;
+  lisp_value n;
+  n.type = LISP_NUMBER;
+  memcpy((char*)lisp_context_push(c, 7), "(vector", 7);
+  for(i = 0; i < v->u.vec.size; i++) {
+    PUTC(c, ' ');
+    n.u.n = v->u.vec.d[i];
+    lisp_stringfy_number(c, &n);
+  }
+  PUTC(c, ')');
+}
+
+// quoted and escaped the way lisp_parse_quoted reads it.
+static void lisp_stringfy_string(lisp_context* c, const lisp_value* v) {
+  const char* s = lisp_str_data(v);
+  size_t i;
+  PUTC(c, '"');
+  for(i = 0; i < lisp_str_size(v); i++) {
+    switch(s[i]) {
+      case '"':	case '\\':	PUTC(c, '\\'); PUTC(c, s[i]); break;
+      case '\n':	PUTC(c, '\\'); PUTC(c, 'n'); break;
+      case '\t':	PUTC(c, '\\'); PUTC(c, 't'); break;
+      default:	PUTC(c, s[i]);
+    }
+  }
+  PUTC(c, '"');
+}
+
 static void lisp_stringfy_value(lisp_context* c, const lisp_value* v) {
   size_t i;
   switch(lisp_get_type(v)) {
-    case LISP_PLUS:        PUTC(c, '+'); break;
-    case LISP_MINUS:	PUTC(c, '-'); break;
-    case LISP_MULTIPLY: PUTC(c, '*'); break;
-    case LISP_DIVIDE: 	PUTC(c, '/'); break;
-    case LISP_LT:         PUTC(c, '<'); break;
-    case LISP_BT:         PUTC(c, '>'); break;
-    case LISP_EQ:         PUTC(c, '='); break;
+    case LISP_PLUS:
+    case LISP_NUM_PLUS:        PUTC(c, '+'); break;
+    case LISP_MINUS:
+    case LISP_NUM_MINUS:	PUTC(c, '-'); break;
+    case LISP_MULTIPLY:
+    case LISP_NUM_MULTIPLY: PUTC(c, '*'); break;
+    case LISP_DIVIDE:
+    case LISP_NUM_DIVIDE: 	PUTC(c, '/'); break;
+    case LISP_LT:
+    case LISP_NUM_LT:         PUTC(c, '<'); break;
+    case LISP_BT:
+    case LISP_NUM_BT:         PUTC(c, '>'); break;
+    case LISP_EQ:
+    case LISP_NUM_EQ:         PUTC(c, '='); break;
     case LISP_TRUE: 	PUTC(c, '1'); break;
     case LISP_FALSE: 	PUTC(c, '0'); break;
     case LISP_NUMBER: 	lisp_stringfy_number(c, v); break;
@@ -328,9 +546,22 @@ static void lisp_stringfy_value(lisp_context* c, const lisp_value* v) {
     case LISP_NOT:         memcpy((char*)lisp_context_push(c, 3), "not", 	 3); break;
     case LISP_CAR:         memcpy((char*)lisp_context_push(c, 3), "car", 	 3); break;
     case LISP_CDR:         memcpy((char*)lisp_context_push(c, 3), "cdr", 	 3); break;
+    case LISP_CXR:
+                      PUTC(c, 'c');
+                      for(i = v->u.cxr.size; i-- > 0;)
+                        PUTC(c, v->u.cxr.path >> i & 1 ? 'a' : 'd');
+                      PUTC(c, 'r');
+                      break;
     case LISP_QUOTE:	memcpy((char*)lisp_context_push(c, 5), "quote",  5); break;
     case LISP_NULL$:	memcpy((char*)lisp_context_push(c, 5), "null?",  5); break;
     case LISP_SYMBOL:	memcpy((char*)lisp_context_push(c, v->u.sym.size), v->u.sym.s, v->u.sym.size); break;
+    case LISP_NATIVE:	memcpy((char*)lisp_context_push(c, 9), "#<native>", 9); break;
+    case LISP_PROMISE:	memcpy((char*)lisp_context_push(c, 10), "#<promise>", 10); break;
+    case LISP_TIME:	memcpy((char*)lisp_context_push(c, 4), "time",   4); break;
+    case LISP_BENCH:	memcpy((char*)lisp_context_push(c, 5), "bench",  5); break;
+    case LISP_SPAWN:	memcpy((char*)lisp_context_push(c, 5), "spawn",  5); break;
+    case LISP_VECTOR:	lisp_stringfy_vector(c, v); break;
+    case LISP_STRING:	lisp_stringfy_string(c, v); break;
 
     case LISP_LIST:
                       PUTC(c, '(');
@@ -342,6 +573,10 @@ static void lisp_stringfy_value(lisp_context* c, const lisp_value* v) {
                         lisp_context_pop(c, 1);
                       PUTC(c, ')');
                       break;
+    default:	// the forms of lisp_keywords
+                      for(i = 0; i < sizeof(lisp_keywords)/sizeof(lisp_keywords[0]); i++)
+                        if(lisp_keywords[i].type == v->type)
+                          memcpy((char*)lisp_context_push(c, lisp_keywords[i].size), lisp_keywords[i].name, lisp_keywords[i].size);
   }
 }
 
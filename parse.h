@@ -27,15 +27,94 @@ enum value_type {
   LISP_IF,
   LISP_NOT,
   LISP_SYMBOL,
-  LISP_NIL
+  LISP_NIL,
+  // operators specialized by the evaluator's type inference, they work on raw doubles.
+  LISP_NUM_PLUS,
+  LISP_NUM_MINUS,
+  LISP_NUM_MULTIPLY,
+  LISP_NUM_DIVIDE,
+  LISP_NUM_LT,
+  LISP_NUM_BT,
+  LISP_NUM_EQ,
+  LISP_NATIVE,    // C function over numbers, bound with lisp_define_native_number
+  LISP_TIME,
+  LISP_BENCH,
+  LISP_SPAWN,
+  LISP_VECTOR,    // contiguous doubles, see vector.h
+  LISP_MAKE_VECTOR,
+  LISP_VECTOR_NEW,
+  LISP_VECTOR_REF,
+  LISP_VECTOR_LENGTH,
+  // elementwise forms and reductions, in the order of the kernels' operations.
+  LISP_VECTOR_ADD,
+  LISP_VECTOR_SUB,
+  LISP_VECTOR_MUL,
+  LISP_VECTOR_DIV,
+  LISP_VECTOR_LT,
+  LISP_VECTOR_BT,
+  LISP_VECTOR_EQ,
+  LISP_VECTOR_DOT,
+  LISP_VECTOR_SUM,
+  LISP_VECTOR_MIN,
+  LISP_VECTOR_MAX,
+  LISP_LOAD_F64,
+  LISP_LOAD_CSV,
+  LISP_STRING,    // bytes, see str.h
+  LISP_STRING_LENGTH,
+  LISP_STRING_APPEND,
+  LISP_SUBSTRING,
+  LISP_STRING_EQ,
+  LISP_STRING_LT,
+  LISP_STRING_SEARCH,
+  LISP_STRING_TO_NUMBER,
+  LISP_NUMBER_TO_STRING,
+  LISP_LOAD_TEXT,
+  LISP_MAKE_TABLE,    // tables are numbers, see table.h. keep the table forms together
+  LISP_TABLE_REF,
+  LISP_TABLE_SET,
+  LISP_TABLE_DELETE,
+  LISP_TABLE_SIZE,
+  LISP_TABLE_NEXT,
+  LISP_TABLE_KEY,
+  LISP_TABLE_VALUE,
+  LISP_TABLE_FREE,
+  LISP_LENGTH,    // the list library, see eval.c. keep the list forms together
+  LISP_MAP,
+  LISP_FILTER,
+  LISP_FOLD,
+  LISP_APPEND,
+  LISP_REVERSE,
+  LISP_CXR,    // cadr, cddr and the like, see u.cxr
+  LISP_DEFINE_MACRO,    // bound to a macro, the form is its own value, see eval.c
+  LISP_PROMISE,    // what delay makes, see promise.h. keep the stream forms after it
+  LISP_DELAY,
+  LISP_FORCE,
+  LISP_STREAM_CONS,
+  LISP_STREAM_CAR,
+  LISP_STREAM_CDR,
+  LISP_STREAM_TAKE,
+  LISP_SET,    // set!, let and do, see eval.c
+  LISP_LET,
+  LISP_DO,
+  LISP_TYPES    // number of types, keep it last
 };
 
 typedef struct lisp_value lisp_value;
 
+#define LISP_CXR_MAX	(sizeof(size_t) * 8)    // letters of the longest c[ad]+r
+#define LISP_STRING_INLINE	16    // longest string kept in the value itself
+
 struct lisp_value {
   union {
     struct { lisp_value* e; size_t size; }a;
-    struct { char* s; size_t size; }sym;
+    struct { char* s; size_t size; struct lisp_ic* ic; }sym;    // ic: inline cache of a call site head, see eval.c
+    struct { size_t proven; }op;    // specialized operator: bit i set if operand i+1 is known to be a number
+    struct { size_t calls; struct lisp_jit* jit; size_t running; }fn;    // lambda head: call count and native code, see jit.c; applications in progress
+    struct { size_t path, size; }cxr;    // size steps, bit i of path set if step i is a car. the rightmost letter is step 0
+    struct { double (*fn)(const double* args); size_t arity; int boolean; int (*call)(lisp_value* args, size_t count); }native;    // call: see lisp_define_native, fn is unused then
+    struct { struct lisp_promise* p; }promise;    // see promise.h
+    struct { double* d; size_t size, map; }vec;    // map: 0 if d is from lisp_vec_alloc, see lisp_vec_free
+    struct { union { char in[LISP_STRING_INLINE]; struct { const char* p; struct lisp_str_buf* buf; }h; }d; size_t size; }str;    // see str.h
     double n;
   }u;
   int type;
@@ -48,7 +127,8 @@ enum parse_state {
   LISP_PARSE_NUMBER_TOO_BIG,
   LISP_PARSE_ROOT_NOT_SINGULAR,
   LISP_PARSE_MISS_CLOSE_PRAN,
-  LISP_PARSE_NULL
+  LISP_PARSE_NULL,
+  LISP_PARSE_MISS_QUOTATION_MARK
 };
 
 #define lisp_value_init(v) \
@@ -59,6 +139,7 @@ enum parse_state {
   } while(0)
 
 void lisp_value_free(lisp_value* v);
+void lisp_value_copy(lisp_value* dst, const lisp_value* src);
 
 int lisp_parse(lisp_value* v, const char* code);
 
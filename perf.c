@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf.h"
+
+static const struct {
+  const char* name;
+  unsigned type;
+  unsigned long long config;
+}perf_events[LISP_PERF_COUNTERS] = {
+  { "cycles",			PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions",		PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "branch-misses",	PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  { "cache-misses",		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { "task-clock-ns",	PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK }
+};
+
+static const char* perf_phases[LISP_PERF_PHASES] = { "parse", "eval" };
+
+// every counter that opened is in one group, read at once at both ends of a call.
+static LISP_THREAD_LOCAL struct {
+  int fd[LISP_PERF_COUNTERS];    // -1 if the counter is unavailable
+  int slot[LISP_PERF_COUNTERS];    // position in the group read
+  int leader, size, enabled;
+  int depth[LISP_PERF_PHASES];
+  unsigned long long start[LISP_PERF_PHASES][LISP_PERF_COUNTERS];
+  lisp_perf_sample last[LISP_PERF_PHASES], total[LISP_PERF_PHASES];
+}perf = { { -1, -1, -1, -1, -1 }, { 0 }, -1 };
+
+static int perf_open(int counter, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = perf_events[counter].type;
+  attr.config = perf_events[counter].config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void perf_close() {
+  int i;
+  for(i = 0; i < LISP_PERF_COUNTERS; i++) {
+    if(perf.fd[i] != -1)
+      close(perf.fd[i]);
+    perf.fd[i] = -1;
+  }
+  perf.leader = -1;
+  perf.size = 0;
+}
+
+int lisp_perf_enable(int on) {
+  int i;
+  perf_close();
+  perf.enabled = 0;
+  if(!on) return 0;
+  for(i = 0; i < LISP_PERF_COUNTERS; i++) {
+    if((perf.fd[i] = perf_open(i, perf.leader)) == -1)
+      continue;
+    if(perf.leader == -1)
+      perf.leader = perf.fd[i];
+    perf.slot[i] = perf.size++;
+  }
+  memset(perf.depth, 0, sizeof(perf.depth));
+  perf.enabled = perf.size != 0;
+  return perf.size;
+}
+
+int lisp_perf_available(int counter) {
+  return perf.fd[counter] != -1;
+}
+
+static int perf_read(unsigned long long* counts) {
+  unsigned long long buf[1 + LISP_PERF_COUNTERS];
+  int i;
+  if(read(perf.leader, buf, sizeof(buf)) < (ssize_t)sizeof(buf[0]) || buf[0] != (unsigned long long)perf.size)
+    return 0;
+  for(i = 0; i < LISP_PERF_COUNTERS; i++)
+    counts[i] = perf.fd[i] != -1 ? buf[1 + perf.slot[i]] : 0;
+  return 1;
+}
+
+// calls nest, e.g. a load function evaluating defines: only the outermost is counted.
+void lisp_perf_begin(int phase) {
+  if(!perf.enabled || perf.depth[phase]++ != 0) return;
+  if(!perf_read(perf.start[phase]))
+    perf.depth[phase] = 0, perf.enabled = 0;
+}
+
+void lisp_perf_end(int phase) {
+  unsigned long long now[LISP_PERF_COUNTERS];
+  lisp_perf_sample* last = &perf.last[phase];
+  int i;
+  if(!perf.enabled || --perf.depth[phase] != 0) return;
+  if(!perf_read(now)) {
+    perf.enabled = 0;
+    return;
+  }
+  for(i = 0; i < LISP_PERF_COUNTERS; i++) {
+    last->counts[i] = now[i] - perf.start[phase][i];
+    perf.total[phase].counts[i] += last->counts[i];
+  }
+  last->calls = 1;
+  perf.total[phase].calls++;
+}
+
+void lisp_perf_last(int phase, lisp_perf_sample* s) {
+  *s = perf.last[phase];
+}
+
+void lisp_perf_total(int phase, lisp_perf_sample* s) {
+  *s = perf.total[phase];
+}
+
+void lisp_perf_reset() {
+  memset(perf.last, 0, sizeof(perf.last));
+  memset(perf.total, 0, sizeof(perf.total));
+}
+
+void lisp_perf_report(FILE* out) {
+  int i, j;
+  if(perf.size == 0) {
+    fprintf(out, "perf: no counters available\n");
+    return;
+  }
+  for(i = 0; i < LISP_PERF_PHASES; i++) {
+    fprintf(out, "%-6s %10lu calls\n", perf_phases[i], perf.total[i].calls);
+    for(j = 0; j < LISP_PERF_COUNTERS; j++) {
+      if(perf.fd[j] == -1)
+        fprintf(out, "       %14s %s\n", "-", perf_events[j].name);
+      else fprintf(out, "       %14llu %s, %.1f per call\n", perf.total[i].counts[j], perf_events[j].name,
+          perf.total[i].calls != 0 ? (double)perf.total[i].counts[j] / perf.total[i].calls : 0.0);
+    }
+  }
+}
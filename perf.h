@@ -0,0 +1,52 @@
+#ifndef LEPT_PERF__
+#define LEPT_PERF__
+#include <stdio.h>
+#include "eval.h"
+
+/*
+ * hardware counters around lisp_parse and lisp_eval, read with Linux
+ * perf_event_open. built with LISP_PERF and off until lisp_perf_enable(1).
+ * the counters follow the thread that opened them: with LISP_THREADS each
+ * thread enables, reads and resets its own.
+ */
+
+enum {
+  LISP_PERF_CYCLES,
+  LISP_PERF_INSTRUCTIONS,
+  LISP_PERF_BRANCH_MISSES,
+  LISP_PERF_CACHE_MISSES,
+  LISP_PERF_TASK_CLOCK,    // ns on the cpu, a software counter that is there when the others are not
+  LISP_PERF_COUNTERS
+};
+
+enum {
+  LISP_PERF_PARSE,
+  LISP_PERF_EVAL,
+  LISP_PERF_PHASES
+};
+
+typedef struct lisp_perf_sample lisp_perf_sample;
+struct lisp_perf_sample {
+  unsigned long long counts[LISP_PERF_COUNTERS];
+  unsigned long calls;
+};
+
+#ifdef LISP_PERF
+// returns the number of counters that could be opened, 0 if none: the hooks then do nothing.
+int lisp_perf_enable(int on);
+int lisp_perf_available(int counter);
+void lisp_perf_last(int phase, lisp_perf_sample* s);     // the last outermost call
+void lisp_perf_total(int phase, lisp_perf_sample* s);    // every call since the last reset
+void lisp_perf_reset();
+void lisp_perf_report(FILE* out);
+
+void lisp_perf_begin(int phase);
+void lisp_perf_end(int phase);
+#define LISP_PERF_BEGIN(phase)	lisp_perf_begin(phase)
+#define LISP_PERF_END(phase)	lisp_perf_end(phase)
+#else
+#define LISP_PERF_BEGIN(phase)	do { } while(0)
+#define LISP_PERF_END(phase)	do { } while(0)
+#endif
+
+#endif
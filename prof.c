@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#ifdef LISP_THREADS
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "prof.h"
+
+#define PROF_BUFFER	(1 << 20)    // bytes of folded stacks kept between reports
+
+LISP_THREAD_LOCAL lisp_prof_stack lisp_prof;
+
+// samples are appended by the handler as NUL-terminated folded stacks.
+static LISP_THREAD_LOCAL struct {
+  char* buffer;
+  size_t used;
+  lisp_prof_stats stats;
+#ifdef LISP_THREADS
+  timer_t timer;
+  int armed;
+#endif
+}prof;
+
+static void prof_append(size_t* at, const volatile char* s, size_t size) {
+  size_t i;
+  for(i = 0; i < size; i++)
+    prof.buffer[(*at)++] = s[i];
+}
+
+static void prof_sample(int sig) {
+  size_t depth = lisp_prof.depth, named = depth < LISP_PROF_DEPTH ? depth : LISP_PROF_DEPTH;
+  size_t need = 1, at = prof.used, i;
+  (void)sig;
+  if(depth == 0) need += sizeof("[toplevel]");
+  for(i = 0; i < named; i++)
+    need += lisp_prof.frames[i].size + 1;
+  if(depth > named) need += sizeof(";...");
+  if(prof.buffer == NULL || prof.used + need > PROF_BUFFER) {
+    prof.stats.dropped++;
+    return;
+  }
+  if(depth == 0) prof_append(&at, "[toplevel]", sizeof("[toplevel]") - 1);
+  for(i = 0; i < named; i++) {
+    if(i != 0) prof.buffer[at++] = ';';
+    prof_append(&at, lisp_prof.frames[i].name, lisp_prof.frames[i].size);
+  }
+  if(depth > named) prof_append(&at, ";...", sizeof(";...") - 1);
+  prof.buffer[at++] = '\0';
+  prof.used = at;
+  prof.stats.samples++;
+}
+
+#ifdef LISP_THREADS
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id	_sigev_un._tid
+#endif
+
+// an itimer counts the cpu time of the whole process and signals any thread;
+// this one counts the calling thread's cpu time and signals that thread only.
+static int prof_timer(const struct itimerval* timer) {
+  struct itimerspec spec;
+  struct sigevent event;
+  if(!prof.armed) {
+    if(timer->it_value.tv_sec == 0 && timer->it_value.tv_usec == 0)
+      return 0;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &prof.timer) != 0)
+      return -1;
+    prof.armed = 1;
+  }
+  spec.it_interval.tv_sec = timer->it_interval.tv_sec;
+  spec.it_interval.tv_nsec = timer->it_interval.tv_usec * 1000;
+  spec.it_value.tv_sec = timer->it_value.tv_sec;
+  spec.it_value.tv_nsec = timer->it_value.tv_usec * 1000;
+  if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    timer_delete(prof.timer);
+    prof.armed = 0;
+    return 0;
+  }
+  return timer_settime(prof.timer, 0, &spec, NULL);
+}
+#else
+static int prof_timer(const struct itimerval* timer) {
+  return setitimer(ITIMER_PROF, timer, NULL);
+}
+#endif
+
+int lisp_prof_enable(int hz) {
+  struct itimerval timer;
+  struct sigaction action;
+  memset(&timer, 0, sizeof(timer));
+  if(hz <= 0) {
+    prof_timer(&timer);
+    lisp_prof.enabled = 0;
+    lisp_prof.depth = 0;
+    return 0;
+  }
+  if(prof.buffer == NULL && (prof.buffer = (char*)malloc(PROF_BUFFER)) == NULL)
+    return -1;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = prof_sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if(sigaction(SIGPROF, &action, NULL) != 0)
+    return -1;
+  timer.it_interval.tv_sec = hz == 1;
+  timer.it_interval.tv_usec = hz >= 1000000 ? 1 : 1000000 / hz % 1000000;
+  timer.it_value = timer.it_interval;
+  lisp_prof.depth = 0;
+  lisp_prof.enabled = 1;
+  if(prof_timer(&timer) != 0) {
+    lisp_prof.enabled = 0;
+    return -1;
+  }
+  return 0;
+}
+
+// the handler does not run while SIGPROF is blocked.
+static void prof_block(int block) {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPROF);
+#ifdef LISP_THREADS
+  pthread_sigmask(block ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+#else
+  sigprocmask(block ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+#endif
+}
+
+void lisp_prof_get_stats(lisp_prof_stats* s) {
+  prof_block(1);
+  *s = prof.stats;
+  prof_block(0);
+}
+
+void lisp_prof_reset() {
+  prof_block(1);
+  free(prof.buffer);
+  prof.buffer = NULL;
+  prof.used = 0;
+  memset(&prof.stats, 0, sizeof(prof.stats));
+  prof_block(0);
+}
+
+static int prof_cmp(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void lisp_prof_report(FILE* out) {
+  char** stacks;
+  size_t count = 0, at, i, run;
+  prof_block(1);
+  if((stacks = (char**)malloc((prof.stats.samples + 1) * sizeof(char*))) == NULL) {
+    prof_block(0);
+    return;
+  }
+  for(at = 0; at < prof.used; at += strlen(prof.buffer + at) + 1)
+    stacks[count++] = prof.buffer + at;
+  qsort(stacks, count, sizeof(char*), prof_cmp);
+  for(i = 0; i < count; i += run) {
+    for(run = 1; i + run < count && strcmp(stacks[i], stacks[i + run]) == 0; run++) ;
+    fprintf(out, "%s %zu\n", stacks[i], run);
+  }
+  free(stacks);
+  prof_block(0);
+}
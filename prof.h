@@ -0,0 +1,66 @@
+#ifndef LEPT_PROF__
+#define LEPT_PROF__
+#include <stdio.h>
+#include <stddef.h>
+#include "eval.h"
+
+/*
+ * sampling profiler: a SIGPROF timer samples a shadow stack of the lisp
+ * functions being applied, and the samples come out as folded stacks
+ * ("f;g;h count" lines) for flamegraph.pl. built with LISP_PROF; without it
+ * the hooks in lisp_apply compile to nothing. with LISP_THREADS the shadow
+ * stack, the samples and the timer are the calling thread's: the timer runs
+ * on that thread's cpu time and a thread profiles its own evaluations.
+ */
+
+#define LISP_PROF_DEPTH	256    // deeper frames are counted but not named
+
+typedef struct lisp_prof_frame lisp_prof_frame;
+struct lisp_prof_frame {
+  const char* name;
+  size_t size;
+};
+
+typedef struct lisp_prof_stats lisp_prof_stats;
+struct lisp_prof_stats {
+  size_t samples, dropped;    // dropped: the sample buffer was full
+};
+
+#ifdef LISP_PROF
+typedef struct lisp_prof_stack lisp_prof_stack;
+struct lisp_prof_stack {
+  volatile int enabled;
+  volatile size_t depth;
+  volatile lisp_prof_frame frames[LISP_PROF_DEPTH];
+};
+extern LISP_THREAD_LOCAL lisp_prof_stack lisp_prof;
+
+// hz samples per second of cpu time, 0 stops the timer. returns 0 on success, -1 if the timer or buffer failed.
+int lisp_prof_enable(int hz);
+void lisp_prof_get_stats(lisp_prof_stats* s);
+void lisp_prof_reset();    // drops the samples and frees their buffer
+void lisp_prof_report(FILE* out);    // folded stacks, one line per distinct stack
+
+// the frame is filled in before depth moves, so the handler never sees a half-written one.
+#define LISP_PROF_PUSH(s, n) \
+  do { \
+    if(lisp_prof.enabled) { \
+      if(lisp_prof.depth < LISP_PROF_DEPTH) { \
+        lisp_prof.frames[lisp_prof.depth].name = (s); \
+        lisp_prof.frames[lisp_prof.depth].size = (n); \
+      } \
+      lisp_prof.depth++; \
+    } \
+  } while(0)
+// frames pushed before lisp_prof_enable were not counted, they pop at depth 0.
+#define LISP_PROF_POP() \
+  do { \
+    if(lisp_prof.depth > 0) \
+      lisp_prof.depth--; \
+  } while(0)
+#else
+#define LISP_PROF_PUSH(s, n)	do { } while(0)
+#define LISP_PROF_POP()	do { } while(0)
+#endif
+
+#endif
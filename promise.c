@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "promise.h"
+#define LISP_STATS_ALLOCATOR
+#include "stats.h"
+
+lisp_promise* lisp_promise_new(lisp_value* v, int kind) {
+  lisp_promise* p = (lisp_promise*)calloc(1, sizeof(lisp_promise));
+  p->refs = 1;
+  p->kind = kind;
+  p->value.type = LISP_NULL;
+  v->type = LISP_PROMISE;
+  v->u.promise.p = p;
+  return p;
+}
+
+void lisp_promise_ref(lisp_value* dst, const lisp_value* src) {
+  assert(src->type == LISP_PROMISE);
+  src->u.promise.p->refs++;
+  *dst = *src;
+}
+
+lisp_promise* lisp_promise_tail(const lisp_value* v) {
+  if(v->type != LISP_LIST || v->u.a.size != 2 || v->u.a.e[0].type != LISP_QUOTE
+      || v->u.a.e[1].type != LISP_LIST || v->u.a.e[1].u.a.size != 2 || v->u.a.e[1].u.a.e[1].type != LISP_PROMISE)
+    return NULL;
+  return v->u.a.e[1].u.a.e[1].u.promise.p;
+}
+
+// the promise v goes on with, taken out of it: v itself, or the rest of a cell.
+// any other value stays for lisp_value_free.
+static lisp_promise* promise_detach(lisp_value* v) {
+  lisp_promise* p;
+  if(v->type == LISP_PROMISE)
+    p = v->u.promise.p;
+  else if((p = lisp_promise_tail(v)) != NULL)
+    v = &v->u.a.e[1].u.a.e[1];
+  if(p != NULL)
+    v->type = LISP_NULL;
+  return p;
+}
+
+// everything but the value.
+static void promise_clear(lisp_promise* p) {
+  size_t i;
+  for(i = 0; p->bindings != NULL && i < p->count; i++)
+    lisp_value_free(&p->bindings[i].value);
+  free(p->bindings);
+  free(p->stages);
+  p->bindings = NULL;
+  p->stages = NULL;
+  p->code = NULL;
+  p->count = 0;
+}
+
+void lisp_promise_free(lisp_value* v) {
+  lisp_promise *p = v->u.promise.p, *next;
+  v->type = LISP_NULL;
+  // the cells of a forced stream are freed in a loop, each promise is not freed within the one before it.
+  for(; p != NULL && --p->refs == 0; p = next) {
+    next = promise_detach(&p->value);
+    promise_clear(p);
+    lisp_value_free(&p->value);
+    free(p);
+  }
+}
+
+void lisp_promise_done(lisp_promise* p, lisp_value* value) {
+  promise_clear(p);
+  lisp_value_free(&p->value);
+  p->value = *value;
+  p->kind = LISP_PROMISE_DONE;
+}
@@ -0,0 +1,58 @@
+#ifndef LEPT_PROMISE__
+#define LEPT_PROMISE__
+#include <stddef.h>
+#include "parse.h"
+
+/*
+ * promises: what delay makes. the first force evaluates it, the value is kept
+ * for the forces after it. a promise is reference counted, copies of it share
+ * it. a stream is a cell (quote (x P)), P the promise of the rest of the
+ * stream, or (quote ()) once it ends:
+ *   (delay x) (force p)
+ *   (stream-cons x y)             a cell of x, with y delayed
+ *   (stream-car s) (stream-cdr s)    stream-cdr forces the rest, one cell is copied
+ *   (stream-take n s)             the first n elements of s, as a stream
+ * map and filter of a stream are streams themselves, fold and length walk one,
+ * see eval.c. a forced promise lets go of what it was forced from, and the cells
+ * a walk has gone past are freed unless something else holds them, so that a
+ * pipeline over a stream runs in as much memory for any length of it.
+ */
+
+enum {
+  LISP_PROMISE_DONE,    // value is what it was forced to
+  LISP_PROMISE_FORCING,    // forcing it again meanwhile is an error
+  LISP_PROMISE_CODE,    // (delay code), the parameters code uses bound as they were
+  LISP_PROMISE_PIPE,    // the map and filter stages of eval.c over the stream in value
+  LISP_PROMISE_TAKE    // the first count elements of the stream in value
+};
+
+typedef struct lisp_promise_binding lisp_promise_binding;
+struct lisp_promise_binding {
+  lisp_value* symbol;    // in the code
+  lisp_value* lambda;    // a lambda, or the named let, it was bound to, it is not copied. NULL: value
+  lisp_value value;
+};
+
+typedef struct lisp_promise lisp_promise;
+struct lisp_promise {
+  size_t refs;
+  int kind;
+  lisp_value value;    // DONE: the value. PIPE, TAKE: a stream cell or a promise of one
+  lisp_value* code;    // CODE, in the parse tree
+  lisp_promise_binding* bindings;    // CODE: count of them
+  void* stages;    // PIPE: count of them
+  size_t count;    // TAKE: elements still to take
+};
+
+// a promise of kind, referenced by v.
+lisp_promise* lisp_promise_new(lisp_value* v, int kind);
+// dst becomes another reference to the promise of src.
+void lisp_promise_ref(lisp_value* dst, const lisp_value* src);
+// drops the reference of v, the promise goes with the last one.
+void lisp_promise_free(lisp_value* v);
+// p is forced to value, which it takes over. what it was forced from is let go.
+void lisp_promise_done(lisp_promise* p, lisp_value* value);
+// the promise of the rest of stream cell v, NULL if v is no cell.
+lisp_promise* lisp_promise_tail(const lisp_value* v);
+
+#endif
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "parse.h"
+#include "eval.h"
+
+/*
+ * lisp_server: evaluates expressions sent over a unix domain socket.
+ *
+ *   lisp_server [-w workers] path
+ *
+ * a request is one expression on a line. the response is a line with the
+ * lisp_stringfy of its value, "nil" for a define, or "error parse <code>" /
+ * "error eval <code>". a client may send any number of requests without
+ * waiting, the responses of a connection come back in the order of its
+ * requests. every connection evaluates in a global env of its own, its
+ * defines and tables are not seen by other connections and go when it closes. a malformed form, like
+ * (define) or (car 1), is answered with its error like any other.
+ *
+ * the workers are threads with their own interpreter state (LISP_THREADS),
+ * each waits on the listening socket and serves the connections it
+ * accepted with epoll. SIGINT or SIGTERM stops the server and removes the
+ * socket. the default is a worker per cpu.
+ */
+
+#define SERVER_EVENTS	64
+#define SERVER_READ	4096
+#define SERVER_MAX_LINE	(1 << 20)    // a longer line closes the connection
+#define SERVER_OUT_HIGH	(1 << 20)    // stop reading while this many response bytes wait
+
+typedef struct buf buf;
+struct buf {
+  char* p;
+  size_t top, size;
+};
+
+typedef struct conn conn;
+struct conn {
+  int fd;
+  size_t index;    // in the worker's conns
+  env_t env;
+  buf in, out;    // in: bytes of a line not yet complete, out: responses from `sent` on not yet written
+  size_t sent;
+  int eof, paused;    // paused: waits for out to drain before reading on
+  struct {
+    lisp_value* p;    // parse trees of defines and macros, env points into them until the connection closes
+    size_t top, size;
+  }defs;
+};
+
+typedef struct worker worker;
+struct worker {
+  pthread_t thread;
+  int epoll;
+  size_t requests;
+  struct {
+    conn** p;
+    size_t top, size;
+  }conns;
+};
+
+static int server_fd = -1, stop_fd = -1;
+static char server_listen, server_stop;    // epoll tags of the two descriptors
+
+static int buf_reserve(buf* b, size_t size) {
+  char* p;
+  size_t n = b->size == 0 ? SERVER_READ : b->size;
+  if(b->top + size <= b->size)
+    return 0;
+  while(n < b->top + size)
+    n += n >> 1;
+  if((p = (char*)realloc(b->p, n)) == NULL)
+    return -1;
+  b->p = p;
+  b->size = n;
+  return 0;
+}
+
+static void buf_append(buf* b, const char* s, size_t size) {
+  if(buf_reserve(b, size) == 0) {
+    memcpy(b->p + b->top, s, size);
+    b->top += size;
+  }
+}
+
+static void conn_close(worker* w, conn* c) {
+  size_t i;
+  epoll_ctl(w->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  w->conns.p[c->index] = w->conns.p[--w->conns.top];
+  w->conns.p[c->index]->index = c->index;
+  env_free(&c->env);
+  for(i = 0; i < c->defs.top; i++)
+    lisp_value_free(&c->defs.p[i]);
+  free(c->defs.p);
+  free(c->in.p);
+  free(c->out.p);
+  free(c);
+}
+
+// one connection per wakeup, the listening socket stays ready and the next goes to another worker.
+static void worker_accept(worker* w) {
+  struct epoll_event ev;
+  conn* c;
+  int fd;
+  if((fd = accept(server_fd, NULL, NULL)) < 0)
+    return;    // EAGAIN: another worker took it
+  if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0 || (c = (conn*)calloc(1, sizeof(conn))) == NULL) {
+    close(fd);
+    return;
+  }
+  if(w->conns.top == w->conns.size) {
+    w->conns.size = w->conns.size == 0 ? 16 : w->conns.size * 2;
+    w->conns.p = (conn**)realloc(w->conns.p, w->conns.size * sizeof(conn*));
+  }
+  c->fd = fd;
+  c->index = w->conns.top;
+  w->conns.p[w->conns.top++] = c;
+  env_init(NULL, &c->env);
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = c;
+  if(epoll_ctl(w->epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+    conn_close(w, c);
+}
+
+static void conn_eval(worker* w, conn* c, char* line) {
+  lisp_value v, result;
+  char error[32], *s;
+  int ret;
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  w->requests++;
+  if((ret = lisp_parse(&v, line)) != LISP_PARSE_OK) {
+    buf_append(&c->out, error, sprintf(error, "error parse %d\n", ret));
+    return;
+  }
+  if((ret = lisp_eval(&v, &result, &c->env)) != LISP_EVAL_OK) {
+    buf_append(&c->out, error, sprintf(error, "error eval %d\n", ret));
+    lisp_value_free(&v);
+    return;
+  }
+  if(lisp_get_type(&result) == LISP_NIL) {
+    buf_append(&c->out, "nil\n", 4);
+    if(lisp_get_type(&v) == LISP_LIST && (lisp_get_type(lisp_get_list_element(&v, 0)) == LISP_DEFINE
+        || lisp_get_type(lisp_get_list_element(&v, 0)) == LISP_DEFINE_MACRO)) {
+      if(c->defs.top == c->defs.size) {
+        c->defs.size = c->defs.size == 0 ? 16 : c->defs.size * 2;
+        c->defs.p = (lisp_value*)realloc(c->defs.p, c->defs.size * sizeof(lisp_value));
+      }
+      c->defs.p[c->defs.top++] = v;
+      return;
+    }
+  }
+  else {
+    s = lisp_stringfy(&result);
+    buf_append(&c->out, s, strlen(s));
+    buf_append(&c->out, "\n", 1);
+    free(s);
+    lisp_value_free(&result);
+  }
+  lisp_value_free(&v);
+}
+
+// write what is pending. returns -1 if the connection failed.
+static int conn_flush(conn* c) {
+  ssize_t n;
+  while(c->sent < c->out.top) {
+    if((n = send(c->fd, c->out.p + c->sent, c->out.top - c->sent, MSG_NOSIGNAL)) < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    c->sent += (size_t)n;
+  }
+  c->sent = c->out.top = 0;
+  return 0;
+}
+
+// evaluate the complete lines read so far, keep the rest for the next read.
+static int conn_lines(worker* w, conn* c) {
+  char *p = c->in.p, *end = c->in.p + c->in.top, *nl;
+  while((nl = (char*)memchr(p, '\n', end - p)) != NULL) {
+    *nl = '\0';
+    if(nl > p && nl[-1] == '\r')
+      nl[-1] = '\0';
+    if(*p != '\0')
+      conn_eval(w, c, p);
+    p = nl + 1;
+  }
+  c->in.top = end - p;
+  memmove(c->in.p, p, c->in.top);
+  return c->in.top > SERVER_MAX_LINE ? -1 : 0;
+}
+
+// read until the socket is drained, or too many responses wait to be written.
+static int conn_read(worker* w, conn* c) {
+  ssize_t n;
+  c->paused = 0;
+  while(!c->eof) {
+    if(c->out.top - c->sent > SERVER_OUT_HIGH) {
+      c->paused = 1;
+      return 0;
+    }
+    if(buf_reserve(&c->in, SERVER_READ + 1) != 0)
+      return -1;
+    if((n = read(c->fd, c->in.p + c->in.top, c->in.size - c->in.top - 1)) < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    if(n == 0) {
+      c->eof = 1;
+      break;
+    }
+    c->in.top += (size_t)n;
+    if(conn_lines(w, c) != 0 || conn_flush(c) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+static void conn_event(worker* w, conn* c, unsigned events) {
+  if(events & EPOLLERR) {
+    conn_close(w, c);
+    return;
+  }
+  if(((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !c->paused && conn_read(w, c) != 0)
+      || conn_flush(c) != 0
+      || (c->paused && c->out.top - c->sent <= SERVER_OUT_HIGH && conn_read(w, c) != 0)) {
+    conn_close(w, c);
+    return;
+  }
+  // the peer shut its side: answer what it sent, then close.
+  if(c->eof && c->sent == c->out.top)
+    conn_close(w, c);
+}
+
+static void* worker_main(void* arg) {
+  worker* w = (worker*)arg;
+  struct epoll_event ev, events[SERVER_EVENTS];
+  int i, n, running = 1;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;    // one worker is woken per connection
+  ev.data.ptr = &server_listen;
+  epoll_ctl(w->epoll, EPOLL_CTL_ADD, server_fd, &ev);
+  ev.events = EPOLLIN;    // level triggered and never read, every worker sees it
+  ev.data.ptr = &server_stop;
+  epoll_ctl(w->epoll, EPOLL_CTL_ADD, stop_fd, &ev);
+  while(running) {
+    if((n = epoll_wait(w->epoll, events, SERVER_EVENTS, -1)) < 0) {
+      if(errno == EINTR) continue;
+      perror("epoll_wait");
+      break;
+    }
+    for(i = 0; i < n; i++) {
+      if(events[i].data.ptr == &server_stop)
+        running = 0;
+      else if(events[i].data.ptr == &server_listen)
+        worker_accept(w);
+      else conn_event(w, (conn*)events[i].data.ptr, events[i].events);
+    }
+  }
+  while(w->conns.top != 0)
+    conn_close(w, w->conns.p[0]);
+  free(w->conns.p);
+  close(w->epoll);
+  return NULL;
+}
+
+static int server_open(const char* path) {
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd;
+  if(strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: path too long\n", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);    // left by a server that did not stop cleanly
+  if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+      || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+      || listen(fd, SOMAXCONN) != 0
+      || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+    perror(path);
+    if(fd >= 0)
+      close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  worker* workers;
+  sigset_t signals;
+  long count = sysconf(_SC_NPROCESSORS_ONLN), i;
+  size_t requests = 0;
+  unsigned long long one = 1;
+  int opt, sig;
+
+  while((opt = getopt(argc, argv, "w:")) != -1) {
+    if(opt == 'w') count = atol(optarg);
+    else {
+      fprintf(stderr, "usage: %s [-w workers] path\n", argv[0]);
+      return 1;
+    }
+  }
+  if(optind != argc - 1 || count <= 0) {
+    fprintf(stderr, "usage: %s [-w workers] path\n", argv[0]);
+    return 1;
+  }
+  if((server_fd = server_open(argv[optind])) < 0)
+    return 1;
+  if((stop_fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+    perror("eventfd");
+    return 1;
+  }
+
+  // the workers inherit the mask, the signals are taken by sigwait below.
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  workers = (worker*)calloc((size_t)count, sizeof(worker));
+  for(i = 0; i < count; i++) {
+    if((workers[i].epoll = epoll_create1(EPOLL_CLOEXEC)) < 0
+        || pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+      perror("worker");
+      return 1;
+    }
+  }
+  fprintf(stderr, "%s: %ld workers on %s\n", argv[0], count, argv[optind]);
+
+  sigwait(&signals, &sig);
+  if(write(stop_fd, &one, sizeof(one)) != sizeof(one))
+    perror("eventfd");
+  for(i = 0; i < count; i++) {
+    pthread_join(workers[i].thread, NULL);
+    requests += workers[i].requests;
+  }
+  fprintf(stderr, "%s: %zu requests\n", argv[0], requests);
+  free(workers);
+  close(stop_fd);
+  close(server_fd);
+  unlink(argv[optind]);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+LISP_THREAD_LOCAL lisp_stats lisp_stats_counters;
+
+static const char* stats_forms[LISP_TYPES] = {
+  [LISP_PLUS] = "+", [LISP_MINUS] = "-", [LISP_MULTIPLY] = "*", [LISP_DIVIDE] = "/",
+  [LISP_LT] = "<", [LISP_BT] = ">", [LISP_EQ] = "=",
+  [LISP_DEFINE] = "define", [LISP_LAMBDA] = "lambda", [LISP_CAR] = "car", [LISP_CDR] = "cdr",
+  [LISP_CONS] = "cons", [LISP_QUOTE] = "quote", [LISP_LIST] = "((lambda ...) ...)", [LISP_NULL$] = "null?",
+  [LISP_IF] = "if", [LISP_NOT] = "not", [LISP_SYMBOL] = "application",
+  [LISP_NUM_PLUS] = "+ (numbers)", [LISP_NUM_MINUS] = "- (numbers)", [LISP_NUM_MULTIPLY] = "* (numbers)",
+  [LISP_NUM_DIVIDE] = "/ (numbers)", [LISP_NUM_LT] = "< (numbers)", [LISP_NUM_BT] = "> (numbers)",
+  [LISP_NUM_EQ] = "= (numbers)", [LISP_TIME] = "time", [LISP_BENCH] = "bench",
+  [LISP_SPAWN] = "spawn", [LISP_MAKE_VECTOR] = "make-vector", [LISP_VECTOR_NEW] = "vector",
+  [LISP_VECTOR_REF] = "vector-ref", [LISP_VECTOR_LENGTH] = "vector-length", [LISP_VECTOR_ADD] = "vector+",
+  [LISP_VECTOR_SUB] = "vector-", [LISP_VECTOR_MUL] = "vector*", [LISP_VECTOR_DIV] = "vector/",
+  [LISP_VECTOR_LT] = "vector<", [LISP_VECTOR_BT] = "vector>", [LISP_VECTOR_EQ] = "vector=",
+  [LISP_VECTOR_DOT] = "vector-dot", [LISP_VECTOR_SUM] = "vector-sum", [LISP_VECTOR_MIN] = "vector-min",
+  [LISP_VECTOR_MAX] = "vector-max", [LISP_LOAD_F64] = "load-f64", [LISP_LOAD_CSV] = "load-csv",
+  [LISP_STRING_LENGTH] = "string-length", [LISP_STRING_APPEND] = "string-append", [LISP_SUBSTRING] = "substring",
+  [LISP_STRING_EQ] = "string=?", [LISP_STRING_LT] = "string<?", [LISP_STRING_SEARCH] = "string-search",
+  [LISP_STRING_TO_NUMBER] = "string->number", [LISP_NUMBER_TO_STRING] = "number->string",
+  [LISP_LOAD_TEXT] = "load-text", [LISP_MAKE_TABLE] = "make-table", [LISP_TABLE_REF] = "table-ref",
+  [LISP_TABLE_SET] = "table-set!", [LISP_TABLE_DELETE] = "table-delete!", [LISP_TABLE_SIZE] = "table-size",
+  [LISP_TABLE_NEXT] = "table-next", [LISP_TABLE_KEY] = "table-key", [LISP_TABLE_VALUE] = "table-value",
+  [LISP_TABLE_FREE] = "table-free", [LISP_LENGTH] = "length", [LISP_MAP] = "map", [LISP_FILTER] = "filter",
+  [LISP_FOLD] = "fold", [LISP_APPEND] = "append", [LISP_REVERSE] = "reverse", [LISP_CXR] = "c[ad]+r",
+  [LISP_DEFINE_MACRO] = "define-macro", [LISP_DELAY] = "delay", [LISP_FORCE] = "force",
+  [LISP_STREAM_CONS] = "stream-cons", [LISP_STREAM_CAR] = "stream-car", [LISP_STREAM_CDR] = "stream-cdr",
+  [LISP_STREAM_TAKE] = "stream-take", [LISP_SET] = "set!", [LISP_LET] = "let", [LISP_DO] = "do"
+};
+
+void lisp_get_stats(lisp_stats* s) {
+  *s = lisp_stats_counters;
+}
+
+void lisp_reset_stats() {
+  memset(&lisp_stats_counters, 0, sizeof(lisp_stats_counters));
+}
+
+size_t lisp_stats_bucket(size_t depth) {
+  size_t bucket = 0;
+  for(; depth != 0 && bucket < LISP_STATS_DEPTHS - 1; depth >>= 1)
+    bucket++;
+  return bucket;
+}
+
+void* lisp_stats_malloc(size_t size) {
+  lisp_stats_counters.mallocs++;
+  lisp_stats_counters.malloc_bytes += size;
+  return malloc(size);
+}
+
+void* lisp_stats_realloc(void* p, size_t size) {
+  lisp_stats_counters.mallocs++;
+  lisp_stats_counters.malloc_bytes += size;
+  return realloc(p, size);
+}
+
+void lisp_stats_report(FILE* out) {
+  size_t i;
+  fprintf(out, "forms:\n");
+  for(i = 0; i < LISP_TYPES; i++) {
+    if(lisp_stats_counters.forms[i] == 0) continue;
+    if(stats_forms[i] != NULL) fprintf(out, "%20s %zu\n", stats_forms[i], lisp_stats_counters.forms[i]);
+    else fprintf(out, "%15s %4zu %zu\n", "type", i, lisp_stats_counters.forms[i]);
+  }
+  fprintf(out, "lookup depth:\n");
+  for(i = 0; i < LISP_STATS_DEPTHS; i++) {
+    if(lisp_stats_counters.depth[i] == 0) continue;
+    if(i <= 1) fprintf(out, "%20zu %zu\n", i, lisp_stats_counters.depth[i]);
+    else if(i == LISP_STATS_DEPTHS - 1) fprintf(out, "%19zu+ %zu\n", (size_t)1 << (i - 1), lisp_stats_counters.depth[i]);
+    else fprintf(out, "%10zu-%-9zu %zu\n", (size_t)1 << (i - 1), ((size_t)1 << i) - 1, lisp_stats_counters.depth[i]);
+  }
+  fprintf(out, "eval stack high: %zu bytes\n", lisp_stats_counters.eval_stack_high);
+  fprintf(out, "env stack high: %zu bytes\n", lisp_stats_counters.env_stack_high);
+  fprintf(out, "mallocs: %zu, %zu bytes\n", lisp_stats_counters.mallocs, lisp_stats_counters.malloc_bytes);
+}
@@ -0,0 +1,55 @@
+#ifndef LEPT_STATS__
+#define LEPT_STATS__
+#include <stdio.h>
+#include <stddef.h>
+#include "eval.h"
+
+/*
+ * interpreter counters: forms evaluated by lisp_eval_list, environment
+ * search depth of lisp_eval_symbol, stack high-water marks and the heap
+ * traffic of parse.c and eval.c. built with LISP_STATS, otherwise every
+ * hook below compiles to nothing. with LISP_THREADS the counters are the
+ * calling thread's.
+ */
+
+#define LISP_STATS_DEPTHS	16    // depth histogram buckets: 0, 1, 2-3, 4-7, ... and everything above
+
+typedef struct lisp_stats lisp_stats;
+struct lisp_stats {
+  size_t forms[LISP_TYPES];    // lisp_eval_list by the type of the head
+  size_t depth[LISP_STATS_DEPTHS];    // pairs scanned per lookup, an inline cache hit scans none
+  size_t eval_stack_high, env_stack_high;    // bytes
+  size_t mallocs, malloc_bytes;    // malloc and realloc calls
+};
+
+#ifdef LISP_STATS
+extern LISP_THREAD_LOCAL lisp_stats lisp_stats_counters;
+
+void lisp_get_stats(lisp_stats* s);
+void lisp_reset_stats();
+void lisp_stats_report(FILE* out);
+
+size_t lisp_stats_bucket(size_t depth);
+void* lisp_stats_malloc(size_t size);
+void* lisp_stats_realloc(void* p, size_t size);
+
+#define LISP_STATS_FORM(type)	do { lisp_stats_counters.forms[type]++; } while(0)
+#define LISP_STATS_DEPTH(d)	do { lisp_stats_counters.depth[lisp_stats_bucket(d)]++; } while(0)
+#define LISP_STATS_HIGH(mark, top) \
+  do { \
+    if((top) > lisp_stats_counters.mark) \
+      lisp_stats_counters.mark = (top); \
+  } while(0)
+
+// parse.c and eval.c define LISP_STATS_ALLOCATOR before including this header, after <stdlib.h>.
+#ifdef LISP_STATS_ALLOCATOR
+#define malloc(size)	lisp_stats_malloc(size)
+#define realloc(p, size)	lisp_stats_realloc(p, size)
+#endif
+#else
+#define LISP_STATS_FORM(type)	do { } while(0)
+#define LISP_STATS_DEPTH(d)	do { } while(0)
+#define LISP_STATS_HIGH(mark, top)	do { } while(0)
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "str.h"
+#define LISP_STATS_ALLOCATOR
+#include "stats.h"
+
+static int str_inline(const lisp_value* v) {
+  return v->u.str.size <= LISP_STRING_INLINE;
+}
+
+char* lisp_str_alloc(lisp_value* v, size_t size) {
+  v->type = LISP_STRING;
+  v->u.str.size = size;
+  if(size <= LISP_STRING_INLINE)
+    return v->u.str.d.in;
+  v->u.str.d.h.buf = (lisp_str_buf*)malloc(sizeof(lisp_str_buf) + size);
+  v->u.str.d.h.buf->refs = 1;
+  v->u.str.d.h.p = v->u.str.d.h.buf->s;
+  return v->u.str.d.h.buf->s;
+}
+
+void lisp_str_make(lisp_value* v, const char* s, size_t size) {
+  memcpy(lisp_str_alloc(v, size), s, size);
+}
+
+void lisp_str_slice(lisp_value* dst, const lisp_value* src, size_t start, size_t size) {
+  const char* bytes = lisp_str_data(src) + start;
+  assert(start <= src->u.str.size && size <= src->u.str.size - start);
+  if(size <= LISP_STRING_INLINE) {
+    memcpy(lisp_str_alloc(dst, size), bytes, size);
+    return;
+  }
+  *dst = *src;
+  dst->u.str.d.h.p += start;
+  dst->u.str.size = size;
+  dst->u.str.d.h.buf->refs++;
+}
+
+void lisp_str_ref(lisp_value* dst, const lisp_value* src) {
+  assert(src->type == LISP_STRING);
+  *dst = *src;
+  if(!str_inline(dst))
+    dst->u.str.d.h.buf->refs++;
+}
+
+void lisp_str_free(lisp_value* v) {
+  assert(v->type == LISP_STRING);
+  if(!str_inline(v) && --v->u.str.d.h.buf->refs == 0)
+    free(v->u.str.d.h.buf);
+}
+
+const char* lisp_str_data(const lisp_value* v) {
+  assert(v->type == LISP_STRING);
+  return str_inline(v) ? v->u.str.d.in : v->u.str.d.h.p;
+}
+
+size_t lisp_str_size(const lisp_value* v) {
+  assert(v->type == LISP_STRING);
+  return v->u.str.size;
+}
+
+int lisp_str_compare(const lisp_value* a, const lisp_value* b) {
+  size_t size = a->u.str.size < b->u.str.size ? a->u.str.size : b->u.str.size;
+  int cmp = memcmp(lisp_str_data(a), lisp_str_data(b), size);
+  if(cmp != 0)
+    return cmp;
+  return a->u.str.size < b->u.str.size ? -1 : a->u.str.size > b->u.str.size;
+}
+
+// memchr finds the candidates for the first byte, memcmp checks the rest.
+size_t lisp_str_search(const lisp_value* s, const lisp_value* pattern, size_t start) {
+  const char *base = lisp_str_data(s), *p = base + start, *end, *hit;
+  const char* pat = lisp_str_data(pattern);
+  size_t n = s->u.str.size, m = pattern->u.str.size;
+  if(start > n || m > n - start)
+    return LISP_STR_NONE;
+  if(m == 0)
+    return start;
+  end = base + n - m + 1;    // past the last place the pattern can start
+  while(p < end && (hit = (const char*)memchr(p, pat[0], end - p)) != NULL) {
+    if(memcmp(hit + 1, pat + 1, m - 1) == 0)
+      return (size_t)(hit - base);
+    p = hit + 1;
+  }
+  return LISP_STR_NONE;
+}
@@ -0,0 +1,38 @@
+#ifndef LEPT_STR__
+#define LEPT_STR__
+#include <stddef.h>
+#include "parse.h"
+
+/*
+ * strings: byte strings, not NUL terminated. up to LISP_STRING_INLINE bytes
+ * are kept in the value itself; longer ones point into a reference counted
+ * buffer that copies and slices share, so neither copies the bytes. a slice
+ * short enough to be inline is copied out instead, it no longer keeps a
+ * large buffer alive.
+ */
+
+#define LISP_STR_NONE	((size_t)-1)    // lisp_str_search found nothing
+
+typedef struct lisp_str_buf lisp_str_buf;
+struct lisp_str_buf {
+  size_t refs;
+  char s[];
+};
+
+// v becomes a string of size bytes, returns where they are to be written.
+char* lisp_str_alloc(lisp_value* v, size_t size);
+void lisp_str_make(lisp_value* v, const char* s, size_t size);
+// dst shares src's bytes start .. start+size-1, which must be within src. dst is not src.
+void lisp_str_slice(lisp_value* dst, const lisp_value* src, size_t start, size_t size);
+// another reference to src, released with lisp_str_free like src.
+void lisp_str_ref(lisp_value* dst, const lisp_value* src);
+void lisp_str_free(lisp_value* v);
+
+const char* lisp_str_data(const lisp_value* v);
+size_t lisp_str_size(const lisp_value* v);
+// <0, 0 or >0 like memcmp, a prefix orders first.
+int lisp_str_compare(const lisp_value* a, const lisp_value* b);
+// the first index at or after start where pattern occurs, LISP_STR_NONE if there is none.
+size_t lisp_str_search(const lisp_value* s, const lisp_value* pattern, size_t start);
+
+#endif
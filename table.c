@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "table.h"
+#include "eval.h"
+#include "str.h"
+#define LISP_STATS_ALLOCATOR
+#include "stats.h"
+
+#define TABLE_SYMBOL	((size_t)1 << (sizeof(size_t) * 8 - 1))
+#define TABLE_MIN	8    // entries of a new table, the index has twice as many slots
+
+// a key as it is looked up.
+typedef struct {
+  size_t hash;
+  double n;
+  const char* s;
+  size_t size;
+  int number;
+}table_key;
+
+static size_t table_mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return (size_t)x & ~TABLE_SYMBOL;
+}
+
+static int table_key_of(const lisp_value* key, table_key* k) {
+  uint64_t h = 0xcbf29ce484222325ULL;    // FNV-1a
+  size_t i;
+  switch(lisp_get_type(key)) {
+    case LISP_NUMBER:
+      if(key->u.n != key->u.n)
+        return 0;    // NaN equals nothing, it could never be found
+      k->number = 1;
+      k->n = key->u.n == 0 ? 0 : key->u.n;    // -0 is the key 0
+      memcpy(&h, &k->n, sizeof(h));
+      k->hash = table_mix(h);
+      return 1;
+    case LISP_SYMBOL:
+      k->s = key->u.sym.s;
+      k->size = key->u.sym.size;
+      break;
+    case LISP_STRING:
+      k->s = lisp_str_data(key);
+      k->size = lisp_str_size(key);
+      break;
+    default:
+      return 0;
+  }
+  k->number = 0;
+  for(i = 0; i < k->size; i++)
+    h = (h ^ (unsigned char)k->s[i]) * 0x100000001b3ULL;
+  k->hash = table_mix(h) | (lisp_get_type(key) == LISP_SYMBOL ? TABLE_SYMBOL : 0);
+  return 1;
+}
+
+static int table_match(const lisp_table_entry* e, const table_key* k) {
+  if(e->hash != k->hash)
+    return 0;
+  if(k->number)
+    return e->key.type == LISP_NUMBER && e->key.u.n == k->n;
+  return e->key.type == LISP_STRING && lisp_str_size(&e->key) == k->size && memcmp(lisp_str_data(&e->key), k->s, k->size) == 0;
+}
+
+// the index slot of k, or the free one that ends its probe run.
+static size_t table_find(const lisp_table* t, const table_key* k) {
+  size_t i;
+  for(i = k->hash & t->mask; t->index[i] != 0; i = (i + 1) & t->mask)
+    if(table_match(&t->entries[t->index[i] - 1], k))
+      break;
+  return i;
+}
+
+static void table_value_free(lisp_value* v) {
+  if(v->type == LISP_STRING)
+    lisp_str_free(v);
+}
+
+// room for as many entries again as are live, the deleted ones are dropped.
+static int table_resize(lisp_table* t) {
+  lisp_table_entry* entries;
+  uint32_t* index;
+  size_t i, j, slot, capacity = TABLE_MIN;
+  while(capacity < t->size * 2)
+    capacity *= 2;
+  if(capacity > UINT32_MAX / 2)
+    return 0;
+  entries = (lisp_table_entry*)malloc(capacity * sizeof(lisp_table_entry));
+  index = (uint32_t*)calloc(capacity * 2, sizeof(uint32_t));
+  for(i = j = 0; i < t->used; i++)
+    if(t->entries[i].key.type != LISP_NULL)
+      entries[j++] = t->entries[i];
+  free(t->entries);
+  free(t->index);
+  t->entries = entries;
+  t->index = index;
+  t->used = j;
+  t->capacity = capacity;
+  t->mask = capacity * 2 - 1;
+  for(i = 0; i < t->used; i++) {
+    for(slot = entries[i].hash & t->mask; index[slot] != 0; slot = (slot + 1) & t->mask);
+    index[slot] = (uint32_t)(i + 1);
+  }
+  return 1;
+}
+
+lisp_table* lisp_table_new() {
+  lisp_table* t = (lisp_table*)calloc(1, sizeof(lisp_table));
+  table_resize(t);
+  return t;
+}
+
+void lisp_table_free(lisp_table* t) {
+  size_t i;
+  for(i = 0; i < t->used; i++) {
+    if(t->entries[i].key.type == LISP_NULL)
+      continue;
+    table_value_free(&t->entries[i].key);
+    table_value_free(&t->entries[i].value);
+  }
+  free(t->entries);
+  free(t->index);
+  free(t);
+}
+
+int lisp_table_set(lisp_table* t, const lisp_value* key, const lisp_value* value) {
+  lisp_table_entry* e;
+  lisp_value copy;
+  table_key k;
+  size_t i;
+  if(!table_key_of(key, &k))
+    return LISP_EVAL_NOT_A_KEY;
+  switch(lisp_get_type(value)) {
+    case LISP_NUMBER:
+    case LISP_TRUE:
+    case LISP_FALSE:
+    case LISP_STRING:	break;
+    default:	return LISP_EVAL_NOT_STORABLE;
+  }
+  i = table_find(t, &k);
+  if(t->index[i] != 0) {
+    e = &t->entries[t->index[i] - 1];
+    copy = e->value;
+    if(lisp_get_type(value) == LISP_STRING)
+      lisp_str_ref(&e->value, value);    // before the old value goes, it may be the same string
+    else e->value = *value;
+    table_value_free(&copy);
+    return LISP_EVAL_OK;
+  }
+  if(t->used == t->capacity) {
+    if(!table_resize(t))
+      return LISP_EVAL_NOT_STORABLE;    // 2^31 entries
+    i = table_find(t, &k);
+  }
+  e = &t->entries[t->used];
+  e->hash = k.hash;
+  if(k.number) {
+    e->key.type = LISP_NUMBER;
+    e->key.u.n = k.n;
+  }
+  else lisp_str_make(&e->key, k.s, k.size);
+  t->index[i] = (uint32_t)++t->used;
+  t->size++;
+  if(lisp_get_type(value) == LISP_STRING)
+    lisp_str_ref(&e->value, value);
+  else e->value = *value;
+  return LISP_EVAL_OK;
+}
+
+const lisp_value* lisp_table_ref(const lisp_table* t, const lisp_value* key) {
+  table_key k;
+  size_t i;
+  if(!table_key_of(key, &k))
+    return NULL;
+  i = table_find(t, &k);
+  return t->index[i] != 0 ? &t->entries[t->index[i] - 1].value : NULL;
+}
+
+int lisp_table_delete(lisp_table* t, const lisp_value* key) {
+  lisp_table_entry* e;
+  table_key k;
+  size_t i, j, home;
+  if(!table_key_of(key, &k))
+    return 0;
+  i = table_find(t, &k);
+  if(t->index[i] == 0)
+    return 0;
+  e = &t->entries[t->index[i] - 1];
+  table_value_free(&e->key);
+  table_value_free(&e->value);
+  e->key.type = LISP_NULL;
+  t->size--;
+  // move the rest of the probe run back over the hole, a lookup must not stop short at it.
+  for(j = (i + 1) & t->mask; t->index[j] != 0; j = (j + 1) & t->mask) {
+    home = t->entries[t->index[j] - 1].hash & t->mask;
+    if(((j - home) & t->mask) >= ((j - i) & t->mask)) {
+      t->index[i] = t->index[j];
+      i = j;
+    }
+  }
+  t->index[i] = 0;
+  while(t->used > 0 && t->entries[t->used - 1].key.type == LISP_NULL)
+    t->used--;    // the last entries can be taken again right away
+  return 1;
+}
+
+size_t lisp_table_next(const lisp_table* t, size_t i) {
+  for(; i < t->used; i++)
+    if(t->entries[i].key.type != LISP_NULL)
+      return i;
+  return LISP_TABLE_END;
+}
+
+int lisp_table_key_is_symbol(const lisp_table_entry* e) {
+  return (e->hash & TABLE_SYMBOL) != 0;
+}
+
+// the global env of an evaluation holds its tables.
+static env_t* table_env(env_t* e) {
+  while(e->prev != NULL)
+    e = e->prev;
+  return e;
+}
+
+double lisp_table_register(env_t* e, lisp_table* t) {
+  e = table_env(e);
+  if(e->tables.top == e->tables.size) {
+    e->tables.size = e->tables.size == 0 ? 16 : e->tables.size * 2;
+    e->tables.p = (lisp_table**)realloc(e->tables.p, e->tables.size * sizeof(lisp_table*));
+  }
+  e->tables.p[e->tables.top] = t;
+  return (double)e->tables.top++;
+}
+
+lisp_table* lisp_table_lookup(env_t* e, double handle) {
+  e = table_env(e);
+  if(!(handle >= 0 && handle < e->tables.top) || handle != (double)(size_t)handle)
+    return NULL;
+  return e->tables.p[(size_t)handle];
+}
+
+int lisp_table_release(env_t* e, double handle) {
+  lisp_table* t = lisp_table_lookup(e, handle);
+  if(t == NULL)
+    return 0;
+  lisp_table_free(t);
+  table_env(e)->tables.p[(size_t)handle] = NULL;
+  return 1;
+}
+
+void lisp_tables_free(env_t* e) {
+  size_t i;
+  for(i = 0; i < e->tables.top; i++)
+    if(e->tables.p[i] != NULL)
+      lisp_table_free(e->tables.p[i]);
+  free(e->tables.p);
+  e->tables.p = NULL;
+  e->tables.top = e->tables.size = 0;
+}
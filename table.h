@@ -0,0 +1,64 @@
+#ifndef LEPT_TABLE__
+#define LEPT_TABLE__
+#include <stddef.h>
+#include <stdint.h>
+#include "eval.h"
+
+/*
+ * hash tables: keys are numbers, symbols or strings, values are numbers,
+ * booleans or strings. entries are kept in insertion order in a dense array,
+ * found through an open addressing index of entry numbers with linear
+ * probing; a delete shifts the probe run back instead of leaving a
+ * tombstone, and the holes it leaves in the entries are closed when the
+ * array grows. scripts hold tables by number, a handle of the global env
+ * they were made in: the env frees them with it, another env does not see them.
+ *   (make-table)                  a new table
+ *   (table-ref t k)               the value of k, false if there is none
+ *   (table-ref t k default)       default if there is none
+ *   (table-set! t k x)            x, now the value of k
+ *   (table-delete! t k)           whether k was there
+ *   (table-size t)                the number of keys
+ *   (table-next t i)              the first entry at or after i, -1 if there is none
+ *   (table-key t i) (table-value t i)    of entry i
+ *   (table-free t)                true, t is no longer a table
+ * a symbol key is given quoted, (quote name), or as a symbol a list held.
+ * entry numbers are valid until the next table-set! that grows the table.
+ */
+
+#define LISP_TABLE_END	((size_t)-1)    // lisp_table_next found no entry
+
+typedef struct lisp_table_entry lisp_table_entry;
+struct lisp_table_entry {
+  size_t hash;    // the top bit tells a symbol key, kept as a string, from a string key
+  lisp_value key, value;    // key LISP_NULL: deleted
+};
+
+typedef struct lisp_table lisp_table;
+struct lisp_table {
+  lisp_table_entry* entries;
+  uint32_t* index;    // 0: a free slot, otherwise entry + 1
+  size_t used, size, capacity, mask;    // used: entries taken, deleted ones included. size: live ones
+};
+
+lisp_table* lisp_table_new();
+void lisp_table_free(lisp_table* t);
+// returns LISP_EVAL_OK, LISP_EVAL_NOT_A_KEY or LISP_EVAL_NOT_STORABLE.
+int lisp_table_set(lisp_table* t, const lisp_value* key, const lisp_value* value);
+// the value of key, NULL if there is none.
+const lisp_value* lisp_table_ref(const lisp_table* t, const lisp_value* key);
+// 1 if key was there.
+int lisp_table_delete(lisp_table* t, const lisp_value* key);
+size_t lisp_table_next(const lisp_table* t, size_t i);
+int lisp_table_key_is_symbol(const lisp_table_entry* e);
+
+// handles of the tables of e, what scripts hold. e may be an env a task or a
+// coroutine evaluates in, the tables are those of the global env it extends.
+double lisp_table_register(env_t* e, lisp_table* t);
+// NULL if handle is not a table of e.
+lisp_table* lisp_table_lookup(env_t* e, double handle);
+// frees the table of handle, 0 if there was none.
+int lisp_table_release(env_t* e, double handle);
+// frees every table of e, env_free does.
+void lisp_tables_free(env_t* e);
+
+#endif
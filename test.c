@@ -1,8 +1,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "parse.h"
 #include "eval.h"
+#include "perf.h"
+#include "prof.h"
+#include "stats.h"
+#include "trace.h"
+#include "vector.h"
+#include "str.h"
+#include "table.h"
+#ifdef LISP_THREADS
+#include <pthread.h>
+#endif
+#ifdef LISP_SERVER_PATH
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+#ifdef LISP_CORO
+#include <unistd.h>
+#include "coro.h"
+#endif
+#ifdef LISP_JIT
+#include "jit.h"
+#endif
 
 int main_ret, passed, total;
 
@@ -64,6 +89,30 @@ static void test_parse_operator() {
   EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "cdr"));
   EXPECT_EQ_INT(LISP_CDR, lisp_get_type(&v));
   v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "cadr"));
+  EXPECT_EQ_INT(LISP_CXR, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)2, v.u.cxr.size);
+  EXPECT_EQ_SIZE_T((size_t)2, v.u.cxr.path);
+  TEST_STRINGFY("cadr", &v);
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "caddr"));
+  EXPECT_EQ_INT(LISP_CXR, lisp_get_type(&v));
+  TEST_STRINGFY("caddr", &v);
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "cr"));
+  EXPECT_EQ_INT(LISP_SYMBOL, lisp_get_type(&v));
+  lisp_value_free(&v);
+  // an accessor ends at a delimiter, a longer word is a symbol.
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "cadrx"));
+  EXPECT_EQ_INT(LISP_SYMBOL, lisp_get_type(&v));
+  TEST_STRINGFY("cadrx", &v);
+  lisp_value_free(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "cddar-list"));
+  EXPECT_EQ_INT(LISP_SYMBOL, lisp_get_type(&v));
+  lisp_value_free(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(cadr(quote (1 2)))"));
+  EXPECT_EQ_INT(LISP_CXR, lisp_get_type(lisp_get_list_element(&v, 0)));
+  lisp_value_free(&v);
 }
 
 static void test_parse_number() {
@@ -286,6 +335,84 @@ static void test_car_and_cdr() {
   EXPECT_EQ_INT(LISP_TRUE, lisp_get_type(&result));
   lisp_value_free(&v);
   lisp_value_free(&result);
+
+  // a cdr result bound to a parameter, walked recursively.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define sum (lambda (l) (if (null? l) 0 (+ (car l) (sum (cdr l))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(sum (quote (1 2 3 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)10, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // c[ad]+r, and chains of car and cdr, walk the list by index.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(caddr (quote (1 2 3 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("3", &result);
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(cddr (quote (1 (2) 3 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (3 4))", &result);
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(cadr (quote (1 (2 (3)) 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (2 (3)))", &result);
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(car (cadadr (quote (1 (2 (3 4)) 5))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("3", &result);
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(cdr (cadr (quote (1 (2 (3 4)) 5))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote ((3 4)))", &result);
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  // a chain in a defined body becomes one accessor.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define third (lambda (l) (car (cdr (cdr l)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(define third (lambda (l) (caddr l)))", &v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (third (quote (1 2 3))) (third (cdr (quote (1 2 3 4)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(caddr (quote (1 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(caar (quote (1 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_LIST, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
 }
 
 static void test_stringfy() {
@@ -620,136 +747,2413 @@ static void test_eval() {
   lisp_value_free(&result);
 }
 
-#if 1
-static void test_global_env() {
+static void test_inline() {
   lisp_value v, result;
 
   lisp_value_init(&v);
   lisp_value_init(&result);
-  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define id (lambda (x) x))"));
-  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
-  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define square (lambda (x) (* x x)))"));
   EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
   EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
   lisp_value_free(&result);
 
   lisp_value_init(&v);
   lisp_value_init(&result);
-  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(id 1)"));
-  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
-  EXPECT_EQ_SIZE_T((size_t)2, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define sum-of-squares (lambda (x y) (+ (square x) (square y))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(sum-of-squares 3 4)"));
   EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
   EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
-  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  EXPECT_EQ_DOUBLE((double)25, lisp_get_number(&result));
+  lisp_value_free(&v);
   lisp_value_free(&result);
 
   lisp_value_init(&v);
   lisp_value_init(&result);
-  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define add (lambda (z y) (+ z y)))"));
-  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
-  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define twice-square (lambda (x) (* 2 (square (- x 1)))))"));
   EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
   EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
   lisp_value_free(&result);
 
   lisp_value_init(&v);
   lisp_value_init(&result);
-  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(add 0 1)"));
-  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
-  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(twice-square 4)"));
   EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
   EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
-  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  EXPECT_EQ_DOUBLE((double)18, lisp_get_number(&result));
+  lisp_value_free(&v);
   lisp_value_free(&result);
 
+  // redefining the helper invalidates the inlined copies.
   lisp_value_init(&v);
   lisp_value_init(&result);
-  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define fact (lambda (n) (if (= n 0) 1 (* n (fact (- n 1))))))"));
-  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
-  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define square (lambda (x) (+ x x)))"));
   EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
   EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
   lisp_value_free(&result);
 
   lisp_value_init(&v);
   lisp_value_init(&result);
-  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fact 0)"));
-  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
-  EXPECT_EQ_SIZE_T((size_t)2, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(sum-of-squares 3 4)"));
   EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
   EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
-  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  EXPECT_EQ_DOUBLE((double)14, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(twice-square 4)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_DOUBLE((double)12, lisp_get_number(&result));
+  lisp_value_free(&v);
   lisp_value_free(&result);
 }
-#endif
 
-// and now it maybe as defined `symbol` at the program
-static void test_invalid_value() {
-  lisp_value v;
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "defi"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "lambd"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "ca"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "cd"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
+static void test_inline_cache() {
+  lisp_value v, call, result;
+  lisp_ic_stats stats;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define inc (lambda (x) (+ x 1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&result);
+
+  lisp_reset_ic_stats();
+  lisp_value_init(&call);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call, "(inc 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+  lisp_get_ic_stats(&stats);
+  EXPECT_EQ_SIZE_T((size_t)1, stats.hits);
+  EXPECT_EQ_SIZE_T((size_t)0, stats.invalidations);
+
+  // redefinition bumps the env version, the cached lambda is dropped.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define inc (lambda (x) (+ x 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&result);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_get_ic_stats(&stats);
+  EXPECT_EQ_SIZE_T((size_t)1, stats.invalidations);
+
+  // a parameter named like the global shadows it, the cache must not be used.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define call-inc (lambda (inc) (inc 1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&result);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(call-inc (lambda (y) 42))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)42, lisp_get_number(&result));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&call);
 }
 
-static void test_root_not_singular() {
-  lisp_value v;
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "definea"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "define a"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "lambdab"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "carr"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "car r"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "cdrr"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
-  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "cdr r"));
-  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
-  v.type = LISP_NULL;
+static void test_specialize() {
+  lisp_value v, result;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define poly (lambda (x) (if (< (* 2 x) 10) (+ (* x x) 1) (- x (/ 9 3)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(define poly (lambda (x) (if (< (* 2 x) 10) (+ (* x x) 1) (- x (/ 9 3)))))", &v);
+  EXPECT_EQ_INT(LISP_NUM_LT, lisp_get_type(lisp_get_list_element(lisp_get_list_element(lisp_get_list_element(lisp_get_list_element(&v, 2), 2), 1), 0)));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(poly 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_DOUBLE((double)10, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(poly 7)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)4, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  // parameters are not proven, a list operand is caught by the dynamic check.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(poly (quote (1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_NUMBER, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(poly 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_free(&result);
 }
 
-static void test_invalid_list() {
-  lisp_value v;
+static double native_hypot2(const double* args) {
+  return args[0]*args[0] + args[1]*args[1];
+}
+
+static double native_positive(const double* args) {
+  return args[0] > 0;
+}
+
+static void test_native_number() {
+  lisp_value v, result;
+
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_define_native_number(&global_env, "hypot2", 2, native_hypot2, 0));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_define_native_number(&global_env, "positive?", 1, native_positive, 1));
+
   lisp_value_init(&v);
-  EXPECT_EQ_INT(LISP_PARSE_MISS_CLOSE_PRAN, lisp_parse(&v, "("));
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(hypot2 3 (+ 2 2))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_DOUBLE((double)25, lisp_get_number(&result));
   lisp_value_free(&v);
+
+  // natives are called from lambdas like any other global.
   lisp_value_init(&v);
-  EXPECT_EQ_INT(LISP_PARSE_MISS_CLOSE_PRAN, lisp_parse(&v, "(+"));
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define clamp (lambda (x) (if (positive? x) x 0)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(clamp (- 0 5))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)0, lisp_get_number(&result));
   lisp_value_free(&v);
+
   lisp_value_init(&v);
-  EXPECT_EQ_INT(LISP_PARSE_MISS_CLOSE_PRAN, lisp_parse(&v, "(("));
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(hypot2 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(positive? (quote (1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_NUMBER, lisp_eval(&v, &result, &global_env));
   lisp_value_free(&v);
 }
 
-static void test_parse() {
-  test_parse_operator();
-  test_parse_number();
-  test_parse_list();
-  //test_invalid_value();
-  test_root_not_singular();
-  test_invalid_list();
-  test_car_and_cdr();
-  test_stringfy();
-  test_eval();
+// the sum of a list of numbers.
+static int native_lsum(lisp_value* args, size_t count) {
+  lisp_value* l;
+  double n = 0;
+  size_t i;
+  if(args[0].type != LISP_LIST || args[0].u.a.size != 2 || args[0].u.a.e[0].type != LISP_QUOTE)
+    return LISP_EVAL_NOT_A_LIST;
+  l = &args[0].u.a.e[1];
+  for(i = 0; i < l->u.a.size; i++) {
+    if(l->u.a.e[i].type != LISP_NUMBER)
+      return LISP_EVAL_NOT_A_NUMBER;
+    n += l->u.a.e[i].u.n;
+  }
+  args[0].type = LISP_NUMBER;
+  args[0].u.n = n;
+  return LISP_EVAL_OK;
+}
+
+// a new string of the first argument count times.
+static int native_repeat(lisp_value* args, size_t count) {
+  lisp_value s = args[0];
+  size_t i, size;
+  char* p;
+  if(s.type != LISP_STRING)
+    return LISP_EVAL_NOT_A_STRING;
+  if(args[1].type != LISP_NUMBER)
+    return LISP_EVAL_NOT_A_NUMBER;
+  size = lisp_str_size(&s);
+  p = lisp_str_alloc(&args[0], size * (size_t)args[1].u.n);
+  for(i = 0; i < (size_t)args[1].u.n; i++)
+    memcpy(p + i * size, lisp_str_data(&s), size);
+  return LISP_EVAL_OK;
+}
+
+static int native_answer(lisp_value* args, size_t count) {
+  args[0].type = LISP_NUMBER;
+  args[0].u.n = 42;
+  return LISP_EVAL_OK;
+}
+
+static void test_native() {
+  lisp_value v, result;
+
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_define_native(&global_env, "lsum", 1, native_lsum));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_define_native(&global_env, "repeat", 2, native_repeat));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_define_native(&global_env, "answer", 0, native_answer));
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (lsum (quote (1 2 3))) (lsum (cdr (quote (1 2 3)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)11, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a string it makes is the evaluation's, like one string-append makes.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(string-length (repeat (repeat \"ab\" 3) 4))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)24, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(repeat \"abcdefghij\" 2)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("\"abcdefghijabcdefghij\"", &result);
+  lisp_value_free(&v);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(answer)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)42, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // natives are values the list forms apply, and globals lambdas call.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold (lambda (x acc) (+ x acc)) 0 (map lsum (quote ((1 2) (3 4)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)10, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lmean (lambda (l) (/ (lsum l) (length l))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(lmean (quote (2 4 6)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)4, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(lsum (quote (1 2)) 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(lsum 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_LIST, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+
+static void test_time_and_bench() {
+  lisp_value v, result;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(time (+ 1 (* 2 3)))"));
+  TEST_STRINGFY("(time (+ 1 (* 2 3)))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // bench throws the runs' values away and evaluates to the mean latency.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bench (+ 10 10) (car (cdr (quote (1 (2 3))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_INT(1, lisp_get_number(&result) >= 0);
+  lisp_value_free(&v);
+
+  // the keywords are whole words, longer names stay symbols.
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(timer benchmark)"));
+  EXPECT_EQ_INT(LISP_SYMBOL, lisp_get_type(lisp_get_list_element(&v, 0)));
+  EXPECT_EQ_INT(LISP_SYMBOL, lisp_get_type(lisp_get_list_element(&v, 1)));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(time (define tb 1))"));
+  EXPECT_EQ_INT(LISP_LISP_OP_ILLEAGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bench 0 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_NUMBER, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bench 2.5 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bench 1e300 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bench 10)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(time)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+
+static void test_eval_batch() {
+  lisp_value v, results[100];
+  int rets[100];
+#ifdef LISP_STATS
+  lisp_value many[100];
+  lisp_stats stats;
+  size_t i, mallocs;
+#endif
+
+  // the forms of one parsed buffer; v is kept, the define points into it.
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((+ 1 2) (define bsq (lambda (x) (* x x))) (bsq 4) (bnothing 1) (car (quote ((1) 2))))"));
+  EXPECT_EQ_SIZE_T((size_t)1, lisp_eval_batch(v.u.a.e, 5, results, rets, &global_env));
+  EXPECT_EQ_INT(LISP_EVAL_OK, rets[0]);
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&results[0]));
+  EXPECT_EQ_INT(LISP_EVAL_OK, rets[1]);
+  EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&results[1]));
+  EXPECT_EQ_INT(LISP_EVAL_OK, rets[2]);
+  EXPECT_EQ_DOUBLE((double)16, lisp_get_number(&results[2]));
+  EXPECT_EQ_INT(LISP_EVAL_VARIABLE_NOT_FOUND, rets[3]);
+  EXPECT_EQ_INT(LISP_EVAL_OK, rets[4]);
+  TEST_STRINGFY("(quote (1))", &results[4]);
+  lisp_value_free(&results[4]);
+
+#ifdef LISP_STATS
+  // after the first form sized the stacks, the others do not allocate.
+  for(i = 0; i < 100; i++)
+    many[i] = v.u.a.e[2];
+  lisp_reset_stats();
+  lisp_eval_batch(many, 1, results, rets, &global_env);
+  lisp_get_stats(&stats);
+  mallocs = stats.mallocs;
+  lisp_reset_stats();
+  lisp_eval_batch(many, 100, results, rets, &global_env);
+  lisp_get_stats(&stats);
+  EXPECT_EQ_SIZE_T(mallocs, stats.mallocs);
+#endif
+}
+
+static void test_vector() {
+  lisp_value v, result;
+  double a[37], b[37], r[37], expect[37];
+  size_t i;
+  int isa, op;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector+ (vector 1 2 3) (vector* (vector 4 5 6) 2))"));
+  TEST_STRINGFY("(vector+ (vector 1 2 3) (vector* (vector 4 5 6) 2))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_VECTOR, lisp_get_type(&result));
+  TEST_STRINGFY("(vector 9 12 15)", &result);
+  EXPECT_EQ_INT(0, (int)((size_t)result.u.vec.d % LISP_VEC_ALIGN));
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  // a number on the left goes with every element too, comparisons give 1 and 0.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector< 2 (vector- (make-vector 5 3) (vector 0 1 2 3 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(vector 1 0 0 0 0)", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (vector-ref (vector 7 8 9) 2) (vector-length (make-vector 4)) (vector-dot (vector 1 2 3) (vector 4 5 6)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)45, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(- (vector-max (vector 3 9 1)) (vector-min (vector 3 9 1)) (vector-sum (vector= (vector 1 2 3) (vector 1 0 3))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)6, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // parameters are bound to copies, the vector lives as long as the call.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define vnorm2 (lambda (x) (vector-dot x x)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ 1 (vnorm2 (vector/ (vector 6 8) 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)26, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (x) x) (vector 1 2))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(vector 1 2)", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector+ (vector 1 2) (vector 1 2 3))"));
+  EXPECT_EQ_INT(LISP_EVAL_LENGTH_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-ref (vector 1 2) 2)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-ref (vector 1 2) 0.5)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-sum (quote (1 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_VECTOR, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector* 1 2)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_VECTOR, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector 1 (quote (2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_NUMBER, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // every kernel gives what the scalar loops give, tails included.
+  for(i = 0; i < 37; i++) {
+    a[i] = (double)(i * 7 % 11);
+    b[i] = (double)(i % 5) + 1;
+  }
+  for(isa = LISP_VEC_SCALAR; isa <= LISP_VEC_AVX2; isa++) {
+    for(op = LISP_VEC_ADD; op <= LISP_VEC_EQ; op++) {
+      lisp_vec_set_isa(LISP_VEC_SCALAR);
+      lisp_vec_binary(op, expect, a, 1, b, 1, 37);
+      lisp_vec_set_isa(isa);
+      lisp_vec_binary(op, r, a, 1, b, 1, 37);
+      EXPECT_EQ_INT(0, memcmp(expect, r, sizeof(r)));
+      lisp_vec_set_isa(LISP_VEC_SCALAR);
+      lisp_vec_binary(op, expect, a, 1, b + 3, 0, 37);
+      lisp_vec_set_isa(isa);
+      lisp_vec_binary(op, r, a, 1, b + 3, 0, 37);
+      EXPECT_EQ_INT(0, memcmp(expect, r, sizeof(r)));
+    }
+    lisp_vec_set_isa(isa);
+    EXPECT_EQ_DOUBLE((double)185, lisp_vec_reduce(LISP_VEC_SUM, a, 37));
+    EXPECT_EQ_DOUBLE((double)0, lisp_vec_reduce(LISP_VEC_MIN, a, 37));
+    EXPECT_EQ_DOUBLE((double)10, lisp_vec_reduce(LISP_VEC_MAX, a, 37));
+    EXPECT_EQ_DOUBLE((double)0, lisp_vec_reduce(LISP_VEC_SUM, a, 0));
+    EXPECT_EQ_DOUBLE((double)8, lisp_vec_reduce(LISP_VEC_MAX, a + 30, 3));
+    EXPECT_EQ_DOUBLE((double)10, lisp_vec_reduce(LISP_VEC_MAX, a + 30, 7));
+    EXPECT_EQ_DOUBLE((double)556, lisp_vec_dot(a, b, 37));
+    lisp_vec_fill(r, 2, 37);
+    EXPECT_EQ_DOUBLE((double)74, lisp_vec_reduce(LISP_VEC_SUM, r, 37));
+  }
+  lisp_vec_set_isa(LISP_VEC_AVX2);
+}
+
+static void test_string() {
+  lisp_value v, result, s, slice;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(string-append \"a \\\"b\\\"\" \"\\n\")"));
+  TEST_STRINGFY("(string-append \"a \\\"b\\\"\" \"\\n\")", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_STRING, lisp_get_type(&result));
+  EXPECT_EQ_SIZE_T((size_t)6, lisp_str_size(&result));
+  EXPECT_EQ_INT(0, memcmp("a \"b\"\n", lisp_str_data(&result), 6));
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_MISS_QUOTATION_MARK, lisp_parse(&v, "(string-length \"abc)"));
+  lisp_value_free(&v);
+
+  // short strings are inline, a long one is shared by its slices.
+  lisp_str_make(&s, "0123456789abcdefghij", 20);
+  EXPECT_EQ_INT(1, lisp_str_data(&s) != s.u.str.d.in);
+  lisp_str_slice(&slice, &s, 2, 17);
+  EXPECT_EQ_INT(1, lisp_str_data(&slice) == lisp_str_data(&s) + 2);
+  EXPECT_EQ_SIZE_T((size_t)2, s.u.str.d.h.buf->refs);
+  lisp_str_free(&slice);
+  lisp_str_slice(&slice, &s, 4, 3);
+  EXPECT_EQ_INT(1, lisp_str_data(&slice) == slice.u.str.d.in);
+  EXPECT_EQ_SIZE_T((size_t)1, s.u.str.d.h.buf->refs);
+  EXPECT_EQ_INT(0, memcmp("456", lisp_str_data(&slice), 3));
+  lisp_str_free(&slice);
+  lisp_str_make(&slice, "abc", 3);
+  EXPECT_EQ_SIZE_T((size_t)10, lisp_str_search(&s, &slice, 0));
+  EXPECT_EQ_SIZE_T(LISP_STR_NONE, lisp_str_search(&s, &slice, 11));
+  EXPECT_EQ_INT(1, lisp_str_compare(&s, &slice) < 0);
+  lisp_str_free(&slice);
+  lisp_str_free(&s);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(substring \"GET /index.html HTTP/1.1 200\" 4 15)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("\"/index.html\"", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (string-length (substring \"a long line of a log file\" 2)) (string-search \"a long line of a log file\" \"log\") (string-search \"abc\" \"x\"))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(23 + 17 - 1), lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(if (string=? \"ab\" (substring \"cab\" 1)) (string<? \"ab\" \"abc\") 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_TRUE, lisp_get_type(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (string->number \"12.5\") (string->number (number->string 0.25)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE(12.75, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(string->number \"12ms\")"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_FALSE, lisp_get_type(&result));
+  lisp_value_free(&v);
+
+  // parameters share the string, the result holds a reference of its own.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define field (lambda (line from) (substring line from (string-search line \" \" from))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(field (string-append \"2024-01-01 ERROR \" \"upstream timed out\") 11)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("\"ERROR\"", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (x) x) \"a string longer than inline\")"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  TEST_STRINGFY("\"a string longer than inline\"", &result);
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(string-length 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_STRING, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(substring \"abc\" 2 4)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(substring \"abc\" 2 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(string=? \"abc\")"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+
+static void test_table() {
+  lisp_value v, result, key, x;
+  const lisp_value* found;
+  lisp_table* t;
+  size_t i, n;
+  int ok;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(make-table)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)0, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (table-set! 0 0 10) (table-set! 0 (quote alice) 20) (table-set! 0 \"alice\" 30) (table-set! 0 0 40))"));
+  TEST_STRINGFY("(+ (table-set! 0 0 10) (table-set! 0 (quote alice) 20) (table-set! 0 \"alice\" 30) (table-set! 0 0 40))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)100, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a symbol and a string of the same name are different keys, -0 is 0.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (table-size 0) (table-ref 0 (* -1 0)) (table-ref 0 (quote alice)) (table-ref 0 \"alice\") (table-ref 0 2 1000))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(3 + 40 + 20 + 30 + 1000), lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-ref 0 (quote bob))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_FALSE, lisp_get_type(&result));
+  lisp_value_free(&v);
+
+  // a symbol a list held is a key too, the symbol comes back from the entry.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-ref 0 (car (quote (alice bob))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)20, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-key 0 (table-next 0 1))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_SYMBOL, lisp_get_type(&result));
+  TEST_STRINGFY("alice", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  // the entries walked in the order they were set, a deleted one skipped.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define tsum (lambda (t i) (if (< i 0) 0 (+ (table-value t i) (tsum t (table-next t (+ i 1)))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(if (table-delete! 0 (quote alice)) (tsum 0 (table-next 0 0)) 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)70, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-delete! 0 (quote alice))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_FALSE, lisp_get_type(&result));
+  lisp_value_free(&v);
+
+  // a string value outlives its entry.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-set! 0 3 (string-append \"a value longer \" \"than inline\"))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (x d) (string-length x)) (table-ref 0 3) (table-delete! 0 3))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)26, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // an argument is not moved past the table operations of an inlined body.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define tbump (lambda (old) (+ (table-set! 0 k 100) old)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define tbump-at (lambda (k) (tbump (table-ref 0 k 0))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(tbump-at 7)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)100, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-ref 5 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_TABLE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-set! 0 (quote (1 2)) 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_KEY, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-set! 0 1 (vector 1))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_STORABLE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-value 0 100)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // the tables are those of the env they were made in, env_free frees them.
+  {
+    env_t other;
+    env_init(NULL, &other);
+    lisp_value_init(&v);
+    EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-size 0)"));
+    EXPECT_EQ_INT(LISP_EVAL_NOT_A_TABLE, lisp_eval(&v, &result, &other));
+    lisp_value_free(&v);
+    lisp_value_init(&v);
+    lisp_value_init(&result);
+    EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-set! (make-table) 1 2)"));
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &other));
+    EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+    lisp_value_free(&v);
+    lisp_value_init(&v);
+    lisp_value_init(&result);
+    EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-size 0)"));
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &other));
+    EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+    EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+    lisp_value_free(&v);
+    env_free(&other);
+  }
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(table-free 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_TRUE, lisp_get_type(&result));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_TABLE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // deletes shift probe runs back: every key left is still found, through resizes.
+  t = lisp_table_new();
+  key.type = x.type = LISP_NUMBER;
+  for(i = 0; i < 5000; i++) {
+    key.u.n = x.u.n = (double)(i * 7919 % 5000);
+    lisp_table_set(t, &key, &x);
+    if(i % 3 == 0) {
+      key.u.n = (double)(i / 2 * 7919 % 5000);
+      lisp_table_delete(t, &key);
+    }
+  }
+  for(i = n = 0, ok = 1; i < 5000; i++) {
+    key.u.n = (double)i;
+    found = lisp_table_ref(t, &key);
+    if(found != NULL && found->u.n != key.u.n) ok = 0;
+    n += found != NULL;
+  }
+  EXPECT_EQ_INT(1, ok);
+  EXPECT_EQ_SIZE_T(t->size, n);
+  for(i = lisp_table_next(t, 0), n = 0; i != LISP_TABLE_END; i = lisp_table_next(t, i + 1))
+    n++;
+  EXPECT_EQ_SIZE_T(t->size, n);
+  lisp_table_free(t);
+  lisp_tables_free(&global_env);
+}
+
+static void test_list() {
+  lisp_value v, result;
+  char code[256], *big;
+  size_t i, k, size;
+  double handle;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lsq (lambda (x) (* x x)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(map lsq (quote (1 2 3)))"));
+  TEST_STRINGFY("(map lsq (quote (1 2 3)))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (1 4 9))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(filter (lambda (x) (< x 3)) (quote (1 5 2 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (1 2))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(filter positive? (quote (-1 2 -3 4)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (2 4))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (length (quote (1 (2 3) a))) (length (quote ())))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // (f x acc) from the left, over a pipeline.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold (lambda (x acc) (- x acc)) 0 (map lsq (filter (lambda (x) (< x 4)) (quote (1 2 3 4)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(9 - (4 - (1 - 0))), lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // nested lists, symbols and strings go through f and come back as they were.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(map (lambda (x) x) (quote ((1 (2)) a \"s\")))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote ((1 (2)) a \"s\"))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(map (lambda (x) (car (cdr x))) (quote ((1 2) (3 4))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (2 4))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(append (quote (1 2)) (quote ((3) a)) (quote ()))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (1 2 (3) a))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(reverse (quote (1 (2 3) b)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (b (2 3) 1))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (car (reverse (quote (1 2 3)))) (car (cdr (map lsq (quote (1 2 3))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(3 + 4), lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // accumulators that are lists, strings and booleans.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(length (fold (lambda (x acc) (append acc acc)) (quote (1)) (quote (1 2 3))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)8, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold (lambda (x acc) (string-append acc (number->string x))) \"list of numbers: \" (quote (1 2 3)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("\"list of numbers: 123\"", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold (lambda (x acc) (not acc)) (< 1 2) (quote (1 2 3)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_FALSE, lisp_get_type(&result));
+  lisp_value_free(&v);
+
+  // f passed down as a parameter, by name and as a lambda.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lmap (lambda (f l) (map f l)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(append (lmap lsq (quote (2))) (lmap (lambda (y) (+ y 1)) (quote (2))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (4 3))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  // a fused pipeline takes each element through all stages before the next
+  // one: the filter sees the table entry the map stage has just set.
+  handle = lisp_table_register(&global_env, lisp_table_new());
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  sprintf(code, "(length (filter (lambda (x) (= x (table-ref %.0f 0))) (map (lambda (x) (table-set! %.0f 0 x)) (quote (1 2 3)))))", handle, handle);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, code));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_table_release(&global_env, handle);
+
+  // a long list, the temporaries of an element are released after it.
+  size = 10000;
+  big = (char*)malloc(size * 8 + 128);
+  i = sprintf(big, "(fold (lambda (x acc) (+ x acc)) 0 (map lsq (filter (lambda (x) (< x 100)) (quote (");
+  for(k = 0; k < size; k++)
+    i += sprintf(big + i, " %zu", k % 200);
+  strcpy(big + i, ")))))");
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, big));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(50 * 328350), lisp_get_number(&result));    // 50 rounds of 0^2 + ... + 99^2
+  lisp_value_free(&v);
+  free(big);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(map lsq 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_LIST, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(map car (quote ((1))))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_FUNCTION, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold lsq 0 (quote (1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(map (lambda (x) (+ x 1)) (quote (1 a)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_NUMBER, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+
+static void test_macro() {
+  lisp_value v, result;
+  size_t size;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define-macro (munless c x y) (if c y x))"));
+  EXPECT_EQ_INT(LISP_DEFINE_MACRO, lisp_get_type(lisp_get_list_element(&v, 0)));
+  TEST_STRINGFY("(define-macro (munless c x y) (if c y x))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define-macro (msquare x) (* x x))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(munless (< 1 2) 10 (msquare 5))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)25, lisp_get_number(&result));
+  TEST_STRINGFY("(if (< 1 2) (* 5 5) 10)", &v);
+  lisp_value_free(&v);
+
+  // a defined body keeps the expansion, nested calls expanded too.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define mf (lambda (n) (munless (< n 0) (msquare (msquare n)) 0)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(define mf (lambda (n) (if (< n 0) 0 (* (* n n) (* n n)))))", &v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (mf 2) (mf (- 0 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)16, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // quoted data, parameters and the names defines bind are no calls.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(quote (msquare 3))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (msquare 3))", &result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define mg (lambda (msquare x) (+ msquare x)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(define mg (lambda (msquare x) (+ msquare x)))", &v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(mg 3 4)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(msquare 1 2)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define-macro (mloop x) (mloop x))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(mloop 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_MACRO_ERROR, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "msquare"));
+  EXPECT_EQ_INT(LISP_EVAL_MACRO_ERROR, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define-macro mbad (+ 1 2))"));
+  EXPECT_EQ_INT(LISP_EVAL_INVALID_VALUE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // a redefined macro keeps its one name in the env, the new template is used.
+  size = global_env.macros.top;
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define-macro (msquare x) (+ x x))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_SIZE_T(size, global_env.macros.top);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(msquare 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)6, lisp_get_number(&result));
+  lisp_value_free(&v);
+}
+
+static double stream_ticks;
+
+// the number of times it was called, what a forced promise must not be again.
+static double native_tick(const double* args) {
+  return ++stream_ticks;
+}
+
+static void test_stream() {
+  lisp_value v, result;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(force (delay (+ 1 2)))"));
+  EXPECT_EQ_INT(LISP_DELAY, lisp_get_type(lisp_get_list_element(lisp_get_list_element(&v, 1), 0)));
+  TEST_STRINGFY("(force (delay (+ 1 2)))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(force 5)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)5, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a promise of a vector frees it with the promise.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-sum (force (delay (vector 1 2 3))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)6, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(delay 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_PROMISE, lisp_get_type(&result));
+  TEST_STRINGFY("#<promise>", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  // forced once, the second force gives the value kept.
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_define_native_number(&global_env, "tick", 1, native_tick, 0));
+  stream_ticks = 0;
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (p) (+ (force p) (force p))) (delay (tick 0)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+  EXPECT_EQ_DOUBLE((double)1, stream_ticks);
+  lisp_value_free(&v);
+
+  // the parameters a delay uses are the ones of where it was made.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define sinc (lambda (x) (delay (+ x 1))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (x) (force (sinc 10))) 99)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)11, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define sints (lambda (n) (stream-cons n (sints (+ n 1)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(stream-car (stream-cdr (stream-cdr (sints 5))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(stream-take 3 (sints 0))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (0 #<promise>))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(null? (stream-cdr (stream-take 1 (sints 0))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_TRUE, lisp_get_type(&result));
+  lisp_value_free(&v);
+
+  // a forced rest is not evaluated again: the heads of 0 and 1 tick, not a third one.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define sticks (lambda (n) (stream-cons (+ n (* 0 (tick n))) (sticks (+ n 1)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  stream_ticks = 0;
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (s) (+ (stream-car (stream-cdr s)) (stream-car (stream-cdr s)))) (sticks 1))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)4, lisp_get_number(&result));
+  EXPECT_EQ_DOUBLE((double)2, stream_ticks);
+  lisp_value_free(&v);
+
+  // map and filter of a stream are lazy, fold and length walk what is taken.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold (lambda (x acc) (+ x acc)) 0 (stream-take 4 (map (lambda (x) (* x x)) (filter (lambda (x) (< 2 x)) (sints 0)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(9 + 16 + 25 + 36), lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  stream_ticks = 0;
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(length (stream-take 5 (stream-take 3 (sticks 0))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  EXPECT_EQ_DOUBLE((double)3, stream_ticks);
+  lisp_value_free(&v);
+
+  // the cells walked are freed as the fold goes, a long stream needs no more memory.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fold (lambda (x acc) (+ x acc)) 0 (stream-take 100000 (sints 1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)100000 * 100001 / 2, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(stream-car (stream-cons (quote (1 2)) 0))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(quote (1 2))", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(stream-cdr (stream-cons 1 2))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_STREAM, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(stream-take 2 (quote (1 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_STREAM, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+
+static void test_loop() {
+  lisp_value v, result;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define dsum (lambda (n) (do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i n) acc))))"));
+  EXPECT_EQ_INT(LISP_DO, lisp_get_type(lisp_get_list_element(lisp_get_list_element(lisp_get_list_element(&v, 2), 2), 0)));
+  TEST_STRINGFY("(define dsum (lambda (n) (do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i n) acc))))", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(dsum 10)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)45, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // the tail calls of a named let go back to the top of it.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define nsum (lambda (n) (let loop ((i 0) (acc 0)) (if (= i n) acc (loop (+ i 1) (+ acc i))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(nsum 10)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)45, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(let loop ((l (quote (1 2 3))) (acc 0)) (if (null? l) acc (loop (cdr l) (+ acc (car l)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)6, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // one that is no tail call recurses as a lambda would.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(let depth ((n 3)) (if (= n 0) 0 (+ 1 (depth (- n 1)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(let ((a 1) (b 2)) (+ a b))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a million iterations in one frame.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(dsum 1000000)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)499999500000, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // set! updates the binding it finds, a global here.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define counter 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define bump (lambda (by) (set! counter (+ counter by))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bump 5)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)5, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(bump 2)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "counter"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a parameter is a copy of the argument, setting it leaves the argument as it was.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define pset (lambda (x) (set! x 100)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(pset counter)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)100, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "counter"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)7, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "((lambda (n) (let ((total 0)) (do ((i 0 (+ i 1))) ((= i n) total) (set! total (+ total i))))) 5)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)10, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // the callers a lambda was inlined into see the one it is set to.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lstep (lambda (x) (+ x 10)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define luse (lambda (x) (lstep x)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(luse 4)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)14, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(set! lstep (lambda (x) (+ x 8)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(luse 4)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)12, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a lambda set! replaces while it runs goes on to its end, one set! in a loop reuses its box.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(set! lstep (lambda (x) (do ((i 0 (+ i 1))) ((= i 2) (+ x 1)) (set! lstep (lambda (y) (* y 100))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (luse 1) (luse 2))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)202, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(do ((i 0 (+ i 1))) ((= i 1000) (luse 4)) (set! lstep (lambda (x) (+ x 8))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)12, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // an argument that calls a lambda is not inlined: the call may set what the body reads first.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define ln 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lbump (lambda (x) (set! ln 10)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lf (lambda (a) (+ ln a)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lh (lambda (y) (lf (lbump y))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(lh 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)20, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a delay in a named let keeps the let to call once it is forced.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define lgen (lambda (k) (let next ((n k)) (stream-cons n (next (+ n 1))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(stream-car (stream-cdr (lgen 5)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)6, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(set! nowhere 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_VARIABLE_NOT_FOUND, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(let loop ((i 0)) (if (= i 1) i (loop 1 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(let (a 1) a)"));
+  EXPECT_EQ_INT(LISP_EVAL_INVALID_VALUE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+
+#ifdef LISP_DATA
+static void test_data() {
+  lisp_value v, result;
+  FILE* out;
+  double x;
+  int i;
+
+  out = fopen("lisp_test.f64", "wb");
+  for(i = 0; i < 10000; i++) {
+    x = i;
+    fwrite(&x, sizeof(x), 1, out);
+  }
+  fclose(out);
+  out = fopen("lisp_test.csv", "w");
+  fprintf(out, "id,price\n");
+  for(i = 0; i < 1000; i++)
+    fprintf(out, "%d,%g\r\n", i, i * 0.5);
+  fprintf(out, "1000,n/a\n");
+  fclose(out);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-f64 lisp_test.f64 1000 3)"));
+  TEST_STRINGFY("(load-f64 lisp_test.f64 1000 3)", &v);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  TEST_STRINGFY("(vector 1000 1001 1002)", &result);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (vector-sum (load-f64 lisp_test.f64)) (vector-length (load-f64 lisp_test.f64 9990 100)) (vector-length (load-f64 lisp_test.f64 20000 1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)49995010, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // a file walked window by window.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define fsum (lambda (i) (if (< i 10000) (+ (vector-sum (load-f64 lisp_test.f64 i 1000)) (fsum (+ i 1000))) 0)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fsum 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)49995000, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // the header and the row without a price are skipped.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ (vector-sum (load-csv lisp_test.csv 1)) (vector-length (load-csv lisp_test.csv 0)) (vector-length (load-csv lisp_test.csv 2)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)(249750 + 1001), lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  // consecutive windows, the second resumes where the first stopped.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-max (load-csv lisp_test.csv 1 0 10))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE(4.5, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-csv lisp_test.csv 1 10 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_SIZE_T((size_t)3, result.u.vec.size);
+  EXPECT_EQ_DOUBLE(5.0, result.u.vec.d[0]);
+  EXPECT_EQ_DOUBLE(6.0, result.u.vec.d[2]);
+  lisp_value_free(&result);
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-ref (load-csv lisp_test.csv 0 995 10) 4)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)999, lisp_get_number(&result));
+  lisp_value_free(&v);
+
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-f64 lisp_test.missing)"));
+  EXPECT_EQ_INT(LISP_EVAL_IO_ERROR, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-csv lisp_test.csv)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-f64 lisp_test.f64 (- 0 1) 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_INDEX_OUT_OF_RANGE, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // a path given as a string.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(- (string-length (load-text \"lisp_test.csv\")) (string-search (load-text (string-append \"lisp_test\" \".csv\")) \"1000,n/a\"))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)9, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(vector-length (load-f64 \"lisp_test.f64\" 9999 5))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-text (+ 1 2))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_STRING, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(load-text lisp_test.missing)"));
+  EXPECT_EQ_INT(LISP_EVAL_IO_ERROR, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  remove("lisp_test.f64");
+  remove("lisp_test.csv");
+}
+#endif
+
+#ifdef LISP_TASK
+static void test_task() {
+  lisp_value v, call[2], result, other;
+  lisp_task *t, *u;
+  size_t slices = 0, top;
+  int ret, ret2;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define kfib (lambda (n) (if (< n 2) n (+ (kfib (- n 1)) (kfib (- n 2))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  top = global_env.s.top;
+  lisp_value_init(&call[0]);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call[0], "(kfib 12)"));
+  lisp_value_init(&call[1]);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call[1], "(kfib 10)"));
+
+  // slices of 100 steps, with plain evaluations and another task in between.
+  t = lisp_task_new(&call[0], &global_env);
+  u = lisp_task_new(&call[1], &global_env);
+  do {
+    slices++;
+    ret = lisp_task_run(t, 100, 0, &result);
+    ret2 = lisp_task_run(u, 100, 0, &other);
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call[1], &other, &global_env));
+  } while(ret == LISP_EVAL_SUSPENDED && slices < 100000);
+  EXPECT_EQ_INT(LISP_EVAL_OK, ret);
+  EXPECT_EQ_INT(1, slices > 10);
+  EXPECT_EQ_DOUBLE((double)144, lisp_get_number(&result));
+  EXPECT_EQ_INT(LISP_EVAL_OK, ret2);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_task_run(u, 0, 0, &other));
+  EXPECT_EQ_DOUBLE((double)55, lisp_get_number(&other));
+  EXPECT_EQ_SIZE_T(top, global_env.s.top);
+  lisp_task_free(t);
+  lisp_task_free(u);
+
+  // a time budget, 0 steps is no step limit.
+  t = lisp_task_new(&call[0], &global_env);
+  while((ret = lisp_task_run(t, 0, 20, &result)) == LISP_EVAL_SUSPENDED) ;
+  EXPECT_EQ_INT(LISP_EVAL_OK, ret);
+  EXPECT_EQ_DOUBLE((double)144, lisp_get_number(&result));
+  lisp_task_free(t);
+
+  // cancelled half way, and before it ever ran.
+  t = lisp_task_new(&call[0], &global_env);
+  EXPECT_EQ_INT(LISP_EVAL_SUSPENDED, lisp_task_run(t, 100, 0, &result));
+  lisp_task_cancel(t);
+  EXPECT_EQ_INT(LISP_EVAL_CANCELLED, lisp_task_run(t, 100, 0, &result));
+  EXPECT_EQ_INT(LISP_EVAL_CANCELLED, lisp_task_run(t, 100, 0, &result));
+  lisp_task_free(t);
+  t = lisp_task_new(&call[0], &global_env);
+  lisp_task_cancel(t);
+  EXPECT_EQ_INT(LISP_EVAL_CANCELLED, lisp_task_run(t, 100, 0, &result));
+  lisp_task_free(t);
+  // freeing a suspended task unwinds it.
+  t = lisp_task_new(&call[0], &global_env);
+  EXPECT_EQ_INT(LISP_EVAL_SUSPENDED, lisp_task_run(t, 100, 0, &result));
+  lisp_task_free(t);
+  EXPECT_EQ_SIZE_T(top, global_env.s.top);
+
+  // a define in a task stays in the task's env.
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define klocal 5)"));
+  t = lisp_task_new(&v, &global_env);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_task_run(t, 0, 0, &result));
+  lisp_task_free(t);
+  EXPECT_EQ_SIZE_T(top, global_env.s.top);
+  lisp_value_free(&v);
+  lisp_value_free(&call[0]);
+  lisp_value_free(&call[1]);
+}
+#endif
+
+#ifdef LISP_CORO
+static double eval_number(const char* code) {
+  lisp_value v, result;
+  double n = -1;
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  if(lisp_parse(&v, code) == LISP_PARSE_OK && lisp_eval(&v, &result, &global_env) == LISP_EVAL_OK && lisp_get_type(&result) == LISP_NUMBER)
+    n = lisp_get_number(&result);
+  lisp_value_free(&v);
+  return n;
+}
+
+static void test_coro() {
+  lisp_value v, result;
+  lisp_coro_stats stats;
+  char code[128];
+  size_t failed;
+  double ch, x = 3.5;
+  int fds[2], i;
+
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_coro_init(&global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define cput (lambda (c n) (if (= n 0) 0 (+ (send c n) (cput c (- n 1))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define ctake (lambda (c n) (if (= n 0) 0 (+ (recv c) (ctake c (- n 1))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+
+  // a producer blocks on the full channel, the receiver outside runs the scheduler.
+  ch = eval_number("(chan)");
+  EXPECT_EQ_INT(1, ch >= 0);
+  sprintf(code, "(spawn (cput %.0f 100))", ch);
+  EXPECT_EQ_INT(1, eval_number(code) >= 0);
+  sprintf(code, "(ctake %.0f 100)", ch);
+  EXPECT_EQ_DOUBLE((double)5050, eval_number(code));
+  EXPECT_EQ_SIZE_T((size_t)0, lisp_coro_run());
+
+  // a thousand coroutines on one channel.
+  for(i = 0; i < 1000; i++) {
+    sprintf(code, "(spawn (send %.0f 2))", ch);
+    eval_number(code);
+  }
+  sprintf(code, "(ctake %.0f 1000)", ch);
+  EXPECT_EQ_DOUBLE((double)2000, eval_number(code));
+  EXPECT_EQ_SIZE_T((size_t)0, lisp_coro_run());
+
+  // numbers through a pipe, the reader parks on epoll until the writer has run.
+  EXPECT_EQ_INT(0, pipe(fds));
+  sprintf(code, "(spawn (ctake-fd %d 3))", fds[0]);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define ctake-fd (lambda (fd n) (if (= n 0) 0 (+ (read-fd fd) (ctake-fd fd (- n 1))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  sprintf(code, "(spawn (send %.0f (ctake-fd %d 3)))", ch, fds[0]);
+  eval_number(code);
+  sprintf(code, "(+ (write-fd %d 1) (+ (write-fd %d 2) (write-fd %d 3)))", fds[1], fds[1], fds[1]);
+  EXPECT_EQ_DOUBLE((double)6, eval_number(code));
+  sprintf(code, "(recv %.0f)", ch);
+  EXPECT_EQ_DOUBLE((double)6, eval_number(code));
+
+  EXPECT_EQ_INT(1, write(fds[1], &x, sizeof(x)) == sizeof(x));
+  close(fds[1]);
+  sprintf(code, "(eof? %d)", fds[0]);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, code));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_FALSE, lisp_get_type(&result));
+  sprintf(code, "(read-fd %d)", fds[0]);
+  EXPECT_EQ_DOUBLE(3.5, eval_number(code));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_TRUE, lisp_get_type(&result));
+  lisp_value_free(&v);
+  close(fds[0]);
+
+  // a coroutine sees the parameters of its spawner as they were at the spawn.
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define cstart (lambda (c k) (spawn (send c k))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  sprintf(code, "(cstart %.0f 42)", ch);
+  EXPECT_EQ_INT(1, eval_number(code) >= 0);
+  EXPECT_EQ_SIZE_T((size_t)0, lisp_coro_run());
+  sprintf(code, "(recv %.0f)", ch);
+  EXPECT_EQ_DOUBLE((double)42, eval_number(code));
+
+  // the error a coroutine finished with goes to whoever runs the scheduler.
+  lisp_get_coro_stats(&stats);
+  EXPECT_EQ_INT(1, eval_number("(spawn (car 1))") >= 0);
+  EXPECT_EQ_SIZE_T((size_t)0, lisp_coro_run());
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_LIST, lisp_coro_error());
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_coro_error());
+  failed = stats.failed;
+  lisp_get_coro_stats(&stats);
+  EXPECT_EQ_SIZE_T(failed + 1, stats.failed);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(spawn)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(spawn 1 2)"));
+  EXPECT_EQ_INT(LISP_EVAL_ARITY_MISMATCH, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // a receive nobody sends to: the coroutine is left over, and cancelled on free.
+  ch = eval_number("(chan)");
+  sprintf(code, "(spawn (recv %.0f))", ch);
+  eval_number(code);
+  EXPECT_EQ_SIZE_T((size_t)1, lisp_coro_run());
+  lisp_get_coro_stats(&stats);
+  EXPECT_EQ_SIZE_T(stats.spawned - 1, stats.finished);
+  lisp_coro_free();
+}
+#endif
+
+#ifdef LISP_THREADS
+// fib in a global_env of the thread's own, the expectations are checked by the main thread.
+static void* thread_fib(void* arg) {
+  lisp_value def, v, result;
+  double* n = (double*)arg;
+  env_init(NULL, &global_env);
+  lisp_value_init(&def);
+  lisp_value_init(&v);
+  if(lisp_parse(&def, "(define tfib (lambda (n) (if (< n 2) n (+ (tfib (- n 1)) (tfib (- n 2))))))") == LISP_PARSE_OK
+      && lisp_eval(&def, &result, &global_env) == LISP_EVAL_OK
+      && lisp_parse(&v, "(tfib 15)") == LISP_PARSE_OK
+      && lisp_eval(&v, &result, &global_env) == LISP_EVAL_OK)
+    *n = lisp_get_number(&result);
+  env_free(&global_env);
+  lisp_value_free(&v);
+  lisp_value_free(&def);
+  return NULL;
+}
+
+static void test_threads() {
+  pthread_t threads[4];
+  double n[4];
+  lisp_value v, result;
+  int i;
+  for(i = 0; i < 4; i++) {
+    n[i] = -1;
+    EXPECT_EQ_INT(0, pthread_create(&threads[i], NULL, thread_fib, &n[i]));
+  }
+  for(i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+    EXPECT_EQ_DOUBLE((double)610, n[i]);
+  }
+  // the threads' defines went to their own global_env.
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(tfib 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_VARIABLE_NOT_FOUND, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+}
+#endif
+
+#ifdef LISP_SERVER_PATH
+// sends a request line, its response is read up to the newline.
+static void server_expect(int fd, const char* line, const char* expect) {
+  char response[64];
+  size_t size = 0;
+  EXPECT_EQ_INT((int)strlen(line), (int)write(fd, line, strlen(line)));
+  EXPECT_EQ_INT(1, (int)write(fd, "\n", 1));
+  while(size < sizeof(response) - 1 && read(fd, &response[size], 1) == 1 && response[size] != '\n')
+    size++;
+  response[size] = '\0';
+  EXPECT_EQ_STRING(expect, response, strlen(expect) + 1);
+}
+
+static int server_connect(const char* path) {
+  struct sockaddr_un addr;
+  int fd, i;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  for(i = 0; i < 200; i++) {    // the server may not listen yet
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return -1;
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+      return fd;
+    close(fd);
+    usleep(10000);
+  }
+  return -1;
+}
+
+// malformed forms are answered with errors, the server and the connection go on.
+static void test_server() {
+  static const struct { const char* form; int ret; } malformed[] = {
+    { "(define)", LISP_EVAL_ARITY_MISMATCH },
+    { "(define x)", LISP_EVAL_ARITY_MISMATCH },
+    { "(define 1 2)", LISP_EVAL_INVALID_VALUE },
+    { "(car 1)", LISP_EVAL_NOT_A_LIST },
+    { "(car)", LISP_EVAL_ARITY_MISMATCH },
+    { "(< 1)", LISP_EVAL_ARITY_MISMATCH },
+    { "(if (< 1 2) 1)", LISP_EVAL_ARITY_MISMATCH },
+    { "(not)", LISP_EVAL_ARITY_MISMATCH },
+    { "(null?)", LISP_EVAL_ARITY_MISMATCH },
+    { "()", LISP_EVAL_INVALID_VALUE },
+    { "(1 2)", LISP_EVAL_NOT_A_FUNCTION },
+    { "(cons 1 2)", LISP_EVAL_NOT_A_FUNCTION },
+    { "((lambda (1) 1) 2)", LISP_EVAL_INVALID_VALUE },
+    { "(f 1)", LISP_EVAL_ARITY_MISMATCH },
+    { "(f 1 2 3)", LISP_EVAL_ARITY_MISMATCH },
+    { "(g 1)", LISP_EVAL_NOT_A_FUNCTION }
+  };
+  char path[64], expect[32];
+  int fd, other, status;
+  size_t i;
+  pid_t pid;
+  sprintf(path, "/tmp/lisp_test_%d.sock", (int)getpid());
+  unlink(path);
+  if((pid = fork()) == 0) {
+    if(freopen("/dev/null", "w", stderr) == NULL)
+      _exit(127);
+    execl(LISP_SERVER_PATH, LISP_SERVER_PATH, "-w", "2", path, (char*)NULL);
+    _exit(127);
+  }
+  EXPECT_EQ_INT(1, pid > 0);
+  if(pid < 0)
+    return;
+  fd = server_connect(path);
+  EXPECT_EQ_INT(1, fd >= 0);
+  if(fd >= 0) {
+    server_expect(fd, "(define f (lambda (a b) a))", "nil");
+    server_expect(fd, "(define g (quote (1 2)))", "nil");
+    for(i = 0; i < sizeof(malformed)/sizeof(malformed[0]); i++) {
+      sprintf(expect, "error eval %d", malformed[i].ret);
+      server_expect(fd, malformed[i].form, expect);
+    }
+    sprintf(expect, "error parse %d", LISP_PARSE_INVALID_VALUE);
+    server_expect(fd, ")", expect);
+    server_expect(fd, "(+ 1 2)", "3");
+    server_expect(fd, "(f 4 5)", "4");
+    server_expect(fd, "(make-table)", "0");
+    server_expect(fd, "(table-set! 0 1 2)", "2");
+    // a connection opened after the errors is served too, the tables of another are not its own.
+    other = server_connect(path);
+    EXPECT_EQ_INT(1, other >= 0);
+    if(other >= 0) {
+      server_expect(other, "(* 2 3)", "6");
+      sprintf(expect, "error eval %d", LISP_EVAL_NOT_A_TABLE);
+      server_expect(other, "(table-size 0)", expect);
+      close(other);
+    }
+    close(fd);
+  }
+  kill(pid, SIGTERM);
+  EXPECT_EQ_INT(pid, waitpid(pid, &status, 0));
+  EXPECT_EQ_INT(1, WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+#endif
+
+#ifdef LISP_PERF
+static void test_perf() {
+  lisp_value v, result;
+  lisp_perf_sample last, sum;
+  int counters = lisp_perf_enable(1);
+
+  lisp_perf_reset();
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(+ 1 (* 2 3))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+  lisp_perf_total(LISP_PERF_EVAL, &sum);
+  lisp_perf_last(LISP_PERF_EVAL, &last);
+  // without counters (containers, perf_event_paranoid) the hooks do nothing.
+  EXPECT_EQ_SIZE_T((size_t)(counters != 0 ? 2 : 0), (size_t)sum.calls);
+  EXPECT_EQ_SIZE_T((size_t)(counters != 0 ? 1 : 0), (size_t)last.calls);
+  lisp_perf_total(LISP_PERF_PARSE, &sum);
+  EXPECT_EQ_SIZE_T((size_t)(counters != 0 ? 1 : 0), (size_t)sum.calls);
+  lisp_perf_report(stdout);
+#ifdef LISP_THREADS
+  // the counters of this thread do not see the evaluations of another one.
+  {
+    pthread_t thread;
+    double n = -1;
+    lisp_perf_reset();
+    EXPECT_EQ_INT(0, pthread_create(&thread, NULL, thread_fib, &n));
+    pthread_join(thread, NULL);
+    EXPECT_EQ_DOUBLE((double)610, n);
+    lisp_perf_total(LISP_PERF_EVAL, &sum);
+    EXPECT_EQ_SIZE_T((size_t)0, (size_t)sum.calls);
+  }
+#endif
+
+  lisp_perf_enable(0);
+  lisp_perf_reset();
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "1"));
+  lisp_perf_total(LISP_PERF_PARSE, &sum);
+  EXPECT_EQ_SIZE_T((size_t)0, (size_t)sum.calls);
+}
+#endif
+
+#ifdef LISP_PROF
+#ifdef LISP_THREADS
+static void* thread_prof(void* arg) {
+  *(int*)arg = lisp_prof.enabled;
+  return NULL;
+}
+#endif
+
+static void test_prof() {
+  lisp_value v, call, result;
+  lisp_prof_stats stats;
+  FILE* out;
+  char line[256];
+  int nested = 0, ret;
+  clock_t start;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define plen (lambda (l) (if (null? l) 0 (+ 1 (plen (cdr l))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&call);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call, "(plen (quote (1 2 3 4 5 6 7 8)))"));
+
+  // sample until the recursion has shown up a few times, or give up after two seconds of cpu.
+  lisp_prof_reset();
+  EXPECT_EQ_INT(0, lisp_prof_enable(1000));
+  start = clock();
+  do {
+    ret = lisp_eval(&call, &result, &global_env);
+    lisp_prof_get_stats(&stats);
+  } while(ret == LISP_EVAL_OK && stats.samples < 10 && clock() - start < 2 * CLOCKS_PER_SEC);
+  EXPECT_EQ_INT(0, lisp_prof_enable(0));
+  EXPECT_EQ_INT(LISP_EVAL_OK, ret);
+  EXPECT_EQ_DOUBLE((double)8, lisp_get_number(&result));
+  EXPECT_EQ_INT(1, stats.samples >= 10);
+  EXPECT_EQ_SIZE_T((size_t)0, (size_t)lisp_prof.depth);
+
+  out = tmpfile();
+  lisp_prof_report(out);
+  rewind(out);
+  while(fgets(line, sizeof(line), out) != NULL)
+    nested |= strncmp(line, "plen;plen", 9) == 0;
+  fclose(out);
+  EXPECT_EQ_INT(1, nested);
+  lisp_prof_reset();
+#ifdef LISP_THREADS
+  // profiling this thread leaves the shadow stack of another one alone.
+  {
+    pthread_t thread;
+    int enabled = -1;
+    EXPECT_EQ_INT(0, lisp_prof_enable(1000));
+    EXPECT_EQ_INT(0, pthread_create(&thread, NULL, thread_prof, &enabled));
+    pthread_join(thread, NULL);
+    EXPECT_EQ_INT(0, lisp_prof_enable(0));
+    EXPECT_EQ_INT(0, enabled);
+    lisp_prof_reset();
+  }
+#endif
+  lisp_value_free(&call);
+}
+#endif
+
+#ifdef LISP_STATS
+static void test_stats() {
+  lisp_value v, result;
+  lisp_stats stats;
+  size_t i, lookups = 0;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define sfact (lambda (n) (if (= n 0) 1 (* n (sfact (- n 1))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+
+  lisp_reset_stats();
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(sfact 5)"));
+  lisp_get_stats(&stats);
+  EXPECT_EQ_INT(1, stats.mallocs > 0);
+  EXPECT_EQ_INT(1, stats.malloc_bytes > 0);
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)120, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_get_stats(&stats);
+  // (sfact 5) and the five recursive calls, each evaluating one if.
+  EXPECT_EQ_SIZE_T((size_t)6, stats.forms[LISP_SYMBOL]);
+  EXPECT_EQ_SIZE_T((size_t)6, stats.forms[LISP_IF]);
+  for(i = 0; i < LISP_STATS_DEPTHS; i++)
+    lookups += stats.depth[i];
+  EXPECT_EQ_INT(1, lookups >= 6);
+  EXPECT_EQ_INT(1, stats.eval_stack_high >= sizeof(lisp_value));
+  EXPECT_EQ_INT(1, stats.env_stack_high >= 6 * sizeof(lisp_value_pair));
+#ifdef LISP_THREADS
+  // another thread counts into counters of its own.
+  {
+    pthread_t thread;
+    double n = -1;
+    lisp_reset_stats();
+    EXPECT_EQ_INT(0, pthread_create(&thread, NULL, thread_fib, &n));
+    pthread_join(thread, NULL);
+    EXPECT_EQ_DOUBLE((double)610, n);
+    lisp_get_stats(&stats);
+    EXPECT_EQ_SIZE_T((size_t)0, stats.forms[LISP_SYMBOL]);
+    EXPECT_EQ_SIZE_T((size_t)0, stats.mallocs);
+  }
+#endif
+  EXPECT_EQ_SIZE_T((size_t)1, lisp_stats_bucket(1));
+  EXPECT_EQ_SIZE_T((size_t)2, lisp_stats_bucket(3));
+  EXPECT_EQ_SIZE_T((size_t)LISP_STATS_DEPTHS - 1, lisp_stats_bucket((size_t)-1));
+}
+#endif
+
+#ifdef LISP_TRACE
+static void test_trace() {
+  lisp_value v, call, result;
+  lisp_trace_event events[8];
+  FILE *dump, *out;
+  char line[128];
+  size_t count, i;
+
+  lisp_trace_clear();
+  lisp_trace_enable(1);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define tsquare (lambda (x) (* x x)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&call);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call, "(tsquare 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+  lisp_value_free(&call);
+  count = lisp_trace_read(events, 8);
+  EXPECT_EQ_SIZE_T((size_t)3, count);
+  EXPECT_EQ_INT(LISP_TRACE_DEFINE, events[0].kind);
+  EXPECT_EQ_INT(LISP_TRACE_ENTER, events[1].kind);
+  EXPECT_EQ_INT(LISP_TRACE_EXIT, events[2].kind);
+  EXPECT_EQ_SIZE_T((size_t)7, (size_t)events[1].size);
+  EXPECT_EQ_INT(0, memcmp(events[1].name, "tsquare", 7));
+  EXPECT_EQ_INT(LISP_EVAL_OK, (int)events[2].arg);
+
+  // a failed evaluation records an error and dumps the ring.
+  dump = tmpfile();
+  lisp_trace_dump_on_error(dump);
+  lisp_value_init(&call);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call, "(tundefined 1)"));
+  EXPECT_EQ_INT(LISP_EVAL_VARIABLE_NOT_FOUND, lisp_eval(&call, &result, &global_env));
+  lisp_value_free(&call);
+  lisp_trace_dump_on_error(NULL);
+  rewind(dump);
+  out = tmpfile();
+  EXPECT_EQ_INT(4, (int)lisp_trace_decode(dump, out));
+  rewind(out);
+  for(i = 0; fgets(line, sizeof(line), out) != NULL; i++) ;
+  EXPECT_EQ_SIZE_T((size_t)4, i);
+  EXPECT_EQ_INT(1, strstr(line, "error") != NULL);
+  fclose(out);
+  fclose(dump);
+
+  // the oldest events are overwritten.
+  for(i = 0; i < LISP_TRACE_EVENTS + 5; i++)
+    lisp_trace_record(LISP_TRACE_ALLOC, (unsigned)i, NULL, NULL, 0);
+  EXPECT_EQ_SIZE_T((size_t)8, lisp_trace_read(events, 8));
+  EXPECT_EQ_SIZE_T((size_t)LISP_TRACE_EVENTS + 4, (size_t)events[7].arg);
+#ifdef LISP_THREADS
+  // another thread's evaluations go to a ring of its own, its tracing is off.
+  {
+    pthread_t thread;
+    double n = -1;
+    lisp_trace_clear();
+    EXPECT_EQ_INT(0, pthread_create(&thread, NULL, thread_fib, &n));
+    pthread_join(thread, NULL);
+    EXPECT_EQ_DOUBLE((double)610, n);
+    EXPECT_EQ_SIZE_T((size_t)0, lisp_trace_read(events, 8));
+  }
+#endif
+  lisp_trace_enable(0);
+  lisp_trace_clear();
+}
+#endif
+
+#ifdef LISP_JIT
+static void test_jit() {
+  lisp_value v, call, result;
+  lisp_jit_stats stats;
+  size_t i;
+  FILE* maps;
+  char line[512];
+  int writable_code;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jfib (lambda (n) (if (< n 2) n (+ (jfib (- n 1)) (jfib (- n 2))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&result);
+
+  // the first calls run in the interpreter, the hot lambda is then compiled once.
+  lisp_value_init(&call);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call, "(jfib 15)"));
+  for(i = 0; i < 3; i++) {
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+    EXPECT_EQ_DOUBLE((double)610, lisp_get_number(&result));
+  }
+  lisp_get_jit_stats(&stats);
+  EXPECT_EQ_INT(1, stats.compiled >= 1);
+  EXPECT_EQ_INT(1, stats.native_calls >= 2);
+
+  // the compiled code is executable, not writable: no mapping is both.
+  if((maps = fopen("/proc/self/maps", "r")) != NULL) {
+    writable_code = 0;
+    while(fgets(line, sizeof(line), maps) != NULL)
+      if(strstr(line, " rwx") != NULL)
+        writable_code++;
+    fclose(maps);
+    EXPECT_EQ_INT(0, writable_code);
+  }
+
+  // a boolean result, and a callee compiled together with its caller.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jeven (lambda (n) (if (= n 0) (= 0 0) (jodd (- n 1)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jodd (lambda (n) (if (= n 0) (= 0 1) (jeven (- n 1)))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(jeven 41)"));
+  for(i = 0; i < 2; i++) {
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+    EXPECT_EQ_INT(LISP_FALSE, lisp_get_type(&result));
+  }
+  lisp_value_free(&v);
+
+  // redefining a global drops the native code, the new definition is used.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jfib (lambda (n) (if (< n 2) 1 (+ (jfib (- n 1)) (jfib (- n 2))))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  for(i = 0; i < 2; i++) {
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+    EXPECT_EQ_DOUBLE((double)987, lisp_get_number(&result));
+  }
+  lisp_value_free(&call);
+
+  // arguments that are not numbers go through the interpreter.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(jfib (quote (1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_NOT_A_NUMBER, lisp_eval(&v, &result, &global_env));
+  lisp_value_free(&v);
+
+  // free variables are dynamically scoped, such lambdas stay interpreted.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jscale (lambda (x) (* x jfactor)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jfactor 3)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(jscale 2)"));
+  for(i = 0; i < LISP_JIT_THRESHOLD + 2; i++) {
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+    EXPECT_EQ_DOUBLE((double)6, lisp_get_number(&result));
+  }
+  lisp_value_free(&v);
+
+  // the arguments of a compiled lambda are evaluated once, also when the interpreter takes the call.
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jk 0)"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define jfirst (lambda (a b) (+ a 1)))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  lisp_value_init(&call);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&call, "(jfirst 1 2)"));
+  for(i = 0; i < LISP_JIT_THRESHOLD + 2; i++)
+    EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&call, &result, &global_env));
+  lisp_value_free(&call);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(jfirst (set! jk (+ jk 1)) (quote x))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(jfirst (set! jk (+ jk 1)) (cdr (quote (1 2))))"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)3, lisp_get_number(&result));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "jk"));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_DOUBLE((double)2, lisp_get_number(&result));
+  lisp_value_free(&v);
+}
+#endif
+
+#if 1
+static void test_global_env() {
+  lisp_value v, result;
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define id (lambda (x) x))"));
+  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(id 1)"));
+  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)2, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define add (lambda (z y) (+ z y)))"));
+  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(add 0 1)"));
+  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(define fact (lambda (n) (if (= n 0) 1 (* n (fact (- n 1))))))"));
+  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)3, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NIL, lisp_get_type(&result));
+  lisp_value_free(&result);
+
+  lisp_value_init(&v);
+  lisp_value_init(&result);
+  EXPECT_EQ_INT(LISP_PARSE_OK, lisp_parse(&v, "(fact 0)"));
+  EXPECT_EQ_INT(LISP_LIST, lisp_get_type(&v));
+  EXPECT_EQ_SIZE_T((size_t)2, lisp_get_list_size(&v));
+  EXPECT_EQ_INT(LISP_EVAL_OK, lisp_eval(&v, &result, &global_env));
+  EXPECT_EQ_INT(LISP_NUMBER, lisp_get_type(&result));
+  EXPECT_EQ_DOUBLE((double)1, lisp_get_number(&result));
+  lisp_value_free(&result);
+}
+#endif
+
+// and now it maybe as defined `symbol` at the program
+static void test_invalid_value() {
+  lisp_value v;
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "defi"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "lambd"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "ca"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_INVALID_VALUE, lisp_parse(&v, "cd"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+}
+
+static void test_root_not_singular() {
+  lisp_value v;
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "definea"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "define a"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "lambdab"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "carr"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "car r"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "car\nr"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "cdrr"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+  EXPECT_EQ_INT(LISP_PARSE_ROOT_NOT_SINGULAR, lisp_parse(&v, "cdr r"));
+  EXPECT_EQ_INT(LISP_NULL, lisp_get_type(&v));
+  v.type = LISP_NULL;
+}
+
+static void test_invalid_list() {
+  lisp_value v;
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_MISS_CLOSE_PRAN, lisp_parse(&v, "("));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_MISS_CLOSE_PRAN, lisp_parse(&v, "(+"));
+  lisp_value_free(&v);
+  lisp_value_init(&v);
+  EXPECT_EQ_INT(LISP_PARSE_MISS_CLOSE_PRAN, lisp_parse(&v, "(("));
+  lisp_value_free(&v);
+}
+
+static void test_parse() {
+  test_parse_operator();
+  test_parse_number();
+  test_parse_list();
+  //test_invalid_value();
+  test_root_not_singular();
+  test_invalid_list();
+  test_car_and_cdr();
+  test_stringfy();
+  test_eval();
+  test_inline();
+  test_inline_cache();
+  test_specialize();
+  test_native_number();
+  test_native();
+  test_time_and_bench();
+  test_eval_batch();
+  test_vector();
+  test_string();
+  test_table();
+  test_list();
+  test_macro();
+  test_stream();
+  test_loop();
+#ifdef LISP_DATA
+  test_data();
+#endif
+#ifdef LISP_TASK
+  test_task();
+#endif
+#ifdef LISP_CORO
+  test_coro();
+#endif
+#ifdef LISP_THREADS
+  test_threads();
+#endif
+#ifdef LISP_SERVER_PATH
+  test_server();
+#endif
+#ifdef LISP_JIT
+  test_jit();
+#endif
+#ifdef LISP_PERF
+  test_perf();
+#endif
+#ifdef LISP_PROF
+  test_prof();
+#endif
+#ifdef LISP_STATS
+  test_stats();
+#endif
+#ifdef LISP_TRACE
+  test_trace();
+#endif
   // test_global_env();
 }
 
@@ -775,6 +3179,7 @@ int main() {
       s = lisp_stringfy(&result);
       printf("=> %s\n", s);
       free(s);
+      lisp_value_free(&result);
       lisp_value_free(&v);
     }
     else printf("=> nil\n");
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_MAGIC	"LTRC"
+#define TRACE_VERSION	1
+
+LISP_THREAD_LOCAL int lisp_trace_on;
+
+// one writer, the evaluator of the thread; the head only grows and its low bits index the ring.
+static LISP_THREAD_LOCAL struct {
+  lisp_trace_event events[LISP_TRACE_EVENTS];
+  unsigned long long head;
+  FILE* on_error;
+}trace;
+
+typedef struct trace_header trace_header;
+struct trace_header {
+  char magic[4];
+  unsigned int version, event_size, reserved;
+  unsigned long long count;
+};
+
+static const char* trace_kinds[LISP_TRACE_KINDS] = { "enter", "exit", "alloc", "free", "define", "error" };
+
+void lisp_trace_enable(int on) {
+  lisp_trace_on = on;
+}
+
+void lisp_trace_clear() {
+  trace.head = 0;
+}
+
+void lisp_trace_record(int kind, unsigned arg, const void* p, const char* name, size_t size) {
+  lisp_trace_event* ev = &trace.events[trace.head & (LISP_TRACE_EVENTS - 1)];
+  ev->p = (unsigned long long)(size_t)p;
+  ev->arg = arg;
+  ev->kind = (unsigned char)kind;
+  ev->size = (unsigned char)(size > 255 ? 255 : size);
+  if(size != 0)
+    memcpy(ev->name, name, size < LISP_TRACE_NAME ? size : LISP_TRACE_NAME);
+  trace.head++;
+}
+
+size_t lisp_trace_read(lisp_trace_event* events, size_t max) {
+  unsigned long long first = trace.head > LISP_TRACE_EVENTS ? trace.head - LISP_TRACE_EVENTS : 0, i;
+  size_t count = 0;
+  if(trace.head - first > max)
+    first = trace.head - max;
+  for(i = first; i < trace.head; i++)
+    events[count++] = trace.events[i & (LISP_TRACE_EVENTS - 1)];
+  return count;
+}
+
+int lisp_trace_dump(FILE* out) {
+  trace_header header;
+  unsigned long long first = trace.head > LISP_TRACE_EVENTS ? trace.head - LISP_TRACE_EVENTS : 0;
+  size_t start = (size_t)(first & (LISP_TRACE_EVENTS - 1)), count = (size_t)(trace.head - first);
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  header.event_size = sizeof(lisp_trace_event);
+  header.reserved = 0;
+  header.count = count;
+  if(fwrite(&header, sizeof(header), 1, out) != 1)
+    return -1;
+  // the oldest events are at the head's slot when the ring has wrapped.
+  if(start + count > LISP_TRACE_EVENTS) {
+    if(fwrite(trace.events + start, sizeof(lisp_trace_event), LISP_TRACE_EVENTS - start, out) != LISP_TRACE_EVENTS - start
+        || fwrite(trace.events, sizeof(lisp_trace_event), start + count - LISP_TRACE_EVENTS, out) != start + count - LISP_TRACE_EVENTS)
+      return -1;
+  }
+  else if(count != 0 && fwrite(trace.events + start, sizeof(lisp_trace_event), count, out) != count)
+    return -1;
+  return fflush(out) == 0 ? 0 : -1;
+}
+
+void lisp_trace_dump_on_error(FILE* out) {
+  trace.on_error = out;
+}
+
+void lisp_trace_error(int ret) {
+  lisp_trace_record(LISP_TRACE_ERROR, (unsigned)ret, NULL, NULL, 0);
+  if(trace.on_error != NULL)
+    lisp_trace_dump(trace.on_error);
+}
+
+long lisp_trace_decode(FILE* in, FILE* out) {
+  trace_header header;
+  lisp_trace_event ev;
+  long i;
+  int named;
+  if(fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) != 0
+      || header.version != TRACE_VERSION || header.event_size != sizeof(lisp_trace_event))
+    return -1;
+  for(i = 0; (unsigned long long)i < header.count && fread(&ev, sizeof(ev), 1, in) == 1; i++) {
+    fprintf(out, "%6ld %-6s", i, ev.kind < LISP_TRACE_KINDS ? trace_kinds[ev.kind] : "?");
+    named = ev.kind == LISP_TRACE_ENTER || ev.kind == LISP_TRACE_EXIT || ev.kind == LISP_TRACE_DEFINE;
+    if(named)
+      fprintf(out, " %.*s%s", ev.size < LISP_TRACE_NAME ? (int)ev.size : LISP_TRACE_NAME, ev.name, ev.size > LISP_TRACE_NAME ? "..." : "");
+    switch(ev.kind) {
+      case LISP_TRACE_ENTER:
+      case LISP_TRACE_DEFINE:	fprintf(out, " depth=%u\n", ev.arg); break;
+      case LISP_TRACE_EXIT:
+      case LISP_TRACE_ERROR:	fprintf(out, " ret=%u\n", ev.arg); break;
+      case LISP_TRACE_ALLOC:	fprintf(out, " %#llx %u bytes\n", ev.p, ev.arg); break;
+      case LISP_TRACE_FREE:	fprintf(out, " %#llx type=%u\n", ev.p, ev.arg); break;
+      default:	fprintf(out, " arg=%u\n", ev.arg);
+    }
+  }
+  return i;
+}
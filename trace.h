@@ -0,0 +1,72 @@
+#ifndef LEPT_TRACE__
+#define LEPT_TRACE__
+#include <stdio.h>
+#include <stddef.h>
+#include "eval.h"
+
+/*
+ * binary trace: a fixed ring of compact events recorded by the evaluator,
+ * the newest overwriting the oldest. nothing is formatted while recording;
+ * lisp_trace_dump writes the raw ring and lisp_trace_decode (or the
+ * lisp_trace tool) turns a dump into text. built with LISP_TRACE and off
+ * until lisp_trace_enable(1). with LISP_THREADS the switch, the ring and the
+ * dump on errors are the calling thread's: a thread traces its own evaluations.
+ */
+
+#ifndef LISP_TRACE_EVENTS
+#define LISP_TRACE_EVENTS 4096    // a power of two
+#endif
+#define LISP_TRACE_NAME	14    // leading bytes of a symbol name kept in an event
+
+enum {
+  LISP_TRACE_ENTER,    // application of a symbol, arg: env depth in pairs
+  LISP_TRACE_EXIT,    // arg: the lisp_eval_* return code
+  LISP_TRACE_ALLOC,    // temporary value made by the evaluator, arg: bytes
+  LISP_TRACE_FREE,    // temporary value released at the end of lisp_eval, arg: its type
+  LISP_TRACE_DEFINE,    // arg: env depth in pairs
+  LISP_TRACE_ERROR,    // lisp_eval failed, arg: the return code
+  LISP_TRACE_KINDS
+};
+
+typedef struct lisp_trace_event lisp_trace_event;
+struct lisp_trace_event {
+  unsigned long long p;    // address of the value or symbol concerned
+  unsigned int arg;
+  unsigned char kind, size;    // size: length of the full name, up to 255
+  char name[LISP_TRACE_NAME];    // not NUL-terminated when the name fills it
+};
+
+#ifdef LISP_TRACE
+extern LISP_THREAD_LOCAL int lisp_trace_on;
+
+void lisp_trace_enable(int on);
+void lisp_trace_clear();
+// copies up to max events, oldest first, and returns how many.
+size_t lisp_trace_read(lisp_trace_event* events, size_t max);
+// raw ring, oldest first. returns 0 on success, -1 on a write error.
+int lisp_trace_dump(FILE* out);
+// dump the ring to out whenever lisp_eval fails, NULL to stop.
+void lisp_trace_dump_on_error(FILE* out);
+void lisp_trace_error(int ret);
+
+void lisp_trace_record(int kind, unsigned arg, const void* p, const char* name, size_t size);
+
+#define LISP_TRACE_EVENT(kind, arg, p, name, size) \
+  do { \
+    if(lisp_trace_on) \
+      lisp_trace_record(kind, arg, p, name, size); \
+  } while(0)
+#define LISP_TRACE_FAILED(ret) \
+  do { \
+    if(lisp_trace_on) \
+      lisp_trace_error(ret); \
+  } while(0)
+
+// text, one event per line. returns the number of events, -1 if in is not a dump.
+long lisp_trace_decode(FILE* in, FILE* out);
+#else
+#define LISP_TRACE_EVENT(kind, arg, p, name, size)	do { } while(0)
+#define LISP_TRACE_FAILED(ret)	do { } while(0)
+#endif
+
+#endif
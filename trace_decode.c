@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include "trace.h"
+
+/*
+ * trace decoder: prints a dump written by lisp_trace_dump as text.
+ *
+ *   lisp_trace [dump]
+ *
+ * reads stdin when no file is given.
+ */
+
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  long count;
+  if(argc > 2) {
+    fprintf(stderr, "usage: %s [dump]\n", argv[0]);
+    return 1;
+  }
+  if(argc == 2 && (in = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  if((count = lisp_trace_decode(in, stdout)) < 0) {
+    fprintf(stderr, "%s: not a trace dump\n", argc == 2 ? argv[1] : "stdin");
+    return 1;
+  }
+  if(in != stdin)
+    fclose(in);
+  return 0;
+}
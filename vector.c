@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef LISP_DATA
+#include <sys/mman.h>
+#endif
+
+#include "vector.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define VEC_X86
+#define VEC_AVX2_FN	__attribute__((target("avx2")))
+#endif
+
+static int vec_isa = -1;
+
+static int vec_best() {
+#ifdef VEC_X86
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? LISP_VEC_AVX2 : LISP_VEC_SSE2;
+#else
+  return LISP_VEC_SCALAR;
+#endif
+}
+
+int lisp_vec_isa() {
+  if(vec_isa < 0)
+    vec_isa = vec_best();
+  return vec_isa;
+}
+
+int lisp_vec_set_isa(int isa) {
+  int best = vec_best();
+  return vec_isa = isa < best ? isa : best;
+}
+
+double* lisp_vec_alloc(size_t size) {
+  size_t bytes;
+  if(size > ((size_t)-1 - LISP_VEC_ALIGN) / sizeof(double))
+    return NULL;
+  bytes = (size * sizeof(double) + LISP_VEC_ALIGN - 1) & ~(size_t)(LISP_VEC_ALIGN - 1);
+  return (double*)aligned_alloc(LISP_VEC_ALIGN, bytes != 0 ? bytes : LISP_VEC_ALIGN);
+}
+
+void lisp_vec_free(double* d, size_t size, size_t map) {
+#ifdef LISP_DATA
+  if(map != 0) {
+    munmap((char*)d - (map - 1), map - 1 + size * sizeof(double));
+    return;
+  }
+#endif
+  free(d);
+}
+
+/* scalar loops, they also finish the tails of the SIMD ones. */
+
+#define VEC_SCALAR_LOOP(expr) \
+  for(; i < n; i++) { \
+    x = a[i*as]; \
+    y = b[i*bs]; \
+    r[i] = (expr); \
+  }
+
+static void vec_binary_scalar(int op, double* r, const double* a, size_t as, const double* b, size_t bs, size_t n) {
+  double x, y;
+  size_t i = 0;
+  switch(op) {
+    case LISP_VEC_ADD:	VEC_SCALAR_LOOP(x + y); break;
+    case LISP_VEC_SUB:	VEC_SCALAR_LOOP(x - y); break;
+    case LISP_VEC_MUL:	VEC_SCALAR_LOOP(x * y); break;
+    case LISP_VEC_DIV:	VEC_SCALAR_LOOP(x / y); break;
+    case LISP_VEC_LT:	VEC_SCALAR_LOOP(x < y ? 1.0 : 0.0); break;
+    case LISP_VEC_BT:	VEC_SCALAR_LOOP(x > y ? 1.0 : 0.0); break;
+    case LISP_VEC_EQ:	VEC_SCALAR_LOOP(x == y ? 1.0 : 0.0); break;
+  }
+}
+
+static double vec_reduce_scalar(int op, const double* a, size_t n, double acc) {
+  size_t i;
+  for(i = 0; i < n; i++) {
+    switch(op) {
+      case LISP_VEC_SUM:	acc += a[i]; break;
+      case LISP_VEC_MIN:	if(a[i] < acc) acc = a[i]; break;
+      case LISP_VEC_MAX:	if(a[i] > acc) acc = a[i]; break;
+    }
+  }
+  return acc;
+}
+
+static double vec_dot_scalar(const double* a, const double* b, size_t n, double acc) {
+  size_t i;
+  for(i = 0; i < n; i++)
+    acc += a[i] * b[i];
+  return acc;
+}
+
+static void vec_fill_scalar(double* r, double x, size_t n) {
+  size_t i;
+  for(i = 0; i < n; i++)
+    r[i] = x;
+}
+
+#ifdef VEC_X86
+/* SSE2, two lanes. every x86-64 cpu has it. */
+
+#define VEC_SSE2_LOOP(expr) \
+  for(; i + 2 <= n; i += 2) { \
+    x = as ? _mm_loadu_pd(a + i) : xa; \
+    y = bs ? _mm_loadu_pd(b + i) : xb; \
+    _mm_storeu_pd(r + i, (expr)); \
+  }
+
+static void vec_binary_sse2(int op, double* r, const double* a, size_t as, const double* b, size_t bs, size_t n) {
+  __m128d x, y, xa = _mm_setzero_pd(), xb = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+  size_t i = 0;
+  if(n >= 2) {
+    if(as == 0) xa = _mm_set1_pd(*a);
+    if(bs == 0) xb = _mm_set1_pd(*b);
+  }
+  switch(op) {
+    case LISP_VEC_ADD:	VEC_SSE2_LOOP(_mm_add_pd(x, y)); break;
+    case LISP_VEC_SUB:	VEC_SSE2_LOOP(_mm_sub_pd(x, y)); break;
+    case LISP_VEC_MUL:	VEC_SSE2_LOOP(_mm_mul_pd(x, y)); break;
+    case LISP_VEC_DIV:	VEC_SSE2_LOOP(_mm_div_pd(x, y)); break;
+    case LISP_VEC_LT:	VEC_SSE2_LOOP(_mm_and_pd(_mm_cmplt_pd(x, y), one)); break;
+    case LISP_VEC_BT:	VEC_SSE2_LOOP(_mm_and_pd(_mm_cmpgt_pd(x, y), one)); break;
+    case LISP_VEC_EQ:	VEC_SSE2_LOOP(_mm_and_pd(_mm_cmpeq_pd(x, y), one)); break;
+  }
+  vec_binary_scalar(op, r + i, a + i*as, as, b + i*bs, bs, n - i);
+}
+
+static double vec_reduce_sse2(int op, const double* a, size_t n, double init) {
+  __m128d acc = _mm_set1_pd(init), x;
+  double lanes[2];
+  size_t i;
+  for(i = 0; i + 2 <= n; i += 2) {
+    x = _mm_loadu_pd(a + i);
+    switch(op) {
+      case LISP_VEC_SUM:	acc = _mm_add_pd(acc, x); break;
+      case LISP_VEC_MIN:	acc = _mm_min_pd(acc, x); break;
+      case LISP_VEC_MAX:	acc = _mm_max_pd(acc, x); break;
+    }
+  }
+  _mm_storeu_pd(lanes, acc);
+  return vec_reduce_scalar(op, a + i, n - i, vec_reduce_scalar(op, lanes + 1, 1, lanes[0]));
+}
+
+static double vec_dot_sse2(const double* a, const double* b, size_t n) {
+  __m128d acc = _mm_setzero_pd();
+  double lanes[2];
+  size_t i;
+  for(i = 0; i + 2 <= n; i += 2)
+    acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  _mm_storeu_pd(lanes, acc);
+  return vec_dot_scalar(a + i, b + i, n - i, lanes[0] + lanes[1]);
+}
+
+static void vec_fill_sse2(double* r, double x, size_t n) {
+  __m128d v = _mm_set1_pd(x);
+  size_t i;
+  for(i = 0; i + 2 <= n; i += 2)
+    _mm_storeu_pd(r + i, v);
+  vec_fill_scalar(r + i, x, n - i);
+}
+
+/* AVX2, four lanes; the reductions keep two accumulators to overlap the adds. */
+
+#define VEC_AVX2_LOOP(expr) \
+  for(; i + 4 <= n; i += 4) { \
+    x = as ? _mm256_loadu_pd(a + i) : xa; \
+    y = bs ? _mm256_loadu_pd(b + i) : xb; \
+    _mm256_storeu_pd(r + i, (expr)); \
+  }
+
+VEC_AVX2_FN static void vec_binary_avx2(int op, double* r, const double* a, size_t as, const double* b, size_t bs, size_t n) {
+  __m256d x, y, xa = _mm256_setzero_pd(), xb = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+  size_t i = 0;
+  if(n >= 4) {
+    if(as == 0) xa = _mm256_set1_pd(*a);
+    if(bs == 0) xb = _mm256_set1_pd(*b);
+  }
+  switch(op) {
+    case LISP_VEC_ADD:	VEC_AVX2_LOOP(_mm256_add_pd(x, y)); break;
+    case LISP_VEC_SUB:	VEC_AVX2_LOOP(_mm256_sub_pd(x, y)); break;
+    case LISP_VEC_MUL:	VEC_AVX2_LOOP(_mm256_mul_pd(x, y)); break;
+    case LISP_VEC_DIV:	VEC_AVX2_LOOP(_mm256_div_pd(x, y)); break;
+    case LISP_VEC_LT:	VEC_AVX2_LOOP(_mm256_and_pd(_mm256_cmp_pd(x, y, _CMP_LT_OQ), one)); break;
+    case LISP_VEC_BT:	VEC_AVX2_LOOP(_mm256_and_pd(_mm256_cmp_pd(x, y, _CMP_GT_OQ), one)); break;
+    case LISP_VEC_EQ:	VEC_AVX2_LOOP(_mm256_and_pd(_mm256_cmp_pd(x, y, _CMP_EQ_OQ), one)); break;
+  }
+  vec_binary_scalar(op, r + i, a + i*as, as, b + i*bs, bs, n - i);
+}
+
+VEC_AVX2_FN static double vec_reduce_avx2(int op, const double* a, size_t n, double init) {
+  __m256d acc0 = _mm256_set1_pd(init), acc1 = acc0, x0, x1;
+  double lanes[4];
+  size_t i;
+  for(i = 0; i + 8 <= n; i += 8) {
+    x0 = _mm256_loadu_pd(a + i);
+    x1 = _mm256_loadu_pd(a + i + 4);
+    switch(op) {
+      case LISP_VEC_SUM:	acc0 = _mm256_add_pd(acc0, x0); acc1 = _mm256_add_pd(acc1, x1); break;
+      case LISP_VEC_MIN:	acc0 = _mm256_min_pd(acc0, x0); acc1 = _mm256_min_pd(acc1, x1); break;
+      case LISP_VEC_MAX:	acc0 = _mm256_max_pd(acc0, x0); acc1 = _mm256_max_pd(acc1, x1); break;
+    }
+  }
+  switch(op) {
+    case LISP_VEC_SUM:	acc0 = _mm256_add_pd(acc0, _mm256_sub_pd(acc1, _mm256_set1_pd(init))); break;    // init was added twice
+    case LISP_VEC_MIN:	acc0 = _mm256_min_pd(acc0, acc1); break;
+    case LISP_VEC_MAX:	acc0 = _mm256_max_pd(acc0, acc1); break;
+  }
+  _mm256_storeu_pd(lanes, acc0);
+  if(op == LISP_VEC_SUM)
+    lanes[0] -= 3 * init;    // and once per lane
+  return vec_reduce_scalar(op, a + i, n - i, vec_reduce_scalar(op, lanes + 1, 3, lanes[0]));
+}
+
+VEC_AVX2_FN static double vec_dot_avx2(const double* a, const double* b, size_t n) {
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  double lanes[4];
+  size_t i;
+  for(i = 0; i + 8 <= n; i += 8) {
+    acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+  }
+  _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+  return vec_dot_scalar(a + i, b + i, n - i, lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+VEC_AVX2_FN static void vec_fill_avx2(double* r, double x, size_t n) {
+  __m256d v = _mm256_set1_pd(x);
+  size_t i;
+  for(i = 0; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(r + i, v);
+  vec_fill_scalar(r + i, x, n - i);
+}
+#endif
+
+void lisp_vec_fill(double* r, double x, size_t n) {
+  switch(lisp_vec_isa()) {
+#ifdef VEC_X86
+    case LISP_VEC_AVX2:	vec_fill_avx2(r, x, n); return;
+    case LISP_VEC_SSE2:	vec_fill_sse2(r, x, n); return;
+#endif
+    default:	vec_fill_scalar(r, x, n);
+  }
+}
+
+void lisp_vec_binary(int op, double* r, const double* a, size_t as, const double* b, size_t bs, size_t n) {
+  switch(lisp_vec_isa()) {
+#ifdef VEC_X86
+    case LISP_VEC_AVX2:	vec_binary_avx2(op, r, a, as, b, bs, n); return;
+    case LISP_VEC_SSE2:	vec_binary_sse2(op, r, a, as, b, bs, n); return;
+#endif
+    default:	vec_binary_scalar(op, r, a, as, b, bs, n);
+  }
+}
+
+double lisp_vec_reduce(int op, const double* a, size_t n) {
+  double init = op == LISP_VEC_SUM ? 0 : op == LISP_VEC_MIN ? HUGE_VAL : -HUGE_VAL;
+  switch(lisp_vec_isa()) {
+#ifdef VEC_X86
+    case LISP_VEC_AVX2:	return vec_reduce_avx2(op, a, n, init);
+    case LISP_VEC_SSE2:	return vec_reduce_sse2(op, a, n, init);
+#endif
+    default:	return vec_reduce_scalar(op, a, n, init);
+  }
+}
+
+double lisp_vec_dot(const double* a, const double* b, size_t n) {
+  switch(lisp_vec_isa()) {
+#ifdef VEC_X86
+    case LISP_VEC_AVX2:	return vec_dot_avx2(a, b, n);
+    case LISP_VEC_SSE2:	return vec_dot_sse2(a, b, n);
+#endif
+    default:	return vec_dot_scalar(a, b, n, 0);
+  }
+}
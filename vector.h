@@ -0,0 +1,53 @@
+#ifndef LEPT_VECTOR__
+#define LEPT_VECTOR__
+#include <stddef.h>
+
+/*
+ * kernels of the vector forms, over contiguous doubles. an operand with a
+ * stride of 0 is one number repeated along the vector. on x86-64 the AVX2 or
+ * SSE2 versions are picked at run time, elsewhere the scalar loops run; the
+ * results only differ in the rounding of sums.
+ */
+
+#define LISP_VEC_ALIGN	32    // vector data starts at a multiple of this many bytes
+
+enum {
+  LISP_VEC_SCALAR,
+  LISP_VEC_SSE2,
+  LISP_VEC_AVX2
+};
+
+// elementwise operations, in the order of LISP_VECTOR_ADD and the following forms.
+enum {
+  LISP_VEC_ADD,
+  LISP_VEC_SUB,
+  LISP_VEC_MUL,
+  LISP_VEC_DIV,
+  LISP_VEC_LT,    // comparisons give 1.0 or 0.0
+  LISP_VEC_BT,
+  LISP_VEC_EQ
+};
+
+// reductions, in the order of LISP_VECTOR_SUM and the following forms.
+enum {
+  LISP_VEC_SUM,    // 0 for an empty vector
+  LISP_VEC_MIN,    // +inf for an empty vector
+  LISP_VEC_MAX     // -inf for an empty vector
+};
+
+// room for size doubles, aligned to LISP_VEC_ALIGN, NULL if it cannot be had. released with free.
+double* lisp_vec_alloc(size_t size);
+// data of a vector: from lisp_vec_alloc if map is 0, else mapped from a file
+// map-1 bytes ahead of d, see data.h.
+void lisp_vec_free(double* d, size_t size, size_t map);
+int lisp_vec_isa();
+// use isa, or the best one the cpu has below it. returns the one in use.
+int lisp_vec_set_isa(int isa);
+
+void lisp_vec_fill(double* r, double x, size_t n);
+// r[i] = a[i*as] op b[i*bs], the strides are 0 or 1.
+void lisp_vec_binary(int op, double* r, const double* a, size_t as, const double* b, size_t bs, size_t n);
+double lisp_vec_reduce(int op, const double* a, size_t n);
+double lisp_vec_dot(const double* a, const double* b, size_t n);
+
+#endif